@@ -0,0 +1,455 @@
+//
+// Rigid bodies pulled around by the black hole, stored as structure of arrays.
+//
+
+#include "BodySystem.h"
+
+#include "QuaternionBatch.h"
+
+#include <algorithm>
+#include <cmath>
+
+const uint32_t BodySystem::INVALID_INDEX;
+
+BodySystem::BodySystem() {
+    _jobSystem = nullptr;
+    _mutualValid = false;
+    _substepAccuracy = 0.1f;
+    _maxSubsteps = 256;
+    _uniformSubsteps = 0;
+    _totalSubsteps = 0;
+    _maxSubstepsTaken = 0;
+    _referenceEnergy = 0.0;
+    _broadphaseValid = false;
+    _restitution = 0.5f;
+    _numContacts = 0;
+    _numParticleContacts = 0;
+    _broadphase.setCellSize(0.5f);
+};
+
+void BodySystem::initialize(JobSystem *jobSystem) {
+    _jobSystem = jobSystem;
+    _solver.setJobSystem(jobSystem);
+    _broadphase.setJobSystem(jobSystem);
+}
+
+uint32_t BodySystem::addMaterial(const BodyMaterial &material) {
+    _materials.push_back(material);
+    return _materials.size() - 1;
+}
+
+const BodyMaterial& BodySystem::getMaterial(uint32_t materialID) const {
+    return _materials[materialID];
+}
+
+const std::vector<BodyMaterial>& BodySystem::getMaterials() const {
+    return _materials;
+}
+
+BodyHandle BodySystem::create(glm::vec3 position, glm::vec3 velocity, glm::vec3 angularVelocity, glm::vec3 scale, float radius, float mass, uint32_t materialID) {
+    uint32_t index = positions.size();
+    positions.push_back(position);
+    velocities.push_back(velocity);
+    angularVelocities.push_back(angularVelocity);
+    orientations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    scales.push_back(scale);
+    radii.push_back(radius);
+    masses.push_back(mass);
+    materialIDs.push_back(materialID);
+    _mutualValid = false;
+    _broadphaseValid = false;
+
+    // reuse a dead slot when there is one
+    uint32_t slot;
+    if(!_freeSlots.empty()) {
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+        _slotToIndex[slot] = index;
+    } else {
+        slot = _slotToIndex.size();
+        _slotToIndex.push_back(index);
+        _slotGenerations.push_back(0);
+    }
+    _indexToSlot.push_back(slot);
+
+    BodyHandle handle;
+    handle.slot = slot;
+    handle.generation = _slotGenerations[slot];
+    return handle;
+}
+
+void BodySystem::destroy(BodyHandle handle) {
+    uint32_t index = indexOf(handle);
+    if(index == INVALID_INDEX) return;
+
+    // move the last body into the hole
+    uint32_t last = positions.size() - 1;
+    if(index != last) {
+        positions[index] = positions[last];
+        velocities[index] = velocities[last];
+        angularVelocities[index] = angularVelocities[last];
+        orientations[index] = orientations[last];
+        scales[index] = scales[last];
+        radii[index] = radii[last];
+        masses[index] = masses[last];
+        materialIDs[index] = materialIDs[last];
+        _indexToSlot[index] = _indexToSlot[last];
+        _slotToIndex[_indexToSlot[index]] = index;
+    }
+    positions.pop_back();
+    velocities.pop_back();
+    angularVelocities.pop_back();
+    orientations.pop_back();
+    scales.pop_back();
+    radii.pop_back();
+    masses.pop_back();
+    materialIDs.pop_back();
+    _indexToSlot.pop_back();
+    _mutualValid = false;
+    _broadphaseValid = false;
+
+    // bumping the generation invalidates every outstanding handle to this slot
+    _slotToIndex[handle.slot] = INVALID_INDEX;
+    _slotGenerations[handle.slot]++;
+    _freeSlots.push_back(handle.slot);
+}
+
+bool BodySystem::isValid(BodyHandle handle) const {
+    return indexOf(handle) != INVALID_INDEX;
+}
+
+uint32_t BodySystem::indexOf(BodyHandle handle) const {
+    if(handle.slot >= _slotToIndex.size() || _slotGenerations[handle.slot] != handle.generation) {
+        return INVALID_INDEX;
+    }
+    return _slotToIndex[handle.slot];
+}
+
+void BodySystem::copyHandleTables(std::vector<uint32_t> &slotToIndex, std::vector<uint32_t> &slotGenerations) const {
+    slotToIndex.assign(_slotToIndex.begin(), _slotToIndex.end());
+    slotGenerations.assign(_slotGenerations.begin(), _slotGenerations.end());
+}
+
+size_t BodySystem::size() const {
+    return positions.size();
+}
+
+NBodySolver& BodySystem::getSolver() {
+    return _solver;
+}
+
+void BodySystem::parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func) {
+    if(_jobSystem != nullptr) {
+        _jobSystem->parallelFor(count, grainSize, func);
+    } else {
+        func(0, count, 0);
+    }
+}
+
+void BodySystem::setSubstepAccuracy(float radiansPerSubstep) {
+    _substepAccuracy = radiansPerSubstep;
+}
+
+void BodySystem::setMaxSubsteps(uint32_t maxSubsteps) {
+    _maxSubsteps = maxSubsteps > 0 ? maxSubsteps : 1;
+}
+
+void BodySystem::setUniformSubsteps(uint32_t substeps) {
+    _uniformSubsteps = substeps;
+}
+
+uint32_t BodySystem::getTotalSubsteps() const {
+    return _totalSubsteps;
+}
+
+uint32_t BodySystem::getMaxSubstepsTaken() const {
+    return _maxSubstepsTaken;
+}
+
+void BodySystem::setRestitution(float restitution) {
+    _restitution = restitution;
+}
+
+void BodySystem::setCollisionCellSize(float cellSize) {
+    _broadphase.setCellSize(cellSize);
+    _broadphaseValid = false;
+}
+
+uint32_t BodySystem::getNumContacts() const {
+    return _numContacts;
+}
+
+uint32_t BodySystem::getNumParticleContacts() const {
+    return _numParticleContacts;
+}
+
+uint32_t BodySystem::substepsFor(const glm::vec3 &position, const glm::vec3 &velocity, float dt) const {
+    if(_uniformSubsteps > 0) return _uniformSubsteps;
+
+    // The step is sized for the closest approach of the body's orbit rather than where it is
+    // now.  Periapsis is a constant of the orbit so a body keeps the same substep count all the
+    // way round, which keeps the integrator symplectic - switching step sizes mid orbit would
+    // make the energy error random walk.  The fastest attractor wins.
+    const std::vector<Attractor> &attractors = _solver.getAttractors();
+    const float EPSILON2 = _solver.getSoftening() * _solver.getSoftening();
+    float rate = 0.0f;
+    for(size_t a = 0; a < attractors.size(); a++) {
+        glm::vec3 r = position - attractors[a].position;
+        float gm = attractors[a].gm;
+        float distance = std::sqrt(glm::dot(r, r));
+        float h2 = glm::dot(glm::cross(r, velocity), glm::cross(r, velocity));     // squared angular momentum
+        float energy = 0.5f * glm::dot(velocity, velocity) - gm / std::max(distance, 1e-6f);
+        float eccentricity = std::sqrt(std::max(1.0f + 2.0f * energy * h2 / (gm * gm), 0.0f));
+        float periapsis = std::min(h2 / (gm * (1.0f + eccentricity)), distance);
+
+        // speed over distance at periapsis and where the body is now, both softened like the force.
+        // the kepler estimate breaks down inside the softened core, so the current state is a floor
+        float speed2 = glm::dot(velocity, velocity);
+        float softened2 = periapsis * periapsis + EPSILON2;
+        float currentSoftened2 = distance * distance + EPSILON2;
+        float softenedEnergy = 0.5f * speed2 - gm / std::sqrt(currentSoftened2);
+        float periapsisSpeed2 = 2.0f * (softenedEnergy + gm / std::sqrt(softened2));
+        rate = std::max(rate, std::sqrt(std::max(periapsisSpeed2, speed2) / softened2));
+        rate = std::max(rate, std::sqrt(gm / (currentSoftened2 * std::sqrt(currentSoftened2))));
+    }
+
+    // powers of two so slow changes from the mutual forces rarely move a body to another count
+    uint32_t substeps = 1;
+    float needed = rate * dt / _substepAccuracy;
+    while(substeps < needed && substeps < _maxSubsteps) {
+        substeps *= 2;
+    }
+    return std::min(substeps, _maxSubsteps);
+}
+
+void BodySystem::step(float dt) {
+    size_t numBodies = positions.size();
+    if(numBodies == 0) return;
+
+    _mutualAccelerations.resize(numBodies);
+    _substeps.resize(numBodies);
+    if(!_mutualValid) {
+        _solver.computeMutualAccelerations(&positions[0], &masses[0], numBodies, &_mutualAccelerations[0]);
+    }
+
+    // kick with the mutual forces, then drift under the attractors in substeps
+    const float HALF_DT = 0.5f * dt;
+    parallelFor(numBodies, 256, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            glm::vec3 p = positions[i];
+            glm::vec3 v = velocities[i] + _mutualAccelerations[i] * HALF_DT;
+
+            uint32_t substeps = substepsFor(p, v, dt);
+            float h = dt / substeps;
+            glm::vec3 a = _solver.attractorAcceleration(p);
+            for(uint32_t s = 0; s < substeps; s++) {
+                v += a * (0.5f * h);
+                p += v * h;
+                a = _solver.attractorAcceleration(p);
+                v += a * (0.5f * h);
+            }
+
+            positions[i] = p;
+            velocities[i] = v;
+            _substeps[i] = substeps;
+        }
+    });
+
+    resolveCollisions();
+
+    // closing kick with the mutual forces at the new positions, kept for the next step's opening kick
+    _solver.computeMutualAccelerations(&positions[0], &masses[0], numBodies, &_mutualAccelerations[0]);
+    _mutualValid = true;
+    parallelFor(numBodies, 1024, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            velocities[i] += _mutualAccelerations[i] * HALF_DT;
+        }
+        QuaternionBatch::integrate(&orientations[begin], &angularVelocities[begin], end - begin, dt);
+    });
+
+    _totalSubsteps = 0;
+    _maxSubstepsTaken = 0;
+    for(size_t i = 0; i < numBodies; i++) {
+        _totalSubsteps += _substeps[i];
+        _maxSubstepsTaken = std::max(_maxSubstepsTaken, _substeps[i]);
+    }
+}
+
+void BodySystem::resolveCollisions() {
+    size_t numBodies = positions.size();
+    _broadphase.build(&positions[0], &radii[0], numBodies);
+    _resolvedPositions.resize(numBodies);
+    _resolvedVelocities.resize(numBodies);
+    _numContacts = 0;
+
+    // each body moves itself by its share of every overlap, split by inverse mass like the impulse
+    const float BOUNCE = 1.0f + _restitution;
+    parallelFor(numBodies, 256, [&](size_t begin, size_t end, unsigned) {
+        uint32_t contacts = 0;
+        for(size_t i = begin; i < end; i++) {
+            glm::vec3 p = positions[i];
+            glm::vec3 v = velocities[i];
+            glm::vec3 dp(0.0f);
+            glm::vec3 dv(0.0f);
+            float inverseMass = 1.0f / masses[i];
+
+            _broadphase.querySphere(p, radii[i], [&](uint32_t j) {
+                if(j == i) return;
+                glm::vec3 d = p - positions[j];
+                float distance = std::sqrt(glm::dot(d, d));
+                // bodies sitting exactly on top of each other split along y, the lower index going up
+                glm::vec3 n = distance > 1e-6f ? d / distance : glm::vec3(0.0f, i < j ? 1.0f : -1.0f, 0.0f);
+                float share = inverseMass / (inverseMass + 1.0f / masses[j]);
+
+                dp += n * ((radii[i] + radii[j] - distance) * share);
+                float closing = glm::dot(v - velocities[j], n);
+                if(closing < 0.0f) {
+                    dv -= n * (BOUNCE * closing * share);
+                }
+                contacts++;
+            });
+
+            _resolvedPositions[i] = p + dp;
+            _resolvedVelocities[i] = v + dv;
+        }
+        _numContacts += contacts;
+    });
+
+    parallelFor(numBodies, 4096, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            positions[i] = _resolvedPositions[i];
+            velocities[i] = _resolvedVelocities[i];
+        }
+    });
+    // pushed out bodies may have crossed into other cells, so the grid is for where they were
+    _broadphaseValid = false;
+}
+
+void BodySystem::collideParticles(glm::vec3 *particlePositions, glm::vec3 *particleVelocities, size_t count, float radius) {
+    _numParticleContacts = 0;
+    if(positions.empty() || count == 0) return;
+    if(!_broadphaseValid) {
+        _broadphase.build(&positions[0], &radii[0], positions.size());
+        _broadphaseValid = true;
+    }
+
+    const float BOUNCE = 1.0f + _restitution;
+    parallelFor(count, 2048, [&](size_t begin, size_t end, unsigned) {
+        uint32_t contacts = 0;
+        for(size_t i = begin; i < end; i++) {
+            glm::vec3 p = particlePositions[i];
+            glm::vec3 v = particleVelocities[i];
+
+            // the query looks around where the particle started, p moves as it is pushed out
+            _broadphase.querySphere(particlePositions[i], radius, [&](uint32_t j) {
+                glm::vec3 d = p - positions[j];
+                float distance = std::sqrt(glm::dot(d, d));
+                if(distance <= 1e-6f) return;
+                glm::vec3 n = d / distance;
+
+                // back out to the surface and reflect off it in the body's frame
+                p = positions[j] + n * (radii[j] + radius);
+                float closing = glm::dot(v - velocities[j], n);
+                if(closing < 0.0f) {
+                    v -= n * (BOUNCE * closing);
+                }
+                contacts++;
+            });
+
+            particlePositions[i] = p;
+            particleVelocities[i] = v;
+        }
+        _numParticleContacts += contacts;
+    });
+}
+
+double BodySystem::computeEnergy() {
+    double kinetic = 0.0;
+    for(size_t i = 0; i < positions.size(); i++) {
+        kinetic += 0.5 * masses[i] * glm::dot(velocities[i], velocities[i]);
+    }
+    if(positions.empty()) return kinetic;
+    return kinetic + _solver.computePotentialEnergy(&positions[0], &masses[0], positions.size());
+}
+
+void BodySystem::saveCheckpoint(CheckpointWriter &checkpoint) const {
+    IntegratorState integrator;
+    integrator.referenceEnergy = _referenceEnergy;
+    integrator.mutualValid = _mutualValid && _mutualAccelerations.size() == positions.size();
+    integrator.unused = 0;
+
+    checkpoint.add(BODY_POSITIONS, positions);
+    checkpoint.add(BODY_VELOCITIES, velocities);
+    checkpoint.add(BODY_ANGULAR_VELOCITIES, angularVelocities);
+    checkpoint.add(BODY_ORIENTATIONS, orientations);
+    checkpoint.add(BODY_SCALES, scales);
+    checkpoint.add(BODY_RADII, radii);
+    checkpoint.add(BODY_MASSES, masses);
+    checkpoint.add(BODY_MATERIAL_IDS, materialIDs);
+    checkpoint.add(BODY_MATERIALS, _materials);
+    checkpoint.add(BODY_MUTUAL_ACCELERATIONS, _mutualAccelerations);
+    checkpoint.add(BODY_SLOT_TO_INDEX, _slotToIndex);
+    checkpoint.add(BODY_SLOT_GENERATIONS, _slotGenerations);
+    checkpoint.add(BODY_INDEX_TO_SLOT, _indexToSlot);
+    checkpoint.add(BODY_FREE_SLOTS, _freeSlots);
+    checkpoint.addValue(BODY_INTEGRATOR, integrator);
+}
+
+bool BodySystem::canRestoreCheckpoint(const CheckpointReader &checkpoint) const {
+    // everything is there and the per body arrays agree
+    IntegratorState integrator;
+    size_t numBodies = 0, count = 0;
+    if(!checkpoint.readValue(BODY_INTEGRATOR, integrator) || !checkpoint.getCount<glm::vec3>(BODY_POSITIONS, numBodies)) {
+        return false;
+    }
+    return checkpoint.getCount<glm::vec3>(BODY_VELOCITIES, count) && count == numBodies
+           && checkpoint.getCount<glm::vec3>(BODY_ANGULAR_VELOCITIES, count) && count == numBodies
+           && checkpoint.getCount<glm::quat>(BODY_ORIENTATIONS, count) && count == numBodies
+           && checkpoint.getCount<glm::vec3>(BODY_SCALES, count) && count == numBodies
+           && checkpoint.getCount<float>(BODY_RADII, count) && count == numBodies
+           && checkpoint.getCount<float>(BODY_MASSES, count) && count == numBodies
+           && checkpoint.getCount<uint32_t>(BODY_MATERIAL_IDS, count) && count == numBodies
+           && checkpoint.getCount<uint32_t>(BODY_INDEX_TO_SLOT, count) && count == numBodies
+           && checkpoint.getCount<BodyMaterial>(BODY_MATERIALS, count)
+           && checkpoint.getCount<glm::vec3>(BODY_MUTUAL_ACCELERATIONS, count)
+           && checkpoint.getCount<uint32_t>(BODY_SLOT_TO_INDEX, count)
+           && checkpoint.getCount<uint32_t>(BODY_SLOT_GENERATIONS, count)
+           && checkpoint.getCount<uint32_t>(BODY_FREE_SLOTS, count);
+}
+
+bool BodySystem::restoreCheckpoint(const CheckpointReader &checkpoint) {
+    // check everything is there before changing anything
+    if(!canRestoreCheckpoint(checkpoint)) return false;
+    IntegratorState integrator;
+    checkpoint.readValue(BODY_INTEGRATOR, integrator);
+    size_t numBodies = 0;
+    checkpoint.getCount<glm::vec3>(BODY_POSITIONS, numBodies);
+
+    checkpoint.read(BODY_POSITIONS, positions);
+    checkpoint.read(BODY_VELOCITIES, velocities);
+    checkpoint.read(BODY_ANGULAR_VELOCITIES, angularVelocities);
+    checkpoint.read(BODY_ORIENTATIONS, orientations);
+    checkpoint.read(BODY_SCALES, scales);
+    checkpoint.read(BODY_RADII, radii);
+    checkpoint.read(BODY_MASSES, masses);
+    checkpoint.read(BODY_MATERIAL_IDS, materialIDs);
+    checkpoint.read(BODY_MATERIALS, _materials);
+    checkpoint.read(BODY_MUTUAL_ACCELERATIONS, _mutualAccelerations);
+    checkpoint.read(BODY_SLOT_TO_INDEX, _slotToIndex);
+    checkpoint.read(BODY_SLOT_GENERATIONS, _slotGenerations);
+    checkpoint.read(BODY_INDEX_TO_SLOT, _indexToSlot);
+    checkpoint.read(BODY_FREE_SLOTS, _freeSlots);
+    _referenceEnergy = integrator.referenceEnergy;
+    _mutualValid = integrator.mutualValid != 0 && _mutualAccelerations.size() == numBodies;
+    _broadphaseValid = false;
+    return true;
+}
+
+void BodySystem::resetEnergyReference() {
+    _referenceEnergy = computeEnergy();
+}
+
+double BodySystem::getEnergyDrift() {
+    if(_referenceEnergy == 0.0) return 0.0;
+    return (computeEnergy() - _referenceEnergy) / std::fabs(_referenceEnergy);
+}
@@ -0,0 +1,166 @@
+//
+// Rigid bodies pulled around by the black hole, stored as structure of arrays.
+//
+// Every property lives in its own contiguous array indexed by a dense body index
+// so the integrator sweeps each one front to back.  Bodies are referred to from
+// outside through generational handles: a handle names a slot, the slot maps to
+// the current dense index, and the generation detects handles to bodies that
+// have since been destroyed.  Destroying a body moves the last body into its
+// place so the arrays stay packed.
+//
+// step() advances the simulation and is run before anything is drawn, the
+// renderer only ever reads the arrays.
+//
+// Integration is kick-drift-kick leapfrog with the forces split in two.  The
+// mutual gravity from the Barnes-Hut tree changes slowly and is applied as a
+// half kick at either end of the frame.  The attractor pull in between is
+// integrated with velocity Verlet in substeps, each body picking its own power
+// of two count from the closest approach of its orbit to the attractor.  Only
+// bodies diving towards the singularity pay for the extra steps.  Both halves
+// are symplectic so energy errors stay bounded instead of growing every orbit.
+//
+// Bodies are spheres for collisions.  After the drift every body looks up its
+// neighbours in a spatial hash and pushes itself out of and bounces off each
+// one it overlaps, using only the positions from before the pass so bodies can
+// be resolved in parallel and in any order.  Particles can be bounced off the
+// bodies with the same hash through collideParticles().
+//
+
+#ifndef LAB10_BODYSYSTEM_H
+#define LAB10_BODYSYSTEM_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+#include <glm/gtx/quaternion.hpp>
+
+// include C and C++ libraries
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "JobSystem.h"
+#include "NBodySolver.h"
+#include "SpatialHash.h"
+
+struct BodyHandle {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+struct BodyMaterial {
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    glm::vec3 ambient;
+    float shininess;
+};
+
+class BodySystem {
+public:
+    static const uint32_t INVALID_INDEX = 0xffffffff;
+
+    BodySystem();
+
+    // the job system is used for the force and integration passes, may be null
+    void initialize(JobSystem *jobSystem);
+
+    uint32_t addMaterial(const BodyMaterial &material);
+    const BodyMaterial& getMaterial(uint32_t materialID) const;
+    const std::vector<BodyMaterial>& getMaterials() const;
+
+    BodyHandle create(glm::vec3 position, glm::vec3 velocity, glm::vec3 angularVelocity, glm::vec3 scale, float radius, float mass, uint32_t materialID);
+    void destroy(BodyHandle handle);
+    bool isValid(BodyHandle handle) const;
+
+    // dense index of the body for indexing the arrays below, INVALID_INDEX for a stale handle
+    uint32_t indexOf(BodyHandle handle) const;
+    size_t size() const;
+    // copies the slot tables indexOf() looks handles up in, so another thread can look them up in its copy
+    void copyHandleTables(std::vector<uint32_t> &slotToIndex, std::vector<uint32_t> &slotGenerations) const;
+
+    // advances every body by dt frames
+    void step(float dt);
+
+    // radians a body may swing around an attractor per substep, smaller is more accurate
+    void setSubstepAccuracy(float radiansPerSubstep);
+    void setMaxSubsteps(uint32_t maxSubsteps);
+    // forces every body to take the same number of substeps, 0 goes back to adaptive
+    void setUniformSubsteps(uint32_t substeps);
+    uint32_t getTotalSubsteps() const;  // over every body in the last step
+    uint32_t getMaxSubstepsTaken() const;
+
+    // fraction of the closing speed kept after a bounce, 0 to 1
+    void setRestitution(float restitution);
+    // hash cell edge, about the diameter of the common bodies - bigger bodies still work but cost more
+    void setCollisionCellSize(float cellSize);
+    uint32_t getNumContacts() const;    // body pairs touching in the last step, counted from both sides
+
+    // bounces particles of the given radius off the bodies, massless so the bodies do not notice
+    void collideParticles(glm::vec3 *particlePositions, glm::vec3 *particleVelocities, size_t count, float radius);
+    uint32_t getNumParticleContacts() const;
+
+    // kinetic plus potential energy, O(n^2) so for diagnostics only
+    double computeEnergy();
+    void resetEnergyReference();
+    double getEnergyDrift();            // relative change since resetEnergyReference()
+
+    NBodySolver& getSolver();
+
+    // every body, the handles, the materials and the accelerations carried between steps, so a restored
+    // system steps exactly as the saved one would have.  The solver and integrator settings are not saved.
+    void saveCheckpoint(CheckpointWriter &checkpoint) const;
+    // whether restoreCheckpoint() would take the checkpoint, without changing anything
+    bool canRestoreCheckpoint(const CheckpointReader &checkpoint) const;
+    bool restoreCheckpoint(const CheckpointReader &checkpoint);
+
+    // the body arrays, all indexed by the dense index
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    std::vector<glm::vec3> angularVelocities;   // world space axis times radians per frame
+    std::vector<glm::quat> orientations;
+    std::vector<glm::vec3> scales;
+    std::vector<float> radii;           // collision sphere, 0 never collides
+    std::vector<float> masses;
+    std::vector<uint32_t> materialIDs;
+
+private:
+
+    void parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func);
+
+    uint32_t substepsFor(const glm::vec3 &position, const glm::vec3 &velocity, float dt) const;
+
+    void resolveCollisions();
+
+    struct IntegratorState {
+        double referenceEnergy;
+        uint32_t mutualValid;
+        uint32_t unused;
+    };
+
+    JobSystem *_jobSystem;
+    NBodySolver _solver;
+    std::vector<glm::vec3> _mutualAccelerations;
+    bool _mutualValid;                  // false after bodies were added or removed
+    std::vector<uint32_t> _substeps;
+    float _substepAccuracy;
+    uint32_t _maxSubsteps;
+    uint32_t _uniformSubsteps;
+    uint32_t _totalSubsteps;
+    uint32_t _maxSubstepsTaken;
+    double _referenceEnergy;
+    SpatialHash _broadphase;
+    bool _broadphaseValid;              // false once the arrays may have moved since the last build
+    float _restitution;
+    std::vector<glm::vec3> _resolvedPositions;
+    std::vector<glm::vec3> _resolvedVelocities;
+    std::atomic<uint32_t> _numContacts;
+    std::atomic<uint32_t> _numParticleContacts;
+    std::vector<BodyMaterial> _materials;
+
+    // handle bookkeeping
+    std::vector<uint32_t> _slotToIndex;
+    std::vector<uint32_t> _slotGenerations;
+    std::vector<uint32_t> _indexToSlot;
+    std::vector<uint32_t> _freeSlots;
+};
+
+#endif //LAB10_BODYSYSTEM_H
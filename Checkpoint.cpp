@@ -0,0 +1,117 @@
+//
+// Saves simulation state to disk and maps it back in, for starting from a warmed up scene.
+//
+
+#include "Checkpoint.h"
+
+#include <cstdio>
+
+const uint32_t CheckpointReader::PAGE_SIZE;
+const uint32_t CheckpointReader::MAX_SECTIONS;
+
+namespace {
+    uint64_t roundUpToPage(uint64_t offset, uint64_t pageSize) {
+        return (offset + pageSize - 1) / pageSize * pageSize;
+    }
+}
+
+void CheckpointWriter::add(uint32_t id, const void *data, size_t elementSize, size_t count) {
+    PendingSection section;
+    section.id = id;
+    section.data = data;
+    section.elementSize = elementSize;
+    section.count = count;
+    _sections.push_back(section);
+}
+
+bool CheckpointWriter::write(const char* filename) const {
+    const uint64_t PAGE_SIZE = CheckpointReader::PAGE_SIZE;
+    if(_sections.size() > CheckpointReader::MAX_SECTIONS) {
+        fprintf(stderr, "[ERROR]: %zu checkpoint sections, at most %u fit\n", _sections.size(), CheckpointReader::MAX_SECTIONS);
+        return false;
+    }
+
+    // lay the sections out a page apart after the table
+    std::vector<CheckpointReader::Section> table(_sections.size());
+    uint64_t offset = PAGE_SIZE;
+    for(size_t s = 0; s < _sections.size(); s++) {
+        table[s].id = _sections[s].id;
+        table[s].elementSize = _sections[s].elementSize;
+        table[s].offset = offset;
+        table[s].count = _sections[s].count;
+        offset = roundUpToPage(offset + _sections[s].elementSize * _sections[s].count, PAGE_SIZE);
+    }
+
+    CheckpointReader::Header header;
+    memcpy(header.magic, "CKP1", 4);
+    header.numSections = table.size();
+    header.fileSize = offset;
+
+    FILE *file = fopen(filename, "wb");
+    if(file == nullptr) {
+        fprintf(stderr, "[ERROR]: Could not open \"%s\" for writing\n", filename);
+        return false;
+    }
+    std::vector<char> padding(PAGE_SIZE, 0);
+    fwrite(&header, sizeof(header), 1, file);
+    if(!table.empty()) fwrite(&table[0], sizeof(CheckpointReader::Section), table.size(), file);
+    uint64_t written = sizeof(header) + table.size() * sizeof(CheckpointReader::Section);
+    for(size_t s = 0; s < _sections.size(); s++) {
+        fwrite(&padding[0], 1, table[s].offset - written, file);
+        size_t bytes = _sections[s].elementSize * _sections[s].count;
+        const void *data = _sections[s].copy.empty() ? _sections[s].data : &_sections[s].copy[0];
+        if(bytes > 0) fwrite(data, 1, bytes, file);
+        written = table[s].offset + bytes;
+    }
+    // pad the last section out too, so every section is whole pages
+    fwrite(&padding[0], 1, header.fileSize - written, file);
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    if(!ok) {
+        fprintf(stderr, "[ERROR]: Could not write \"%s\"\n", filename);
+    }
+    return ok;
+}
+
+bool CheckpointReader::open(const char* filename) {
+    if(!_file.open(filename)) {
+        fprintf(stderr, "[ERROR]: Could not open checkpoint \"%s\"\n", filename);
+        return false;
+    }
+    const Header *header = (const Header*)_file.data();
+    if(_file.size() < PAGE_SIZE || memcmp(header->magic, "CKP1", 4) != 0 || header->fileSize != _file.size()
+       || header->numSections > MAX_SECTIONS) {
+        fprintf(stderr, "[ERROR]: \"%s\" is not a complete checkpoint\n", filename);
+        _file.close();
+        return false;
+    }
+    // the copies will read nearly all of it, so start reading ahead now
+    _file.prefetch();
+    return true;
+}
+
+void CheckpointReader::close() {
+    _file.close();
+}
+
+bool CheckpointReader::isOpen() const {
+    return _file.isOpen();
+}
+
+const void* CheckpointReader::find(uint32_t id, size_t elementSize, size_t &count) const {
+    if(!_file.isOpen()) return nullptr;
+    const Header *header = (const Header*)_file.data();
+    const Section *table = (const Section*)(header + 1);
+    for(uint32_t s = 0; s < header->numSections; s++) {
+        if(table[s].id != id) continue;
+        if(table[s].elementSize != elementSize || table[s].offset + table[s].elementSize * table[s].count > _file.size()) {
+            fprintf(stderr, "[ERROR]: checkpoint section 0x%x does not match this build\n", id);
+            return nullptr;
+        }
+        count = table[s].count;
+        return (const char*)_file.data() + table[s].offset;
+    }
+    fprintf(stderr, "[ERROR]: checkpoint has no section 0x%x\n", id);
+    return nullptr;
+}
@@ -0,0 +1,130 @@
+//
+// Saves simulation state to disk and maps it back in, for starting from a warmed up scene.
+//
+// A checkpoint is a table of sections, each one array copied straight out of
+// the structure of arrays it came from.  The header and section table take
+// the first page and every section starts on a page boundary of its own, so
+// restoring maps the file and does one bulk copy per array from whole,
+// aligned pages - no parsing, no per element work.  The systems that own the
+// state decide what goes in through saveCheckpoint() and restoreCheckpoint()
+// methods, using the section ids below.
+//
+// Sections remember their element size and a restore refuses a section
+// whose size differs, so a checkpoint from a build with a different layout
+// fails instead of loading garbage.  Like recordings, checkpoints are not
+// meant to move between platforms.
+//
+
+#ifndef LAB10_CHECKPOINT_H
+#define LAB10_CHECKPOINT_H
+
+// include C and C++ libraries
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "MappedFile.h"
+
+// every section that can be in a checkpoint, ids must never be reused
+enum CheckpointSection {
+    PARTICLE_POSITIONS = 0x100,
+    PARTICLE_VELOCITIES,
+    PARTICLE_LIFESPANS,
+    PARTICLE_TYPES,
+    PARTICLE_EMITTER,
+    PARTICLE_RANDOM_STATE,
+
+    BODY_POSITIONS = 0x200,
+    BODY_VELOCITIES,
+    BODY_ANGULAR_VELOCITIES,
+    BODY_ORIENTATIONS,
+    BODY_SCALES,
+    BODY_RADII,
+    BODY_MASSES,
+    BODY_MATERIAL_IDS,
+    BODY_MATERIALS,
+    BODY_MUTUAL_ACCELERATIONS,
+    BODY_SLOT_TO_INDEX,
+    BODY_SLOT_GENERATIONS,
+    BODY_INDEX_TO_SLOT,
+    BODY_FREE_SLOTS,
+    BODY_INTEGRATOR                     // reference energy and whether the mutual accelerations are current
+};
+
+class CheckpointWriter {
+public:
+    // array sections point at the caller's data, which must stay put until write()
+    void add(uint32_t id, const void *data, size_t elementSize, size_t count);
+    template<typename T> void add(uint32_t id, const std::vector<T> &values) {
+        add(id, values.empty() ? nullptr : &values[0], sizeof(T), values.size());
+    }
+    // single values are copied, so they can be built on the stack
+    template<typename T> void addValue(uint32_t id, const T &value) {
+        add(id, nullptr, sizeof(T), 1);
+        _sections.back().copy.assign((const char*)&value, (const char*)&value + sizeof(T));
+    }
+
+    bool write(const char* filename) const;
+
+private:
+    struct PendingSection {
+        uint32_t id;
+        const void *data;
+        size_t elementSize;
+        size_t count;
+        std::vector<char> copy;         // holds the data instead when it was copied
+    };
+    std::vector<PendingSection> _sections;
+};
+
+class CheckpointReader {
+public:
+    bool open(const char* filename);
+    void close();
+    bool isOpen() const;
+
+    // true if the section is there with T sized elements, and how many
+    template<typename T> bool getCount(uint32_t id, size_t &count) const {
+        return find(id, sizeof(T), count) != nullptr;
+    }
+    // resizes values to the section and copies it in, false if it is missing or has the wrong element size
+    template<typename T> bool read(uint32_t id, std::vector<T> &values) const {
+        size_t count = 0;
+        const void *data = find(id, sizeof(T), count);
+        if(data == nullptr) return false;
+        values.resize(count);
+        if(count > 0) memcpy(&values[0], data, count * sizeof(T));
+        return true;
+    }
+    template<typename T> bool readValue(uint32_t id, T &value) const {
+        size_t count = 0;
+        const void *data = find(id, sizeof(T), count);
+        if(data == nullptr || count != 1) return false;
+        memcpy(&value, data, sizeof(T));
+        return true;
+    }
+
+private:
+    friend class CheckpointWriter;
+
+    static const uint32_t PAGE_SIZE = 4096;
+    static const uint32_t MAX_SECTIONS = (PAGE_SIZE - 16) / 24;    // as many as fit in the first page
+
+    struct Header {
+        char magic[4];                  // "CKP1"
+        uint32_t numSections;
+        uint64_t fileSize;
+    };
+    struct Section {
+        uint32_t id;
+        uint32_t elementSize;
+        uint64_t offset;                // from the start of the file, a multiple of PAGE_SIZE
+        uint64_t count;
+    };
+
+    const void* find(uint32_t id, size_t elementSize, size_t &count) const;
+
+    MappedFile _file;
+};
+
+#endif //LAB10_CHECKPOINT_H
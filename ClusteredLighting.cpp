@@ -0,0 +1,286 @@
+//
+// Clustered forward lighting for many point lights.
+//
+
+#include "ClusteredLighting.h"
+#include "ResourceRegistry.h"
+
+#include <cmath>				// for log() functionality
+#include <cstdio>				// for printf functionality
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CLUSTERED_LIGHTING_SSE
+#endif
+
+ClusteredLighting::ClusteredLighting() {
+    _farPlane = 100.0f;
+    _sliceScale = 0.0f;
+    _sliceBias = 0.0f;
+    for(GLuint s = 0; s < CLUSTERS_Z - 1; s++) {
+        _sliceStarts[s] = CLUSTER_NEAR;
+    }
+    _nearPlane = 0.1f;
+    _projection = glm::vec4(1.0f, 0.0f, 1.0f, 0.0f);
+    _screenSize = glm::ivec2(1, 1);
+    _numLights = 0;
+    for(int i = 0; i < 3; i++) {
+        _buffers[i] = 0;
+        _textures[i] = 0;
+    }
+};
+
+void ClusteredLighting::initialize() {
+    ResourceRegistry::genBuffers(OWNER_LIGHTING, 3, _buffers);
+    ResourceRegistry::genTextures(OWNER_LIGHTING, 3, _textures);
+
+    const GLenum FORMATS[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    for(int i = 0; i < 3; i++) {
+        glBindBuffer(GL_TEXTURE_BUFFER, _buffers[i]);
+        ResourceRegistry::bufferData(_buffers[i], GL_TEXTURE_BUFFER, 16, nullptr, GL_DYNAMIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, _textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, FORMATS[i], _buffers[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    _clusterGrid.resize(NUM_CLUSTERS);
+    _writeHeads.resize(NUM_CLUSTERS);
+
+    fprintf( stdout, "[INFO]: clustered lighting set up with %u x %u x %u clusters\n", CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z );
+}
+
+void ClusteredLighting::lookupUniforms(GLuint program, ClusteredShaderUniforms &uniforms) {
+    uniforms.clusterDims    = glGetUniformLocation(program, "clusterDims");
+    uniforms.screenSize     = glGetUniformLocation(program, "screenSize");
+    uniforms.depthSlicing   = glGetUniformLocation(program, "depthSlicing");
+    uniforms.lightData      = glGetUniformLocation(program, "lightData");
+    uniforms.clusterGrid    = glGetUniformLocation(program, "clusterGrid");
+    uniforms.lightIndices   = glGetUniformLocation(program, "lightIndices");
+}
+
+GLuint ClusteredLighting::sliceForDepth(float depth) const {
+    // how many slices have started by this depth, the same count the SSE path makes
+    GLuint slice = 0;
+    for(GLuint s = 0; s < CLUSTERS_Z - 1; s++) {
+        if(depth >= _sliceStarts[s]) slice++;
+    }
+    return slice;
+}
+
+void ClusteredLighting::assignRange(GLuint i) {
+    glm::vec4 light = _viewSpaceLights[i];
+    float depthMin = std::max(-light.z - light.w, _nearPlane);
+    float depthMax = -light.z + light.w;
+    if(depthMax < _nearPlane || depthMin > _farPlane) {
+        // entirely outside of the frustum depth range
+        _lightMin[i] = glm::uvec3(1, 1, 1);
+        _lightMax[i] = glm::uvec3(0, 0, 0);
+        return;
+    }
+
+    float extent[2][2];             // [axis][min/max] in normalized device coordinates
+    const float CENTER[2] = { light.x, light.y };
+    const float SCALE[2] = { _projection.x, _projection.z };
+    const float OFFSET[2] = { _projection.y, _projection.w };
+    for(int axis = 0; axis < 2; axis++) {
+        float lo = CENTER[axis] - light.w, hi = CENTER[axis] + light.w;
+        float a = lo / depthMin, b = lo / depthMax, c = hi / depthMin, d = hi / depthMax;
+        extent[axis][0] = SCALE[axis] * std::min(std::min(a, b), std::min(c, d)) + OFFSET[axis];
+        extent[axis][1] = SCALE[axis] * std::max(std::max(a, b), std::max(c, d)) + OFFSET[axis];
+    }
+    if(extent[0][1] < -1.0f || extent[0][0] > 1.0f || extent[1][1] < -1.0f || extent[1][0] > 1.0f) {
+        _lightMin[i] = glm::uvec3(1, 1, 1);
+        _lightMax[i] = glm::uvec3(0, 0, 0);
+        return;
+    }
+
+    // clamped before truncating, as the SSE path has to
+    const float DIMS[2] = { (float)CLUSTERS_X, (float)CLUSTERS_Y };
+    GLuint tileMin[2], tileMax[2];
+    for(int axis = 0; axis < 2; axis++) {
+        float lo = (extent[axis][0] * 0.5f + 0.5f) * DIMS[axis];
+        float hi = (extent[axis][1] * 0.5f + 0.5f) * DIMS[axis];
+        tileMin[axis] = (GLuint)std::min(std::max(lo, 0.0f), DIMS[axis] - 1.0f);
+        tileMax[axis] = (GLuint)std::min(std::max(hi, 0.0f), DIMS[axis] - 1.0f);
+    }
+    _lightMin[i] = glm::uvec3(tileMin[0], tileMin[1], sliceForDepth(depthMin));
+    _lightMax[i] = glm::uvec3(tileMax[0], tileMax[1], sliceForDepth(std::min(depthMax, _farPlane)));
+}
+
+void ClusteredLighting::assignRanges() {
+    GLuint i = 0;
+#ifdef CLUSTERED_LIGHTING_SSE
+    // four lights per pass, one component per register, the same arithmetic as assignRange()
+    const __m128 ZERO = _mm_setzero_ps();
+    const __m128 ONE = _mm_set1_ps(1.0f);
+    const __m128 MINUS_ONE = _mm_set1_ps(-1.0f);
+    const __m128 HALF = _mm_set1_ps(0.5f);
+    const __m128 NEAR_PLANE = _mm_set1_ps(_nearPlane);
+    const __m128 FAR_PLANE = _mm_set1_ps(_farPlane);
+    const __m128 SCALE[2] = { _mm_set1_ps(_projection.x), _mm_set1_ps(_projection.z) };
+    const __m128 OFFSET[2] = { _mm_set1_ps(_projection.y), _mm_set1_ps(_projection.w) };
+    const __m128 DIMS[2] = { _mm_set1_ps((float)CLUSTERS_X), _mm_set1_ps((float)CLUSTERS_Y) };
+    const __m128 LAST_TILE[2] = { _mm_set1_ps(CLUSTERS_X - 1.0f), _mm_set1_ps(CLUSTERS_Y - 1.0f) };
+    for(; i + 4 <= _numLights; i += 4) {
+        __m128 x = _mm_loadu_ps(&_viewSpaceLights[i][0]);
+        __m128 y = _mm_loadu_ps(&_viewSpaceLights[i + 1][0]);
+        __m128 z = _mm_loadu_ps(&_viewSpaceLights[i + 2][0]);
+        __m128 radius = _mm_loadu_ps(&_viewSpaceLights[i + 3][0]);
+        _MM_TRANSPOSE4_PS(x, y, z, radius);
+
+        __m128 depth = _mm_sub_ps(ZERO, z);
+        __m128 depthMin = _mm_max_ps(_mm_sub_ps(depth, radius), NEAR_PLANE);
+        __m128 depthMax = _mm_add_ps(depth, radius);
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(depthMax, NEAR_PLANE), _mm_cmple_ps(depthMin, FAR_PLANE));
+
+        __m128i tileMin[2], tileMax[2];
+        const __m128 CENTER[2] = { x, y };
+        for(int axis = 0; axis < 2; axis++) {
+            __m128 lo = _mm_sub_ps(CENTER[axis], radius), hi = _mm_add_ps(CENTER[axis], radius);
+            __m128 a = _mm_div_ps(lo, depthMin), b = _mm_div_ps(lo, depthMax);
+            __m128 c = _mm_div_ps(hi, depthMin), d = _mm_div_ps(hi, depthMax);
+            __m128 extentMin = _mm_add_ps(_mm_mul_ps(SCALE[axis], _mm_min_ps(_mm_min_ps(a, b), _mm_min_ps(c, d))), OFFSET[axis]);
+            __m128 extentMax = _mm_add_ps(_mm_mul_ps(SCALE[axis], _mm_max_ps(_mm_max_ps(a, b), _mm_max_ps(c, d))), OFFSET[axis]);
+            inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(extentMax, MINUS_ONE), _mm_cmple_ps(extentMin, ONE)));
+
+            __m128 tileLo = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(extentMin, HALF), HALF), DIMS[axis]);
+            __m128 tileHi = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(extentMax, HALF), HALF), DIMS[axis]);
+            tileMin[axis] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(tileLo, ZERO), LAST_TILE[axis]));
+            tileMax[axis] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(tileHi, ZERO), LAST_TILE[axis]));
+        }
+
+        // a true compare is -1, so subtracting the masks counts the slices started
+        __m128 sliceDepthMax = _mm_min_ps(depthMax, FAR_PLANE);
+        __m128i sliceMin = _mm_setzero_si128(), sliceMax = _mm_setzero_si128();
+        for(GLuint s = 0; s < CLUSTERS_Z - 1; s++) {
+            __m128 start = _mm_set1_ps(_sliceStarts[s]);
+            sliceMin = _mm_sub_epi32(sliceMin, _mm_castps_si128(_mm_cmpge_ps(depthMin, start)));
+            sliceMax = _mm_sub_epi32(sliceMax, _mm_castps_si128(_mm_cmpge_ps(sliceDepthMax, start)));
+        }
+
+        alignas(16) int32_t ranges[6][4];
+        _mm_store_si128((__m128i*)ranges[0], tileMin[0]);
+        _mm_store_si128((__m128i*)ranges[1], tileMin[1]);
+        _mm_store_si128((__m128i*)ranges[2], sliceMin);
+        _mm_store_si128((__m128i*)ranges[3], tileMax[0]);
+        _mm_store_si128((__m128i*)ranges[4], tileMax[1]);
+        _mm_store_si128((__m128i*)ranges[5], sliceMax);
+        int insideMask = _mm_movemask_ps(inside);
+        for(int lane = 0; lane < 4; lane++) {
+            if(insideMask & (1 << lane)) {
+                _lightMin[i + lane] = glm::uvec3(ranges[0][lane], ranges[1][lane], ranges[2][lane]);
+                _lightMax[i + lane] = glm::uvec3(ranges[3][lane], ranges[4][lane], ranges[5][lane]);
+            } else {
+                _lightMin[i + lane] = glm::uvec3(1, 1, 1);
+                _lightMax[i + lane] = glm::uvec3(0, 0, 0);
+            }
+        }
+    }
+#endif
+    for(; i < _numLights; i++) {
+        assignRange(i);
+    }
+}
+
+void ClusteredLighting::update(const std::vector<PointLight>& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                               float nearPlane, float farPlane, GLint screenWidth, GLint screenHeight) {
+    _farPlane = farPlane;
+    _nearPlane = nearPlane;
+    _screenSize = glm::ivec2(screenWidth, screenHeight);
+    _sliceScale = (CLUSTERS_Z - 1) / std::log(farPlane / CLUSTER_NEAR);
+    _sliceBias = -std::log(CLUSTER_NEAR) * _sliceScale;
+    // where log(depth) * scale + bias reaches each whole number, so no light needs a log of its own
+    for(GLuint s = 0; s < CLUSTERS_Z - 1; s++) {
+        _sliceStarts[s] = CLUSTER_NEAR * std::exp(s / _sliceScale);
+    }
+
+    _numLights = lights.size();
+    _lightData.resize(_numLights * 2);
+    _viewSpaceLights.resize(_numLights);
+    _lightMin.resize(_numLights);
+    _lightMax.resize(_numLights);
+
+    // transform every light into view space in one sweep
+    for(GLuint i = 0; i < _numLights; i++) {
+        glm::vec4 viewPos = viewMatrix * glm::vec4(lights[i].position, 1.0f);
+        _viewSpaceLights[i] = glm::vec4(viewPos.x, viewPos.y, viewPos.z, lights[i].radius);
+        _lightData[i*2] = glm::vec4(lights[i].position, lights[i].radius);
+        _lightData[i*2+1] = glm::vec4(lights[i].color, 0.0f);
+    }
+
+    // find the range of clusters covered by each light's bounding box
+    //   x/y are found by projecting the extreme corners of the box, which
+    //   is conservative because x/depth is monotonic in both terms
+    _projection = glm::vec4(projectionMatrix[0][0], -projectionMatrix[2][0], projectionMatrix[1][1], -projectionMatrix[2][1]);
+    assignRanges();
+
+    // count how many lights land in each cluster
+    std::fill(_clusterGrid.begin(), _clusterGrid.end(), glm::uvec2(0, 0));
+    for(GLuint i = 0; i < _numLights; i++) {
+        for(GLuint z = _lightMin[i].z; z <= _lightMax[i].z; z++)
+            for(GLuint y = _lightMin[i].y; y <= _lightMax[i].y; y++)
+                for(GLuint x = _lightMin[i].x; x <= _lightMax[i].x; x++)
+                    _clusterGrid[(z * CLUSTERS_Y + y) * CLUSTERS_X + x].y++;
+    }
+
+    // prefix sum the counts into offsets
+    GLuint total = 0;
+    for(GLuint c = 0; c < NUM_CLUSTERS; c++) {
+        _clusterGrid[c].x = total;
+        _writeHeads[c] = total;
+        total += _clusterGrid[c].y;
+    }
+
+    // scatter the light indices into their clusters
+    _lightIndices.resize(std::max(total, 1u));
+    for(GLuint i = 0; i < _numLights; i++) {
+        for(GLuint z = _lightMin[i].z; z <= _lightMax[i].z; z++)
+            for(GLuint y = _lightMin[i].y; y <= _lightMax[i].y; y++)
+                for(GLuint x = _lightMin[i].x; x <= _lightMax[i].x; x++)
+                    _lightIndices[_writeHeads[(z * CLUSTERS_Y + y) * CLUSTERS_X + x]++] = i;
+    }
+    _lightIndices.resize(total);
+
+    // upload everything, orphaning the old storage so we do not stall on the previous frame
+    const void* DATA[3] = { _lightData.empty() ? nullptr : &_lightData[0], &_clusterGrid[0], _lightIndices.empty() ? nullptr : &_lightIndices[0] };
+    const GLsizeiptr SIZES[3] = { (GLsizeiptr)(_lightData.size() * sizeof(glm::vec4)),
+                                  (GLsizeiptr)(_clusterGrid.size() * sizeof(glm::uvec2)),
+                                  (GLsizeiptr)(_lightIndices.size() * sizeof(GLuint)) };
+    for(int i = 0; i < 3; i++) {
+        glBindBuffer(GL_TEXTURE_BUFFER, _buffers[i]);
+        ResourceRegistry::bufferData(_buffers[i], GL_TEXTURE_BUFFER, std::max(SIZES[i], (GLsizeiptr)16), nullptr, GL_STREAM_DRAW);
+        if(SIZES[i] > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, SIZES[i], DATA[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLighting::bind(const ClusteredShaderUniforms &uniforms, GLuint firstUnit) {
+    const GLint SAMPLERS[3] = { uniforms.lightData, uniforms.clusterGrid, uniforms.lightIndices };
+    for(GLuint i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, _textures[i]);
+        glUniform1i(SAMPLERS[i], firstUnit + i);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform3ui(uniforms.clusterDims, CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+    glUniform2f(uniforms.screenSize, (GLfloat)_screenSize.x, (GLfloat)_screenSize.y);
+    glUniform3f(uniforms.depthSlicing, CLUSTER_NEAR, _sliceScale, _sliceBias);
+}
+
+GLuint ClusteredLighting::getNumLights() const {
+    return _numLights;
+}
+
+GLuint ClusteredLighting::getNumIndices() const {
+    return _lightIndices.size();
+}
+
+void ClusteredLighting::cleanup() {
+    fprintf( stdout, "[INFO]: ...deleting clustered lighting buffers....\n" );
+
+    ResourceRegistry::deleteTextures(3, _textures);
+    ResourceRegistry::deleteBuffers(3, _buffers);
+}
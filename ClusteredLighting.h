@@ -0,0 +1,105 @@
+//
+// Clustered forward lighting for many point lights.
+//
+// The view frustum is split into a CLUSTERS_X x CLUSTERS_Y x CLUSTERS_Z grid of
+// clusters, screen space tiles in x/y and exponential depth slices in z.  Every
+// frame the lights are assigned on the CPU to each cluster their sphere of
+// influence touches and the result is uploaded to three texture buffers that the
+// clusteredPhong shader reads.  The range of clusters each light covers is found
+// for four lights at a time with SSE, the depth slice by comparing against the
+// depths where the slices start rather than taking a log per light:
+//   lightData      - RGBA32F, two texels per light (position + radius, color)
+//   clusterGrid    - RG32UI, one texel per cluster (offset into lightIndices, count)
+//   lightIndices   - R32UI, the light index list of every cluster back to back
+//
+
+#ifndef LAB10_CLUSTEREDLIGHTING_H
+#define LAB10_CLUSTEREDLIGHTING_H
+
+// opengl and glm libraries
+#include <GL/glew.h>                    // define our OpenGL extensions
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <vector>
+
+struct PointLight {
+    glm::vec3 position;                 // world space position
+    float radius;                       // distance at which the light falls off to zero
+    glm::vec3 color;                    // color (and intensity) of the light
+};
+
+struct ClusteredShaderUniforms {
+    GLint clusterDims;                  // number of clusters along x, y, z
+    GLint screenSize;                   // viewport size in pixels
+    GLint depthSlicing;                 // near plane of the slices, scale and bias for the log depth
+    GLint lightData;                    // sampler for the light data buffer
+    GLint clusterGrid;                  // sampler for the cluster offset/count buffer
+    GLint lightIndices;                 // sampler for the light index list
+};
+
+class ClusteredLighting {
+public:
+    static const GLuint CLUSTERS_X = 16;
+    static const GLuint CLUSTERS_Y = 16;
+    static const GLuint CLUSTERS_Z = 24;
+    static const GLuint NUM_CLUSTERS = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+
+    ClusteredLighting();
+
+    // generates the texture buffers, must be called with a current context
+    void initialize();
+
+    // looks up the cluster uniforms within the given program
+    static void lookupUniforms(GLuint program, ClusteredShaderUniforms &uniforms);
+
+    // assigns every light to the clusters it overlaps and uploads the result
+    //   projectionMatrix must be a perspective projection with the given near/far planes
+    void update(const std::vector<PointLight>& lights, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                float nearPlane, float farPlane, GLint screenWidth, GLint screenHeight);
+
+    // binds the buffers to texture units firstUnit..firstUnit+2 and sends the uniforms to the bound program
+    void bind(const ClusteredShaderUniforms &uniforms, GLuint firstUnit);
+
+    GLuint getNumLights() const;
+    GLuint getNumIndices() const;       // total light/cluster pairs after the last update
+
+    void cleanup();
+
+private:
+
+    // depth at which slice 1 starts, everything closer falls into slice 0 so a
+    // tiny projection near plane does not waste slices
+    const float CLUSTER_NEAR = 0.5f;
+
+    GLuint sliceForDepth(float depth) const;
+    // the first and last cluster every light covers, into _lightMin and _lightMax
+    void assignRanges();
+    // assignRanges() for one light, and the tail the SSE path leaves over
+    void assignRange(GLuint i);
+
+    // texture buffer objects and their textures (0 light data, 1 grid, 2 indices)
+    GLuint _buffers[3];
+    GLuint _textures[3];
+
+    float _farPlane;
+    float _sliceScale;                  // CLUSTERS_Z-1 / log(far/near)
+    float _sliceBias;                   // -log(near) * scale
+    float _sliceStarts[CLUSTERS_Z - 1]; // depth where each slice after the first begins
+    float _nearPlane;
+    glm::vec4 _projection;              // x and y scale and offset to normalized device coordinates
+    glm::ivec2 _screenSize;
+    GLuint _numLights;
+
+    // scratch storage reused between frames
+    std::vector<glm::vec4> _lightData;
+    std::vector<glm::uvec2> _clusterGrid;
+    std::vector<GLuint> _lightIndices;
+    std::vector<glm::vec4> _viewSpaceLights;    // xyz view position, w radius
+    std::vector<glm::uvec3> _lightMin;          // first cluster each light covers
+    std::vector<glm::uvec3> _lightMax;          // last cluster each light covers
+    std::vector<GLuint> _writeHeads;
+};
+
+#endif //LAB10_CLUSTEREDLIGHTING_H
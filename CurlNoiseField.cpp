@@ -0,0 +1,318 @@
+//
+// Tileable divergence free turbulence, precomputed on a grid for particles to sample.
+//
+
+#include "CurlNoiseField.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "MappedFile.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CURL_NOISE_SSE
+#endif
+
+namespace {
+    // integer hash of a lattice point, so the noise needs no permutation table
+    uint32_t hashLattice(uint32_t x, uint32_t y, uint32_t z, uint32_t seed) {
+        uint32_t h = seed ^ (x * 0x8da6b343u) ^ (y * 0xd8163841u) ^ (z * 0xcb1ab31fu);
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        h *= 0x846ca68bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    // the twelve edge directions of a cube, the usual Perlin gradients
+    float gradientDot(uint32_t hash, float x, float y, float z) {
+        switch(hash % 12) {
+            case 0:  return  x + y;
+            case 1:  return -x + y;
+            case 2:  return  x - y;
+            case 3:  return -x - y;
+            case 4:  return  x + z;
+            case 5:  return -x + z;
+            case 6:  return  x - z;
+            case 7:  return -x - z;
+            case 8:  return  y + z;
+            case 9:  return -y + z;
+            case 10: return  y - z;
+            default: return -y - z;
+        }
+    }
+
+    float fade(float t) {
+        return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+    }
+
+    uint32_t wrap(int i, uint32_t period) {
+        int p = (int)period;
+        return (uint32_t)(((i % p) + p) % p);
+    }
+}
+
+CurlNoiseField::CurlNoiseField() {
+    _jobSystem = nullptr;
+    _resolution = 64;
+    _period = 4;
+    _octaves = 2;
+    _seed = 1;
+    _normalization = 1.0f;
+}
+
+void CurlNoiseField::setResolution(uint32_t resolution) {
+    _resolution = resolution;
+}
+
+void CurlNoiseField::setPeriod(uint32_t period, uint32_t octaves) {
+    _period = period;
+    _octaves = octaves;
+}
+
+void CurlNoiseField::setSeed(uint32_t seed) {
+    _seed = seed;
+}
+
+void CurlNoiseField::setJobSystem(JobSystem *jobSystem) {
+    _jobSystem = jobSystem;
+}
+
+uint32_t CurlNoiseField::getResolution() const {
+    return _resolution;
+}
+
+bool CurlNoiseField::isGenerated() const {
+    return !_velocities.empty();
+}
+
+void CurlNoiseField::parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func) const {
+    if(_jobSystem != nullptr) {
+        _jobSystem->parallelFor(count, grainSize, func);
+    } else {
+        func(0, count, 0);
+    }
+}
+
+float CurlNoiseField::gradientNoise(const glm::vec3 &position, uint32_t period, uint32_t seed) const {
+    glm::vec3 q = position * (float)period;
+    glm::vec3 cell = glm::floor(q);
+    glm::vec3 f = q - cell;
+    int ix = (int)cell.x, iy = (int)cell.y, iz = (int)cell.z;
+    uint32_t x0 = wrap(ix, period), x1 = wrap(ix + 1, period);
+    uint32_t y0 = wrap(iy, period), y1 = wrap(iy + 1, period);
+    uint32_t z0 = wrap(iz, period), z1 = wrap(iz + 1, period);
+
+    float n000 = gradientDot(hashLattice(x0, y0, z0, seed), f.x,        f.y,        f.z);
+    float n100 = gradientDot(hashLattice(x1, y0, z0, seed), f.x - 1.0f, f.y,        f.z);
+    float n010 = gradientDot(hashLattice(x0, y1, z0, seed), f.x,        f.y - 1.0f, f.z);
+    float n110 = gradientDot(hashLattice(x1, y1, z0, seed), f.x - 1.0f, f.y - 1.0f, f.z);
+    float n001 = gradientDot(hashLattice(x0, y0, z1, seed), f.x,        f.y,        f.z - 1.0f);
+    float n101 = gradientDot(hashLattice(x1, y0, z1, seed), f.x - 1.0f, f.y,        f.z - 1.0f);
+    float n011 = gradientDot(hashLattice(x0, y1, z1, seed), f.x,        f.y - 1.0f, f.z - 1.0f);
+    float n111 = gradientDot(hashLattice(x1, y1, z1, seed), f.x - 1.0f, f.y - 1.0f, f.z - 1.0f);
+
+    float u = fade(f.x), v = fade(f.y), w = fade(f.z);
+    float n00 = n000 + (n100 - n000) * u, n10 = n010 + (n110 - n010) * u;
+    float n01 = n001 + (n101 - n001) * u, n11 = n011 + (n111 - n011) * u;
+    float n0 = n00 + (n10 - n00) * v, n1 = n01 + (n11 - n01) * v;
+    return n0 + (n1 - n0) * w;
+}
+
+float CurlNoiseField::potential(const glm::vec3 &position, uint32_t channel) const {
+    float sum = 0.0f, amplitude = 1.0f;
+    for(uint32_t octave = 0; octave < _octaves; octave++) {
+        sum += amplitude * gradientNoise(position, _period << octave, _seed + channel * 977u + octave * 131u);
+        amplitude *= 0.5f;
+    }
+    return sum;
+}
+
+glm::vec3 CurlNoiseField::sampleAnalytic(const glm::vec3 &position) const {
+    // the same central differences the grid uses, one cell either side
+    float h = 1.0f / _resolution;
+    glm::vec3 dx(h, 0.0f, 0.0f), dy(0.0f, h, 0.0f), dz(0.0f, 0.0f, h);
+    float dPzdy = potential(position + dy, 2) - potential(position - dy, 2);
+    float dPydz = potential(position + dz, 1) - potential(position - dz, 1);
+    float dPxdz = potential(position + dz, 0) - potential(position - dz, 0);
+    float dPzdx = potential(position + dx, 2) - potential(position - dx, 2);
+    float dPydx = potential(position + dx, 1) - potential(position - dx, 1);
+    float dPxdy = potential(position + dy, 0) - potential(position - dy, 0);
+    return glm::vec3(dPzdy - dPydz, dPxdz - dPzdx, dPydx - dPxdy) * (_normalization / (2.0f * h));
+}
+
+void CurlNoiseField::generate() {
+    const uint32_t R = _resolution, MASK = R - 1;
+    const size_t numCells = (size_t)R * R * R;
+
+    // the potential at every grid point first, so the curl is just differences of neighbours
+    std::vector<glm::vec3> potentials(numCells);
+    parallelFor(R * R, 16, [&](size_t begin, size_t end, unsigned) {
+        for(size_t row = begin; row < end; row++) {
+            uint32_t y = row % R, z = row / R;
+            for(uint32_t x = 0; x < R; x++) {
+                glm::vec3 p = glm::vec3(x, y, z) / (float)R;
+                potentials[row * R + x] = glm::vec3(potential(p, 0), potential(p, 1), potential(p, 2));
+            }
+        }
+    });
+
+    _velocities.resize(numCells);
+    const float inverseTwoH = 0.5f * R;
+    parallelFor(R * R, 16, [&](size_t begin, size_t end, unsigned) {
+        for(size_t row = begin; row < end; row++) {
+            uint32_t y = row % R, z = row / R;
+            const glm::vec3 *yPrev = &potentials[((size_t)z * R + ((y - 1) & MASK)) * R];
+            const glm::vec3 *yNext = &potentials[((size_t)z * R + ((y + 1) & MASK)) * R];
+            const glm::vec3 *zPrev = &potentials[((size_t)((z - 1) & MASK) * R + y) * R];
+            const glm::vec3 *zNext = &potentials[((size_t)((z + 1) & MASK) * R + y) * R];
+            const glm::vec3 *here = &potentials[row * R];
+            for(uint32_t x = 0; x < R; x++) {
+                const glm::vec3 &xPrev = here[(x - 1) & MASK], &xNext = here[(x + 1) & MASK];
+                _velocities[row * R + x] = glm::vec3(
+                        (yNext[x].z - yPrev[x].z) - (zNext[x].y - zPrev[x].y),
+                        (zNext[x].x - zPrev[x].x) - (xNext.z - xPrev.z),
+                        (xNext.y - xPrev.y) - (yNext[x].x - yPrev[x].x)) * inverseTwoH;
+            }
+        }
+    });
+
+    // scale to unit RMS speed so strength reads as a speed whatever the period and octaves
+    double sumSquares = 0.0;
+    for(size_t i = 0; i < numCells; i++) {
+        sumSquares += glm::dot(_velocities[i], _velocities[i]);
+    }
+    _normalization = sumSquares > 0.0 ? (float)(1.0 / std::sqrt(sumSquares / numCells)) : 1.0f;
+    parallelFor(numCells, 65536, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            _velocities[i] *= _normalization;
+        }
+    });
+}
+
+bool CurlNoiseField::loadOrGenerate(const char* cacheFile) {
+    MappedFile file;
+    if(file.open(cacheFile)) {
+        const CacheHeader *header = (const CacheHeader*)file.data();
+        size_t numCells = (size_t)_resolution * _resolution * _resolution;
+        if(file.size() == sizeof(CacheHeader) + numCells * sizeof(glm::vec3) && memcmp(header->magic, "CRL1", 4) == 0
+           && header->resolution == _resolution && header->period == _period && header->octaves == _octaves
+           && header->seed == _seed) {
+            _normalization = header->normalization;
+            const glm::vec3 *cells = (const glm::vec3*)(header + 1);
+            _velocities.assign(cells, cells + numCells);
+            fprintf(stdout, "[INFO]: curl noise read from \"%s\"\n", cacheFile);
+            return true;
+        }
+        fprintf(stdout, "[INFO]: curl noise cache \"%s\" is out of date, regenerating\n", cacheFile);
+    }
+
+    generate();
+    fprintf(stdout, "[INFO]: curl noise generated, %u^3 cells\n", _resolution);
+    return save(cacheFile);
+}
+
+bool CurlNoiseField::save(const char* filename) const {
+    CacheHeader header;
+    memcpy(header.magic, "CRL1", 4);
+    header.resolution = _resolution;
+    header.period = _period;
+    header.octaves = _octaves;
+    header.seed = _seed;
+    header.normalization = _normalization;
+
+    FILE *file = fopen(filename, "wb");
+    if(file == nullptr) {
+        fprintf(stderr, "[ERROR]: Could not open \"%s\" for writing\n", filename);
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(&_velocities[0], sizeof(glm::vec3), _velocities.size(), file);
+    bool written = ferror(file) == 0;
+    fclose(file);
+    if(!written) {
+        fprintf(stderr, "[ERROR]: Could not write \"%s\"\n", filename);
+    }
+    return written;
+}
+
+glm::vec3 CurlNoiseField::sample(const glm::vec3 &position) const {
+    const uint32_t R = _resolution, MASK = R - 1;
+    glm::vec3 g = position * (float)R;
+    glm::vec3 cell = glm::floor(g);
+    glm::vec3 f = g - cell;
+    uint32_t x0 = (uint32_t)(int)cell.x & MASK, x1 = (x0 + 1) & MASK;
+    uint32_t y0 = (uint32_t)(int)cell.y & MASK, y1 = (y0 + 1) & MASK;
+    uint32_t z0 = (uint32_t)(int)cell.z & MASK, z1 = (z0 + 1) & MASK;
+
+    const glm::vec3 *v = &_velocities[0];
+    glm::vec3 c00 = glm::mix(v[(z0 * R + y0) * R + x0], v[(z0 * R + y0) * R + x1], f.x);
+    glm::vec3 c10 = glm::mix(v[(z0 * R + y1) * R + x0], v[(z0 * R + y1) * R + x1], f.x);
+    glm::vec3 c01 = glm::mix(v[(z1 * R + y0) * R + x0], v[(z1 * R + y0) * R + x1], f.x);
+    glm::vec3 c11 = glm::mix(v[(z1 * R + y1) * R + x0], v[(z1 * R + y1) * R + x1], f.x);
+    return glm::mix(glm::mix(c00, c10, f.y), glm::mix(c01, c11, f.y), f.z);
+}
+
+void CurlNoiseField::addVelocitiesScalar(const glm::vec3 *positions, glm::vec3 *velocities, size_t count, float scale, float strength) const {
+    for(size_t i = 0; i < count; i++) {
+        velocities[i] += strength * sample(positions[i] * scale);
+    }
+}
+
+void CurlNoiseField::addVelocities(const glm::vec3 *positions, glm::vec3 *velocities, size_t count, float scale, float strength) const {
+    if(_velocities.empty()) return;
+    size_t i = 0;
+#ifdef CURL_NOISE_SSE
+    // four particles per pass, one axis per register; only the grid reads are done lane by lane
+    const uint32_t R = _resolution;
+    const __m128 GRID_SCALE = _mm_set1_ps(scale * R);
+    const __m128 ONE = _mm_set1_ps(1.0f);
+    const __m128 STRENGTH = _mm_set1_ps(strength);
+    const __m128i MASK = _mm_set1_epi32(R - 1);
+    const glm::vec3 *v = &_velocities[0];
+    for(; i + 4 <= count; i += 4) {
+        const glm::vec3 *p = positions + i;
+        __m128 g[3], f[3];
+        alignas(16) int32_t lo[3][4], hi[3][4];
+        for(int axis = 0; axis < 3; axis++) {
+            g[axis] = _mm_mul_ps(_mm_set_ps(p[3][axis], p[2][axis], p[1][axis], p[0][axis]), GRID_SCALE);
+            // floor without SSE4.1, truncation rounds negative values the wrong way
+            __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(g[axis]));
+            __m128 cell = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmplt_ps(g[axis], truncated), ONE));
+            f[axis] = _mm_sub_ps(g[axis], cell);
+            __m128i index = _mm_cvttps_epi32(cell);
+            _mm_store_si128((__m128i*)lo[axis], _mm_and_si128(index, MASK));
+            _mm_store_si128((__m128i*)hi[axis], _mm_and_si128(_mm_add_epi32(index, _mm_set1_epi32(1)), MASK));
+        }
+
+        __m128 sum[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        for(int corner = 0; corner < 8; corner++) {
+            const int32_t *xs = (corner & 1) ? hi[0] : lo[0];
+            const int32_t *ys = (corner & 2) ? hi[1] : lo[1];
+            const int32_t *zs = (corner & 4) ? hi[2] : lo[2];
+            __m128 weight = _mm_mul_ps(_mm_mul_ps((corner & 1) ? f[0] : _mm_sub_ps(ONE, f[0]),
+                                                  (corner & 2) ? f[1] : _mm_sub_ps(ONE, f[1])),
+                                       (corner & 4) ? f[2] : _mm_sub_ps(ONE, f[2]));
+            const glm::vec3 &c0 = v[((size_t)zs[0] * R + ys[0]) * R + xs[0]];
+            const glm::vec3 &c1 = v[((size_t)zs[1] * R + ys[1]) * R + xs[1]];
+            const glm::vec3 &c2 = v[((size_t)zs[2] * R + ys[2]) * R + xs[2]];
+            const glm::vec3 &c3 = v[((size_t)zs[3] * R + ys[3]) * R + xs[3]];
+            sum[0] = _mm_add_ps(sum[0], _mm_mul_ps(weight, _mm_set_ps(c3.x, c2.x, c1.x, c0.x)));
+            sum[1] = _mm_add_ps(sum[1], _mm_mul_ps(weight, _mm_set_ps(c3.y, c2.y, c1.y, c0.y)));
+            sum[2] = _mm_add_ps(sum[2], _mm_mul_ps(weight, _mm_set_ps(c3.z, c2.z, c1.z, c0.z)));
+        }
+
+        alignas(16) float out[3][4];
+        for(int axis = 0; axis < 3; axis++) {
+            _mm_store_ps(out[axis], _mm_mul_ps(sum[axis], STRENGTH));
+        }
+        for(int lane = 0; lane < 4; lane++) {
+            velocities[i + lane] += glm::vec3(out[0][lane], out[1][lane], out[2][lane]);
+        }
+    }
+#endif
+    addVelocitiesScalar(positions + i, velocities + i, count - i, scale, strength);
+}
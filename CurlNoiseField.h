@@ -0,0 +1,80 @@
+//
+// Tileable divergence free turbulence, precomputed on a grid for particles to sample.
+//
+// A vector potential is built from three channels of periodic gradient noise
+// and the velocity is its curl, so the flow has no sources or sinks and
+// particles swirl rather than bunch up.  Evaluating that per particle costs
+// a dozen noise lookups, so the curl is taken once over a RESOLUTION^3 grid
+// covering one tile and sampled with trilinear interpolation afterwards.  The
+// grid wraps at the tile edges, so the field repeats seamlessly everywhere.
+//
+// Generation runs on the job system, and the grid can be cached on disk so
+// later runs only read it back.  Builds without SSE (Apple silicon) sample
+// with the scalar loop.
+//
+
+#ifndef LAB10_CURLNOISEFIELD_H
+#define LAB10_CURLNOISEFIELD_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <cstdint>
+#include <vector>
+
+#include "JobSystem.h"
+
+class CurlNoiseField {
+public:
+    CurlNoiseField();
+
+    // cells along each edge of the tile, must be a power of two
+    void setResolution(uint32_t resolution);
+    // noise lattice cells along each edge of the tile for the first octave, each further octave doubles it
+    void setPeriod(uint32_t period, uint32_t octaves);
+    void setSeed(uint32_t seed);
+    void setJobSystem(JobSystem *jobSystem);
+
+    // fills the grid from the noise
+    void generate();
+    // reads the grid from cacheFile if it was made with the same settings, otherwise generates and writes it
+    bool loadOrGenerate(const char* cacheFile);
+    bool save(const char* filename) const;
+
+    // velocity at a point in tile space, where one unit is one tile
+    glm::vec3 sample(const glm::vec3 &position) const;
+    // adds strength * sample(position * scale) to each velocity, four at a time with SSE
+    void addVelocities(const glm::vec3 *positions, glm::vec3 *velocities, size_t count, float scale, float strength) const;
+    void addVelocitiesScalar(const glm::vec3 *positions, glm::vec3 *velocities, size_t count, float scale, float strength) const;
+    // evaluates the curl straight from the noise, what the grid saves doing per particle
+    glm::vec3 sampleAnalytic(const glm::vec3 &position) const;
+
+    uint32_t getResolution() const;
+    bool isGenerated() const;
+
+private:
+    struct CacheHeader {
+        char magic[4];                  // "CRL1"
+        uint32_t resolution;
+        uint32_t period;
+        uint32_t octaves;
+        uint32_t seed;
+        float normalization;
+    };
+
+    // one channel of the potential, periodic over the tile
+    float potential(const glm::vec3 &position, uint32_t channel) const;
+    float gradientNoise(const glm::vec3 &position, uint32_t period, uint32_t seed) const;
+
+    void parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func) const;
+
+    JobSystem *_jobSystem;
+    uint32_t _resolution;
+    uint32_t _period;
+    uint32_t _octaves;
+    uint32_t _seed;
+    float _normalization;               // scales the raw curl to unit RMS speed
+    std::vector<glm::vec3> _velocities; // x fastest
+};
+
+#endif //LAB10_CURLNOISEFIELD_H
@@ -0,0 +1,258 @@
+//
+// Smoothed particle hydrodynamics forces for fountain particles.
+//
+
+#include "FluidSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+const uint32_t FluidSolver::MAX_NEIGHBORS;
+
+FluidSolver::FluidSolver() {
+    _jobSystem = nullptr;
+    _mass = 1.0f;
+    _restDensity = 1000.0f;
+    _stiffness = 1.0f;
+    _viscosity = 0.1f;
+    _bucketMask = 0;
+    setSmoothingRadius(0.1f);
+}
+
+void FluidSolver::setJobSystem(JobSystem *jobSystem) {
+    _jobSystem = jobSystem;
+}
+
+void FluidSolver::setSmoothingRadius(float h) {
+    const float PI = 3.14159265f;
+    _h = h;
+    _inverseH = 1.0f / h;
+    _poly6 = 315.0f / (64.0f * PI * powf(h, 9.0f));
+    _spikyGradient = -45.0f / (PI * powf(h, 6.0f));
+    _viscosityLaplacian = 45.0f / (PI * powf(h, 6.0f));
+}
+
+void FluidSolver::setParticleMass(float mass) {
+    _mass = mass;
+}
+
+void FluidSolver::setRestDensity(float density) {
+    _restDensity = density;
+}
+
+void FluidSolver::setStiffness(float k) {
+    _stiffness = k;
+}
+
+void FluidSolver::setViscosity(float mu) {
+    _viscosity = mu;
+}
+
+const float* FluidSolver::getDensities() const {
+    return _densities.empty() ? nullptr : &_densities[0];
+}
+
+float FluidSolver::getAverageNeighbors() const {
+    if(_sortedNeighbors.empty()) return 0.0f;
+    uint64_t total = 0;
+    for(size_t i = 0; i < _sortedNeighbors.size(); i++) {
+        total += _sortedNeighbors[i];
+    }
+    return (float)total / _sortedNeighbors.size();
+}
+
+void FluidSolver::parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func) {
+    if(_jobSystem != nullptr) {
+        _jobSystem->parallelFor(count, grainSize, func);
+    } else {
+        func(0, count, 0);
+    }
+}
+
+// 21 bits per axis, enough for two million cells either side of the origin
+uint64_t FluidSolver::packCell(int32_t x, int32_t y, int32_t z) {
+    const uint32_t BIAS = 1u << 20, MASK = 0x1fffff;
+    return (uint64_t)(((uint32_t)z + BIAS) & MASK) << 42 | (uint64_t)(((uint32_t)y + BIAS) & MASK) << 21 | (((uint32_t)x + BIAS) & MASK);
+}
+
+uint32_t FluidSolver::bucketOf(uint64_t key) const {
+    uint64_t h = key * 0x9e3779b97f4a7c15ull;
+    return (uint32_t)(h >> 32) & _bucketMask;
+}
+
+void FluidSolver::sortByCell(const glm::vec3 *positions, size_t count) {
+    uint32_t numBuckets = 64;
+    while(numBuckets < 2 * count) {
+        numBuckets *= 2;
+    }
+    _bucketMask = numBuckets - 1;
+    _keys.resize(count);
+    _buckets.resize(count);
+    _order.resize(count);
+
+    parallelFor(count, 4096, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            glm::vec3 cell = glm::floor(positions[i] * _inverseH);
+            _keys[i] = packCell((int32_t)cell.x, (int32_t)cell.y, (int32_t)cell.z);
+            _buckets[i] = bucketOf(_keys[i]);
+        }
+    });
+
+    // counting sort, done serially so the order never depends on the threads
+    _bucketStarts.assign(numBuckets + 1, 0);
+    for(size_t i = 0; i < count; i++) {
+        _bucketStarts[_buckets[i] + 1]++;
+    }
+    for(uint32_t b = 0; b < numBuckets; b++) {
+        _bucketStarts[b + 1] += _bucketStarts[b];
+    }
+    std::vector<uint32_t> &cursors = _sortedNeighbors;     // free until the density pass
+    cursors.assign(_bucketStarts.begin(), _bucketStarts.end() - 1);
+    for(size_t i = 0; i < count; i++) {
+        _order[cursors[_buckets[i]]++] = i;
+    }
+
+    // group the cells sharing a bucket, the index breaks ties so the order is repeatable
+    parallelFor(numBuckets, 16384, [&](size_t begin, size_t end, unsigned) {
+        for(size_t b = begin; b < end; b++) {
+            uint32_t first = _bucketStarts[b], last = _bucketStarts[b + 1];
+            if(last - first > 1) {
+                std::sort(_order.begin() + first, _order.begin() + last, [&](uint32_t x, uint32_t y) {
+                    return _keys[x] < _keys[y] || (_keys[x] == _keys[y] && x < y);
+                });
+            }
+        }
+    });
+}
+
+void FluidSolver::findCell(uint64_t key, uint32_t &first, uint32_t &last) const {
+    uint32_t b = bucketOf(key);
+    // keys are sorted within a bucket, so the cell is one run
+    first = _bucketStarts[b];
+    last = _bucketStarts[b + 1];
+    while(first < last && _sortedKeys[first] < key) first++;
+    uint32_t end = first;
+    while(end < last && _sortedKeys[end] == key) end++;
+    last = end;
+}
+
+int FluidSolver::findSurroundingRuns(const glm::vec3 &position, uint32_t *runFirst, uint32_t *runLast) const {
+    glm::vec3 cell = glm::floor(position * _inverseH);
+    int32_t cx = (int32_t)cell.x, cy = (int32_t)cell.y, cz = (int32_t)cell.z;
+    int numRuns = 0;
+    for(int32_t z = cz - 1; z <= cz + 1; z++) {
+        for(int32_t y = cy - 1; y <= cy + 1; y++) {
+            for(int32_t x = cx - 1; x <= cx + 1; x++) {
+                findCell(packCell(x, y, z), runFirst[numRuns], runLast[numRuns]);
+                if(runFirst[numRuns] < runLast[numRuns]) numRuns++;
+            }
+        }
+    }
+    return numRuns;
+}
+
+void FluidSolver::computeAccelerations(const glm::vec3 *positions, const glm::vec3 *velocities, size_t count, glm::vec3 *accelerations) {
+    _densities.resize(count);
+    if(count == 0) return;
+    sortByCell(positions, count);
+
+    // gather into cell order so neighbours are close in memory
+    _sortedKeys.resize(count);
+    _sortedPositions.resize(count);
+    _sortedVelocities.resize(count);
+    _sortedDensities.resize(count);
+    _sortedPressures.resize(count);
+    _sortedNeighbors.resize(count);
+    _neighborLists.resize(count * MAX_NEIGHBORS);
+    parallelFor(count, 4096, [&](size_t begin, size_t end, unsigned) {
+        for(size_t s = begin; s < end; s++) {
+            uint32_t i = _order[s];
+            _sortedKeys[s] = _keys[i];
+            _sortedPositions[s] = positions[i];
+            _sortedVelocities[s] = velocities[i];
+        }
+    });
+    // room for every particle in a cell of its own, so a new high in occupied cells never reallocates mid run
+    _cellStarts.clear();
+    _cellStarts.reserve(count + 1);
+    for(uint32_t s = 0; s < count; s++) {
+        if(s == 0 || _sortedKeys[s] != _sortedKeys[s - 1]) _cellStarts.push_back(s);
+    }
+    _cellStarts.push_back(count);
+
+    // density and pressure, a cell at a time so the surrounding cells are only looked up once
+    const float h2 = _h * _h;
+    parallelFor(_cellStarts.size() - 1, 64, [&](size_t begin, size_t end, unsigned) {
+        uint32_t runFirst[27], runLast[27];
+        for(size_t c = begin; c < end; c++) {
+            uint32_t first = _cellStarts[c], last = _cellStarts[c + 1];
+            int numRuns = findSurroundingRuns(_sortedPositions[first], runFirst, runLast);
+
+            for(uint32_t s = first; s < last; s++) {
+                const glm::vec3 p = _sortedPositions[s];
+                uint32_t *neighbors = &_neighborLists[(size_t)s * MAX_NEIGHBORS];
+                uint32_t numNeighbors = 0;
+                float sum = 0.0f;
+                for(int r = 0; r < numRuns; r++) {
+                    for(uint32_t j = runFirst[r]; j < runLast[r]; j++) {
+                        glm::vec3 offset = p - _sortedPositions[j];
+                        float r2 = glm::dot(offset, offset);
+                        if(r2 >= h2) continue;
+                        float w = h2 - r2;
+                        sum += w * w * w;
+                        if(j == s) continue;
+                        // counted past the end of the list too, so the force pass knows to search again
+                        if(numNeighbors < MAX_NEIGHBORS) neighbors[numNeighbors] = j;
+                        numNeighbors++;
+                    }
+                }
+                float density = _mass * _poly6 * sum;
+                _sortedDensities[s] = density;
+                _sortedPressures[s] = std::max(_stiffness * (density - _restDensity), 0.0f);
+                _sortedNeighbors[s] = numNeighbors + 1;
+                _densities[_order[s]] = density;
+            }
+        }
+    });
+
+    // pressure and viscosity forces over the recorded neighbours, written back in the caller's order
+    parallelFor(count, 256, [&](size_t begin, size_t end, unsigned) {
+        uint32_t runFirst[27], runLast[27];
+        for(size_t s = begin; s < end; s++) {
+            glm::vec3 pressureForce(0.0f), viscosityForce(0.0f);
+            float pressure = _sortedPressures[s];
+            const glm::vec3 p = _sortedPositions[s];
+            const glm::vec3 velocity = _sortedVelocities[s];
+            auto addNeighbor = [&](uint32_t j) {
+                glm::vec3 offset = p - _sortedPositions[j];
+                float r = sqrtf(glm::dot(offset, offset));
+                float inverseDensity = 1.0f / _sortedDensities[j];
+                float falloff = _h - r;
+                // coincident particles get no direction, viscosity still evens out their velocities
+                if(r > 1e-6f) {
+                    pressureForce -= offset * ((pressure + _sortedPressures[j]) * 0.5f * inverseDensity * _spikyGradient * falloff * falloff / r);
+                }
+                viscosityForce += (_sortedVelocities[j] - velocity) * (inverseDensity * _viscosityLaplacian * falloff);
+            };
+
+            uint32_t numNeighbors = _sortedNeighbors[s] - 1;
+            if(numNeighbors <= MAX_NEIGHBORS) {
+                const uint32_t *neighbors = &_neighborLists[s * MAX_NEIGHBORS];
+                for(uint32_t n = 0; n < numNeighbors; n++) {
+                    addNeighbor(neighbors[n]);
+                }
+            } else {
+                // too closely packed for the list, go through the runs again in the same order rather than
+                // drop some, or whether a pair pushes on each other would depend on which was scanned first
+                int numRuns = findSurroundingRuns(p, runFirst, runLast);
+                for(int r = 0; r < numRuns; r++) {
+                    for(uint32_t j = runFirst[r]; j < runLast[r]; j++) {
+                        glm::vec3 offset = p - _sortedPositions[j];
+                        if(j != s && glm::dot(offset, offset) < h2) addNeighbor(j);
+                    }
+                }
+            }
+            accelerations[_order[s]] = (pressureForce * _mass + viscosityForce * (_mass * _viscosity)) / _sortedDensities[s];
+        }
+    });
+}
@@ -0,0 +1,99 @@
+//
+// Smoothed particle hydrodynamics forces for fountain particles.
+//
+// Every call to computeAccelerations() sorts the particles by the grid cell
+// they are in, one cell per smoothing radius, hashed so the grid has no
+// bounds.  The positions and velocities are copied into that order, so the
+// particles of a cell are one run and their neighbours sit near them in
+// memory.  The density pass works a cell at a time, looking up the 27
+// surrounding runs once for all of its particles and recording each
+// particle's neighbours for the force pass to reuse.  A particle with more
+// neighbours than the list holds has its runs searched again by the force
+// pass, so every pair within h always sees each other.  Both passes run on the
+// job system; each particle only writes its own results and adds up its
+// neighbours in sorted order, so the output is the same bit for bit whatever
+// the number of threads.
+//
+// Densities use the poly6 kernel, pressure the spiky kernel gradient and
+// viscosity the viscosity kernel laplacian (Muller et al. 2003).  Pressure is
+// clamped at zero so particles never pull each other together.
+//
+
+#ifndef LAB10_FLUIDSOLVER_H
+#define LAB10_FLUIDSOLVER_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <cstdint>
+#include <vector>
+
+#include "JobSystem.h"
+
+class FluidSolver {
+public:
+    FluidSolver();
+
+    // optional worker pool for the passes, runs serially without one
+    void setJobSystem(JobSystem *jobSystem);
+
+    void setSmoothingRadius(float h);   // how far a particle feels its neighbours, also the cell size
+    void setParticleMass(float mass);
+    void setRestDensity(float density);
+    void setStiffness(float k);         // pressure per unit of density above rest
+    void setViscosity(float mu);
+
+    // pressure and viscosity accelerations on every particle, gravity and boundaries are up to the caller
+    void computeAccelerations(const glm::vec3 *positions, const glm::vec3 *velocities, size_t count, glm::vec3 *accelerations);
+
+    // density of each particle in the last call, in the order they were passed in
+    const float* getDensities() const;
+    // average number of particles within the smoothing radius of each, itself included
+    float getAverageNeighbors() const;
+
+private:
+    static const uint32_t MAX_NEIGHBORS = 64;   // listed per particle, any more are found again by the force pass
+
+    static uint64_t packCell(int32_t x, int32_t y, int32_t z);
+    uint32_t bucketOf(uint64_t key) const;
+
+    void sortByCell(const glm::vec3 *positions, size_t count);
+    // sorted range of the particles in a cell, empty if there are none
+    void findCell(uint64_t key, uint32_t &first, uint32_t &last) const;
+    // the occupied runs of the 27 cells around the cell of position, returns how many
+    int findSurroundingRuns(const glm::vec3 &position, uint32_t *runFirst, uint32_t *runLast) const;
+
+    void parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func);
+
+    JobSystem *_jobSystem;
+    float _h;
+    float _inverseH;
+    float _mass;
+    float _restDensity;
+    float _stiffness;
+    float _viscosity;
+
+    // kernel constants for the current h
+    float _poly6;
+    float _spikyGradient;
+    float _viscosityLaplacian;
+
+    // sort state reused between calls
+    uint32_t _bucketMask;
+    std::vector<uint64_t> _keys;            // cell of each particle as passed in
+    std::vector<uint32_t> _buckets;
+    std::vector<uint32_t> _bucketStarts;    // first sorted particle of each bucket, plus an end marker
+    std::vector<uint32_t> _order;           // original index of each sorted particle
+    std::vector<uint32_t> _cellStarts;      // first sorted particle of each occupied cell, plus an end marker
+
+    std::vector<uint64_t> _sortedKeys;
+    std::vector<glm::vec3> _sortedPositions;
+    std::vector<glm::vec3> _sortedVelocities;
+    std::vector<float> _sortedDensities;
+    std::vector<float> _sortedPressures;
+    std::vector<uint32_t> _sortedNeighbors;     // how many particles are within h of each, itself included
+    std::vector<uint32_t> _neighborLists;       // MAX_NEIGHBORS slots per particle, found by the density pass
+    std::vector<float> _densities;          // in the original order
+};
+
+#endif //LAB10_FLUIDSOLVER_H
@@ -0,0 +1,231 @@
+//
+// Regions of space that push particles about: wind, vortices and attractors.
+//
+
+#include "ForceVolumes.h"
+
+#include <algorithm>
+#include <cmath>
+
+const size_t ForceVolumes::CHUNK_SIZE;
+const uint32_t ForceVolumes::MAX_LEAF_VOLUMES;
+
+namespace {
+    bool overlaps(const glm::vec3 &minA, const glm::vec3 &maxA, const glm::vec3 &minB, const glm::vec3 &maxB) {
+        return minA.x <= maxB.x && minB.x <= maxA.x && minA.y <= maxB.y && minB.y <= maxA.y && minA.z <= maxB.z && minB.z <= maxA.z;
+    }
+}
+
+ForceVolumes::ForceVolumes() {
+}
+
+void ForceVolumes::clear() {
+    _volumes.clear();
+    _boundsMin.clear();
+    _boundsMax.clear();
+    _order.clear();
+    _nodes.clear();
+}
+
+uint32_t ForceVolumes::addBox(ForceVolume::Type type, const glm::vec3 &center, const glm::vec3 &halfExtents, const glm::vec3 &direction, float strength) {
+    ForceVolume volume;
+    volume.shape = ForceVolume::BOX;
+    volume.type = type;
+    volume.center = center;
+    volume.halfExtents = halfExtents;
+    volume.radius = glm::length(halfExtents);
+    volume.direction = glm::normalize(direction);
+    volume.strength = strength;
+    _volumes.push_back(volume);
+    _boundsMin.push_back(center - halfExtents);
+    _boundsMax.push_back(center + halfExtents);
+    return _volumes.size() - 1;
+}
+
+uint32_t ForceVolumes::addSphere(ForceVolume::Type type, const glm::vec3 &center, float radius, const glm::vec3 &direction, float strength) {
+    ForceVolume volume;
+    volume.shape = ForceVolume::SPHERE;
+    volume.type = type;
+    volume.center = center;
+    volume.halfExtents = glm::vec3(radius);
+    volume.radius = radius;
+    volume.direction = glm::normalize(direction);
+    volume.strength = strength;
+    _volumes.push_back(volume);
+    _boundsMin.push_back(center - glm::vec3(radius));
+    _boundsMax.push_back(center + glm::vec3(radius));
+    return _volumes.size() - 1;
+}
+
+size_t ForceVolumes::getNumVolumes() const {
+    return _volumes.size();
+}
+
+const ForceVolume& ForceVolumes::getVolume(uint32_t index) const {
+    return _volumes[index];
+}
+
+void ForceVolumes::build() {
+    _order.resize(_volumes.size());
+    for(uint32_t i = 0; i < _order.size(); i++) {
+        _order[i] = i;
+    }
+    _nodes.clear();
+    if(_volumes.empty()) return;
+    _nodes.reserve(2 * _volumes.size());
+    _nodes.push_back(Node());
+    subdivide(0, 0, _volumes.size());
+}
+
+void ForceVolumes::subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count) {
+    glm::vec3 boundsMin(INFINITY), boundsMax(-INFINITY), centroidMin(INFINITY), centroidMax(-INFINITY);
+    for(uint32_t i = first; i < first + count; i++) {
+        uint32_t v = _order[i];
+        boundsMin = glm::min(boundsMin, _boundsMin[v]);
+        boundsMax = glm::max(boundsMax, _boundsMax[v]);
+        centroidMin = glm::min(centroidMin, _volumes[v].center);
+        centroidMax = glm::max(centroidMax, _volumes[v].center);
+    }
+    _nodes[nodeIndex].boundsMin = boundsMin;
+    _nodes[nodeIndex].boundsMax = boundsMax;
+    if(count <= MAX_LEAF_VOLUMES) {
+        _nodes[nodeIndex].leftOrFirst = first;
+        _nodes[nodeIndex].count = count;
+        return;
+    }
+
+    // there are only ever a handful of volumes, a median split on the widest axis is plenty
+    glm::vec3 extent = centroidMax - centroidMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    uint32_t half = count / 2;
+    std::nth_element(_order.begin() + first, _order.begin() + first + half, _order.begin() + first + count,
+                     [&](uint32_t a, uint32_t b) { return _volumes[a].center[axis] < _volumes[b].center[axis]; });
+
+    uint32_t left = _nodes.size();
+    _nodes.push_back(Node());
+    _nodes.push_back(Node());
+    _nodes[nodeIndex].leftOrFirst = left;
+    _nodes[nodeIndex].count = 0;
+    subdivide(left, first, half);
+    subdivide(left + 1, first + half, count - half);
+}
+
+void ForceVolumes::query(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, std::vector<uint32_t> &volumes) const {
+    volumes.resize(_volumes.size());
+    volumes.resize(volumes.empty() ? 0 : query(boundsMin, boundsMax, &volumes[0]));
+}
+
+uint32_t ForceVolumes::query(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, uint32_t *volumes) const {
+    if(_nodes.empty()) return 0;
+
+    uint32_t numVolumes = 0;
+    uint32_t stack[64];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while(stackSize > 0) {
+        const Node &node = _nodes[stack[--stackSize]];
+        if(!overlaps(node.boundsMin, node.boundsMax, boundsMin, boundsMax)) continue;
+        if(node.count == 0) {
+            stack[stackSize++] = node.leftOrFirst;
+            stack[stackSize++] = node.leftOrFirst + 1;
+            continue;
+        }
+        for(uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+            uint32_t v = _order[i];
+            if(overlaps(_boundsMin[v], _boundsMax[v], boundsMin, boundsMax)) {
+                volumes[numVolumes++] = v;
+            }
+        }
+    }
+    return numVolumes;
+}
+
+bool ForceVolumes::contains(const ForceVolume &volume, const glm::vec3 &position) const {
+    glm::vec3 offset = position - volume.center;
+    if(volume.shape == ForceVolume::BOX) {
+        return fabsf(offset.x) <= volume.halfExtents.x && fabsf(offset.y) <= volume.halfExtents.y && fabsf(offset.z) <= volume.halfExtents.z;
+    }
+    return glm::dot(offset, offset) <= volume.radius * volume.radius;
+}
+
+glm::vec3 ForceVolumes::force(const ForceVolume &volume, const glm::vec3 &position) const {
+    switch(volume.type) {
+        case ForceVolume::WIND:
+            return volume.direction * volume.strength;
+        case ForceVolume::VORTEX: {
+            // tangent to the circle around the axis, the same speed at any distance from it
+            glm::vec3 offset = position - volume.center;
+            glm::vec3 radial = offset - volume.direction * glm::dot(offset, volume.direction);
+            glm::vec3 tangent = glm::cross(volume.direction, radial);
+            float length = glm::length(tangent);
+            return length > 1e-6f ? tangent * (volume.strength / length) : glm::vec3(0.0f);
+        }
+        case ForceVolume::ATTRACTOR:
+        default: {
+            glm::vec3 offset = volume.center - position;
+            float length = glm::length(offset);
+            return length > 1e-6f ? offset * (volume.strength / length) : glm::vec3(0.0f);
+        }
+    }
+}
+
+void ForceVolumes::apply(const glm::vec3 *positions, glm::vec3 *velocities, size_t count, FrameArena &arena) const {
+    if(_nodes.empty()) return;
+
+    uint32_t *candidates = arena.allocate<uint32_t>(_volumes.size());
+    for(size_t begin = 0; begin < count; begin += CHUNK_SIZE) {
+        size_t end = std::min(begin + CHUNK_SIZE, count);
+        glm::vec3 chunkMin = positions[begin], chunkMax = positions[begin];
+        for(size_t i = begin + 1; i < end; i++) {
+            chunkMin = glm::min(chunkMin, positions[i]);
+            chunkMax = glm::max(chunkMax, positions[i]);
+        }
+        uint32_t numCandidates = query(chunkMin, chunkMax, candidates);
+
+        for(uint32_t c = 0; c < numCandidates; c++) {
+            const ForceVolume &volume = _volumes[candidates[c]];
+            for(size_t i = begin; i < end; i++) {
+                if(contains(volume, positions[i])) {
+                    velocities[i] += force(volume, positions[i]);
+                }
+            }
+        }
+    }
+}
+
+void ForceVolumes::appendOutlines(std::vector<glm::vec3> &lines) const {
+    const int CIRCLE_SEGMENTS = 24;
+    for(size_t v = 0; v < _volumes.size(); v++) {
+        const ForceVolume &volume = _volumes[v];
+        if(volume.shape == ForceVolume::BOX) {
+            // the twelve edges, four along each axis
+            for(int axis = 0; axis < 3; axis++) {
+                int u = (axis + 1) % 3, w = (axis + 2) % 3;
+                for(int corner = 0; corner < 4; corner++) {
+                    glm::vec3 offset = volume.halfExtents;
+                    offset[u] *= (corner & 1) ? 1.0f : -1.0f;
+                    offset[w] *= (corner & 2) ? 1.0f : -1.0f;
+                    glm::vec3 end = offset;
+                    offset[axis] = -offset[axis];
+                    lines.push_back(volume.center + offset);
+                    lines.push_back(volume.center + end);
+                }
+            }
+        } else {
+            // a circle in each axis plane
+            for(int axis = 0; axis < 3; axis++) {
+                int u = (axis + 1) % 3, w = (axis + 2) % 3;
+                for(int s = 0; s < CIRCLE_SEGMENTS; s++) {
+                    float a0 = 6.2831853f * s / CIRCLE_SEGMENTS, a1 = 6.2831853f * (s + 1) / CIRCLE_SEGMENTS;
+                    glm::vec3 p0(0.0f), p1(0.0f);
+                    p0[u] = cosf(a0) * volume.radius;
+                    p0[w] = sinf(a0) * volume.radius;
+                    p1[u] = cosf(a1) * volume.radius;
+                    p1[w] = sinf(a1) * volume.radius;
+                    lines.push_back(volume.center + p0);
+                    lines.push_back(volume.center + p1);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,90 @@
+//
+// Regions of space that push particles about: wind, vortices and attractors.
+//
+// Each volume is a box or a sphere with one kind of force inside it.  The
+// volumes are kept in a small BVH over their bounds, and particles are handled
+// in chunks: the bounds of a chunk are tested against the tree once, and only
+// the volumes that overlap it are tested against each particle.  A scene full
+// of volumes costs little where the particles are not.
+//
+
+#ifndef LAB10_FORCEVOLUMES_H
+#define LAB10_FORCEVOLUMES_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <cstdint>
+#include <vector>
+
+#include "FrameArena.h"
+
+struct ForceVolume {
+    enum Shape {
+        BOX,
+        SPHERE
+    };
+    enum Type {
+        WIND,                           // pushes along direction
+        VORTEX,                         // swirls around direction through the centre, counter clockwise looking down it
+        ATTRACTOR                       // pulls towards the centre, pushes away with a negative strength
+    };
+
+    Shape shape;
+    Type type;
+    glm::vec3 center;
+    glm::vec3 halfExtents;              // boxes only
+    float radius;                       // spheres only
+    glm::vec3 direction;                // unit, for wind and vortices
+    float strength;                     // added to the velocity every update
+};
+
+class ForceVolumes {
+public:
+    static const size_t CHUNK_SIZE = 64;    // particles tested against the tree together
+
+    ForceVolumes();
+
+    void clear();
+    // returns the index of the volume
+    uint32_t addBox(ForceVolume::Type type, const glm::vec3 &center, const glm::vec3 &halfExtents, const glm::vec3 &direction, float strength);
+    uint32_t addSphere(ForceVolume::Type type, const glm::vec3 &center, float radius, const glm::vec3 &direction, float strength);
+
+    // must be called after adding volumes and before applying them
+    void build();
+
+    // adds the force of every volume each particle is inside to its velocity, the candidate lists come from the arena
+    void apply(const glm::vec3 *positions, glm::vec3 *velocities, size_t count, FrameArena &arena) const;
+    // indices of the volumes whose bounds overlap the box
+    void query(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, std::vector<uint32_t> &volumes) const;
+    // the same into an array with room for every volume, returns how many were written
+    uint32_t query(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, uint32_t *volumes) const;
+
+    // pairs of points outlining every volume, for drawing as GL_LINES
+    void appendOutlines(std::vector<glm::vec3> &lines) const;
+
+    size_t getNumVolumes() const;
+    const ForceVolume& getVolume(uint32_t index) const;
+
+private:
+    static const uint32_t MAX_LEAF_VOLUMES = 2;
+
+    struct Node {
+        glm::vec3 boundsMin;
+        uint32_t leftOrFirst;           // first child for inner nodes, first volume in _order for leaves
+        glm::vec3 boundsMax;
+        uint32_t count;                 // volumes in a leaf, 0 for inner nodes
+    };
+
+    void subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count);
+    glm::vec3 force(const ForceVolume &volume, const glm::vec3 &position) const;
+    bool contains(const ForceVolume &volume, const glm::vec3 &position) const;
+
+    std::vector<ForceVolume> _volumes;
+    std::vector<glm::vec3> _boundsMin;  // per volume
+    std::vector<glm::vec3> _boundsMax;
+    std::vector<uint32_t> _order;       // volumes in leaf order
+    std::vector<Node> _nodes;
+};
+
+#endif //LAB10_FORCEVOLUMES_H
@@ -0,0 +1,66 @@
+//
+// Bump allocator for scratch memory that only lives for one frame.
+//
+
+#include "FrameArena.h"
+
+const size_t FrameArena::DEFAULT_CAPACITY;
+
+FrameArena::FrameArena(size_t capacity) {
+    _capacity = capacity;
+    _block = new char[_capacity];
+    _used = 0;
+    _highWater = 0;
+    _overflowBytes = 0;
+}
+
+FrameArena::~FrameArena() {
+    for(size_t i = 0; i < _overflow.size(); i++) {
+        delete[] _overflow[i];
+    }
+    delete[] _block;
+}
+
+void* FrameArena::allocateBytes(size_t bytes, size_t alignment) {
+    uintptr_t base = (uintptr_t)_block;
+    size_t start = ((base + _used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    if(start + bytes <= _capacity) {
+        _used = start + bytes;
+        return _block + start;
+    }
+
+    // out of room, this frame borrows a block of its own and reset() grows the arena to match
+    char *extra = new char[bytes + alignment];
+    _overflow.push_back(extra);
+    _overflowBytes += bytes + alignment;
+    return (void*)(((uintptr_t)extra + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void FrameArena::reset() {
+    size_t needed = _used + _overflowBytes;
+    if(needed > _highWater) _highWater = needed;
+    _used = 0;
+    if(_overflow.empty()) return;
+
+    for(size_t i = 0; i < _overflow.size(); i++) {
+        delete[] _overflow[i];
+    }
+    _overflow.clear();
+    _overflowBytes = 0;
+    // a quarter more than the frame needed, so slow growth does not reallocate every frame
+    delete[] _block;
+    _capacity = needed + needed / 4;
+    _block = new char[_capacity];
+}
+
+size_t FrameArena::getUsed() const {
+    return _used + _overflowBytes;
+}
+
+size_t FrameArena::getCapacity() const {
+    return _capacity;
+}
+
+size_t FrameArena::getHighWater() const {
+    return _highWater;
+}
@@ -0,0 +1,55 @@
+//
+// Bump allocator for scratch memory that only lives for one frame.
+//
+// allocate() hands out the next aligned piece of one big block and reset()
+// takes it all back at the end of the frame, so scratch buffers cost a
+// pointer increment and no trip to the heap.  Nothing is constructed or
+// destroyed, so only use it for plain data.  A frame that needs more than the
+// block holds spills into extra blocks; reset() then replaces them all with
+// one block big enough for that frame, so after the first few frames the
+// arena stops touching the heap altogether.
+//
+// An arena is not thread safe, allocate from it on one thread only.
+//
+
+#ifndef LAB10_FRAMEARENA_H
+#define LAB10_FRAMEARENA_H
+
+// include C and C++ libraries
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class FrameArena {
+public:
+    static const size_t DEFAULT_CAPACITY = 1 << 20;
+
+    explicit FrameArena(size_t capacity = DEFAULT_CAPACITY);
+    ~FrameArena();
+
+    // uninitialized room for count Ts, valid until the next reset()
+    template<typename T> T* allocate(size_t count) {
+        return (T*)allocateBytes(count * sizeof(T), alignof(T) < 16 ? 16 : alignof(T));
+    }
+    void* allocateBytes(size_t bytes, size_t alignment);
+
+    // frees everything allocated since the last reset, keeping the memory
+    void reset();
+
+    size_t getUsed() const;
+    size_t getCapacity() const;
+    size_t getHighWater() const;        // most used in any one frame
+
+private:
+    FrameArena(const FrameArena&);      // not copyable, the blocks belong to one arena
+    FrameArena& operator=(const FrameArena&);
+
+    char *_block;
+    size_t _capacity;
+    size_t _used;
+    size_t _highWater;
+    std::vector<char*> _overflow;       // extra blocks for this frame, folded into _block by reset()
+    size_t _overflowBytes;
+};
+
+#endif //LAB10_FRAMEARENA_H
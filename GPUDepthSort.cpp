@@ -0,0 +1,170 @@
+//
+// Sorts particles back to front on the GPU, for drawing them without a trip through the CPU.
+//
+
+#include "GPUDepthSort.h"
+#include "ResourceRegistry.h"
+
+#include <cstdio>				// for printf functionality
+#include <string>
+#include <vector>
+
+const GLuint GPUDepthSort::MAX_ELEMENTS = 1u << 23;
+const GLuint GPUDepthSort::WORKGROUP_SIZE = 256;
+const GLuint GPUDepthSort::BLOCK_SIZE = 2 * GPUDepthSort::WORKGROUP_SIZE;
+
+GPUDepthSort::GPUDepthSort() {
+    _keyPrograms[FLOAT_POSITIONS] = _keyPrograms[HALF_POSITIONS] = 0;
+    _stepProgram = _localProgram = _gatherProgram = 0;
+    _stepK = _stepJ = _localKFirst = _localKLast = -1;
+    _supported = false;
+    _keyBuffer = _indexBuffer = _gatherBuffer = 0;
+    _capacity = 0;
+    _gatherBytes = 0;
+}
+
+bool GPUDepthSort::initialize() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if(major < 4 || (major == 4 && minor < 3)) {
+        fprintf(stdout, "[INFO]: OpenGL %d.%d has no compute shaders, particles are depth sorted on the CPU\n", major, minor);
+        return false;
+    }
+
+    std::vector<std::string> defines(1, "WORKGROUP_SIZE " + std::to_string(WORKGROUP_SIZE));
+    _keyPrograms[FLOAT_POSITIONS] = _programs.getComputeProgram("shaders/depthSortKeys.c.glsl", defines);
+    _stepProgram = _programs.getComputeProgram("shaders/bitonicSortStep.c.glsl", defines);
+    _localProgram = _programs.getComputeProgram("shaders/bitonicSortLocal.c.glsl", defines);
+    _gatherProgram = _programs.getComputeProgram("shaders/gatherSorted.c.glsl", defines);
+    defines.push_back("HALF_POSITIONS");
+    _keyPrograms[HALF_POSITIONS] = _programs.getComputeProgram("shaders/depthSortKeys.c.glsl", defines);
+    if(_keyPrograms[FLOAT_POSITIONS] == 0 || _keyPrograms[HALF_POSITIONS] == 0 || _stepProgram == 0
+       || _localProgram == 0 || _gatherProgram == 0) {
+        fprintf(stderr, "[ERROR]: could not build the depth sort programs, particles are depth sorted on the CPU\n");
+        _programs.cleanup();
+        return false;
+    }
+    _stepK = glGetUniformLocation(_stepProgram, "k");
+    _stepJ = glGetUniformLocation(_stepProgram, "j");
+    _localKFirst = glGetUniformLocation(_localProgram, "kFirst");
+    _localKLast = glGetUniformLocation(_localProgram, "kLast");
+
+    ResourceRegistry::genBuffers(OWNER_PARTICLES, 1, &_keyBuffer);
+    ResourceRegistry::genBuffers(OWNER_PARTICLES, 1, &_indexBuffer);
+    ResourceRegistry::genBuffers(OWNER_PARTICLES, 1, &_gatherBuffer);
+    _supported = true;
+    fprintf(stdout, "[INFO]: particles are depth sorted on the GPU\n");
+    return true;
+}
+
+bool GPUDepthSort::isSupported() const {
+    return _supported;
+}
+
+void GPUDepthSort::sort(GLuint positionBuffer, PositionFormat format, GLuint wordsPerElement, GLuint count,
+                        glm::vec3 origin, glm::vec3 eyePos, glm::vec3 viewDirection) {
+    if(!_supported || count == 0 || count > MAX_ELEMENTS) return;
+
+    // whole blocks, so every workgroup of the local passes is full
+    GLuint paddedCount = BLOCK_SIZE;
+    while(paddedCount < count) {
+        paddedCount *= 2;
+    }
+    reserve(paddedCount);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _keyBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _indexBuffer);
+
+    GLuint keyProgram = _keyPrograms[format];
+    glUseProgram(keyProgram);
+    glUniform1ui(glGetUniformLocation(keyProgram, "count"), count);
+    glUniform1ui(glGetUniformLocation(keyProgram, "paddedCount"), paddedCount);
+    glUniform1ui(glGetUniformLocation(keyProgram, "wordsPerElement"), wordsPerElement);
+    glUniform3fv(glGetUniformLocation(keyProgram, "origin"), 1, &origin[0]);
+    glUniform3fv(glGetUniformLocation(keyProgram, "eyePos"), 1, &eyePos[0]);
+    glUniform3fv(glGetUniformLocation(keyProgram, "viewDir"), 1, &viewDirection[0]);
+    glDispatchCompute(paddedCount / WORKGROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // every block sorted on its own first, each sequence size after that merged through the
+    // storage buffers until the partners fit in a block again
+    GLuint numBlocks = paddedCount / BLOCK_SIZE;
+    glUseProgram(_localProgram);
+    glUniform1ui(_localKFirst, 2);
+    glUniform1ui(_localKLast, BLOCK_SIZE);
+    glDispatchCompute(numBlocks, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    for(GLuint k = BLOCK_SIZE * 2; k <= paddedCount; k *= 2) {
+        glUseProgram(_stepProgram);
+        glUniform1ui(_stepK, k);
+        for(GLuint j = k / 2; j >= BLOCK_SIZE; j /= 2) {
+            glUniform1ui(_stepJ, j);
+            glDispatchCompute(paddedCount / 2 / WORKGROUP_SIZE, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        glUseProgram(_localProgram);
+        glUniform1ui(_localKFirst, k);
+        glUniform1ui(_localKLast, k);
+        glDispatchCompute(numBlocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // the indices are read as elements next
+    glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+    glUseProgram(0);
+}
+
+GLuint GPUDepthSort::getIndexBuffer() const {
+    return _indexBuffer;
+}
+
+GLuint GPUDepthSort::gather(GLuint sourceBuffer, GLuint wordsPerElement, GLuint count) {
+    if(!_supported || count == 0) return _gatherBuffer;
+
+    GLsizeiptr bytes = (GLsizeiptr)count * wordsPerElement * sizeof(GLuint);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _gatherBuffer);
+    if(bytes > _gatherBytes) {
+        ResourceRegistry::bufferData(_gatherBuffer, GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+        _gatherBytes = bytes;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sourceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _indexBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _gatherBuffer);
+    glUseProgram(_gatherProgram);
+    glUniform1ui(glGetUniformLocation(_gatherProgram, "count"), count);
+    glUniform1ui(glGetUniformLocation(_gatherProgram, "wordsPerElement"), wordsPerElement);
+    glDispatchCompute((count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    // read as vertex attributes next
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    glUseProgram(0);
+    return _gatherBuffer;
+}
+
+void GPUDepthSort::reserve(GLuint paddedCount) {
+    if(paddedCount <= _capacity) return;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _keyBuffer);
+    ResourceRegistry::bufferData(_keyBuffer, GL_SHADER_STORAGE_BUFFER, paddedCount * sizeof(GLfloat), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _indexBuffer);
+    ResourceRegistry::bufferData(_indexBuffer, GL_SHADER_STORAGE_BUFFER, paddedCount * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    _capacity = paddedCount;
+}
+
+void GPUDepthSort::cleanup() {
+    if(!_supported) return;
+    fprintf( stdout, "[INFO]: ...deleting depth sort buffers....\n" );
+
+    const GLuint BUFFERS[3] = { _keyBuffer, _indexBuffer, _gatherBuffer };
+    ResourceRegistry::deleteBuffers(3, BUFFERS);
+    _keyBuffer = _indexBuffer = _gatherBuffer = 0;
+    _capacity = 0;
+    _gatherBytes = 0;
+    _programs.cleanup();
+    _supported = false;
+}
@@ -0,0 +1,82 @@
+//
+// Sorts particles back to front on the GPU, for drawing them without a trip through the CPU.
+//
+// A compute pass writes one key per particle, its distance along the view
+// direction, next to its index, both in shader storage buffers padded out to
+// a power of two.  A bitonic sort then orders the pairs farthest first: the
+// passes whose partners lie within a block of 512 run in shared memory, as
+// many to a dispatch as follow one another, and only the passes with partners
+// further apart than that go through the storage buffers one dispatch at a
+// time.  Sorting a million particles takes 79 dispatches, 1 for the keys, 12
+// in shared memory and 66 through the storage buffers, where a dispatch per
+// pass would need 210 for the sort alone.
+//
+// The sorted indices are left in a buffer that can be bound straight to
+// GL_ELEMENT_ARRAY_BUFFER, or gather() copies the elements themselves into
+// that order for instanced drawing.  Compute shaders need OpenGL 4.3, where
+// the context is older initialize() returns false and the caller keeps
+// sorting on the CPU.
+//
+
+#ifndef LAB10_GPUDEPTHSORT_H
+#define LAB10_GPUDEPTHSORT_H
+
+// include OpenGL and GLM libraries
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "ShaderVariantCache.h"
+
+class GPUDepthSort {
+public:
+    // how positions are stored in the buffer being sorted
+    enum PositionFormat {
+        FLOAT_POSITIONS,                // three floats
+        HALF_POSITIONS                  // three half floats, offsets from the origin passed to sort()
+    };
+
+    // the most elements sort() takes, one dispatch cannot cover more
+    static const GLuint MAX_ELEMENTS;
+
+    GPUDepthSort();
+
+    // compiles the compute programs, false when they are not available and sort() must not be called
+    bool initialize();
+    bool isSupported() const;
+
+    // orders the first count elements of positionBuffer back to front as seen from eyePos looking along
+    // viewDirection.  Elements are wordsPerElement 32 bit words apart, count at most MAX_ELEMENTS
+    void sort(GLuint positionBuffer, PositionFormat format, GLuint wordsPerElement, GLuint count,
+              glm::vec3 origin, glm::vec3 eyePos, glm::vec3 viewDirection);
+    // the indices from the last sort(), the first count of them to draw with glDrawElements as GL_UNSIGNED_INT
+    GLuint getIndexBuffer() const;
+    // copies the first count elements of sourceBuffer into sorted order, in a buffer that stays valid until the
+    // next gather()
+    GLuint gather(GLuint sourceBuffer, GLuint wordsPerElement, GLuint count);
+
+    void cleanup();
+
+private:
+    // grows the key and index buffers to at least paddedCount
+    void reserve(GLuint paddedCount);
+
+    static const GLuint WORKGROUP_SIZE;
+    static const GLuint BLOCK_SIZE;     // elements a workgroup sorts in shared memory
+
+    ShaderVariantCache _programs;
+    GLuint _keyPrograms[2];             // by PositionFormat
+    GLuint _stepProgram;
+    GLuint _localProgram;
+    GLuint _gatherProgram;
+    GLint _stepK, _stepJ;               // uniform locations used every pass
+    GLint _localKFirst, _localKLast;
+    bool _supported;
+
+    GLuint _keyBuffer;
+    GLuint _indexBuffer;
+    GLuint _capacity;                   // elements the key and index buffers hold
+    GLuint _gatherBuffer;
+    GLsizeiptr _gatherBytes;
+};
+
+#endif //LAB10_GPUDEPTHSORT_H
@@ -0,0 +1,119 @@
+//
+// Counts calls to the global operator new, to catch heap allocations in code that should make none.
+//
+
+#include "HeapCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifndef NDEBUG
+
+namespace {
+    std::atomic<uint64_t> numAllocations(0);
+    std::atomic<int64_t> liveBytes[HeapCounter::MAX_TAGS];
+    thread_local uint32_t currentTag = 0;
+
+    // sits in front of every block, 16 bytes so the memory handed out keeps malloc's alignment
+    struct alignas(16) BlockHeader {
+        uint64_t size;
+        uint32_t tag;
+    };
+
+    void* countedAllocate(size_t size) {
+        numAllocations.fetch_add(1, std::memory_order_relaxed);
+        BlockHeader *header = (BlockHeader*)malloc(sizeof(BlockHeader) + size);
+        if(header == nullptr) throw std::bad_alloc();
+        header->size = size;
+        header->tag = currentTag;
+        liveBytes[currentTag].fetch_add(size, std::memory_order_relaxed);
+        return header + 1;
+    }
+
+    void countedFree(void *memory) {
+        if(memory == nullptr) return;
+        BlockHeader *header = (BlockHeader*)memory - 1;
+        liveBytes[header->tag].fetch_sub(header->size, std::memory_order_relaxed);
+        free(header);
+    }
+}
+
+// the array and nothrow forms all come through here, aligned new keeps the library version
+void* operator new(size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch(...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch(...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *memory) noexcept {
+    countedFree(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    countedFree(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    countedFree(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+    countedFree(memory);
+}
+
+uint64_t HeapCounter::getNumAllocations() {
+    return numAllocations.load(std::memory_order_relaxed);
+}
+
+bool HeapCounter::isCounting() {
+    return true;
+}
+
+uint32_t HeapCounter::setTag(uint32_t tag) {
+    uint32_t previous = currentTag;
+    currentTag = tag < MAX_TAGS ? tag : 0;
+    return previous;
+}
+
+int64_t HeapCounter::getLiveBytes(uint32_t tag) {
+    return tag < MAX_TAGS ? liveBytes[tag].load(std::memory_order_relaxed) : 0;
+}
+
+#else
+
+uint64_t HeapCounter::getNumAllocations() {
+    return 0;
+}
+
+bool HeapCounter::isCounting() {
+    return false;
+}
+
+uint32_t HeapCounter::setTag(uint32_t tag) {
+    return 0;
+}
+
+int64_t HeapCounter::getLiveBytes(uint32_t tag) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,35 @@
+//
+// Counts calls to the global operator new, to catch heap allocations in code that should make none.
+//
+// Debug builds replace the global operator new and delete with versions that
+// bump an atomic counter and pass on to malloc and free.  Release builds
+// (NDEBUG) leave the allocator alone and the counter always reads zero, so
+// checks against it cost nothing there.  Only C++ allocations are seen, not
+// malloc calls made by C libraries such as the OpenGL driver.
+//
+// Each allocation is also charged to the calling thread's current tag, and a
+// small header in front of the block remembers which, so the bytes still
+// alive per tag can be read back whichever thread frees them.
+//
+
+#ifndef LAB10_HEAPCOUNTER_H
+#define LAB10_HEAPCOUNTER_H
+
+// include C and C++ libraries
+#include <cstdint>
+
+namespace HeapCounter {
+    const uint32_t MAX_TAGS = 16;
+
+    // allocations made by every thread since the program started
+    uint64_t getNumAllocations();
+    // false in release builds, where nothing is counted
+    bool isCounting();
+
+    // charges this thread's allocations to the tag from now on, returns the tag it replaces
+    uint32_t setTag(uint32_t tag);
+    // bytes allocated under the tag and not freed yet
+    int64_t getLiveBytes(uint32_t tag);
+}
+
+#endif //LAB10_HEAPCOUNTER_H
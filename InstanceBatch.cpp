@@ -0,0 +1,121 @@
+//
+// Batched model and normal matrices for instanced drawing.
+//
+
+#include "InstanceBatch.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define INSTANCE_BATCH_AVX2
+#endif
+
+void InstanceBatch::buildTransformsScalar(const glm::vec3 *positions, const glm::quat *orientations, const glm::vec3 *scales, size_t count, InstanceTransform *instances) {
+    for(size_t i = 0; i < count; i++) {
+        const glm::quat &q = orientations[i];
+        float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+        // rotation matrix rows
+        glm::vec3 r0(1.0f - 2.0f * (yy + zz), 2.0f * (xy - wz), 2.0f * (xz + wy));
+        glm::vec3 r1(2.0f * (xy + wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz - wx));
+        glm::vec3 r2(2.0f * (xz - wy), 2.0f * (yz + wx), 1.0f - 2.0f * (xx + yy));
+
+        glm::vec3 s = scales[i];
+        glm::vec3 invS = 1.0f / s;
+        glm::vec3 p = positions[i];
+
+        InstanceTransform &instance = instances[i];
+        // scaling after the rotation scales whole rows
+        instance.modelRows[0] = glm::vec4(r0 * s.x, p.x);
+        instance.modelRows[1] = glm::vec4(r1 * s.y, p.y);
+        instance.modelRows[2] = glm::vec4(r2 * s.z, p.z);
+        instance.normalRows[0] = glm::vec4(r0 * invS.x, 0.0f);
+        instance.normalRows[1] = glm::vec4(r1 * invS.y, 0.0f);
+        instance.normalRows[2] = glm::vec4(r2 * invS.z, 0.0f);
+    }
+}
+
+#ifdef INSTANCE_BATCH_AVX2
+
+bool InstanceBatch::hasAVX2() {
+    static const bool SUPPORTED = __builtin_cpu_supports("avx2");
+    return SUPPORTED;
+}
+
+// components are gathered one by one so this does not depend on GLM's quaternion memory layout
+#define GATHER8(array, i, component) _mm256_set_ps(array[i + 7].component, array[i + 6].component, array[i + 5].component, array[i + 4].component, \
+                                                   array[i + 3].component, array[i + 2].component, array[i + 1].component, array[i].component)
+
+__attribute__((target("avx2")))
+static void buildTransformsAVX2(const glm::vec3 *positions, const glm::quat *orientations, const glm::vec3 *scales, size_t count, InstanceTransform *instances) {
+    const __m256 ONE = _mm256_set1_ps(1.0f);
+    const __m256 TWO = _mm256_set1_ps(2.0f);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 qx = GATHER8(orientations, i, x);
+        __m256 qy = GATHER8(orientations, i, y);
+        __m256 qz = GATHER8(orientations, i, z);
+        __m256 qw = GATHER8(orientations, i, w);
+        __m256 sx = GATHER8(scales, i, x);
+        __m256 sy = GATHER8(scales, i, y);
+        __m256 sz = GATHER8(scales, i, z);
+        __m256 isx = _mm256_div_ps(ONE, sx);
+        __m256 isy = _mm256_div_ps(ONE, sy);
+        __m256 isz = _mm256_div_ps(ONE, sz);
+
+        __m256 x2 = _mm256_mul_ps(qx, TWO), y2 = _mm256_mul_ps(qy, TWO), z2 = _mm256_mul_ps(qz, TWO);
+        __m256 xx = _mm256_mul_ps(qx, x2), yy = _mm256_mul_ps(qy, y2), zz = _mm256_mul_ps(qz, z2);
+        __m256 xy = _mm256_mul_ps(qx, y2), xz = _mm256_mul_ps(qx, z2), yz = _mm256_mul_ps(qy, z2);
+        __m256 wx = _mm256_mul_ps(qw, x2), wy = _mm256_mul_ps(qw, y2), wz = _mm256_mul_ps(qw, z2);
+
+        __m256 r[9] = {
+            _mm256_sub_ps(ONE, _mm256_add_ps(yy, zz)), _mm256_sub_ps(xy, wz), _mm256_add_ps(xz, wy),
+            _mm256_add_ps(xy, wz), _mm256_sub_ps(ONE, _mm256_add_ps(xx, zz)), _mm256_sub_ps(yz, wx),
+            _mm256_sub_ps(xz, wy), _mm256_add_ps(yz, wx), _mm256_sub_ps(ONE, _mm256_add_ps(xx, yy))
+        };
+        const __m256 SCALE[3] = { sx, sy, sz };
+        const __m256 INV_SCALE[3] = { isx, isy, isz };
+
+        // one row element of each matrix across the eight instances, written out per instance
+        alignas(32) float model[9][8];
+        alignas(32) float normal[9][8];
+        for(int e = 0; e < 9; e++) {
+            _mm256_store_ps(model[e], _mm256_mul_ps(r[e], SCALE[e / 3]));
+            _mm256_store_ps(normal[e], _mm256_mul_ps(r[e], INV_SCALE[e / 3]));
+        }
+        for(int j = 0; j < 8; j++) {
+            InstanceTransform &instance = instances[i + j];
+            const glm::vec3 &p = positions[i + j];
+            instance.modelRows[0] = glm::vec4(model[0][j], model[1][j], model[2][j], p.x);
+            instance.modelRows[1] = glm::vec4(model[3][j], model[4][j], model[5][j], p.y);
+            instance.modelRows[2] = glm::vec4(model[6][j], model[7][j], model[8][j], p.z);
+            instance.normalRows[0] = glm::vec4(normal[0][j], normal[1][j], normal[2][j], 0.0f);
+            instance.normalRows[1] = glm::vec4(normal[3][j], normal[4][j], normal[5][j], 0.0f);
+            instance.normalRows[2] = glm::vec4(normal[6][j], normal[7][j], normal[8][j], 0.0f);
+        }
+    }
+    InstanceBatch::buildTransformsScalar(positions + i, orientations + i, scales + i, count - i, instances + i);
+}
+
+#undef GATHER8
+
+void InstanceBatch::buildTransforms(const glm::vec3 *positions, const glm::quat *orientations, const glm::vec3 *scales, size_t count, InstanceTransform *instances) {
+    if(hasAVX2()) {
+        buildTransformsAVX2(positions, orientations, scales, count, instances);
+    } else {
+        buildTransformsScalar(positions, orientations, scales, count, instances);
+    }
+}
+
+#else
+
+bool InstanceBatch::hasAVX2() {
+    return false;
+}
+
+void InstanceBatch::buildTransforms(const glm::vec3 *positions, const glm::quat *orientations, const glm::vec3 *scales, size_t count, InstanceTransform *instances) {
+    buildTransformsScalar(positions, orientations, scales, count, instances);
+}
+
+#endif
@@ -0,0 +1,35 @@
+//
+// Batched model and normal matrices for instanced drawing.
+//
+// Builds the affine world matrix translate * scale * rotate of each instance,
+// the order Transform::updateMatrix uses, straight from its position,
+// orientation and scale, and the normal matrix as inverse scale * rotate
+// instead of inverting the model matrix.  Output goes directly into the
+// per-instance vertex buffer, normally a mapped one.
+//
+// The AVX2 path handles eight instances per iteration and is picked at run time
+// on x86 CPUs that support it, everything else runs the scalar loop.
+//
+
+#ifndef LAB10_INSTANCEBATCH_H
+#define LAB10_INSTANCEBATCH_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+#include <glm/gtx/quaternion.hpp>
+
+// include C and C++ libraries
+#include <cstddef>
+
+// per-instance vertex attributes, three rows each so the matrices take six vec4 slots
+struct InstanceTransform {
+    glm::vec4 modelRows[3];             // rows of the affine model matrix, translation in w
+    glm::vec4 normalRows[3];            // rows of the normal matrix, w unused
+};
+
+namespace InstanceBatch {
+    void buildTransforms(const glm::vec3 *positions, const glm::quat *orientations, const glm::vec3 *scales, size_t count, InstanceTransform *instances);
+    void buildTransformsScalar(const glm::vec3 *positions, const glm::quat *orientations, const glm::vec3 *scales, size_t count, InstanceTransform *instances);
+    bool hasAVX2();
+}
+
+#endif //LAB10_INSTANCEBATCH_H
@@ -0,0 +1,121 @@
+//
+// A small fixed pool of worker threads for data parallel loops.
+//
+
+#include "JobSystem.h"
+
+#include <cstdio>				// for printf functionality
+
+JobSystem::JobSystem() {
+    _func = nullptr;
+    _count = 0;
+    _grainSize = 1;
+    _numChunks = 0;
+    _nextChunk = 0;
+    _chunksDone = 0;
+    _activeWorkers = 0;
+    _generation = 0;
+    _shutdown = false;
+};
+
+JobSystem::~JobSystem() {
+    cleanup();
+}
+
+void JobSystem::initialize(unsigned numThreads) {
+    if(numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+        if(numThreads == 0) numThreads = 1;
+    }
+
+    _shutdown = false;
+    for(unsigned i = 1; i < numThreads; i++) {
+        _threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+
+    fprintf( stdout, "[INFO]: job system started with %u threads\n", numThreads );
+}
+
+void JobSystem::parallelFor(size_t count, size_t grainSize, const RangeFunction &func) {
+    if(count == 0) return;
+    if(grainSize == 0) grainSize = 1;
+
+    // small loops or no workers - just run it here
+    if(_threads.empty() || count <= grainSize) {
+        func(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _func = &func;
+        _count = count;
+        _grainSize = grainSize;
+        _numChunks = (count + grainSize - 1) / grainSize;
+        _nextChunk = 0;
+        _chunksDone = 0;
+        _generation++;
+    }
+    _wake.notify_all();
+
+    // the calling thread helps out instead of sitting idle
+    runChunks(0);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    // wait for stragglers too so none of them can pick up a chunk of the next job with this func
+    _done.wait(lock, [this]() { return _chunksDone.load() == _numChunks && _activeWorkers == 0; });
+    _func = nullptr;
+}
+
+unsigned JobSystem::getNumWorkers() const {
+    return _threads.size() + 1;
+}
+
+void JobSystem::cleanup() {
+    if(_threads.empty()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _shutdown = true;
+    }
+    _wake.notify_all();
+    for(size_t i = 0; i < _threads.size(); i++) {
+        _threads[i].join();
+    }
+    _threads.clear();
+}
+
+void JobSystem::workerLoop(unsigned worker) {
+    unsigned seenGeneration = 0;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&]() { return _shutdown || (_generation != seenGeneration && _func != nullptr); });
+            if(_shutdown) return;
+            seenGeneration = _generation;
+            _activeWorkers++;
+        }
+        runChunks(worker);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _activeWorkers--;
+        }
+        _done.notify_all();
+    }
+}
+
+void JobSystem::runChunks(unsigned worker) {
+    const RangeFunction &func = *_func;
+    size_t chunk;
+    while((chunk = _nextChunk.fetch_add(1)) < _numChunks) {
+        size_t begin = chunk * _grainSize;
+        size_t end = begin + _grainSize < _count ? begin + _grainSize : _count;
+        func(begin, end, worker);
+
+        // the thread finishing the last chunk wakes up the caller
+        if(_chunksDone.fetch_add(1) + 1 == _numChunks) {
+            { std::lock_guard<std::mutex> lock(_mutex); }
+            _done.notify_all();
+        }
+    }
+}
@@ -0,0 +1,83 @@
+//
+// A small fixed pool of worker threads for data parallel loops.
+//
+// parallelFor() splits [0, count) into chunks of at most grainSize items and
+// hands them out to the workers and the calling thread until every chunk is
+// done.  The calling thread blocks until the whole range has been processed.
+//
+
+#ifndef LAB10_JOBSYSTEM_H
+#define LAB10_JOBSYSTEM_H
+
+// include C and C++ libraries
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class JobSystem {
+public:
+    // body of a parallel loop - processes items [begin, end) on the given worker (0 is the calling thread).
+    // Refers to the callable instead of copying it like std::function would, so passing a lambda never
+    // allocates.  The callable only has to outlive the parallelFor() call, which a temporary does.
+    class RangeFunction {
+    public:
+        template<typename Func, typename = typename std::enable_if<!std::is_same<typename std::decay<Func>::type, RangeFunction>::value>::type>
+        RangeFunction(const Func &func) : _callable(&func), _invoke(&invoke<Func>) {}
+
+        void operator()(size_t begin, size_t end, unsigned worker) const {
+            _invoke(_callable, begin, end, worker);
+        }
+
+    private:
+        template<typename Func>
+        static void invoke(const void *callable, size_t begin, size_t end, unsigned worker) {
+            (*(const Func*)callable)(begin, end, worker);
+        }
+
+        const void *_callable;
+        void (*_invoke)(const void *callable, size_t begin, size_t end, unsigned worker);
+    };
+
+    JobSystem();
+    ~JobSystem();
+
+    // starts numThreads-1 workers, 0 uses one thread per hardware core
+    void initialize(unsigned numThreads = 0);
+
+    // runs func over [0, count) in chunks of grainSize, returns once every chunk is done
+    void parallelFor(size_t count, size_t grainSize, const RangeFunction &func);
+
+    // total number of threads that can run a chunk, including the calling thread
+    unsigned getNumWorkers() const;
+
+    // stops and joins every worker
+    void cleanup();
+
+private:
+
+    void workerLoop(unsigned worker);
+
+    // takes chunks off of the current job until there are none left
+    void runChunks(unsigned worker);
+
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _wake;          // signalled when a new job is posted or on shutdown
+    std::condition_variable _done;          // signalled when the last chunk finishes
+
+    // the job currently being run
+    const RangeFunction *_func;
+    size_t _count;
+    size_t _grainSize;
+    size_t _numChunks;
+    std::atomic<size_t> _nextChunk;
+    std::atomic<size_t> _chunksDone;
+    unsigned _activeWorkers;                // workers that picked up the current job, guarded by _mutex
+    unsigned _generation;                   // bumped every time a job is posted
+    bool _shutdown;
+};
+
+#endif //LAB10_JOBSYSTEM_H
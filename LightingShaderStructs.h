@@ -24,6 +24,25 @@ struct ParticleShaderAttributes {
     GLint lifespan;
 };
 
+struct InstancedParticleShaderUniforms {
+    GLint mvMatrix;                     // the ModelView Matrix to apply
+    GLint projMatrix;                   // the Projection Matrix to apply
+    GLint flipbook;                     // the texture array to bind, a frame per layer
+    GLint emitterOrigin;                // what the packed positions are relative to
+    GLint maxSize;                      // the half width a packed size of 1 stands for
+    GLint spinPerLife;                  // radians a sprite turns over its whole life
+    GLint framesPerLife;                // flipbook frames played over a whole life
+    GLint numFrames;
+    GLint blendFrames;
+};
+
+struct InstancedParticleShaderAttributes {
+    GLint vCorner;                      // the corner of the shared quad
+    GLint particleOffset;               // per instance from here on
+    GLint particleAge;
+    GLint particleColorSize;
+};
+
 
 struct FlatShaderProgramUniforms {
     GLint mvpMatrix;                    // the MVP Matrix to apply
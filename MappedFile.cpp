@@ -0,0 +1,125 @@
+//
+// Read only view of a whole file, memory mapped where the platform allows it.
+//
+
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+    _data = nullptr;
+    _size = 0;
+    _mapped = false;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::isOpen() const {
+    return _data != nullptr;
+}
+
+const void* MappedFile::data() const {
+    return _data;
+}
+
+size_t MappedFile::size() const {
+    return _size;
+}
+
+#ifndef _WIN32
+
+bool MappedFile::open(const char* filename) {
+    close();
+    int fd = ::open(filename, O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // the mapping keeps its own reference to the file so the descriptor can go straight away
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        fprintf(stderr, "[ERROR]: Could not map \"%s\"\n", filename);
+        return false;
+    }
+    _data = data;
+    _size = info.st_size;
+    _mapped = true;
+    return true;
+}
+
+void MappedFile::prefetch() const {
+    if(_mapped) {
+        madvise(_data, _size, MADV_WILLNEED);
+    }
+}
+
+void MappedFile::close() {
+    if(_data == nullptr) return;
+    if(_mapped) {
+        munmap(_data, _size);
+    } else {
+        free(_data);
+    }
+    _data = nullptr;
+    _size = 0;
+    _mapped = false;
+}
+
+#else
+
+bool MappedFile::open(const char* filename) {
+    close();
+    FILE *file = fopen(filename, "rb");
+    if(file == nullptr) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if(size <= 0) {
+        fclose(file);
+        return false;
+    }
+
+    void *data = malloc(size);
+    if(data == nullptr || fread(data, 1, size, file) != (size_t)size) {
+        fprintf(stderr, "[ERROR]: Could not read \"%s\"\n", filename);
+        free(data);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    _data = data;
+    _size = size;
+    _mapped = false;
+    return true;
+}
+
+void MappedFile::prefetch() const {
+    // already read in by open()
+}
+
+void MappedFile::close() {
+    if(_data == nullptr) return;
+    free(_data);
+    _data = nullptr;
+    _size = 0;
+}
+
+#endif
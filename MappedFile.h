@@ -0,0 +1,39 @@
+//
+// Read only view of a whole file, memory mapped where the platform allows it.
+//
+// On POSIX systems the file is mmap'd so opening it costs nothing up front and
+// pages are read in as they are first touched.  Windows builds read the file
+// into a heap buffer instead.  Either way data() stays valid until close().
+//
+
+#ifndef LAB10_MAPPEDFILE_H
+#define LAB10_MAPPEDFILE_H
+
+// include C and C++ libraries
+#include <cstddef>
+
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char* filename);
+    void close();
+
+    // asks the system to start reading the whole file in, for when it is about to be read front to back
+    void prefetch() const;
+
+    bool isOpen() const;
+    const void* data() const;
+    size_t size() const;
+
+private:
+    MappedFile(const MappedFile&);              // not copyable, the mapping belongs to one object
+    MappedFile& operator=(const MappedFile&);
+
+    void *_data;
+    size_t _size;
+    bool _mapped;                       // false when _data came from malloc
+};
+
+#endif //LAB10_MAPPEDFILE_H
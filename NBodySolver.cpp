@@ -0,0 +1,328 @@
+//
+// Barnes-Hut N-body gravity solver.
+//
+
+#include "NBodySolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+NBodySolver::NBodySolver() {
+    _jobSystem = nullptr;
+    _g = 1.0f;
+    _epsilon2 = 0.01f;
+    _theta2 = 0.5f * 0.5f;
+    _positions = nullptr;
+    _masses = nullptr;
+};
+
+void NBodySolver::setJobSystem(JobSystem *jobSystem) {
+    _jobSystem = jobSystem;
+}
+
+void NBodySolver::setGravitationalConstant(float g) {
+    _g = g;
+}
+
+void NBodySolver::setSoftening(float epsilon) {
+    _epsilon2 = epsilon * epsilon;
+}
+
+void NBodySolver::setOpeningAngle(float theta) {
+    _theta2 = theta * theta;
+}
+
+void NBodySolver::clearAttractors() {
+    _attractors.clear();
+}
+
+void NBodySolver::addAttractor(const Attractor &attractor) {
+    _attractors.push_back(attractor);
+}
+
+const std::vector<Attractor>& NBodySolver::getAttractors() const {
+    return _attractors;
+}
+
+float NBodySolver::getSoftening() const {
+    return std::sqrt(_epsilon2);
+}
+
+size_t NBodySolver::getNumNodes() const {
+    return _nodes.size();
+}
+
+void NBodySolver::parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func) {
+    if(_jobSystem != nullptr) {
+        _jobSystem->parallelFor(count, grainSize, func);
+    } else {
+        func(0, count, 0);
+    }
+}
+
+// spreads the lower 21 bits of v out so there are two zero bits between each
+uint64_t NBodySolver::expandBits(uint32_t v) {
+    uint64_t x = v & 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8)  & 0x100f00f00f00f00full;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2)  & 0x1249249249249249ull;
+    return x;
+}
+
+void NBodySolver::computeAccelerations(const glm::vec3 *positions, const float *masses, size_t numBodies, glm::vec3 *accelerations) {
+    solve(positions, masses, numBodies, accelerations, true);
+}
+
+void NBodySolver::computeMutualAccelerations(const glm::vec3 *positions, const float *masses, size_t numBodies, glm::vec3 *accelerations) {
+    solve(positions, masses, numBodies, accelerations, false);
+}
+
+void NBodySolver::solve(const glm::vec3 *positions, const float *masses, size_t numBodies, glm::vec3 *accelerations, bool withAttractors) {
+    _nodes.clear();
+    if(numBodies == 0) return;
+
+    // no mutual gravity, skip building the tree
+    if(_g == 0.0f) {
+        parallelFor(numBodies, 4096, [&](size_t begin, size_t end, unsigned) {
+            for(size_t i = begin; i < end; i++) {
+                accelerations[i] = withAttractors ? attractorAcceleration(positions[i]) : glm::vec3(0.0f);
+            }
+        });
+        return;
+    }
+
+    _positions = positions;
+    _masses = masses;
+
+    // bounding cube of every body
+    glm::vec3 lower = positions[0], upper = positions[0];
+    for(size_t i = 1; i < numBodies; i++) {
+        lower = glm::min(lower, positions[i]);
+        upper = glm::max(upper, positions[i]);
+    }
+    glm::vec3 extent = upper - lower;
+    float size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-4f)) * 1.0001f;
+
+    // morton code of every body
+    _codes.resize(numBodies);
+    const float QUANTIZE = (float)(1 << MAX_DEPTH) / size;
+    parallelFor(numBodies, 4096, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            glm::vec3 q = (positions[i] - lower) * QUANTIZE;
+            uint32_t x = (uint32_t)std::min(std::max(q.x, 0.0f), (float)((1 << MAX_DEPTH) - 1));
+            uint32_t y = (uint32_t)std::min(std::max(q.y, 0.0f), (float)((1 << MAX_DEPTH) - 1));
+            uint32_t z = (uint32_t)std::min(std::max(q.z, 0.0f), (float)((1 << MAX_DEPTH) - 1));
+            _codes[i] = expandBits(x) | (expandBits(y) << 1) | (expandBits(z) << 2);
+        }
+    });
+
+    // bucket by top level octant, then sort each octant in parallel
+    const int TOP_SHIFT = 3 * (MAX_DEPTH - 1);
+    uint32_t octantStart[9] = { 0 };
+    for(size_t i = 0; i < numBodies; i++) {
+        octantStart[(_codes[i] >> TOP_SHIFT) + 1]++;
+    }
+    for(int o = 0; o < 8; o++) {
+        octantStart[o + 1] += octantStart[o];
+    }
+    uint32_t writeHeads[8];
+    std::copy(octantStart, octantStart + 8, writeHeads);
+    _sortKeys.resize(numBodies);
+    for(size_t i = 0; i < numBodies; i++) {
+        _sortKeys[writeHeads[_codes[i] >> TOP_SHIFT]++] = std::make_pair(_codes[i], (uint32_t)i);
+    }
+    parallelFor(8, 1, [&](size_t begin, size_t end, unsigned) {
+        for(size_t o = begin; o < end; o++) {
+            std::sort(_sortKeys.begin() + octantStart[o], _sortKeys.begin() + octantStart[o + 1]);
+        }
+    });
+    _order.resize(numBodies);
+    for(size_t i = 0; i < numBodies; i++) {
+        _order[i] = _sortKeys[i].second;
+    }
+
+    if(numBodies <= LEAF_SIZE) {
+        buildSubtree(0, numBodies, 0, size, _nodes);
+    } else {
+        // each top level octant becomes its own subtree, built in parallel
+        parallelFor(8, 1, [&](size_t begin, size_t end, unsigned) {
+            for(size_t o = begin; o < end; o++) {
+                _octantNodes[o].clear();
+                if(octantStart[o] != octantStart[o + 1]) {
+                    buildSubtree(octantStart[o], octantStart[o + 1], 1, size * 0.5f, _octantNodes[o]);
+                }
+            }
+        });
+
+        // the root followed by every octant, shifting their node indices into place
+        Node root;
+        root.centerOfMass = glm::vec3(0.0f);
+        root.mass = 0.0f;
+        root.size = size;
+        root.firstBody = 0;
+        root.lastBody = numBodies;
+        root.numBodies = 0;
+        _nodes.push_back(root);
+        glm::vec3 weightedSum(0.0f);
+        glm::vec3 positionSum(0.0f);
+        for(int o = 0; o < 8; o++) {
+            if(_octantNodes[o].empty()) continue;
+            uint32_t base = _nodes.size();
+            const Node &octant = _octantNodes[o][0];
+            weightedSum += octant.centerOfMass * octant.mass;
+            positionSum += octant.centerOfMass * (float)(octantStart[o + 1] - octantStart[o]);
+            _nodes[0].mass += octant.mass;
+            for(size_t n = 0; n < _octantNodes[o].size(); n++) {
+                Node node = _octantNodes[o][n];
+                node.skip += base;
+                _nodes.push_back(node);
+            }
+        }
+        _nodes[0].centerOfMass = _nodes[0].mass > 0.0f ? weightedSum / _nodes[0].mass : positionSum / (float)numBodies;
+        _nodes[0].skip = _nodes.size();
+    }
+
+    // walk the tree for each body, in morton order so neighbouring bodies share cache lines
+    parallelFor(numBodies, 256, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            uint32_t body = _order[i];
+            accelerations[body] = accelerationAt(i, positions, masses);
+            if(withAttractors) {
+                accelerations[body] += attractorAcceleration(positions[body]);
+            }
+        }
+    });
+}
+
+void NBodySolver::buildSubtree(uint32_t begin, uint32_t end, int level, float size, std::vector<Node> &nodes) {
+    uint32_t index = nodes.size();
+    Node node;
+    node.size = size;
+    node.firstBody = begin;
+    node.lastBody = end;
+    node.numBodies = 0;
+    nodes.push_back(node);
+
+    glm::vec3 weightedSum(0.0f);
+    glm::vec3 positionSum(0.0f);
+    float mass = 0.0f;
+
+    if(end - begin <= LEAF_SIZE || level >= MAX_DEPTH) {
+        for(uint32_t i = begin; i < end; i++) {
+            uint32_t body = _order[i];
+            weightedSum += _positions[body] * _masses[body];
+            positionSum += _positions[body];
+            mass += _masses[body];
+        }
+        nodes[index].numBodies = end - begin;
+    } else {
+        // the codes are sorted so each child octant is a contiguous run
+        const int SHIFT = 3 * (MAX_DEPTH - 1 - level);
+        uint32_t childBegin = begin;
+        while(childBegin < end) {
+            uint64_t digit = (_sortKeys[childBegin].first >> SHIFT) & 7;
+            uint32_t childEnd = childBegin + 1;
+            while(childEnd < end && ((_sortKeys[childEnd].first >> SHIFT) & 7) == digit) {
+                childEnd++;
+            }
+            uint32_t child = nodes.size();
+            buildSubtree(childBegin, childEnd, level + 1, size * 0.5f, nodes);
+            weightedSum += nodes[child].centerOfMass * nodes[child].mass;
+            positionSum += nodes[child].centerOfMass * (float)(childEnd - childBegin);
+            mass += nodes[child].mass;
+            childBegin = childEnd;
+        }
+    }
+
+    nodes[index].mass = mass;
+    nodes[index].centerOfMass = mass > 0.0f ? weightedSum / mass : positionSum / (float)(end - begin);
+    nodes[index].skip = nodes.size();
+}
+
+glm::vec3 NBodySolver::accelerationAt(uint32_t sorted, const glm::vec3 *positions, const float *masses) const {
+    const uint32_t body = _order[sorted];
+    const glm::vec3 p = positions[body];
+    glm::vec3 acceleration(0.0f);
+
+    uint32_t n = 0;
+    const uint32_t NUM_NODES = _nodes.size();
+    while(n < NUM_NODES) {
+        const Node &node = _nodes[n];
+        if(node.numBodies > 0) {
+            // leaf - sum the bodies directly
+            for(uint32_t i = node.firstBody; i < node.firstBody + node.numBodies; i++) {
+                uint32_t other = _order[i];
+                if(other == body) continue;
+                glm::vec3 r = positions[other] - p;
+                float invDist = 1.0f / std::sqrt(glm::dot(r, r) + _epsilon2);
+                acceleration += r * (masses[other] * invDist * invDist * invDist);
+            }
+            n = node.skip;
+        } else {
+            glm::vec3 r = node.centerOfMass - p;
+            float dist2 = glm::dot(r, r);
+            // a cell holding the body is always opened, its center of mass includes the body itself
+            bool containsBody = sorted >= node.firstBody && sorted < node.lastBody;
+            if(!containsBody && node.size * node.size < _theta2 * dist2) {
+                // far enough away to treat the whole cell as one mass
+                float invDist = 1.0f / std::sqrt(dist2 + _epsilon2);
+                acceleration += r * (node.mass * invDist * invDist * invDist);
+                n = node.skip;
+            } else {
+                n++;                    // open the cell, its first child follows it
+            }
+        }
+    }
+    return acceleration * _g;
+}
+
+glm::vec3 NBodySolver::attractorAcceleration(const glm::vec3 &position) const {
+    glm::vec3 acceleration(0.0f);
+    for(size_t i = 0; i < _attractors.size(); i++) {
+        glm::vec3 r = _attractors[i].position - position;
+        float invDist = 1.0f / std::sqrt(glm::dot(r, r) + _epsilon2);
+        acceleration += r * (_attractors[i].gm * invDist * invDist * invDist);
+    }
+    return acceleration;
+}
+
+void NBodySolver::computeAccelerationsBruteForce(const glm::vec3 *positions, const float *masses, size_t numBodies, glm::vec3 *accelerations) {
+    parallelFor(numBodies, 64, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            glm::vec3 acceleration(0.0f);
+            for(size_t j = 0; j < numBodies; j++) {
+                if(i == j) continue;
+                glm::vec3 r = positions[j] - positions[i];
+                float invDist = 1.0f / std::sqrt(glm::dot(r, r) + _epsilon2);
+                acceleration += r * (masses[j] * invDist * invDist * invDist);
+            }
+            accelerations[i] = acceleration * _g + attractorAcceleration(positions[i]);
+        }
+    });
+}
+
+double NBodySolver::computePotentialEnergy(const glm::vec3 *positions, const float *masses, size_t numBodies) {
+    // each worker sums into its own slot so the total does not depend on scheduling
+    std::vector<double> partialSums(numBodies, 0.0);
+    parallelFor(numBodies, 64, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            double energy = 0.0;
+            for(size_t j = i + 1; j < numBodies; j++) {
+                glm::vec3 r = positions[j] - positions[i];
+                energy -= _g * masses[i] * masses[j] / std::sqrt(glm::dot(r, r) + _epsilon2);
+            }
+            for(size_t a = 0; a < _attractors.size(); a++) {
+                glm::vec3 r = _attractors[a].position - positions[i];
+                energy -= _attractors[a].gm * masses[i] / std::sqrt(glm::dot(r, r) + _epsilon2);
+            }
+            partialSums[i] = energy;
+        }
+    });
+    double energy = 0.0;
+    for(size_t i = 0; i < numBodies; i++) {
+        energy += partialSums[i];
+    }
+    return energy;
+}
@@ -0,0 +1,112 @@
+//
+// Barnes-Hut N-body gravity solver.
+//
+// Every call to computeAccelerations() rebuilds an octree over the bodies and
+// walks it once per body.  A cell whose size divided by its distance to the body
+// is below the opening angle theta is treated as a single point mass at its
+// center of mass, giving O(n log n) work instead of the O(n^2) pairwise sum.
+// The cells holding the body itself are always opened, so however large theta
+// is a body never pulls on itself through its own cell's center of mass.
+//
+// The tree is built from bodies sorted by their Morton code.  The eight top level
+// octants are built in parallel into their own node lists and then concatenated.
+// Nodes are stored in depth first order with a skip index to the node following
+// their subtree so the traversal needs no stack.
+//
+// Fixed attractors (the black hole) are added on top of the body-body forces.
+//
+
+#ifndef LAB10_NBODYSOLVER_H
+#define LAB10_NBODYSOLVER_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <cstdint>
+#include <vector>
+
+#include "JobSystem.h"
+
+struct Attractor {
+    glm::vec3 position;
+    float gm;                           // gravitational constant times mass
+};
+
+class NBodySolver {
+public:
+
+    NBodySolver();
+
+    // optional worker pool for the build and force passes, runs serially without one
+    void setJobSystem(JobSystem *jobSystem);
+
+    void setGravitationalConstant(float g);
+    void setSoftening(float epsilon);   // keeps close encounters finite
+    void setOpeningAngle(float theta);  // 0 is exact, larger is faster and less accurate
+
+    void clearAttractors();
+    void addAttractor(const Attractor &attractor);
+    const std::vector<Attractor>& getAttractors() const;
+    float getSoftening() const;
+
+    // acceleration at a point from the attractors alone
+    glm::vec3 attractorAcceleration(const glm::vec3 &position) const;
+
+    // Barnes-Hut accelerations on every body from every other body plus the attractors
+    void computeAccelerations(const glm::vec3 *positions, const float *masses, size_t numBodies, glm::vec3 *accelerations);
+
+    // the same without the attractors, for integrators that step the attractors separately
+    void computeMutualAccelerations(const glm::vec3 *positions, const float *masses, size_t numBodies, glm::vec3 *accelerations);
+
+    // total softened potential energy of the bodies and attractors, O(n^2) so only for diagnostics
+    double computePotentialEnergy(const glm::vec3 *positions, const float *masses, size_t numBodies);
+
+    // O(n^2) pairwise reference used to check the accuracy of the tree
+    void computeAccelerationsBruteForce(const glm::vec3 *positions, const float *masses, size_t numBodies, glm::vec3 *accelerations);
+
+    size_t getNumNodes() const;
+
+private:
+
+    struct Node {
+        glm::vec3 centerOfMass;
+        float mass;
+        float size;                     // edge length of the cell
+        uint32_t skip;                  // node index after this subtree
+        uint32_t firstBody;             // range in _order of the whole subtree
+        uint32_t lastBody;              // one past the end of it
+        uint32_t numBodies;             // bodies summed directly for leaves, 0 for internal nodes
+    };
+
+    static const uint32_t LEAF_SIZE = 8;
+    static const int MAX_DEPTH = 21;    // bits per axis in the Morton code
+
+    static uint64_t expandBits(uint32_t v);
+
+    // builds the subtree over _order[begin, end) whose codes share the bits above level into nodes
+    void buildSubtree(uint32_t begin, uint32_t end, int level, float size, std::vector<Node> &nodes);
+
+    void solve(const glm::vec3 *positions, const float *masses, size_t numBodies, glm::vec3 *accelerations, bool withAttractors);
+
+    // of the body at index sorted in _order
+    glm::vec3 accelerationAt(uint32_t sorted, const glm::vec3 *positions, const float *masses) const;
+
+    void parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func);
+
+    JobSystem *_jobSystem;
+    float _g;
+    float _epsilon2;
+    float _theta2;
+    std::vector<Attractor> _attractors;
+
+    // build state reused between steps
+    const glm::vec3 *_positions;
+    const float *_masses;
+    std::vector<uint64_t> _codes;
+    std::vector<uint32_t> _order;       // body indices sorted by Morton code
+    std::vector<std::pair<uint64_t, uint32_t> > _sortKeys;
+    std::vector<Node> _nodes;
+    std::vector<Node> _octantNodes[8];
+};
+
+#endif //LAB10_NBODYSOLVER_H
@@ -0,0 +1,127 @@
+//
+// Drops particles the camera cannot see before they are sorted and uploaded.
+//
+
+#include "ParticleCuller.h"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLE_CULLER_SSE
+#endif
+
+ParticleCuller::ParticleCuller() {
+    // nothing is culled until setView()
+    for(int p = 0; p < 6; p++) {
+        _planes[p] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    _clipW = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    _radius = 0.0f;
+    _maxW = FLT_MAX;
+}
+
+void ParticleCuller::setView(const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix, float radius,
+                             float viewportHeight, float minPixels) {
+    glm::mat4 viewProjection = projectionMatrix * viewMatrix;
+    glm::vec4 rows[4];
+    for(int r = 0; r < 4; r++) {
+        rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+    }
+    // left, right, bottom, top, near, far
+    for(int axis = 0; axis < 3; axis++) {
+        _planes[axis * 2] = rows[3] + rows[axis];
+        _planes[axis * 2 + 1] = rows[3] - rows[axis];
+    }
+    for(int p = 0; p < 6; p++) {
+        glm::vec4 &plane = _planes[p];
+        float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+        if(length > 0.0f) plane = plane * (1.0f / length);
+    }
+    _clipW = rows[3];
+    _radius = radius;
+
+    // a sprite of radius r at clip w covers r * P[1][1] * height / w pixels
+    _maxW = FLT_MAX;
+    if(viewportHeight > 0.0f && minPixels > 0.0f) {
+        _maxW = radius * projectionMatrix[1][1] * viewportHeight / minPixels;
+    }
+}
+
+bool ParticleCuller::isVisible(const glm::vec3 &position) const {
+    // summed in the same order as the SSE path, so both keep exactly the same particles
+    for(int p = 0; p < 6; p++) {
+        const glm::vec4 &plane = _planes[p];
+        if((plane.x * position.x + plane.y * position.y) + (plane.z * position.z + plane.w) < -_radius) return false;
+    }
+    return (_clipW.x * position.x + _clipW.y * position.y) + (_clipW.z * position.z + _clipW.w) <= _maxW;
+}
+
+size_t ParticleCuller::cullRange(const glm::vec3 *positions, size_t first, size_t count, glm::vec3 *visible, uint32_t *sources,
+                                 size_t numVisible) const {
+    for(size_t i = first; i < count; i++) {
+        if(isVisible(positions[i])) {
+            if(sources != nullptr) sources[numVisible] = i;
+            visible[numVisible++] = positions[i];
+        }
+    }
+    return numVisible;
+}
+
+size_t ParticleCuller::cullScalar(const glm::vec3 *positions, size_t count, glm::vec3 *visible, uint32_t *sources) const {
+    return cullRange(positions, 0, count, visible, sources, 0);
+}
+
+size_t ParticleCuller::cull(const glm::vec3 *positions, size_t count, glm::vec3 *visible, uint32_t *sources) const {
+    size_t i = 0;
+    size_t numVisible = 0;
+#ifdef PARTICLE_CULLER_SSE
+    // four particles per pass, one axis per register, every plane is a multiply-add and a compare
+    const __m128 NEGATIVE_RADIUS = _mm_set1_ps(-_radius);
+    const __m128 MAX_W = _mm_set1_ps(_maxW);
+    __m128 planes[6][4];
+    for(int p = 0; p < 6; p++) {
+        for(int c = 0; c < 4; c++) {
+            planes[p][c] = _mm_set1_ps(_planes[p][c]);
+        }
+    }
+    __m128 clipW[4];
+    for(int c = 0; c < 4; c++) {
+        clipW[c] = _mm_set1_ps(_clipW[c]);
+    }
+    for(; i + 4 <= count; i += 4) {
+        const glm::vec3 *p = positions + i;
+        __m128 x = _mm_set_ps(p[3].x, p[2].x, p[1].x, p[0].x);
+        __m128 y = _mm_set_ps(p[3].y, p[2].y, p[1].y, p[0].y);
+        __m128 z = _mm_set_ps(p[3].z, p[2].z, p[1].z, p[0].z);
+
+        __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(clipW[0], x), _mm_mul_ps(clipW[1], y)),
+                              _mm_add_ps(_mm_mul_ps(clipW[2], z), clipW[3]));
+        __m128 inside = _mm_cmple_ps(w, MAX_W);
+        for(int plane = 0; plane < 6; plane++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[plane][0], x), _mm_mul_ps(planes[plane][1], y)),
+                                         _mm_add_ps(_mm_mul_ps(planes[plane][2], z), planes[plane][3]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, NEGATIVE_RADIUS));
+        }
+
+        // write the survivors one after another, usually all four or none
+        int mask = _mm_movemask_ps(inside);
+        if(mask == 0xF && sources == nullptr) {
+            visible[numVisible] = p[0];
+            visible[numVisible + 1] = p[1];
+            visible[numVisible + 2] = p[2];
+            visible[numVisible + 3] = p[3];
+            numVisible += 4;
+        } else if(mask != 0) {
+            for(int lane = 0; lane < 4; lane++) {
+                if(mask & (1 << lane)) {
+                    if(sources != nullptr) sources[numVisible] = i + lane;
+                    visible[numVisible++] = p[lane];
+                }
+            }
+        }
+    }
+#endif
+    return cullRange(positions, i, count, visible, sources, numVisible);
+}
@@ -0,0 +1,50 @@
+//
+// Drops particles the camera cannot see before they are sorted and uploaded.
+//
+// A particle survives if its sprite's bounding sphere touches the view
+// frustum and it covers at least minPixels on screen.  For a perspective
+// projection the sprite's size on screen only depends on its clip space w,
+// so the size test is a single compare against the w at which sprites shrink
+// below the threshold.  The six planes are taken straight from the
+// view-projection matrix (Gribb and Hartmann) and normalized, so the sphere
+// test is a dot product per plane.  With SSE four particles are tested per
+// pass and the survivors are written out compactly in their original order.
+//
+
+#ifndef LAB10_PARTICLECULLER_H
+#define LAB10_PARTICLECULLER_H
+
+// include GLM libraries
+#include <glm/glm.hpp>
+
+// include C and C++ libraries
+#include <cstddef>
+#include <cstdint>
+
+class ParticleCuller {
+public:
+    ParticleCuller();
+
+    // the frustum and size threshold for this frame.  radius bounds a sprite in world units and
+    // viewportHeight is in pixels, a viewportHeight or minPixels of zero turns the size test off
+    void setView(const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix, float radius,
+                 float viewportHeight, float minPixels);
+
+    // copies the positions that pass into visible, which must have room for count, and returns how many did.
+    // sources, when given, gets the index each survivor had in positions
+    size_t cull(const glm::vec3 *positions, size_t count, glm::vec3 *visible, uint32_t *sources = nullptr) const;
+    size_t cullScalar(const glm::vec3 *positions, size_t count, glm::vec3 *visible, uint32_t *sources = nullptr) const;
+
+private:
+    bool isVisible(const glm::vec3 &position) const;
+    // cullScalar() over positions[first, count), appending after numVisible survivors
+    size_t cullRange(const glm::vec3 *positions, size_t first, size_t count, glm::vec3 *visible, uint32_t *sources,
+                     size_t numVisible) const;
+
+    glm::vec4 _planes[6];               // xyz the inward normal, w the distance, all normalized
+    glm::vec4 _clipW;                   // row of the view-projection that gives clip space w
+    float _radius;
+    float _maxW;                        // farther than this a sprite is below the size threshold
+};
+
+#endif //LAB10_PARTICLECULLER_H
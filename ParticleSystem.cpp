@@ -6,6 +6,9 @@
 #include "ParticleSystem.h"
 #include "Particle.cpp"
 
+#include <algorithm>            // for sort
+#include <cstring>              // for memcpy
+
 
 // helper functions
 
@@ -18,12 +21,39 @@ void particleComputeAndSendTransformationMatrices(glm::mat4 modelMatrix, glm::ma
     glUniformMatrix4fv(projMtxLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 }
 
+// rounds to the nearest half float, flushing what is too small to zero and clamping what is too big
+static GLushort packHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if(exponent <= 0) return sign;
+    if(exponent >= 31) return sign | 0x7BFF;
+    // a carry out of the mantissa rounds up into the exponent, as it should
+    uint32_t half = ((uint32_t)exponent << 10 | mantissa >> 13) + ((mantissa >> 12) & 1);
+    return sign | (half > 0x7BFF ? 0x7BFF : half);
+}
+
 
-ParticleSystem::ParticleSystem() {};
+const size_t ParticleSystem::RESERVED_PARTICLES;
+const GLfloat ParticleSystem::SPRITE_HALF_SIZE = 0.2f;
+const GLfloat ParticleSystem::SPIN_PER_UPDATE = 0.02f;
+const float ParticleSystem::SPRITE_RADIUS = ParticleSystem::SPRITE_HALF_SIZE * 1.41421356f;   // the corner of the quad
+
+ParticleSystem::ParticleSystem() : _localArena(64 * 1024) {};
 
 // initiallizes particle vectors for black hole
 void ParticleSystem::initialize(glm::vec3 startLoc, float radius) {
-    ParticleSystem::_particles = vector<Particle>();
+    _positions.clear();
+    _velocities.clear();
+    _lifespans.clear();
+    _types.clear();
+    // room for the usual number alive up front, so steady state updates never reallocate them
+    _positions.reserve(RESERVED_PARTICLES);
+    _velocities.reserve(RESERVED_PARTICLES);
+    _lifespans.reserve(RESERVED_PARTICLES);
+    _types.reserve(RESERVED_PARTICLES);
 
     // initalize the important variables
     _velocityRange = glm::vec2(.005, .05);
@@ -31,7 +61,8 @@ void ParticleSystem::initialize(glm::vec3 startLoc, float radius) {
     _pos = startLoc;
     _maxLifespan = 20;
     _spawnRate = 20;
-    numParticles = 50;     // have a max of 50 particles on the screen
+    _gravity = glm::vec3(0.0f);
+    numParticles = 64;     // the draw buffers grow when more are alive
     // setup flat shader
     glm::vec3 flatColor(1.0f, 1.0f, 1.0f);
     _flatShaderProgram->useProgram();
@@ -47,7 +78,9 @@ void ParticleSystem::setParticleShaderUandA(CSCI441::ShaderProgram &lightingShad
     _particleShaderAttributes = lightingShaderAttributes;
     _particleShaderProgram = &lightingShader;
     // sets up textures as well
-    particleTextureHandle = CSCI441::TextureUtils::loadAndRegisterTexture("assets/textures/Whoosh.png");
+    particleTextureHandle = ResourceRegistry::loadTexture(OWNER_PARTICLES, "assets/textures/Whoosh.png");
+    // instanced sprites always draw from a flipbook, this one has a single frame
+    if(particleTextureHandle != 0) buildFlipbook(&particleTextureHandle, 1, 1, 1, 1);
 }
 
 // set up shader attributes
@@ -59,11 +92,227 @@ void ParticleSystem::setFlatShaderUandA(CSCI441::ShaderProgram &lightingShader,
     // sets up textures as well
 }
 
+void ParticleSystem::setOITShaderUandA(CSCI441::ShaderProgram &oitShader, ParticleShaderUniforms &oitShaderUniforms,
+                                       ParticleShaderAttributes &oitShaderAttributes) {
+    _oitShaderProgram = &oitShader;
+    _oitShaderUniforms = oitShaderUniforms;
+    _oitShaderAttributes = oitShaderAttributes;
+}
+
+void ParticleSystem::setBlendMode(BlendMode mode) {
+    _blendMode = mode;
+}
+
+ParticleSystem::BlendMode ParticleSystem::getBlendMode() const {
+    return _blendMode;
+}
+
+void ParticleSystem::setInstancedShaderUandA(CSCI441::ShaderProgram &instancedShader, InstancedParticleShaderUniforms &instancedShaderUniforms,
+                                             InstancedParticleShaderAttributes &instancedShaderAttributes) {
+    _instancedShaderProgram = &instancedShader;
+    _instancedShaderUniforms = instancedShaderUniforms;
+    _instancedShaderAttributes = instancedShaderAttributes;
+}
+
+void ParticleSystem::setInstancedOITShaderUandA(CSCI441::ShaderProgram &instancedShader, InstancedParticleShaderUniforms &instancedShaderUniforms,
+                                                InstancedParticleShaderAttributes &instancedShaderAttributes) {
+    _instancedOITShaderProgram = &instancedShader;
+    _instancedOITShaderUniforms = instancedShaderUniforms;
+    _instancedOITShaderAttributes = instancedShaderAttributes;
+}
+
+void ParticleSystem::setBillboardPath(BillboardPath path) {
+    _billboardPath = path;
+}
+
+ParticleSystem::BillboardPath ParticleSystem::getBillboardPath() const {
+    return _billboardPath;
+}
+
+void ParticleSystem::setTint(glm::vec3 tint) {
+    _tint = tint;
+}
+
+bool ParticleSystem::setFlipbook(const char *sheetFilename, GLint columns, GLint rows, GLint numFrames, GLfloat framesPerUpdate, bool blend) {
+    GLuint sheet = ResourceRegistry::loadTexture(OWNER_PARTICLES, sheetFilename);
+    if(sheet == 0) {
+        fprintf(stderr, "[ERROR]: could not load flipbook %s\n", sheetFilename);
+        return false;
+    }
+    bool built = buildFlipbook(&sheet, 1, columns, rows, numFrames);
+    ResourceRegistry::deleteTextures(1, &sheet);
+    if(!built) return false;
+
+    flipbookFramesPerUpdate = framesPerUpdate;
+    blendFlipbookFrames = blend;
+    fprintf(stdout, "[INFO]: flipbook of %d frames read from %s\n", numFrames, sheetFilename);
+    return true;
+}
+
+bool ParticleSystem::setFlipbook(const char * const *frameFilenames, GLint numFrames, GLfloat framesPerUpdate, bool blend) {
+    std::vector<GLuint> frames(numFrames > 0 ? numFrames : 0, 0);
+    bool loaded = numFrames > 0;
+    for(GLint f = 0; f < numFrames && loaded; f++) {
+        frames[f] = ResourceRegistry::loadTexture(OWNER_PARTICLES, frameFilenames[f]);
+        if(frames[f] == 0) {
+            fprintf(stderr, "[ERROR]: could not load flipbook frame %s\n", frameFilenames[f]);
+            loaded = false;
+        }
+    }
+    bool built = loaded && buildFlipbook(&frames[0], numFrames, 1, 1, numFrames);
+    for(GLint f = 0; f < numFrames; f++) {
+        if(frames[f] != 0) ResourceRegistry::deleteTextures(1, &frames[f]);
+    }
+    if(!built) return false;
+
+    flipbookFramesPerUpdate = framesPerUpdate;
+    blendFlipbookFrames = blend;
+    fprintf(stdout, "[INFO]: flipbook of %d frames read from %s on\n", numFrames, frameFilenames[0]);
+    return true;
+}
+
+bool ParticleSystem::buildFlipbook(const GLuint *sources, GLint numSources, GLint columns, GLint rows, GLint numFrames) {
+    if(columns < 1 || rows < 1 || numFrames < 1 || numFrames > numSources * columns * rows) {
+        fprintf(stderr, "[ERROR]: %d flipbook frames do not fit in %d images of %dx%d\n", numFrames, numSources, columns, rows);
+        return false;
+    }
+
+    // the frames are read back once and split into layers, so filtering never bleeds between cells
+    GLuint array = 0;
+    GLint width = 0, height = 0;
+    GLint cellWidth = 0, cellHeight = 0;
+    std::vector<GLubyte> pixels;
+    GLint frame = 0;
+    for(GLint s = 0; s < numSources && frame < numFrames; s++) {
+        GLint sourceWidth = 0, sourceHeight = 0;
+        glBindTexture(GL_TEXTURE_2D, sources[s]);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &sourceWidth);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &sourceHeight);
+        if(s == 0) {
+            width = sourceWidth;
+            height = sourceHeight;
+            cellWidth = width / columns;
+            cellHeight = height / rows;
+            if(cellWidth == 0 || cellHeight == 0) break;
+            ResourceRegistry::genTextures(OWNER_PARTICLES, 1, &array);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+            ResourceRegistry::texImage3D(array, GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, cellWidth, cellHeight, numFrames, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        } else if(sourceWidth != width || sourceHeight != height) {
+            break;
+        }
+        pixels.resize((size_t)width * height * 4);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+        for(GLint cell = 0; cell < columns * rows && frame < numFrames; cell++, frame++) {
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, (cell % columns) * cellWidth);
+            // the loader flips images, so the top row of cells is the last in the texture
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, (rows - 1 - cell / columns) * cellHeight);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, frame, cellWidth, cellHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if(frame < numFrames) {
+        fprintf(stderr, "[ERROR]: flipbook images must all be the same size, and at least one pixel a cell\n");
+        if(array != 0) ResourceRegistry::deleteTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return false;
+    }
+
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    if(flipbookTexture != 0) ResourceRegistry::deleteTextures(1, &flipbookTexture);
+    flipbookTexture = array;
+    numFlipbookFrames = numFrames;
+    return true;
+}
+
+void ParticleSystem::setCullSettings(float viewportHeight, float minPixels) {
+    _cullViewportHeight = viewportHeight;
+    _cullMinPixels = minPixels;
+}
+
+size_t ParticleSystem::getNumVisible() const {
+    return _numVisible;
+}
+
+size_t ParticleSystem::getNumCulled() const {
+    return _numCulled;
+}
+
 void ParticleSystem::setCameraVariables(glm::vec3 lookAtPoint, glm::vec3 eyePos) {
     _particleShaderUniforms.lookAtPoint = lookAtPoint;
     _particleShaderUniforms.eyePos = eyePos;
 }
 
+void ParticleSystem::setGPUSorting(bool enabled) {
+    _gpuSorting = enabled;
+}
+
+bool ParticleSystem::isGPUSorting() const {
+    return _gpuSorting && _depthSort.isSupported();
+}
+
+void ParticleSystem::setGravity(glm::vec3 gravity) {
+    _gravity = gravity;
+}
+
+void ParticleSystem::setMaxLifespan(GLint maxLifespan) {
+    _maxLifespan = maxLifespan;
+}
+
+void ParticleSystem::setSeed(uint32_t seed) {
+    // scrambled so nearby seeds start far apart
+    _randomState = seed * 0x9e3779b9u + 0x7f4a7c15u;
+    if(_randomState == 0) _randomState = 1;
+}
+
+float ParticleSystem::randomFloat() {
+    _randomState ^= _randomState << 13;
+    _randomState ^= _randomState >> 17;
+    _randomState ^= _randomState << 5;
+    return (_randomState >> 8) * (1.0f / 16777215.0f);
+}
+
+void ParticleSystem::setFrameArena(FrameArena *arena) {
+    _frameArena = arena;
+}
+
+void ParticleSystem::setFluidSolver(FluidSolver *solver) {
+    _fluidSolver = solver;
+}
+
+void ParticleSystem::setForceVolumes(const ForceVolumes *volumes) {
+    _forceVolumes = volumes;
+}
+
+void ParticleSystem::setTurbulence(const CurlNoiseField *field, float strength, float scale) {
+    _turbulence = field;
+    _turbulenceStrength = strength;
+    _turbulenceScale = scale;
+}
+
+void ParticleSystem::setCollisionMesh(const TriangleBVH *mesh, CollisionResponse response, float restitution) {
+    _collisionMesh = mesh;
+    _collisionResponse = response;
+    _restitution = restitution;
+}
+
+void ParticleSystem::setCollisionField(const SignedDistanceField *field, CollisionResponse response, float restitution) {
+    _collisionField = field;
+    _collisionResponse = response;
+    _restitution = restitution;
+}
+
 
 // update function updates every particle
 void ParticleSystem::update(int timePassed, int timeThroughSecond, glm::vec3 position) {
@@ -71,19 +320,81 @@ void ParticleSystem::update(int timePassed, int timeThroughSecond, glm::vec3 pos
     //update position
     _pos = position;
 
-    vector<int> deadParticles;
-    // update particles and find particles that should die
-    for(int i = 0; i < _particles.size(); i++) {
-        _particles[i].updatePosition();
-        if(_particles[i].getLifespan() >= _maxLifespan) {
-            deadParticles.push_back(i);
+    // scratch space for this update comes from the frame arena, when the owner resets it it is not ours to
+    FrameArena &arena = _frameArena != nullptr ? *_frameArena : _localArena;
+    if(_frameArena == nullptr) _localArena.reset();
+    const size_t count = _positions.size();
+
+    // pressure and viscosity between the fountain particles
+    if(_fluidSolver != nullptr) {
+        uint32_t *fluidIndices = arena.allocate<uint32_t>(count);
+        glm::vec3 *fluidPositions = arena.allocate<glm::vec3>(count);
+        glm::vec3 *fluidVelocities = arena.allocate<glm::vec3>(count);
+        glm::vec3 *fluidAccelerations = arena.allocate<glm::vec3>(count);
+        size_t numFluid = 0;
+        for(size_t i = 0; i < count; i++) {
+            if(_types[i] != 0) continue;
+            fluidIndices[numFluid] = i;
+            fluidPositions[numFluid] = _positions[i];
+            fluidVelocities[numFluid] = _velocities[i];
+            numFluid++;
+        }
+        if(numFluid > 0) {
+            _fluidSolver->computeAccelerations(fluidPositions, fluidVelocities, numFluid, fluidAccelerations);
         }
+        for(size_t f = 0; f < numFluid; f++) {
+            _velocities[fluidIndices[f]] += fluidAccelerations[f];
+        }
+    }
+
+    // the force volumes only test the particles in chunks they overlap
+    if(_forceVolumes != nullptr && count > 0) {
+        _forceVolumes->apply(&_positions[0], &_velocities[0], count, arena);
+    }
+
+    // look up the turbulence for everyone in one batch, it carries particles along without changing their velocity
+    glm::vec3 *drift = arena.allocate<glm::vec3>(count);
+    for(size_t i = 0; i < count; i++) {
+        drift[i] = glm::vec3(0.0f);
+    }
+    if(_turbulence != nullptr && count > 0) {
+        _turbulence->addVelocities(&_positions[0], drift, count, _turbulenceScale, _turbulenceStrength);
     }
 
-    // remove dead particles
-    for(int n = deadParticles.size()-1; n >= 0; n--) {
-        _particles.erase(_particles.begin() + deadParticles.at(n));
+    // move every particle, packing the survivors towards the front as we go
+    size_t alive = 0;
+    for(size_t i = 0; i < count; i++) {
+        GLint lifespan = _lifespans[i] + 1;
+        if(lifespan >= _maxLifespan) continue;
+        glm::vec3 velocity = _velocities[i] + _gravity;
+        glm::vec3 next = _positions[i] + velocity + drift[i];
+
+        // sweep the move so fast particles cannot tunnel through thin walls
+        RayHit hit;
+        if(_collisionField != nullptr) {
+            if(_collisionField->intersectSegment(_positions[i], next, hit.t, hit.normal)) {
+                if(_collisionResponse == KILL) continue;
+                // the field's surface is fuzzy by a voxel or so, so back off by half of one
+                velocity -= (1.0f + _restitution) * glm::dot(velocity, hit.normal) * hit.normal;
+                next = _positions[i] + (next - _positions[i]) * hit.t + hit.normal * (0.5f * _collisionField->getVoxelSize());
+            }
+        } else if(_collisionMesh != nullptr && _collisionMesh->intersectSegment(_positions[i], next, hit)) {
+            if(_collisionResponse == KILL) continue;
+            // stop at the wall and reflect, the rest of this update's move is dropped
+            velocity -= (1.0f + _restitution) * glm::dot(velocity, hit.normal) * hit.normal;
+            next = _positions[i] + (next - _positions[i]) * hit.t + hit.normal * 1e-3f;
+        }
+
+        _positions[alive] = next;
+        _velocities[alive] = velocity;
+        _lifespans[alive] = lifespan;
+        _types[alive] = _types[i];
+        alive++;
     }
+    _positions.resize(alive);
+    _velocities.resize(alive);
+    _lifespans.resize(alive);
+    _types.resize(alive);
 
     // make new particles
     int amount = 1000/_spawnRate;
@@ -94,173 +405,356 @@ void ParticleSystem::update(int timePassed, int timeThroughSecond, glm::vec3 pos
         if(std::floor(timeThroughSecond/amount) > std::floor((timeThroughSecond-timePassed)/amount))
             fn = 1;
     }
+    // grow the arrays once and write the new fountain particles straight into them
+    size_t first = _positions.size();
+    _positions.resize(first + fn);
+    _velocities.resize(first + fn);
+    _lifespans.resize(first + fn, 0);
+    _types.resize(first + fn, 0);
     for(int n = 0; n < fn; n++) {
         glm::vec3 position;
         glm::vec3 velocity;
-        float theta = glm::radians((rand() / (GLfloat)RAND_MAX * 360));
-        float phi = glm::radians((rand() / (GLfloat)RAND_MAX * 360));
-        float velocityScaler = ((rand() / (GLfloat)RAND_MAX * (_velocityRange.y - _velocityRange.x)) + _velocityRange.x);
+        float theta = glm::radians((randomFloat() * 360));
+        float phi = glm::radians((randomFloat() * 360));
+        float velocityScaler = ((randomFloat() * (_velocityRange.y - _velocityRange.x)) + _velocityRange.x);
         velocity = glm::vec3(sin(phi) * cos(theta), sin(phi) * sin(theta), cos(phi));
         position = _pos + _radius * velocity;
         velocity = velocity * velocityScaler;
 
-        Particle particle = Particle(position, velocity, 0);
-        _particles.push_back(particle);
+        _positions[first + n] = position;
+        _velocities[first + n] = velocity;
         //fprintf(stdout, "\nfountain amount: %i", fn);
     }
 
 }
 
 
+void ParticleSystem::saveCheckpoint(CheckpointWriter &checkpoint) const {
+    EmitterState emitter = EmitterState();      // no stray bytes in the file
+    emitter.position = _pos;
+    emitter.radius = _radius;
+    emitter.velocityRange = _velocityRange;
+    emitter.maxLifespan = _maxLifespan;
+    emitter.spawnRate = _spawnRate;
+    emitter.gravity = _gravity;
+
+    checkpoint.add(PARTICLE_POSITIONS, _positions);
+    checkpoint.add(PARTICLE_VELOCITIES, _velocities);
+    checkpoint.add(PARTICLE_LIFESPANS, _lifespans);
+    checkpoint.add(PARTICLE_TYPES, _types);
+    checkpoint.addValue(PARTICLE_EMITTER, emitter);
+    checkpoint.addValue(PARTICLE_RANDOM_STATE, _randomState);
+}
+
+bool ParticleSystem::canRestoreCheckpoint(const CheckpointReader &checkpoint) const {
+    size_t numParticles = 0, numVelocities = 0, numLifespans = 0, numTypes = 0;
+    EmitterState emitter;
+    uint32_t randomState;
+    return checkpoint.getCount<glm::vec3>(PARTICLE_POSITIONS, numParticles) && checkpoint.getCount<glm::vec3>(PARTICLE_VELOCITIES, numVelocities)
+        && checkpoint.getCount<GLint>(PARTICLE_LIFESPANS, numLifespans) && checkpoint.getCount<GLint>(PARTICLE_TYPES, numTypes)
+        && numVelocities == numParticles && numLifespans == numParticles && numTypes == numParticles
+        && checkpoint.readValue(PARTICLE_EMITTER, emitter) && checkpoint.readValue(PARTICLE_RANDOM_STATE, randomState);
+}
+
+bool ParticleSystem::restoreCheckpoint(const CheckpointReader &checkpoint) {
+    // check everything is there before changing anything
+    if(!canRestoreCheckpoint(checkpoint)) return false;
+    EmitterState emitter;
+    uint32_t randomState;
+    checkpoint.readValue(PARTICLE_EMITTER, emitter);
+    checkpoint.readValue(PARTICLE_RANDOM_STATE, randomState);
+
+    checkpoint.read(PARTICLE_POSITIONS, _positions);
+    checkpoint.read(PARTICLE_VELOCITIES, _velocities);
+    checkpoint.read(PARTICLE_LIFESPANS, _lifespans);
+    checkpoint.read(PARTICLE_TYPES, _types);
+    _pos = emitter.position;
+    _radius = emitter.radius;
+    _velocityRange = emitter.velocityRange;
+    _maxLifespan = emitter.maxLifespan;
+    _spawnRate = emitter.spawnRate;
+    _gravity = emitter.gravity;
+    _randomState = randomState;
+    return true;
+}
+
+
+
+void ParticleSystem::getParticlePositions(std::vector<glm::vec3> &positions) {
+    positions.assign(_positions.begin(), _positions.end());
+}
+
+size_t ParticleSystem::getNumParticles() const {
+    return _positions.size();
+}
+
+glm::vec3* ParticleSystem::getPositions() {
+    return _positions.empty() ? nullptr : &_positions[0];
+}
+
+glm::vec3* ParticleSystem::getVelocities() {
+    return _velocities.empty() ? nullptr : &_velocities[0];
+}
+
+
 void ParticleSystem::drawBoundings(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, glm::mat4 modelMatrix) {
     _flatShaderProgram->useProgram();
 
     glm::mat4 mvpMatrix = projectionMatrix * viewMatrix * modelMatrix;
     glUniformMatrix4fv(_flatShaderUniforms.mvpMatrix, 1, GL_FALSE, &mvpMatrix[0][0]);
 
+    if(_forceVolumes == nullptr) return;
 
-//    for(int i = 0; i < _clouds.size(); i++) {
-//        // draw the points of the wind bounding box
-//        int windPoints = 8;
-//        glm::vec3 windPositions[windPoints];
-//        GLushort windIndices[] = {0,1,2,3,4,5,6,7};
-//
-//        windPositions[0] = _clouds[i].lowerCorner;
-//        windPositions[1] = glm::vec3(_clouds[i].lowerCorner.x,_clouds[i].lowerCorner.y,_clouds[i].upperCorner.z);
-//        windPositions[2] = glm::vec3(_clouds[i].upperCorner.x,_clouds[i].lowerCorner.y,_clouds[i].lowerCorner.z);
-//        windPositions[3] = glm::vec3(_clouds[i].lowerCorner.x,_clouds[i].upperCorner.y,_clouds[i].lowerCorner.z);
-//        windPositions[4] = glm::vec3(_clouds[i].upperCorner.x,_clouds[i].lowerCorner.y,_clouds[i].upperCorner.z);
-//        windPositions[5] = glm::vec3(_clouds[i].upperCorner.x,_clouds[i].upperCorner.y,_clouds[i].lowerCorner.z);
-//        windPositions[6] = glm::vec3(_clouds[i].lowerCorner.x,_clouds[i].upperCorner.y,_clouds[i].upperCorner.z);
-//        windPositions[7] = _clouds[i].upperCorner;
-//
-//        glBindVertexArray( vaos[VAOS.WIND_BOUNDING] );
-//
-//        glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.WIND_BOUNDING] );
-//        glBufferData(GL_ARRAY_BUFFER, windPoints * sizeof(glm::vec3), windPositions, GL_STATIC_DRAW );
-//
-//        glEnableVertexAttribArray( _flatShaderAttributes.vPos );
-//        glVertexAttribPointer( _flatShaderAttributes.vPos, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0 );
-//
-//        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibos[VAOS.WIND_BOUNDING] );
-//        glBufferData(GL_ELEMENT_ARRAY_BUFFER, windPoints * sizeof(GLushort), windIndices, GL_STATIC_DRAW );
-//
-//        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibos[VAOS.WIND_BOUNDING] );
-//        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLushort) * windPoints, windIndices);
-//
-//        glDrawElements(GL_POINTS, windPoints, GL_UNSIGNED_SHORT, (void*)0 );
-//    }
+    // every outline in one buffer and one draw
+    _boundingLines.clear();
+    _forceVolumes->appendOutlines(_boundingLines);
+    if(_boundingLines.empty()) return;
+
+    glUniform3f(_flatShaderUniforms.color, 1.0f, 0.8f, 0.2f);
+    glBindVertexArray( vaos[VAOS.BOUNDINGS] );
+    glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.BOUNDINGS] );
+    ResourceRegistry::bufferData( vbos[VAOS.BOUNDINGS], GL_ARRAY_BUFFER, _boundingLines.size() * sizeof(glm::vec3), &_boundingLines[0], GL_STREAM_DRAW );
+    glEnableVertexAttribArray( _flatShaderAttributes.vPos );
+    glVertexAttribPointer( _flatShaderAttributes.vPos, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0 );
+    glDrawArrays( GL_LINES, 0, _boundingLines.size() );
 }
 
-void ParticleSystem::draw(glm::mat4 viewMatrix, glm::mat4 projectionMatrix) {
-    // go through each system vector and draw them with the appropriate shader
-    _particleShaderProgram->useProgram();
+void ParticleSystem::getDrawState(std::vector<glm::vec3> &positions, std::vector<GLint> &lifespans, EmitterDrawState &emitter) const {
+    positions.assign(_positions.begin(), _positions.end());
+    lifespans.assign(_lifespans.begin(), _lifespans.end());
+    emitter = getEmitterDrawState();
+}
 
-    // bind and draw water stuff
+ParticleSystem::EmitterDrawState ParticleSystem::getEmitterDrawState() const {
+    EmitterDrawState emitter;
+    emitter.origin = _pos;
+    emitter.maxLifespan = _maxLifespan;
+    emitter.tint = _tint;
+    return emitter;
+}
 
-    // bind particles to the buffer
-    int particleCounter = 0;
-    for(int n = 0; n < _particles.size(); n++) {
-        if(n >= 200) break;
-        particleLocations[particleCounter] = _particles[n].getPosition();
-        particleType[particleCounter] = _particles[n].getLifespan();
-        particleIndices[particleCounter] = particleCounter;
-        particleCounter++;
+void ParticleSystem::draw(glm::mat4 viewMatrix, glm::mat4 projectionMatrix) {
+    draw(viewMatrix, projectionMatrix, _positions.empty() ? nullptr : &_positions[0], _lifespans.empty() ? nullptr : &_lifespans[0], _positions.size(),
+         getEmitterDrawState());
+}
+
+void ParticleSystem::draw(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, const glm::vec3 *positions, const GLint *lifespans, size_t count,
+                          const EmitterDrawState &emitter) {
+    bool orderIndependent = _blendMode == WEIGHTED_OIT && _oitShaderProgram != nullptr;
+    CSCI441::ShaderProgram *instancedShaderProgram = orderIndependent ? _instancedOITShaderProgram : _instancedShaderProgram;
+    bool instanced = _billboardPath == INSTANCED_QUADS && instancedShaderProgram != nullptr;
+
+    // only what the camera can see is sorted and uploaded
+    reserveDrawBuffers(count);
+    _culler.setView(viewMatrix, projectionMatrix, SPRITE_RADIUS, _cullViewportHeight, _cullMinPixels);
+    GLuint particleCounter = count > 0 ? _culler.cull(positions, count, particleLocations, instanced ? particleSources : nullptr) : 0;
+    _numVisible = particleCounter;
+    _numCulled = count - particleCounter;
+    for(GLuint n = 0; n < particleCounter; n++) {
+        particleIndices[n] = n;
     }
 
+    if(instanced) {
+        if(orderIndependent) {
+            drawInstanced(viewMatrix, projectionMatrix, _instancedOITShaderProgram, _instancedOITShaderUniforms, _instancedOITShaderAttributes,
+                          lifespans, particleCounter, emitter, false);
+        } else {
+            bool sortOnGPU = sortsOnGPU(particleCounter);
+            if(!sortOnGPU) sortByDepth(particleCounter);
+            drawInstanced(viewMatrix, projectionMatrix, _instancedShaderProgram, _instancedShaderUniforms, _instancedShaderAttributes,
+                          lifespans, particleCounter, emitter, sortOnGPU);
+        }
+        return;
+    }
+    if(orderIndependent) {
+        drawUnsorted(viewMatrix, projectionMatrix, particleCounter);
+        return;
+    }
 
+    // bind particles to the buffer
     glBindVertexArray( vaos[VAOS.PARTICLE_SYSTEM] );
 
     glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.PARTICLE_SYSTEM] );
-    glBufferData( GL_ARRAY_BUFFER, particleCounter * sizeof(glm::vec3), particleLocations, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( vbos[VAOS.PARTICLE_SYSTEM], GL_ARRAY_BUFFER, particleCounter * sizeof(glm::vec3), particleLocations, GL_STATIC_DRAW );
 
     glEnableVertexAttribArray(_particleShaderAttributes.vPos );
     glVertexAttribPointer(_particleShaderAttributes.vPos, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0 );
 
+    // the GPU sorts the positions just uploaded and its indices are drawn as they are
+    if(sortsOnGPU(particleCounter)) {
+        glm::vec3 viewDirection = normalize(_particleShaderUniforms.lookAtPoint - _particleShaderUniforms.eyePos);
+        _depthSort.sort(vbos[VAOS.PARTICLE_SYSTEM], GPUDepthSort::FLOAT_POSITIONS, 3, particleCounter, glm::vec3(0.0f),
+                        _particleShaderUniforms.eyePos, viewDirection);
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _depthSort.getIndexBuffer() );
+    } else {
+        sortByDepth(particleCounter);
+
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibos[VAOS.PARTICLE_SYSTEM] );
+        ResourceRegistry::bufferData( ibos[VAOS.PARTICLE_SYSTEM], GL_ELEMENT_ARRAY_BUFFER, particleCounter * sizeof(GLuint), particleIndices, GL_STATIC_DRAW );
+    }
+
+    // go through each system vector and draw them with the appropriate shader
+    _particleShaderProgram->useProgram();
+
     // draw particles
     glm::mat4 modelMatrix = glm::mat4(1.0f);
     particleComputeAndSendTransformationMatrices(modelMatrix, viewMatrix, projectionMatrix,
                                                  _particleShaderUniforms.mvMatrix, _particleShaderUniforms.projMatrix);
-    glBindVertexArray( vaos[VAOS.PARTICLE_SYSTEM] );
     glBindTexture(GL_TEXTURE_2D, particleTextureHandle);
 
+    glDrawElements( GL_POINTS, particleCounter, GL_UNSIGNED_INT, (void*)0 );
+
+}
 
-    glm::vec3 lookAtPoint = _particleShaderUniforms.lookAtPoint;
-    glm::vec3 eyePos = _particleShaderUniforms.eyePos;
+void ParticleSystem::sortByDepth(GLuint particleCounter) {
     // TODO #1
     glm::vec3 v = normalize(_particleShaderUniforms.lookAtPoint - _particleShaderUniforms.eyePos);    //view vector
 
-    for(int i = 0; i < particleCounter; i++) {
+    for(GLuint i = 0; i < particleCounter; i++) {
         glm::vec3 currentSprite = particleLocations[particleIndices[i]];    //sprite position
-        glm::vec4 p = modelMatrix * glm::vec4(currentSprite, 1);    //sprite point
+        glm::vec4 p = glm::vec4(currentSprite, 1);    //sprite point
         glm::vec4 ep = p - glm::vec4(_particleShaderUniforms.eyePos, 1);         //ep vector
         float d = glm::dot(glm::vec4(v,0),ep);
         distances[i] = d;              //distance vector
     }
 
     // TODO #2
-    // sort the indices by distance
-    for(int i = 0; i < particleCounter; i++) {
-        for(int j = 1; j < particleCounter; j++) {
-            float d1 =  distances[j-i];
-            float d2 =  distances[j];
-            if(distances[j-1] < distances[j]) {
-                float temp = distances[j-1];
-                distances[j-1] = distances[j];
-                distances[j] = temp;
-                temp = particleIndices[j-1];
-                particleIndices[j-1] = particleIndices[j];
-                particleIndices[j] = temp;
-            }
-        }
-    }
+    // sort the indices by distance, farthest first.  particleIndices starts out in order,
+    // so distances is indexed by particle
+    const GLfloat *particleDistances = distances;
+    std::sort(particleIndices, particleIndices + particleCounter,
+              [particleDistances](GLuint a, GLuint b) { return particleDistances[a] > particleDistances[b]; });
+}
 
-    for(int i = 1; i < particleCounter; i++) {
-        if(distances[i-1] < distances[i])
-            printf("uh oh\n");
-    }
+bool ParticleSystem::sortsOnGPU(GLuint count) const {
+    return _gpuSorting && _depthSort.isSupported() && count <= GPUDepthSort::MAX_ELEMENTS;
+}
 
+void ParticleSystem::drawUnsorted(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, GLuint count) {
+    if(count == 0) return;
+    _oitShaderProgram->useProgram();
 
-    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibos[VAOS.PARTICLE_SYSTEM] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, particleCounter * sizeof(GLushort), particleIndices, GL_STATIC_DRAW );
-    // TODO #3
-    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibos[VAOS.PARTICLE_SYSTEM] );
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLushort) * particleCounter, particleIndices);
+    // the blending does not care about order, so the survivors go up as they are
+    glBindVertexArray( vaos[VAOS.PARTICLE_SYSTEM] );
+    glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.PARTICLE_SYSTEM] );
+    ResourceRegistry::bufferData( vbos[VAOS.PARTICLE_SYSTEM], GL_ARRAY_BUFFER, count * sizeof(glm::vec3), particleLocations, GL_STREAM_DRAW );
+    glEnableVertexAttribArray( _oitShaderAttributes.vPos );
+    glVertexAttribPointer( _oitShaderAttributes.vPos, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0 );
+
+    particleComputeAndSendTransformationMatrices(glm::mat4(1.0f), viewMatrix, projectionMatrix,
+                                                 _oitShaderUniforms.mvMatrix, _oitShaderUniforms.projMatrix);
+    glBindTexture( GL_TEXTURE_2D, particleTextureHandle );
+    glDrawArrays( GL_POINTS, 0, count );
+}
 
-    glDrawElements( GL_POINTS, particleCounter, GL_UNSIGNED_SHORT, (void*)0 );
+void ParticleSystem::drawInstanced(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, CSCI441::ShaderProgram *shaderProgram,
+                                   const InstancedParticleShaderUniforms &shaderUniforms, const InstancedParticleShaderAttributes &shaderAttributes,
+                                   const GLint *lifespans, GLuint count, const EmitterDrawState &emitter, bool sortOnGPU) {
+    if(count == 0) return;
+
+    // in draw order, growing smaller as they age.  Offsets from the emitter keep
+    // the half floats precise where the particles are
+    glm::vec3 origin = emitter.origin;
+    GLubyte tint[3];
+    for(int c = 0; c < 3; c++) {
+        tint[c] = (GLubyte)(glm::clamp(emitter.tint[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+    GLfloat lifespanScale = 1.0f / emitter.maxLifespan;
+    for(GLuint i = 0; i < count; i++) {
+        GLuint n = particleIndices[i];
+        GLfloat age = glm::clamp(lifespans[particleSources[n]] * lifespanScale, 0.0f, 1.0f);
+        glm::vec3 offset = particleLocations[n] - origin;
+        BillboardInstance &instance = billboardInstances[i];
+        instance.offset[0] = packHalf(offset.x);
+        instance.offset[1] = packHalf(offset.y);
+        instance.offset[2] = packHalf(offset.z);
+        instance.age = (GLushort)(age * 65535.0f + 0.5f);
+        instance.colorSize[0] = tint[0];
+        instance.colorSize[1] = tint[1];
+        instance.colorSize[2] = tint[2];
+        instance.colorSize[3] = (GLubyte)((1.0f - 0.5f * age) * 255.0f + 0.5f);
+    }
 
-}
+    glBindVertexArray( vaos[VAOS.BILLBOARD_QUAD] );
+    glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.BILLBOARD_QUAD] );
+    glEnableVertexAttribArray( shaderAttributes.vCorner );
+    glVertexAttribPointer( shaderAttributes.vCorner, 2, GL_FLOAT, GL_FALSE, 0, (void*) 0 );
+
+    glBindBuffer( GL_ARRAY_BUFFER, instanceVBO );
+    ResourceRegistry::bufferData( instanceVBO, GL_ARRAY_BUFFER, count * sizeof(BillboardInstance), billboardInstances, GL_STREAM_DRAW );
+    // sorted by their packed offsets and copied into drawing order without coming back to the CPU
+    if(sortOnGPU) {
+        const GLuint WORDS_PER_INSTANCE = sizeof(BillboardInstance) / sizeof(GLuint);
+        glm::vec3 viewDirection = normalize(_particleShaderUniforms.lookAtPoint - _particleShaderUniforms.eyePos);
+        _depthSort.sort(instanceVBO, GPUDepthSort::HALF_POSITIONS, WORDS_PER_INSTANCE, count, origin,
+                        _particleShaderUniforms.eyePos, viewDirection);
+        glBindBuffer( GL_ARRAY_BUFFER, _depthSort.gather(instanceVBO, WORDS_PER_INSTANCE, count) );
+    }
+    const GLint PER_INSTANCE[3] = { shaderAttributes.particleOffset, shaderAttributes.particleAge, shaderAttributes.particleColorSize };
+    const GLint COMPONENTS[3] = { 3, 1, 4 };
+    const GLenum TYPES[3] = { GL_HALF_FLOAT, GL_UNSIGNED_SHORT, GL_UNSIGNED_BYTE };
+    const GLboolean NORMALIZED[3] = { GL_FALSE, GL_TRUE, GL_TRUE };
+    const size_t OFFSETS[3] = { offsetof(BillboardInstance, offset), offsetof(BillboardInstance, age), offsetof(BillboardInstance, colorSize) };
+    for(int a = 0; a < 3; a++) {
+        glEnableVertexAttribArray( PER_INSTANCE[a] );
+        glVertexAttribPointer( PER_INSTANCE[a], COMPONENTS[a], TYPES[a], NORMALIZED[a], sizeof(BillboardInstance), (void*) OFFSETS[a] );
+        glVertexAttribDivisor( PER_INSTANCE[a], 1 );
+    }
 
+    shaderProgram->useProgram();
+    particleComputeAndSendTransformationMatrices(glm::mat4(1.0f), viewMatrix, projectionMatrix,
+                                                 shaderUniforms.mvMatrix, shaderUniforms.projMatrix);
+    glUniform3fv( shaderUniforms.emitterOrigin, 1, &origin[0] );
+    glUniform1f( shaderUniforms.maxSize, SPRITE_HALF_SIZE );
+    glUniform1f( shaderUniforms.spinPerLife, SPIN_PER_UPDATE * emitter.maxLifespan );
+
+    // played once over the life unless a rate was given, ending on the last frame rather than blending back to the first
+    GLfloat framesPerLife = flipbookFramesPerUpdate * emitter.maxLifespan;
+    if(flipbookFramesPerUpdate <= 0.0f) framesPerLife = blendFlipbookFrames ? numFlipbookFrames - 1 : numFlipbookFrames;
+    glUniform1f( shaderUniforms.framesPerLife, framesPerLife );
+    glUniform1i( shaderUniforms.numFrames, numFlipbookFrames > 0 ? numFlipbookFrames : 1 );
+    glUniform1i( shaderUniforms.blendFrames, blendFlipbookFrames );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, flipbookTexture );
+    glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, count );
+}
 
 void ParticleSystem::SetUpBuffers() {
     // generate ALL VAOs, VBOs, IBOs at once
-    glGenVertexArrays( NUM_VAOS, vaos );
-    glGenBuffers( NUM_VAOS, vbos );
-    glGenBuffers( NUM_VAOS, ibos );
+    ResourceRegistry::genVertexArrays( OWNER_PARTICLES, NUM_VAOS, vaos );
+    ResourceRegistry::genBuffers( OWNER_PARTICLES, NUM_VAOS, vbos );
+    ResourceRegistry::genBuffers( OWNER_PARTICLES, NUM_VAOS, ibos );
 
 //     --------------------------------------------------------------------------------------------------
 //     LOOKHERE #2 - generate sprites
 
-    particleLocations = (glm::vec3*)malloc(sizeof(glm::vec3) * numParticles);
-    particleType = (GLuint*)malloc(sizeof(GLushort) * numParticles);
-    particleIndices = (GLushort*)malloc(sizeof(GLushort) * numParticles);
-    distances = (GLfloat*)malloc(sizeof(GLfloat) * numParticles);
+    GLuint startingParticles = numParticles;
+    numParticles = 0;
+    reserveDrawBuffers(startingParticles);
 
     //fprintf(stdout, "num particles: %i", numParticles);
 
     glBindVertexArray( vaos[VAOS.PARTICLE_SYSTEM] );
 
     glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.PARTICLE_SYSTEM] );
-    glBufferData( GL_ARRAY_BUFFER, numParticles * sizeof(glm::vec3), particleLocations, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( vbos[VAOS.PARTICLE_SYSTEM], GL_ARRAY_BUFFER, numParticles * sizeof(glm::vec3), particleLocations, GL_STATIC_DRAW );
 
     glEnableVertexAttribArray(_particleShaderAttributes.vPos );
     glVertexAttribPointer(_particleShaderAttributes.vPos, 3, GL_FLOAT, GL_FALSE, 0, (void*) 0 );
 
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibos[VAOS.PARTICLE_SYSTEM] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, numParticles * sizeof(GLushort), particleIndices, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( ibos[VAOS.PARTICLE_SYSTEM], GL_ELEMENT_ARRAY_BUFFER, numParticles * sizeof(GLuint), particleIndices, GL_STATIC_DRAW );
 
     fprintf( stdout, "[INFO]: point sprites read in with VAO/VBO/IBO %d/%d/%d\n", vaos[VAOS.PARTICLE_SYSTEM], vbos[VAOS.PARTICLE_SYSTEM], ibos[VAOS.PARTICLE_SYSTEM] );
 
+    // the quad every instanced sprite is drawn from, corners in the same order as the geometry shader emits them
+    const GLfloat QUAD_CORNERS[8] = { -1.0f, -1.0f,   -1.0f, 1.0f,   1.0f, -1.0f,   1.0f, 1.0f };
+    glBindVertexArray( vaos[VAOS.BILLBOARD_QUAD] );
+    glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.BILLBOARD_QUAD] );
+    ResourceRegistry::bufferData( vbos[VAOS.BILLBOARD_QUAD], GL_ARRAY_BUFFER, sizeof(QUAD_CORNERS), QUAD_CORNERS, GL_STATIC_DRAW );
+    ResourceRegistry::genBuffers( OWNER_PARTICLES, 1, &instanceVBO );
+
+    _depthSort.initialize();
+
 
 
 
@@ -268,6 +762,23 @@ void ParticleSystem::SetUpBuffers() {
 
 
 
+void ParticleSystem::reserveDrawBuffers(GLuint count) {
+    if(count <= numParticles) return;
+
+    // double so a slowly growing system does not reallocate every frame
+    GLuint capacity = numParticles > 0 ? numParticles : 64;
+    while(capacity < count) {
+        capacity *= 2;
+    }
+    particleLocations = (glm::vec3*)realloc(particleLocations, sizeof(glm::vec3) * capacity);
+    particleIndices = (GLuint*)realloc(particleIndices, sizeof(GLuint) * capacity);
+    distances = (GLfloat*)realloc(distances, sizeof(GLfloat) * capacity);
+    particleSources = (uint32_t*)realloc(particleSources, sizeof(uint32_t) * capacity);
+    billboardInstances = (BillboardInstance*)realloc(billboardInstances, sizeof(BillboardInstance) * capacity);
+    numParticles = capacity;
+}
+
+
 void ParticleSystem::cleanup() {
     fprintf( stdout, "[INFO]: ...deleting particle shaders....\n" );
 
@@ -276,24 +787,28 @@ void ParticleSystem::cleanup() {
 
     fprintf( stdout, "[INFO]: ...deleting particle IBOs....\n" );
 
-    glDeleteBuffers( NUM_VAOS, ibos );
+    ResourceRegistry::deleteBuffers( NUM_VAOS, ibos );
 
     fprintf( stdout, "[INFO]: ...deleting particle VBOs....\n" );
 
-    glDeleteBuffers( NUM_VAOS, vbos );
+    ResourceRegistry::deleteBuffers( NUM_VAOS, vbos );
+    ResourceRegistry::deleteBuffers( 1, &instanceVBO );
     CSCI441::deleteObjectVBOs();
+    _depthSort.cleanup();
 
     fprintf( stdout, "[INFO]: ...deleting particle VAOs....\n" );
 
-    glDeleteVertexArrays( NUM_VAOS, vaos );
+    ResourceRegistry::deleteVertexArrays( NUM_VAOS, vaos );
     CSCI441::deleteObjectVAOs();
 
     free(particleLocations);
     free(particleIndices);
-    free(particleType);
     free(distances);
+    free(particleSources);
+    free(billboardInstances);
 
     fprintf( stdout, "[INFO]: ...deleting particle textures\n" );
 
-    glDeleteTextures(1, &particleTextureHandle);
+    ResourceRegistry::deleteTextures(1, &particleTextureHandle);
+    if(flipbookTexture != 0) ResourceRegistry::deleteTextures(1, &flipbookTexture);
 }
@@ -31,10 +31,42 @@
 
 // other classes
 #include "Particle.h"
+#include "Checkpoint.h"
+#include "CurlNoiseField.h"
+#include "FluidSolver.h"
+#include "ForceVolumes.h"
+#include "FrameArena.h"
+#include "GPUDepthSort.h"
 #include "LightingShaderStructs.h"
+#include "ParticleCuller.h"
+#include "ResourceRegistry.h"
+#include "SignedDistanceField.h"
+#include "TriangleBVH.h"
 
 class ParticleSystem {
 public:
+    // what happens to a particle that runs into the collision mesh
+    enum CollisionResponse {
+        BOUNCE,
+        KILL
+    };
+    // how transparent sprites are combined
+    enum BlendMode {
+        SORTED,                 // sorted back to front and alpha blended
+        WEIGHTED_OIT            // drawn unsorted into WeightedBlendedOIT targets, set up by the caller around draw()
+    };
+    // how each particle becomes a camera facing quad
+    enum BillboardPath {
+        GEOMETRY_SHADER,        // points expanded by billboardQuadShader.g.glsl, all the same size
+        INSTANCED_QUADS         // one shared quad drawn per particle, sized, turned and faded by its age
+    };
+
+    // the emitter settings drawing depends on, copied out with the particles
+    struct EmitterDrawState {
+        glm::vec3 origin;                   // the emitter position instanced offsets are taken from
+        GLint maxLifespan;                  // in updates, for turning lifespans into ages
+        glm::vec3 tint;
+    };
 
     ParticleSystem();
     void initialize(glm::vec3 startLoc, float radius);
@@ -42,11 +74,79 @@ public:
                                 ParticleShaderAttributes &lightingShaderAttributes);
     void setFlatShaderUandA(CSCI441::ShaderProgram &lightingShader, FlatShaderProgramUniforms &lightingShaderUniforms,
                                 FlatShaderProgramAttributes &lightingShaderAttributes);
+    // the billboard program writing accumulation and revealage, needed for WEIGHTED_OIT
+    void setOITShaderUandA(CSCI441::ShaderProgram &oitShader, ParticleShaderUniforms &oitShaderUniforms,
+                           ParticleShaderAttributes &oitShaderAttributes);
+    void setBlendMode(BlendMode mode);
+    BlendMode getBlendMode() const;
+    // programs built on billboardInstanced.v.glsl for INSTANCED_QUADS, one per blend mode.  A blend mode
+    // without its instanced program keeps using the geometry shader
+    void setInstancedShaderUandA(CSCI441::ShaderProgram &instancedShader, InstancedParticleShaderUniforms &instancedShaderUniforms,
+                                 InstancedParticleShaderAttributes &instancedShaderAttributes);
+    void setInstancedOITShaderUandA(CSCI441::ShaderProgram &instancedShader, InstancedParticleShaderUniforms &instancedShaderUniforms,
+                                    InstancedParticleShaderAttributes &instancedShaderAttributes);
+    void setBillboardPath(BillboardPath path);
+    BillboardPath getBillboardPath() const;
+    // multiplies the texture of INSTANCED_QUADS sprites, white by default
+    void setTint(glm::vec3 tint);
+    // animates INSTANCED_QUADS sprites through the cells of a sprite sheet, numbered along the rows from the top
+    // left of the image as it is drawn, or through one image per frame.  The frame follows from each particle's age,
+    // framesPerUpdate of them a frame or all of them once over a life when it is 0, and blend crossfades between
+    // frames.  Every frame must be the same size.  Without one the sprites are the single particle texture
+    bool setFlipbook(const char *sheetFilename, GLint columns, GLint rows, GLint numFrames, GLfloat framesPerUpdate, bool blend);
+    bool setFlipbook(const char * const *frameFilenames, GLint numFrames, GLfloat framesPerUpdate, bool blend);
+    // particles smaller than minPixels on a viewport viewportHeight pixels tall are not drawn, zero for either
+    // only culls to the frustum
+    void setCullSettings(float viewportHeight, float minPixels);
+    // how many particles the last draw() sent to the GPU and how many it culled
+    size_t getNumVisible() const;
+    size_t getNumCulled() const;
     void setCameraVariables(glm::vec3 lookAtPoint, glm::vec3 eyePos);
+    // SORTED particles are ordered by a compute shader when the context has them, on by default.  Off, or
+    // without compute shaders, they are sorted on the CPU
+    void setGPUSorting(bool enabled);
+    bool isGPUSorting() const;
+    void setGravity(glm::vec3 gravity);             // added to the velocity every update, none by default
+    void setMaxLifespan(GLint maxLifespan);         // in updates
+    // new particles are scattered with a generator of their own, the same seed spawns the same particles
+    void setSeed(uint32_t seed);
+    // particles drift with the field as well as their own velocity, scale is tiles per unit of world space
+    // and strength the RMS drift per update, null turns turbulence off
+    void setTurbulence(const CurlNoiseField *field, float strength, float scale);
+    // scratch memory for update(), reset by the caller once per frame.  Without one the
+    // system keeps a small arena of its own and resets it every update
+    void setFrameArena(FrameArena *arena);
+    // fountain particles push on each other like a fluid while a solver is set, its units are world units
+    // and updates, null turns it off
+    void setFluidSolver(FluidSolver *solver);
+    // wind, vortices and attractors acting on the particles, null for none
+    void setForceVolumes(const ForceVolumes *volumes);
+    // particles are swept against the mesh every update, null turns collisions off
+    void setCollisionMesh(const TriangleBVH *mesh, CollisionResponse response, float restitution);
+    // a baked field of the same scene, used instead of the mesh while it is set
+    void setCollisionField(const SignedDistanceField *field, CollisionResponse response, float restitution);
 
     void update(int timePassed, int timeThroughSecond, glm::vec3 position);  // takes in the time passed in milliseconds
 
+    // the live particles, the emitter and the random generator, restoring carries on exactly where the save left off
+    void saveCheckpoint(CheckpointWriter &checkpoint) const;
+    // whether restoreCheckpoint() would take the checkpoint, without changing anything
+    bool canRestoreCheckpoint(const CheckpointReader &checkpoint) const;
+    bool restoreCheckpoint(const CheckpointReader &checkpoint);
+
     void draw(glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
+    // draws particles copied out by getDrawState(), so they can be drawn while the next update runs
+    void draw(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, const glm::vec3 *positions, const GLint *lifespans, size_t count,
+              const EmitterDrawState &emitter);
+    void getDrawState(std::vector<glm::vec3> &positions, std::vector<GLint> &lifespans, EmitterDrawState &emitter) const;
+
+    // copies the position of every live particle into positions
+    void getParticlePositions(std::vector<glm::vec3> &positions);
+
+    // live particles as parallel arrays, for collisions to move them about between updates
+    size_t getNumParticles() const;
+    glm::vec3* getPositions();
+    glm::vec3* getVelocities();
     void drawBoundings(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, glm::mat4 modelMatrix);   // draw the different bounding boxes.
 
     void cleanup();
@@ -55,6 +155,43 @@ private:
 
     void SetUpBuffers();
 
+    // emitter settings as one block for checkpoints
+    struct EmitterState {
+        glm::vec3 position;
+        float radius;
+        glm::vec2 velocityRange;
+        GLint maxLifespan;
+        int spawnRate;
+        glm::vec3 gravity;
+    };
+
+    // one particle as the instanced vertex shader reads it, half the bytes of the floats it stands for
+    struct BillboardInstance {
+        GLushort offset[3];                 // half floats, from the emitter
+        GLushort age;                       // of the lifespan, 0 to 65535
+        GLubyte colorSize[4];               // tint, then the half width as a fraction of SPRITE_HALF_SIZE
+    };
+    static_assert(sizeof(BillboardInstance) == 12, "the instance attributes are laid out for 12 bytes");
+
+    EmitterDrawState getEmitterDrawState() const;
+    // grows the draw buffers to hold at least count particles
+    void reserveDrawBuffers(GLuint count);
+    // copies numFrames cells of columns x rows out of each source texture in turn into a new flipbook texture array
+    bool buildFlipbook(const GLuint *sources, GLint numSources, GLint columns, GLint rows, GLint numFrames);
+    // orders the first count particleIndices back to front on the CPU
+    void sortByDepth(GLuint count);
+    // whether count particles are sorted by _depthSort this frame
+    bool sortsOnGPU(GLuint count) const;
+    // WEIGHTED_OIT drawing of the first count particleLocations, with no sort
+    void drawUnsorted(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, GLuint count);
+    // INSTANCED_QUADS drawing of the first count particleIndices, lifespans is indexed through particleSources.
+    // sortOnGPU orders the instances by depth after they are uploaded
+    void drawInstanced(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, CSCI441::ShaderProgram *shaderProgram,
+                       const InstancedParticleShaderUniforms &shaderUniforms, const InstancedParticleShaderAttributes &shaderAttributes,
+                       const GLint *lifespans, GLuint count, const EmitterDrawState &emitter, bool sortOnGPU);
+    // uniform in [0, 1], xorshift so the sequence is the same with any standard library
+    float randomFloat();
+
     // shader stuff (I'll figure that out tomorrow)
     CSCI441::ShaderProgram *_particleShaderProgram = nullptr;
     ParticleShaderUniforms _particleShaderUniforms;
@@ -62,31 +199,83 @@ private:
     CSCI441::ShaderProgram *_flatShaderProgram = nullptr;
     FlatShaderProgramAttributes _flatShaderAttributes;
     FlatShaderProgramUniforms _flatShaderUniforms;
+    CSCI441::ShaderProgram *_oitShaderProgram = nullptr;
+    ParticleShaderUniforms _oitShaderUniforms;
+    ParticleShaderAttributes _oitShaderAttributes;
+    CSCI441::ShaderProgram *_instancedShaderProgram = nullptr;
+    InstancedParticleShaderUniforms _instancedShaderUniforms;
+    InstancedParticleShaderAttributes _instancedShaderAttributes;
+    CSCI441::ShaderProgram *_instancedOITShaderProgram = nullptr;
+    InstancedParticleShaderUniforms _instancedOITShaderUniforms;
+    InstancedParticleShaderAttributes _instancedOITShaderAttributes;
+    BlendMode _blendMode = SORTED;
+    BillboardPath _billboardPath = GEOMETRY_SHADER;
+    glm::vec3 _tint = glm::vec3(1.0f);
 
 // all drawing information
     const struct VAO_IDS {
         GLuint PARTICLE_SYSTEM = 0;
+        GLuint BOUNDINGS = 1;
+        GLuint BILLBOARD_QUAD = 2;
     } VAOS;
-    const static GLuint NUM_VAOS = 1;
+    const static GLuint NUM_VAOS = 3;
     GLuint vaos[NUM_VAOS];                  // an array of our VAO descriptors
     GLuint vbos[NUM_VAOS];                  // an array of our VBO descriptors
     GLuint ibos[NUM_VAOS];                  // an array of our IBO descriptors
-    GLuint particleTextureHandle;             // the texture to apply to the particle (all water)
-    GLuint numParticles = 0;                // the number of particles on the screen
+    GLuint instanceVBO;                     // the BillboardInstance of each particle drawn
+    GLuint particleTextureHandle = 0;         // the texture to apply to the particle (all water)
+    GLuint flipbookTexture = 0;               // a 2D array of the frames INSTANCED_QUADS sprites animate through
+    GLint numFlipbookFrames = 0;
+    GLfloat flipbookFramesPerUpdate = 0.0f;
+    bool blendFlipbookFrames = false;
+    GLuint numParticles = 0;                // the number of particles the draw buffers can hold
     glm::vec3* particleLocations = nullptr;   // the (x,y,z) location of each particle
-    GLuint* particleType = nullptr;           // the type of the particle
-    GLushort* particleIndices = nullptr;      // the order to draw the particles in
+    GLuint* particleIndices = nullptr;        // the order to draw the particles in
     GLfloat* distances = nullptr;           // will be used to store the distance to the camera
+    uint32_t* particleSources = nullptr;      // where each culled particle came from in the draw state
+    BillboardInstance* billboardInstances = nullptr;
+
+    static const GLfloat SPRITE_HALF_SIZE;  // the size the geometry shader draws every sprite and new instanced ones start at
+    static const GLfloat SPIN_PER_UPDATE;   // radians an instanced sprite turns each update of its life
+    static const float SPRITE_RADIUS;       // bounds the billboard around each point, either way it is drawn
+    ParticleCuller _culler;
+    float _cullViewportHeight = 0.0f;
+    float _cullMinPixels = 0.0f;
+    size_t _numVisible = 0;
+    size_t _numCulled = 0;
+    GPUDepthSort _depthSort;
+    bool _gpuSorting = true;
 
-    // particle information
-    vector<Particle> _particles;
+    // particle information, one array per field so the update pass only touches what it needs
+    std::vector<glm::vec3> _positions;
+    std::vector<glm::vec3> _velocities;
+    std::vector<GLint> _lifespans;
+    std::vector<GLint> _types;
     glm::vec3 _pos;
     float _radius;
     glm::vec2 _velocityRange;
     GLint _maxLifespan;
     int _spawnRate;
+    glm::vec3 _gravity;
+    uint32_t _randomState = 1;              // never 0
+
+    static const size_t RESERVED_PARTICLES = 1024;
+    FrameArena *_frameArena = nullptr;
+    FrameArena _localArena;                 // used when no arena was set
+
+    FluidSolver *_fluidSolver = nullptr;
+
+    const ForceVolumes *_forceVolumes = nullptr;
+    std::vector<glm::vec3> _boundingLines;  // outlines of the force volumes, rebuilt each time they are drawn
+
+    const CurlNoiseField *_turbulence = nullptr;
+    float _turbulenceStrength = 0.0f;
+    float _turbulenceScale = 1.0f;
 
-    const glm::vec3 GRAVITY = glm::vec3(0,-.056,0);
+    const TriangleBVH *_collisionMesh = nullptr;
+    const SignedDistanceField *_collisionField = nullptr;
+    CollisionResponse _collisionResponse = BOUNCE;
+    float _restitution = 0.5f;
 };
 
 #endif //LAB10_PARTICLESYSTEM_H
@@ -0,0 +1,142 @@
+//
+// Batched quaternion kernels for integrating and drawing many rotating bodies.
+//
+
+#include "QuaternionBatch.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define QUATERNION_BATCH_SSE
+#endif
+
+void QuaternionBatch::integrateScalar(glm::quat *orientations, const glm::vec3 *angularVelocities, size_t count, float dt) {
+    const float HALF_DT = 0.5f * dt;
+    for(size_t i = 0; i < count; i++) {
+        glm::quat q = orientations[i];
+        glm::vec3 w = angularVelocities[i] * HALF_DT;
+
+        // (w, 0) * q = (-w.q, q.w w + w x q)
+        float x = q.x + q.w * w.x + (w.y * q.z - w.z * q.y);
+        float y = q.y + q.w * w.y + (w.z * q.x - w.x * q.z);
+        float z = q.z + q.w * w.z + (w.x * q.y - w.y * q.x);
+        float s = q.w - (w.x * q.x + w.y * q.y + w.z * q.z);
+
+        float invLength = 1.0f / std::sqrt(x * x + y * y + z * z + s * s);
+        orientations[i].x = x * invLength;
+        orientations[i].y = y * invLength;
+        orientations[i].z = z * invLength;
+        orientations[i].w = s * invLength;
+    }
+}
+
+void QuaternionBatch::toMatricesScalar(const glm::quat *orientations, const glm::vec3 *positions, size_t count, glm::mat4 *matrices) {
+    for(size_t i = 0; i < count; i++) {
+        const glm::quat &q = orientations[i];
+        float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+        glm::mat4 &m = matrices[i];
+        m[0][0] = 1.0f - 2.0f * (yy + zz); m[0][1] = 2.0f * (xy + wz);        m[0][2] = 2.0f * (xz - wy);        m[0][3] = 0.0f;
+        m[1][0] = 2.0f * (xy - wz);        m[1][1] = 1.0f - 2.0f * (xx + zz); m[1][2] = 2.0f * (yz + wx);        m[1][3] = 0.0f;
+        m[2][0] = 2.0f * (xz + wy);        m[2][1] = 2.0f * (yz - wx);        m[2][2] = 1.0f - 2.0f * (xx + yy); m[2][3] = 0.0f;
+        m[3][0] = positions[i].x;          m[3][1] = positions[i].y;          m[3][2] = positions[i].z;          m[3][3] = 1.0f;
+    }
+}
+
+#ifdef QUATERNION_BATCH_SSE
+
+// the components are gathered one by one so this does not depend on GLM's quaternion memory layout
+#define GATHER4(array, i, component) _mm_set_ps(array[i + 3].component, array[i + 2].component, array[i + 1].component, array[i].component)
+
+void QuaternionBatch::integrate(glm::quat *orientations, const glm::vec3 *angularVelocities, size_t count, float dt) {
+    const __m128 HALF_DT = _mm_set1_ps(0.5f * dt);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 qx = GATHER4(orientations, i, x);
+        __m128 qy = GATHER4(orientations, i, y);
+        __m128 qz = GATHER4(orientations, i, z);
+        __m128 qw = GATHER4(orientations, i, w);
+        __m128 wx = _mm_mul_ps(GATHER4(angularVelocities, i, x), HALF_DT);
+        __m128 wy = _mm_mul_ps(GATHER4(angularVelocities, i, y), HALF_DT);
+        __m128 wz = _mm_mul_ps(GATHER4(angularVelocities, i, z), HALF_DT);
+
+        __m128 x = _mm_add_ps(qx, _mm_add_ps(_mm_mul_ps(qw, wx), _mm_sub_ps(_mm_mul_ps(wy, qz), _mm_mul_ps(wz, qy))));
+        __m128 y = _mm_add_ps(qy, _mm_add_ps(_mm_mul_ps(qw, wy), _mm_sub_ps(_mm_mul_ps(wz, qx), _mm_mul_ps(wx, qz))));
+        __m128 z = _mm_add_ps(qz, _mm_add_ps(_mm_mul_ps(qw, wz), _mm_sub_ps(_mm_mul_ps(wx, qy), _mm_mul_ps(wy, qx))));
+        __m128 s = _mm_sub_ps(qw, _mm_add_ps(_mm_mul_ps(wx, qx), _mm_add_ps(_mm_mul_ps(wy, qy), _mm_mul_ps(wz, qz))));
+
+        __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(s, s)));
+        __m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length2));
+        x = _mm_mul_ps(x, invLength);
+        y = _mm_mul_ps(y, invLength);
+        z = _mm_mul_ps(z, invLength);
+        s = _mm_mul_ps(s, invLength);
+
+        float out[4][4];
+        _mm_storeu_ps(out[0], x);
+        _mm_storeu_ps(out[1], y);
+        _mm_storeu_ps(out[2], z);
+        _mm_storeu_ps(out[3], s);
+        for(int j = 0; j < 4; j++) {
+            orientations[i + j].x = out[0][j];
+            orientations[i + j].y = out[1][j];
+            orientations[i + j].z = out[2][j];
+            orientations[i + j].w = out[3][j];
+        }
+    }
+    integrateScalar(orientations + i, angularVelocities + i, count - i, dt);
+}
+
+void QuaternionBatch::toMatrices(const glm::quat *orientations, const glm::vec3 *positions, size_t count, glm::mat4 *matrices) {
+    const __m128 ONE = _mm_set1_ps(1.0f);
+    const __m128 TWO = _mm_set1_ps(2.0f);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 qx = GATHER4(orientations, i, x);
+        __m128 qy = GATHER4(orientations, i, y);
+        __m128 qz = GATHER4(orientations, i, z);
+        __m128 qw = GATHER4(orientations, i, w);
+
+        __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+        __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+        __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+        // the nine rotation entries, column major like glm
+        float r[9][4];
+        _mm_storeu_ps(r[0], _mm_sub_ps(ONE, _mm_mul_ps(TWO, _mm_add_ps(yy, zz))));
+        _mm_storeu_ps(r[1], _mm_mul_ps(TWO, _mm_add_ps(xy, wz)));
+        _mm_storeu_ps(r[2], _mm_mul_ps(TWO, _mm_sub_ps(xz, wy)));
+        _mm_storeu_ps(r[3], _mm_mul_ps(TWO, _mm_sub_ps(xy, wz)));
+        _mm_storeu_ps(r[4], _mm_sub_ps(ONE, _mm_mul_ps(TWO, _mm_add_ps(xx, zz))));
+        _mm_storeu_ps(r[5], _mm_mul_ps(TWO, _mm_add_ps(yz, wx)));
+        _mm_storeu_ps(r[6], _mm_mul_ps(TWO, _mm_add_ps(xz, wy)));
+        _mm_storeu_ps(r[7], _mm_mul_ps(TWO, _mm_sub_ps(yz, wx)));
+        _mm_storeu_ps(r[8], _mm_sub_ps(ONE, _mm_mul_ps(TWO, _mm_add_ps(xx, yy))));
+
+        for(int j = 0; j < 4; j++) {
+            glm::mat4 &m = matrices[i + j];
+            m[0][0] = r[0][j]; m[0][1] = r[1][j]; m[0][2] = r[2][j]; m[0][3] = 0.0f;
+            m[1][0] = r[3][j]; m[1][1] = r[4][j]; m[1][2] = r[5][j]; m[1][3] = 0.0f;
+            m[2][0] = r[6][j]; m[2][1] = r[7][j]; m[2][2] = r[8][j]; m[2][3] = 0.0f;
+            m[3][0] = positions[i + j].x; m[3][1] = positions[i + j].y; m[3][2] = positions[i + j].z; m[3][3] = 1.0f;
+        }
+    }
+    toMatricesScalar(orientations + i, positions + i, count - i, matrices + i);
+}
+
+#undef GATHER4
+
+#else
+
+void QuaternionBatch::integrate(glm::quat *orientations, const glm::vec3 *angularVelocities, size_t count, float dt) {
+    integrateScalar(orientations, angularVelocities, count, dt);
+}
+
+void QuaternionBatch::toMatrices(const glm::quat *orientations, const glm::vec3 *positions, size_t count, glm::mat4 *matrices) {
+    toMatricesScalar(orientations, positions, count, matrices);
+}
+
+#endif
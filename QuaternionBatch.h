@@ -0,0 +1,33 @@
+//
+// Batched quaternion kernels for integrating and drawing many rotating bodies.
+//
+// Angular velocity is integrated straight onto the orientation quaternions,
+//     q += dt/2 * (w, 0) * q
+// followed by a renormalize, so no trig is evaluated per frame and there is no
+// euler angle round trip to gimbal lock.  The SSE path works on four
+// quaternions at a time, one component per register; builds without SSE (Apple
+// silicon) use the scalar loop.
+//
+
+#ifndef LAB10_QUATERNIONBATCH_H
+#define LAB10_QUATERNIONBATCH_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+#include <glm/gtx/quaternion.hpp>
+
+// include C and C++ libraries
+#include <cstddef>
+
+namespace QuaternionBatch {
+    // rotates each orientation by its world space angular velocity (radians per unit time) over dt
+    void integrate(glm::quat *orientations, const glm::vec3 *angularVelocities, size_t count, float dt);
+
+    // rigid model matrices from a rotation and translation each
+    void toMatrices(const glm::quat *orientations, const glm::vec3 *positions, size_t count, glm::mat4 *matrices);
+
+    // scalar versions, also used for the tail of the batches
+    void integrateScalar(glm::quat *orientations, const glm::vec3 *angularVelocities, size_t count, float dt);
+    void toMatricesScalar(const glm::quat *orientations, const glm::vec3 *positions, size_t count, glm::mat4 *matrices);
+}
+
+#endif //LAB10_QUATERNIONBATCH_H
@@ -0,0 +1,235 @@
+//
+// Keeps count of the GPU and CPU memory each part of the program is holding on to.
+//
+
+#include "ResourceRegistry.h"
+#include "HeapCounter.h"
+
+#include <CSCI441/TextureUtils.hpp>
+
+#include <cstdio>
+#include <map>
+
+static_assert(NUM_RESOURCE_OWNERS <= HeapCounter::MAX_TAGS, "every owner needs a heap counter tag");
+
+namespace {
+    enum Kind {
+        BUFFER,
+        VERTEX_ARRAY,
+        TEXTURE,
+        FRAMEBUFFER,
+        RENDERBUFFER,
+        NUM_KINDS
+    };
+
+    const char* KIND_NAMES[NUM_KINDS] = { "buffer", "vertex array", "texture", "framebuffer", "renderbuffer" };
+    const char* OWNER_NAMES[NUM_RESOURCE_OWNERS] = { "untagged", "scene", "skybox", "town", "particles", "bodies", "lighting", "post-process" };
+
+    struct Resource {
+        ResourceOwner owner;
+        size_t bytes;
+    };
+
+    // by handle, ordered so the leak list reads in creation order
+    std::map<GLuint, Resource> resources[NUM_KINDS];
+
+    void add(Kind kind, ResourceOwner owner, GLsizei count, const GLuint *handles) {
+        for(GLsizei i = 0; i < count; i++) {
+            Resource &resource = resources[kind][handles[i]];
+            resource.owner = owner;
+            resource.bytes = 0;
+        }
+    }
+
+    void remove(Kind kind, GLsizei count, const GLuint *handles) {
+        for(GLsizei i = 0; i < count; i++) {
+            resources[kind].erase(handles[i]);
+        }
+    }
+
+    Resource* find(Kind kind, GLuint handle) {
+        std::map<GLuint, Resource>::iterator it = resources[kind].find(handle);
+        if(it == resources[kind].end()) {
+            fprintf(stderr, "[ERROR]: %s %u was not made through the resource registry\n", KIND_NAMES[kind], handle);
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    // what the driver most likely stores per texel, unsized formats are taken as 8 bits a channel
+    size_t bytesPerTexel(GLint internalFormat) {
+        switch(internalFormat) {
+            case GL_R8: case GL_RED:
+                return 1;
+            case GL_RG8: case GL_RG: case GL_R16F: case GL_DEPTH_COMPONENT16:
+                return 2;
+            case GL_RGBA16F: case GL_RG32F:
+                return 8;
+            case GL_RGBA32F:
+                return 16;
+            case GL_RGB32F:
+                return 12;
+            default:                    // RGB is padded out to 4 bytes, as are 24 bit depths
+                return 4;
+        }
+    }
+
+    // level 0 starts the texture over, the mipmap levels add to it
+    void addTextureLevel(GLuint texture, GLint level, size_t bytes) {
+        Resource *resource = find(TEXTURE, texture);
+        if(resource == nullptr) return;
+        resource->bytes = level == 0 ? bytes : resource->bytes + bytes;
+    }
+}
+
+const char* ResourceRegistry::getOwnerName(ResourceOwner owner) {
+    return owner < NUM_RESOURCE_OWNERS ? OWNER_NAMES[owner] : "unknown";
+}
+
+void ResourceRegistry::genBuffers(ResourceOwner owner, GLsizei count, GLuint *buffers) {
+    glGenBuffers(count, buffers);
+    add(BUFFER, owner, count, buffers);
+}
+
+void ResourceRegistry::bufferData(GLuint buffer, GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+    glBufferData(target, size, data, usage);
+    Resource *resource = find(BUFFER, buffer);
+    if(resource != nullptr) resource->bytes = size;
+}
+
+void ResourceRegistry::deleteBuffers(GLsizei count, const GLuint *buffers) {
+    glDeleteBuffers(count, buffers);
+    remove(BUFFER, count, buffers);
+}
+
+void ResourceRegistry::genVertexArrays(ResourceOwner owner, GLsizei count, GLuint *arrays) {
+    glGenVertexArrays(count, arrays);
+    add(VERTEX_ARRAY, owner, count, arrays);
+}
+
+void ResourceRegistry::deleteVertexArrays(GLsizei count, const GLuint *arrays) {
+    glDeleteVertexArrays(count, arrays);
+    remove(VERTEX_ARRAY, count, arrays);
+}
+
+void ResourceRegistry::genTextures(ResourceOwner owner, GLsizei count, GLuint *textures) {
+    glGenTextures(count, textures);
+    add(TEXTURE, owner, count, textures);
+}
+
+void ResourceRegistry::texImage2D(GLuint texture, GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                                  GLenum format, GLenum type, const void *data) {
+    glTexImage2D(target, level, internalFormat, width, height, 0, format, type, data);
+    addTextureLevel(texture, level, (size_t)width * height * bytesPerTexel(internalFormat));
+}
+
+void ResourceRegistry::texImage3D(GLuint texture, GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                                  GLsizei depth, GLenum format, GLenum type, const void *data) {
+    glTexImage3D(target, level, internalFormat, width, height, depth, 0, format, type, data);
+    addTextureLevel(texture, level, (size_t)width * height * depth * bytesPerTexel(internalFormat));
+}
+
+void ResourceRegistry::adoptTexture(ResourceOwner owner, GLenum target, GLuint texture) {
+    add(TEXTURE, owner, 1, &texture);
+
+    GLint width = 0, height = 0, depth = 0, internalFormat = 0, minFilter = 0;
+    glBindTexture(target, texture);
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_DEPTH, &depth);
+    glGetTexLevelParameteriv(target, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+    glGetTexParameteriv(target, GL_TEXTURE_MIN_FILTER, &minFilter);
+
+    size_t bytes = (size_t)width * height * (depth > 0 ? depth : 1) * bytesPerTexel(internalFormat);
+    // a full mipmap chain adds a third
+    if(minFilter != GL_NEAREST && minFilter != GL_LINEAR) bytes += bytes / 3;
+    resources[TEXTURE][texture].bytes = bytes;
+}
+
+GLuint ResourceRegistry::loadTexture(ResourceOwner owner, const char *filename) {
+    GLuint texture = CSCI441::TextureUtils::loadAndRegisterTexture(filename);
+    if(texture != 0) adoptTexture(owner, GL_TEXTURE_2D, texture);
+    return texture;
+}
+
+void ResourceRegistry::deleteTextures(GLsizei count, const GLuint *textures) {
+    glDeleteTextures(count, textures);
+    remove(TEXTURE, count, textures);
+}
+
+void ResourceRegistry::genFramebuffers(ResourceOwner owner, GLsizei count, GLuint *framebuffers) {
+    glGenFramebuffers(count, framebuffers);
+    add(FRAMEBUFFER, owner, count, framebuffers);
+}
+
+void ResourceRegistry::deleteFramebuffers(GLsizei count, const GLuint *framebuffers) {
+    glDeleteFramebuffers(count, framebuffers);
+    remove(FRAMEBUFFER, count, framebuffers);
+}
+
+void ResourceRegistry::genRenderbuffers(ResourceOwner owner, GLsizei count, GLuint *renderbuffers) {
+    glGenRenderbuffers(count, renderbuffers);
+    add(RENDERBUFFER, owner, count, renderbuffers);
+}
+
+void ResourceRegistry::renderbufferStorage(GLuint renderbuffer, GLenum target, GLenum internalFormat, GLsizei width, GLsizei height) {
+    glRenderbufferStorage(target, internalFormat, width, height);
+    Resource *resource = find(RENDERBUFFER, renderbuffer);
+    if(resource != nullptr) resource->bytes = (size_t)width * height * bytesPerTexel(internalFormat);
+}
+
+void ResourceRegistry::deleteRenderbuffers(GLsizei count, const GLuint *renderbuffers) {
+    glDeleteRenderbuffers(count, renderbuffers);
+    remove(RENDERBUFFER, count, renderbuffers);
+}
+
+size_t ResourceRegistry::getGPUBytes(ResourceOwner owner) {
+    size_t bytes = 0;
+    for(int kind = 0; kind < NUM_KINDS; kind++) {
+        for(std::map<GLuint, Resource>::const_iterator it = resources[kind].begin(); it != resources[kind].end(); ++it) {
+            if(it->second.owner == owner) bytes += it->second.bytes;
+        }
+    }
+    return bytes;
+}
+
+int64_t ResourceRegistry::getCPUBytes(ResourceOwner owner) {
+    return HeapCounter::getLiveBytes(owner);
+}
+
+void ResourceRegistry::printReport() {
+    fprintf(stdout, "[INFO]: memory by owner%s\n", HeapCounter::isCounting() ? "" : " (CPU heap is only counted in debug builds)");
+    size_t totalGPU = 0;
+    int64_t totalCPU = 0;
+    for(int owner = 0; owner < NUM_RESOURCE_OWNERS; owner++) {
+        size_t gpuBytes = getGPUBytes((ResourceOwner)owner);
+        int64_t cpuBytes = getCPUBytes((ResourceOwner)owner);
+        fprintf(stdout, "[INFO]:   %-13s %10.1f KB GPU %10.1f KB CPU\n", OWNER_NAMES[owner], gpuBytes / 1024.0, cpuBytes / 1024.0);
+        totalGPU += gpuBytes;
+        totalCPU += cpuBytes;
+    }
+    fprintf(stdout, "[INFO]:   %-13s %10.1f KB GPU %10.1f KB CPU\n", "total", totalGPU / 1024.0, totalCPU / 1024.0);
+}
+
+bool ResourceRegistry::checkForLeaks() {
+    size_t numLeaks = 0;
+    for(int kind = 0; kind < NUM_KINDS; kind++) {
+        for(std::map<GLuint, Resource>::const_iterator it = resources[kind].begin(); it != resources[kind].end(); ++it) {
+            fprintf(stderr, "[ERROR]: %s %u of %s was never deleted (%zu bytes)\n",
+                    KIND_NAMES[kind], it->first, OWNER_NAMES[it->second.owner], it->second.bytes);
+            numLeaks++;
+        }
+    }
+    if(numLeaks == 0) {
+        fprintf(stdout, "[INFO]: every GL object was deleted\n");
+    }
+    return numLeaks == 0;
+}
+
+ResourceRegistry::OwnerScope::OwnerScope(ResourceOwner owner) {
+    _previous = HeapCounter::setTag(owner);
+}
+
+ResourceRegistry::OwnerScope::~OwnerScope() {
+    HeapCounter::setTag(_previous);
+}
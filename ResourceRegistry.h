@@ -0,0 +1,95 @@
+//
+// Keeps count of the GPU and CPU memory each part of the program is holding on to.
+//
+// The GL objects are made and freed through the functions here instead of
+// straight through OpenGL.  Every buffer, vertex array, texture, framebuffer
+// and renderbuffer is recorded with the owner that made it and an estimate of
+// its size, taken from the sizes passed to glBufferData, glTexImage and
+// glRenderbufferStorage, or read back for textures loaded by someone else.
+// CPU memory is charged through HeapCounter to whichever owner has an
+// OwnerScope open on the allocating thread, so it is only counted in debug
+// builds.
+//
+// printReport() lists both per owner, and checkForLeaks() names every GL
+// object still alive, for calling once everything should have been deleted.
+// The GL side is not thread safe, call it from the thread with the context.
+//
+
+#ifndef LAB10_RESOURCEREGISTRY_H
+#define LAB10_RESOURCEREGISTRY_H
+
+// include OpenGL libraries
+#include <GL/glew.h>
+
+// include C and C++ libraries
+#include <cstddef>
+#include <cstdint>
+
+enum ResourceOwner {
+    OWNER_UNTAGGED,
+    OWNER_SCENE,            // the ground and anything else not listed
+    OWNER_SKYBOX,
+    OWNER_TOWN,
+    OWNER_PARTICLES,
+    OWNER_BODIES,
+    OWNER_LIGHTING,
+    OWNER_POST_PROCESS,
+    NUM_RESOURCE_OWNERS
+};
+
+namespace ResourceRegistry {
+    const char* getOwnerName(ResourceOwner owner);
+
+    void genBuffers(ResourceOwner owner, GLsizei count, GLuint *buffers);
+    // glBufferData on a buffer already bound to target, recording its new size
+    void bufferData(GLuint buffer, GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+    void deleteBuffers(GLsizei count, const GLuint *buffers);
+
+    void genVertexArrays(ResourceOwner owner, GLsizei count, GLuint *arrays);
+    void deleteVertexArrays(GLsizei count, const GLuint *arrays);
+
+    void genTextures(ResourceOwner owner, GLsizei count, GLuint *textures);
+    // glTexImage on a texture already bound to target, adding the level to its size
+    void texImage2D(GLuint texture, GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                    GLenum format, GLenum type, const void *data);
+    void texImage3D(GLuint texture, GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height,
+                    GLsizei depth, GLenum format, GLenum type, const void *data);
+    // for textures made by other code, reads the size of the texture back from GL.  Leaves target bound to it
+    void adoptTexture(ResourceOwner owner, GLenum target, GLuint texture);
+    // CSCI441::TextureUtils::loadAndRegisterTexture, recorded under the owner
+    GLuint loadTexture(ResourceOwner owner, const char *filename);
+    void deleteTextures(GLsizei count, const GLuint *textures);
+
+    void genFramebuffers(ResourceOwner owner, GLsizei count, GLuint *framebuffers);
+    void deleteFramebuffers(GLsizei count, const GLuint *framebuffers);
+
+    void genRenderbuffers(ResourceOwner owner, GLsizei count, GLuint *renderbuffers);
+    // glRenderbufferStorage on a renderbuffer already bound to target
+    void renderbufferStorage(GLuint renderbuffer, GLenum target, GLenum internalFormat, GLsizei width, GLsizei height);
+    void deleteRenderbuffers(GLsizei count, const GLuint *renderbuffers);
+
+    // estimated bytes of GL objects the owner has alive
+    size_t getGPUBytes(ResourceOwner owner);
+    // bytes of CPU heap allocated under the owner and not freed, zero in release builds
+    int64_t getCPUBytes(ResourceOwner owner);
+
+    // a table of GPU and CPU memory per owner on stdout
+    void printReport();
+    // prints every GL object that was never deleted, returns true if there were none
+    bool checkForLeaks();
+
+    // while alive, heap allocations made by this thread are charged to the owner
+    class OwnerScope {
+    public:
+        explicit OwnerScope(ResourceOwner owner);
+        ~OwnerScope();
+
+    private:
+        OwnerScope(const OwnerScope&);
+        OwnerScope& operator=(const OwnerScope&);
+
+        uint32_t _previous;
+    };
+}
+
+#endif //LAB10_RESOURCEREGISTRY_H
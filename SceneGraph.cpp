@@ -0,0 +1,110 @@
+//
+// Flat transform hierarchy with cached world matrices.
+//
+
+#include "SceneGraph.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+const uint32_t SceneGraph::NO_PARENT;
+
+SceneGraph::SceneGraph() {
+    _firstDirty = 0;
+    _numUpdated = 0;
+};
+
+uint32_t SceneGraph::addNode(uint32_t parent, glm::vec3 position, glm::quat rotation, glm::vec3 scale) {
+    uint32_t node = _parents.size();
+    _parents.push_back(parent < node ? parent : NO_PARENT);
+    _positions.push_back(position);
+    _rotations.push_back(rotation);
+    _scales.push_back(scale);
+    _worldMatrices.push_back(glm::mat4(1.0f));
+    _dirty.push_back(0);
+    markDirty(node);
+    return node;
+}
+
+void SceneGraph::clear() {
+    _parents.clear();
+    _positions.clear();
+    _rotations.clear();
+    _scales.clear();
+    _worldMatrices.clear();
+    _dirty.clear();
+    _firstDirty = 0;
+}
+
+void SceneGraph::reserve(size_t numNodes) {
+    _parents.reserve(numNodes);
+    _positions.reserve(numNodes);
+    _rotations.reserve(numNodes);
+    _scales.reserve(numNodes);
+    _worldMatrices.reserve(numNodes);
+    _dirty.reserve(numNodes);
+}
+
+void SceneGraph::markDirty(uint32_t node) {
+    _dirty[node] = 1;
+    if(node < _firstDirty) _firstDirty = node;
+}
+
+void SceneGraph::setPosition(uint32_t node, glm::vec3 position) {
+    _positions[node] = position;
+    markDirty(node);
+}
+
+void SceneGraph::setRotation(uint32_t node, glm::quat rotation) {
+    _rotations[node] = rotation;
+    markDirty(node);
+}
+
+void SceneGraph::setScale(uint32_t node, glm::vec3 scale) {
+    _scales[node] = scale;
+    markDirty(node);
+}
+
+void SceneGraph::setLocal(uint32_t node, glm::vec3 position, glm::quat rotation) {
+    _positions[node] = position;
+    _rotations[node] = rotation;
+    markDirty(node);
+}
+
+void SceneGraph::update() {
+    _numUpdated = 0;
+    const uint32_t NUM_NODES = _parents.size();
+
+    for(uint32_t i = _firstDirty; i < NUM_NODES; i++) {
+        uint32_t parent = _parents[i];
+        if(parent != NO_PARENT && _dirty[parent]) {
+            _dirty[i] = 1;
+        }
+        if(!_dirty[i]) continue;
+
+        glm::mat4 local = glm::scale(glm::translate(glm::mat4(1.0f), _positions[i]), _scales[i]) * glm::toMat4(_rotations[i]);
+        _worldMatrices[i] = parent == NO_PARENT ? local : _worldMatrices[parent] * local;
+        _numUpdated++;
+    }
+
+    // flags are only cleared once every child has seen its parent's
+    for(uint32_t i = _firstDirty; i < NUM_NODES; i++) {
+        _dirty[i] = 0;
+    }
+    _firstDirty = NUM_NODES;
+}
+
+const glm::mat4& SceneGraph::getWorldMatrix(uint32_t node) const {
+    return _worldMatrices[node];
+}
+
+uint32_t SceneGraph::getParent(uint32_t node) const {
+    return _parents[node];
+}
+
+size_t SceneGraph::size() const {
+    return _parents.size();
+}
+
+size_t SceneGraph::getNumUpdated() const {
+    return _numUpdated;
+}
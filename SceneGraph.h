@@ -0,0 +1,62 @@
+//
+// Flat transform hierarchy with cached world matrices.
+//
+// Nodes are stored in topological order - a node can only be added after its
+// parent - so a single front to back sweep sees every parent before its
+// children.  Changing a node marks it dirty; during update() a node is
+// recomputed only when it or one of its ancestors is dirty, the flag flowing
+// down to the children as the sweep passes them.  Nothing before the first
+// dirty node can be affected so the sweep starts there.
+//
+// Local matrices are built in the same order as Transform::updateMatrix().
+//
+
+#ifndef LAB10_SCENEGRAPH_H
+#define LAB10_SCENEGRAPH_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+#include <glm/gtx/quaternion.hpp>
+
+// include C and C++ libraries
+#include <cstdint>
+#include <vector>
+
+class SceneGraph {
+public:
+    static const uint32_t NO_PARENT = 0xffffffff;
+
+    SceneGraph();
+
+    // parent must be NO_PARENT or an existing node, returns the new node
+    uint32_t addNode(uint32_t parent, glm::vec3 position, glm::quat rotation, glm::vec3 scale);
+    void clear();
+    void reserve(size_t numNodes);
+
+    void setPosition(uint32_t node, glm::vec3 position);
+    void setRotation(uint32_t node, glm::quat rotation);
+    void setScale(uint32_t node, glm::vec3 scale);
+    void setLocal(uint32_t node, glm::vec3 position, glm::quat rotation);
+
+    // recomputes the world matrix of every dirty node and their descendants
+    void update();
+
+    const glm::mat4& getWorldMatrix(uint32_t node) const;
+    uint32_t getParent(uint32_t node) const;
+    size_t size() const;
+    size_t getNumUpdated() const;       // world matrices recomputed by the last update()
+
+private:
+
+    void markDirty(uint32_t node);
+
+    std::vector<uint32_t> _parents;
+    std::vector<glm::vec3> _positions;
+    std::vector<glm::quat> _rotations;
+    std::vector<glm::vec3> _scales;
+    std::vector<glm::mat4> _worldMatrices;
+    std::vector<uint8_t> _dirty;
+    uint32_t _firstDirty;
+    size_t _numUpdated;
+};
+
+#endif //LAB10_SCENEGRAPH_H
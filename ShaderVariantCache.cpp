@@ -0,0 +1,156 @@
+//
+// Compiles and caches permutations of a shader program.
+//
+
+#include "ShaderVariantCache.h"
+
+#include <cstdio>				// for printf functionality
+#include <fstream>
+#include <sstream>
+
+ShaderVariantCache::ShaderVariantCache() {};
+
+GLuint ShaderVariantCache::getProgram(const char* vertexFile, const char* fragmentFile, const std::vector<std::string>& defines) {
+    std::string key = makeKey(std::string(vertexFile) + "|" + fragmentFile, defines);
+
+    std::map<std::string, GLuint>::iterator cached = _programs.find(key);
+    if(cached != _programs.end()) {
+        return cached->second;
+    }
+
+    std::string vertexSource, fragmentSource;
+    if( !readFile(vertexFile, vertexSource) || !readFile(fragmentFile, fragmentSource) ) {
+        return 0;
+    }
+
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexFile, injectDefines(vertexSource, defines));
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentFile, injectDefines(fragmentSource, defines));
+    if( vertexShader == 0 || fragmentShader == 0 ) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    const GLuint SHADERS[2] = { vertexShader, fragmentShader };
+    return linkProgram(key, SHADERS, 2);
+}
+
+GLuint ShaderVariantCache::getComputeProgram(const char* computeFile, const std::vector<std::string>& defines) {
+    std::string key = makeKey(computeFile, defines);
+
+    std::map<std::string, GLuint>::iterator cached = _programs.find(key);
+    if(cached != _programs.end()) {
+        return cached->second;
+    }
+
+    std::string computeSource;
+    if( !readFile(computeFile, computeSource) ) {
+        return 0;
+    }
+
+    GLuint computeShader = compileShader(GL_COMPUTE_SHADER, computeFile, injectDefines(computeSource, defines));
+    if( computeShader == 0 ) {
+        return 0;
+    }
+    return linkProgram(key, &computeShader, 1);
+}
+
+std::string ShaderVariantCache::makeKey(const std::string& files, const std::vector<std::string>& defines) {
+    std::string key = files;
+    for(const std::string& define : defines) {
+        key += "|" + define;
+    }
+    return key;
+}
+
+GLuint ShaderVariantCache::linkProgram(const std::string& key, const GLuint *shaders, int numShaders) {
+    GLuint program = glCreateProgram();
+    for(int s = 0; s < numShaders; s++) {
+        glAttachShader(program, shaders[s]);
+    }
+    glLinkProgram(program);
+
+    // the program keeps the compiled code, the shader objects are no longer needed
+    for(int s = 0; s < numShaders; s++) {
+        glDetachShader(program, shaders[s]);
+        glDeleteShader(shaders[s]);
+    }
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if( linked != GL_TRUE ) {
+        GLchar log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        fprintf( stderr, "[ERROR]: could not link shader variant %s\n%s\n", key.c_str(), log );
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    fprintf( stdout, "[INFO]: shader variant %s compiled as program %d\n", key.c_str(), program );
+
+    _programs[key] = program;
+    return program;
+}
+
+size_t ShaderVariantCache::size() const {
+    return _programs.size();
+}
+
+void ShaderVariantCache::cleanup() {
+    fprintf( stdout, "[INFO]: ...deleting shader variants....\n" );
+
+    for(std::map<std::string, GLuint>::iterator it = _programs.begin(); it != _programs.end(); ++it) {
+        glDeleteProgram(it->second);
+    }
+    _programs.clear();
+}
+
+bool ShaderVariantCache::readFile(const char* filename, std::string& contents) {
+    std::ifstream file(filename);
+    if( !file.is_open() ) {
+        fprintf( stderr, "[ERROR]: could not open shader file %s\n", filename );
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+std::string ShaderVariantCache::injectDefines(const std::string& source, const std::vector<std::string>& defines) {
+    std::string defineBlock;
+    for(const std::string& define : defines) {
+        defineBlock += "#define " + define + "\n";
+    }
+
+    // #version must stay the first statement, so place the defines right after it
+    size_t versionPos = source.find("#version");
+    if(versionPos == std::string::npos) {
+        return defineBlock + source;
+    }
+    size_t lineEnd = source.find('\n', versionPos);
+    if(lineEnd == std::string::npos) {
+        return source + "\n" + defineBlock;
+    }
+    std::string result = source;
+    result.insert(lineEnd + 1, defineBlock);
+    return result;
+}
+
+GLuint ShaderVariantCache::compileShader(GLenum type, const char* filename, const std::string& source) {
+    GLuint shader = glCreateShader(type);
+    const GLchar* sourcePtr = source.c_str();
+    glShaderSource(shader, 1, &sourcePtr, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if( compiled != GL_TRUE ) {
+        GLchar log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        fprintf( stderr, "[ERROR]: could not compile shader variant of %s\n%s\n", filename, log );
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
@@ -0,0 +1,58 @@
+//
+// Compiles and caches permutations of a shader program.
+//
+// A permutation is a shader program built from the same source files but with a
+// set of #define lines injected directly after the #version directive.  Each
+// unique combination of files and defines is compiled once and then handed back
+// from the cache on every later request.
+//
+
+#ifndef LAB10_SHADERVARIANTCACHE_H
+#define LAB10_SHADERVARIANTCACHE_H
+
+// opengl libraries
+#include <GL/glew.h>                    // define our OpenGL extensions
+
+// include C and C++ libraries
+#include <map>
+#include <string>
+#include <vector>
+
+class ShaderVariantCache {
+public:
+
+    ShaderVariantCache();
+
+    // returns the program handle for the given defines, compiling it on first use
+    //   defines are given as "NAME" or "NAME VALUE" and become "#define NAME VALUE"
+    //   returns 0 if the program failed to compile or link
+    GLuint getProgram(const char* vertexFile, const char* fragmentFile, const std::vector<std::string>& defines);
+    // the same for a compute shader on its own, which needs OpenGL 4.3
+    GLuint getComputeProgram(const char* computeFile, const std::vector<std::string>& defines);
+
+    // number of programs that have been compiled so far
+    size_t size() const;
+
+    // deletes every cached program off of the GPU
+    void cleanup();
+
+private:
+
+    // reads a whole text file, returns false if it could not be opened
+    static bool readFile(const char* filename, std::string& contents);
+
+    // inserts the defines on the line after #version
+    static std::string injectDefines(const std::string& source, const std::vector<std::string>& defines);
+
+    static GLuint compileShader(GLenum type, const char* filename, const std::string& source);
+
+    // links the compiled shaders, which are deleted either way, and caches the program under key
+    GLuint linkProgram(const std::string& key, const GLuint *shaders, int numShaders);
+
+    // files plus every define
+    static std::string makeKey(const std::string& files, const std::vector<std::string>& defines);
+
+    std::map<std::string, GLuint> _programs;        // key is the files plus every define
+};
+
+#endif //LAB10_SHADERVARIANTCACHE_H
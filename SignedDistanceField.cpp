@@ -0,0 +1,203 @@
+//
+// Sparse signed distance field of the static scene, baked offline by sdfBake.
+//
+
+#include "SignedDistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+const uint32_t SignedDistanceField::VERSION;
+const uint32_t SignedDistanceField::BRICK_SIZE;
+const uint32_t SignedDistanceField::EMPTY_BRICK;
+
+SignedDistanceField::SignedDistanceField() {
+    _header = nullptr;
+    _slots = nullptr;
+    _coarse = nullptr;
+    _samples = nullptr;
+    _inverseVoxelSize = 1.0f;
+    _sampleScale = 0.0f;
+}
+
+bool SignedDistanceField::load(const char* filename) {
+    _header = nullptr;
+    if(!_file.open(filename)) {
+        return false;
+    }
+
+    const char* bytes = (const char*)_file.data();
+    const SDFFileHeader *header = (const SDFFileHeader*)bytes;
+    if(_file.size() < sizeof(SDFFileHeader) || memcmp(header->magic, "SDF1", 4) != 0 || header->version != VERSION
+       || header->brickSize != BRICK_SIZE) {
+        fprintf(stderr, "[ERROR]: \"%s\" is not a version %u distance field\n", filename, VERSION);
+        _file.close();
+        return false;
+    }
+    size_t numSlots = (size_t)header->bricks[0] * header->bricks[1] * header->bricks[2];
+    size_t brickSamples = (BRICK_SIZE + 1) * (BRICK_SIZE + 1) * (BRICK_SIZE + 1);
+    if(header->slotOffset + numSlots * sizeof(uint32_t) > _file.size()
+       || header->coarseOffset + numSlots * sizeof(float) > _file.size()
+       || header->sampleOffset + header->numBricks * brickSamples * sizeof(int16_t) > _file.size()) {
+        fprintf(stderr, "[ERROR]: \"%s\" is truncated\n", filename);
+        _file.close();
+        return false;
+    }
+
+    _header = header;
+    _slots = (const uint32_t*)(bytes + header->slotOffset);
+    _coarse = (const float*)(bytes + header->coarseOffset);
+    _samples = (const int16_t*)(bytes + header->sampleOffset);
+    _origin = glm::vec3(header->origin[0], header->origin[1], header->origin[2]);
+    _inverseVoxelSize = 1.0f / header->voxelSize;
+    _cells = glm::ivec3(header->bricks[0] * BRICK_SIZE, header->bricks[1] * BRICK_SIZE, header->bricks[2] * BRICK_SIZE);
+    _sampleScale = header->band / 32767.0f;
+
+    fprintf(stdout, "[INFO]: distance field \"%s\" mapped, %u of %zu bricks stored, %.1f MB\n",
+            filename, header->numBricks, numSlots, _file.size() / (1024.0 * 1024.0));
+    return true;
+}
+
+bool SignedDistanceField::isLoaded() const {
+    return _header != nullptr;
+}
+
+float SignedDistanceField::sample(const glm::vec3 &position) const {
+    glm::vec3 gradient;
+    return sample(position, gradient);
+}
+
+float SignedDistanceField::sample(const glm::vec3 &position, glm::vec3 &gradient) const {
+    gradient = glm::vec3(0.0f);
+    if(_header == nullptr) return 0.0f;
+
+    glm::vec3 g = (position - _origin) * _inverseVoxelSize;
+    if(g.x < 0.0f || g.y < 0.0f || g.z < 0.0f || g.x >= _cells.x || g.y >= _cells.y || g.z >= _cells.z) {
+        return _header->band;
+    }
+
+    int x = (int)g.x, y = (int)g.y, z = (int)g.z;
+    float fx = g.x - x, fy = g.y - y, fz = g.z - z;
+    const int B = BRICK_SIZE;
+    uint32_t slot = ((uint32_t)(z / B) * _header->bricks[1] + (uint32_t)(y / B)) * _header->bricks[0] + (uint32_t)(x / B);
+    uint32_t brick = _slots[slot];
+    if(brick == EMPTY_BRICK) {
+        return _coarse[slot];
+    }
+
+    // the eight corners of the cell, all inside this brick thanks to the shared border samples
+    const int S = B + 1;
+    const int16_t *s = _samples + (size_t)brick * S * S * S + ((z % B) * S + (y % B)) * S + (x % B);
+    float c000 = s[0],         c100 = s[1];
+    float c010 = s[S],         c110 = s[S + 1];
+    float c001 = s[S * S],     c101 = s[S * S + 1];
+    float c011 = s[S * S + S], c111 = s[S * S + S + 1];
+
+    float c00 = c000 + (c100 - c000) * fx, c10 = c010 + (c110 - c010) * fx;
+    float c01 = c001 + (c101 - c001) * fx, c11 = c011 + (c111 - c011) * fx;
+    float c0 = c00 + (c10 - c00) * fy, c1 = c01 + (c11 - c01) * fy;
+
+    // derivative of the same trilinear blend along each axis
+    float dx = ((c100 - c000) * (1.0f - fy) + (c110 - c010) * fy) * (1.0f - fz)
+             + ((c101 - c001) * (1.0f - fy) + (c111 - c011) * fy) * fz;
+    float dy = (c10 - c00) * (1.0f - fz) + (c11 - c01) * fz;
+    float dz = c1 - c0;
+    gradient = glm::vec3(dx, dy, dz) * (_sampleScale * _inverseVoxelSize);
+    return (c0 + (c1 - c0) * fz) * _sampleScale;
+}
+
+bool SignedDistanceField::intersectSegment(const glm::vec3 &start, const glm::vec3 &end, float &t, glm::vec3 &normal) const {
+    if(_header == nullptr) return false;
+
+    glm::vec3 move = end - start;
+    float length = glm::length(move);
+    // the field is only as good as its samples, closer than a fraction of a voxel counts as touching
+    const float SURFACE = 0.25f * _header->voxelSize;
+    float travelled = 0.0f;
+    while(true) {
+        glm::vec3 gradient;
+        float d = sample(length > 0.0f ? start + move * (travelled / length) : start, gradient);
+        // only counts while heading into the surface, so a particle resting on it can still leave,
+        // but the coarse bricks deep inside have no gradient and always count
+        float g = glm::length(gradient);
+        if(d < SURFACE && (g == 0.0f || glm::dot(move, gradient) < 0.0f)) {
+            t = length > 0.0f ? travelled / length : 0.0f;
+            // push back the way the segment came when the field cannot say which way is out
+            if(g > 0.0f)           normal = gradient / g;
+            else if(length > 0.0f) normal = -move / length;
+            else                   normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            return true;
+        }
+        // nothing is closer than d, so the segment is clear that far
+        if(travelled + std::max(d, 0.0f) >= length) return false;
+        travelled = std::min(travelled + std::max(d, SURFACE), length);
+    }
+}
+
+GLuint SignedDistanceField::createTexture() const {
+    if(_header == nullptr) return 0;
+
+    // expand to one texel per sample, the empty bricks filled with their coarse distance
+    glm::ivec3 size = _cells + glm::ivec3(1);
+    std::vector<GLfloat> texels((size_t)size.x * size.y * size.z);
+    const int B = BRICK_SIZE, S = B + 1;
+    for(int z = 0; z < size.z; z++) {
+        for(int y = 0; y < size.y; y++) {
+            for(int x = 0; x < size.x; x++) {
+                // the last sample along an axis belongs to the last brick
+                int bx = std::min(x / B, (int)_header->bricks[0] - 1);
+                int by = std::min(y / B, (int)_header->bricks[1] - 1);
+                int bz = std::min(z / B, (int)_header->bricks[2] - 1);
+                uint32_t slot = ((uint32_t)bz * _header->bricks[1] + by) * _header->bricks[0] + bx;
+                uint32_t brick = _slots[slot];
+                GLfloat value = _coarse[slot];
+                if(brick != EMPTY_BRICK) {
+                    value = _samples[(size_t)brick * S * S * S + ((z - bz * B) * S + (y - by * B)) * S + (x - bx * B)] * _sampleScale;
+                }
+                texels[((size_t)z * size.y + y) * size.x + x] = value;
+            }
+        }
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R16F, size.x, size.y, size.z, 0, GL_RED, GL_FLOAT, &texels[0]);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    fprintf(stdout, "[INFO]: distance field texture %u is %dx%dx%d\n", texture, size.x, size.y, size.z);
+    return texture;
+}
+
+glm::vec3 SignedDistanceField::getBoundsMin() const {
+    return _origin;
+}
+
+glm::vec3 SignedDistanceField::getBoundsMax() const {
+    if(_header == nullptr) return _origin;
+    return _origin + glm::vec3(_cells) * _header->voxelSize;
+}
+
+float SignedDistanceField::getBand() const {
+    return _header != nullptr ? _header->band : 0.0f;
+}
+
+float SignedDistanceField::getVoxelSize() const {
+    return _header != nullptr ? _header->voxelSize : 0.0f;
+}
+
+uint32_t SignedDistanceField::getNumBricks() const {
+    return _header != nullptr ? _header->numBricks : 0;
+}
+
+size_t SignedDistanceField::getSizeBytes() const {
+    return _file.size();
+}
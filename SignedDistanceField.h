@@ -0,0 +1,86 @@
+//
+// Sparse signed distance field of the static scene, baked offline by sdfBake.
+//
+// The volume is cut into bricks of BRICK_SIZE^3 cells.  Only bricks that come
+// within the band of the surface store samples, (BRICK_SIZE+1)^3 of them so a
+// lookup never has to look into a neighbouring brick.  Every other brick keeps
+// a single signed distance, the nearest the surface comes to any point in it,
+// which tells inside from outside and is safe to sphere trace by.  Samples are
+// 16 bit, scaled by the band.
+//
+// The baked file is memory mapped and used in place, so loading is free and
+// pages are only read in where particles actually go.  A lookup is one table
+// read and a trilinear blend of eight samples, whatever the size of the mesh.
+//
+
+#ifndef LAB10_SIGNEDDISTANCEFIELD_H
+#define LAB10_SIGNEDDISTANCEFIELD_H
+
+#include <GL/glew.h>                    // define our OpenGL extensions
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <cstdint>
+
+#include "MappedFile.h"
+
+// layout of a baked field file, all offsets from the start of the file
+struct SDFFileHeader {
+    char magic[4];                      // "SDF1"
+    uint32_t version;
+    float origin[3];                    // position of the first sample
+    float voxelSize;
+    uint32_t bricks[3];                 // number of bricks along each axis
+    uint32_t brickSize;                 // cells along each edge of a brick
+    float band;                         // distances are clamped to +-band
+    uint32_t numBricks;                 // bricks that store samples
+    uint64_t slotOffset;                // uint32 per brick, index into the samples or EMPTY_BRICK
+    uint64_t coarseOffset;              // float per brick, signed lower bound on the distance inside it
+    uint64_t sampleOffset;              // int16 samples of every stored brick, x fastest
+};
+
+class SignedDistanceField {
+public:
+    static const uint32_t VERSION = 1;
+    static const uint32_t BRICK_SIZE = 8;
+    static const uint32_t EMPTY_BRICK = 0xffffffff;
+
+    SignedDistanceField();
+
+    bool load(const char* filename);
+    bool isLoaded() const;
+
+    // distance to the surface, negative inside, the band for anything outside the volume
+    float sample(const glm::vec3 &position) const;
+    // also the gradient, which points away from the surface
+    float sample(const glm::vec3 &position, glm::vec3 &gradient) const;
+    // sphere traces the segment, t is the fraction of the way along and normal the unit gradient there
+    bool intersectSegment(const glm::vec3 &start, const glm::vec3 &end, float &t, glm::vec3 &normal) const;
+
+    // the whole field as a dense single channel 3D texture for lookups on the GPU, expanded from
+    // the bricks so only build it for a pass that samples it,
+    // texture coordinates are (position - getBoundsMin()) / (getBoundsMax() - getBoundsMin())
+    GLuint createTexture() const;
+
+    glm::vec3 getBoundsMin() const;
+    glm::vec3 getBoundsMax() const;
+    float getBand() const;
+    float getVoxelSize() const;
+    uint32_t getNumBricks() const;
+    size_t getSizeBytes() const;
+
+private:
+    MappedFile _file;
+    const SDFFileHeader *_header;
+    const uint32_t *_slots;
+    const float *_coarse;
+    const int16_t *_samples;
+
+    glm::vec3 _origin;
+    float _inverseVoxelSize;
+    glm::ivec3 _cells;
+    float _sampleScale;                 // band / 32767
+};
+
+#endif //LAB10_SIGNEDDISTANCEFIELD_H
@@ -0,0 +1,125 @@
+//
+// Runs the simulation on its own thread, one frame ahead of the renderer.
+//
+
+#include "SimPipeline.h"
+
+#include <chrono>                       // for high resolution time
+#include <cstdio>				        // for printf functionality
+
+namespace {
+    uint64_t nanosSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+uint32_t SimSnapshot::indexOf(BodyHandle handle) const {
+    if(handle.slot >= bodySlotToIndex.size() || bodySlotGenerations[handle.slot] != handle.generation) {
+        return BodySystem::INVALID_INDEX;
+    }
+    return bodySlotToIndex[handle.slot];
+}
+
+const BodyMaterial& SimSnapshot::materialOf(uint32_t index) const {
+    return bodyMaterials[bodyMaterialIDs[index]];
+}
+
+SimPipeline::SimPipeline() {
+    _published = 0;
+    _released = 0;
+    _stop = false;
+    _renderFrame = 0;
+    _simulationNanos = 0;
+    _simulatedFrames = 0;
+    _waitNanos = 0;
+    _renderedFrames = 0;
+}
+
+SimPipeline::~SimPipeline() {
+    stop();
+}
+
+void SimPipeline::start(const StepFunction &step) {
+    if(_thread.joinable()) return;
+    _step = step;
+    _published = 0;
+    _released = 0;
+    _stop = false;
+    _renderFrame = 0;
+    resetStats();
+    _thread = std::thread(&SimPipeline::simulationLoop, this);
+    fprintf( stdout, "[INFO]: simulation pipelined on its own thread\n" );
+}
+
+void SimPipeline::simulationLoop() {
+    for(uint64_t frame = 0; ; frame++) {
+        // the snapshot for this frame last held frame - 2, wait until the renderer has finished with it
+        while(frame >= 2 && _released.load(std::memory_order_acquire) < frame - 1) {
+            if(_stop.load(std::memory_order_relaxed)) return;
+            std::this_thread::yield();
+        }
+        if(_stop.load(std::memory_order_relaxed)) return;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        SimSnapshot &snapshot = _snapshots[frame % 2];
+        _step(snapshot);
+        snapshot.frame = frame;
+        _simulationNanos.fetch_add(nanosSince(start), std::memory_order_relaxed);
+        _simulatedFrames.fetch_add(1, std::memory_order_relaxed);
+
+        // everything written to the snapshot is visible before the count moves on
+        _published.store(frame + 1, std::memory_order_release);
+    }
+}
+
+const SimSnapshot& SimPipeline::acquire() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while(_published.load(std::memory_order_acquire) <= _renderFrame) {
+        std::this_thread::yield();
+    }
+    _waitNanos += nanosSince(start);
+    return _snapshots[_renderFrame % 2];
+}
+
+void SimPipeline::release() {
+    _renderFrame++;
+    _renderedFrames++;
+    _released.store(_renderFrame, std::memory_order_release);
+}
+
+void SimPipeline::stop() {
+    if(!_thread.joinable()) return;
+    _stop = true;
+    _thread.join();
+}
+
+bool SimPipeline::isRunning() const {
+    return _thread.joinable();
+}
+
+double SimPipeline::getSimulationTime() const {
+    uint64_t frames = _simulatedFrames.load();
+    return frames == 0 ? 0.0 : _simulationNanos.load() / (1e6 * frames);
+}
+
+double SimPipeline::getWaitTime() const {
+    return _renderedFrames == 0 ? 0.0 : _waitNanos / (1e6 * _renderedFrames);
+}
+
+double SimPipeline::getOverlap() const {
+    double simulation = getSimulationTime();
+    if(simulation <= 0.0) return 0.0;
+    double overlap = 1.0 - getWaitTime() / simulation;
+    return overlap < 0.0 ? 0.0 : overlap;
+}
+
+uint64_t SimPipeline::getNumFrames() const {
+    return _renderedFrames;
+}
+
+void SimPipeline::resetStats() {
+    _simulationNanos = 0;
+    _simulatedFrames = 0;
+    _waitNanos = 0;
+    _renderedFrames = 0;
+}
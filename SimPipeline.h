@@ -0,0 +1,105 @@
+//
+// Runs the simulation on its own thread, one frame ahead of the renderer.
+//
+// The simulation thread steps the scene and writes everything the renderer
+// needs into one of two snapshots, while the render thread draws from the
+// other.  Each side only waits on a pair of atomic frame counters: the
+// simulation may not write a snapshot until the renderer has let go of the
+// frame that used it last, and the renderer may not read one until it has
+// been published.  So frame N+1 is simulated while frame N is submitted to
+// GL and swapped, and neither thread takes a lock to hand a frame over.
+//
+// The time the simulation spends stepping and the time the renderer spends
+// waiting for it are both counted, so the overlap actually achieved can be
+// reported: whatever of the simulation time the renderer did not wait for
+// was hidden behind rendering.
+//
+
+#ifndef LAB10_SIMPIPELINE_H
+#define LAB10_SIMPIPELINE_H
+
+#include <GL/glew.h>                    // define our OpenGL extensions
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "BodySystem.h"
+#include "InstanceBatch.h"
+#include "ParticleSystem.h"
+
+// everything the renderer reads from the simulation for one frame, it never looks at the live systems
+struct SimSnapshot {
+    uint64_t frame;
+    std::vector<glm::vec3> particlePositions;
+    std::vector<GLint> particleLifespans;
+    ParticleSystem::EmitterDrawState particleEmitter;
+    std::vector<glm::vec3> bodyPositions;       // in body index order
+    std::vector<uint32_t> bodyMaterialIDs;      // in body index order
+    std::vector<BodyMaterial> bodyMaterials;    // by material ID
+    std::vector<uint32_t> bodySlotToIndex;      // BodySystem's handle tables as of this frame
+    std::vector<uint32_t> bodySlotGenerations;
+    glm::vec3 lightPosition;                    // where the scene's point light is
+    std::vector<glm::mat4> nodeMatrices;        // world matrix of every scene graph node
+    std::vector<InstanceTransform> instances;   // built on the simulation side, ready to upload
+
+    // BodySystem::indexOf() as of this frame
+    uint32_t indexOf(BodyHandle handle) const;
+    // the material of the body at a dense index
+    const BodyMaterial& materialOf(uint32_t index) const;
+};
+
+class SimPipeline {
+public:
+    // advances the scene one frame and fills in the snapshot, called on the simulation thread
+    typedef std::function<void(SimSnapshot &snapshot)> StepFunction;
+
+    SimPipeline();
+    ~SimPipeline();
+
+    // starts the simulation thread, which immediately produces frame 0
+    void start(const StepFunction &step);
+
+    // waits for the next frame to be published and returns it, valid until release()
+    const SimSnapshot& acquire();
+    // hands the snapshot from acquire() back so the simulation can reuse it
+    void release();
+
+    // stops and joins the simulation thread
+    void stop();
+
+    bool isRunning() const;
+
+    // average per frame since the last resetStats(), in milliseconds
+    double getSimulationTime() const;
+    double getWaitTime() const;
+    // share of the simulation time hidden behind rendering, 0 to 1
+    double getOverlap() const;
+    uint64_t getNumFrames() const;
+    void resetStats();
+
+private:
+    void simulationLoop();
+
+    std::thread _thread;
+    StepFunction _step;
+    SimSnapshot _snapshots[2];              // frame N is in _snapshots[N % 2]
+
+    std::atomic<uint64_t> _published;       // frames the simulation has finished
+    std::atomic<uint64_t> _released;        // frames the renderer is done with
+    std::atomic<bool> _stop;
+    uint64_t _renderFrame;                  // frame the renderer is on, render thread only
+
+    // statistics, each written by one thread
+    std::atomic<uint64_t> _simulationNanos;
+    std::atomic<uint64_t> _simulatedFrames;
+    uint64_t _waitNanos;
+    uint64_t _renderedFrames;
+};
+
+#endif //LAB10_SIMPIPELINE_H
@@ -0,0 +1,137 @@
+//
+// Records everything that makes one run differ from the next, so it can be replayed exactly.
+//
+
+#include "SimRecorder.h"
+
+#include <cstring>
+
+const uint32_t SimRecorder::VERSION;
+
+SimRecorder::SimRecorder() {
+    _file = nullptr;
+    _recording = false;
+    _seed = 0;
+    _numFrames = 0;
+}
+
+SimRecorder::~SimRecorder() {
+    close();
+}
+
+bool SimRecorder::startRecording(const char* filename, uint32_t seed) {
+    close();
+    _file = fopen(filename, "wb");
+    if(_file == nullptr) {
+        fprintf(stderr, "[ERROR]: Could not open \"%s\" for writing\n", filename);
+        return false;
+    }
+
+    Header header;
+    memcpy(header.magic, "SREC", 4);
+    header.version = VERSION;
+    header.seed = seed;
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, _file);
+
+    _recording = true;
+    _seed = seed;
+    _numFrames = 0;
+    fprintf(stdout, "[INFO]: recording to \"%s\" with seed %u\n", filename, seed);
+    return true;
+}
+
+void SimRecorder::writeFrame(const FrameRecord &frame) {
+    if(!_recording) return;
+
+    // field by field, so no padding ends up in the file
+    uint16_t numEvents = frame.events.size();
+    fwrite(&frame.timePassed, sizeof(int32_t), 1, _file);
+    fwrite(&frame.timeThroughSecond, sizeof(int32_t), 1, _file);
+    fwrite(&frame.cameraAngles[0], sizeof(float), 3, _file);
+    fwrite(&frame.lookAtPoint[0], sizeof(float), 3, _file);
+    fwrite(&numEvents, sizeof(uint16_t), 1, _file);
+    for(uint16_t e = 0; e < numEvents; e++) {
+        const InputEvent &event = frame.events[e];
+        fwrite(&event.type, sizeof(uint8_t), 1, _file);
+        fwrite(&event.code, sizeof(int32_t), 1, _file);
+        fwrite(&event.action, sizeof(int32_t), 1, _file);
+        fwrite(&event.mods, sizeof(int32_t), 1, _file);
+        fwrite(&event.x, sizeof(double), 1, _file);
+        fwrite(&event.y, sizeof(double), 1, _file);
+    }
+    _numFrames++;
+}
+
+bool SimRecorder::startReplay(const char* filename) {
+    close();
+    _file = fopen(filename, "rb");
+    if(_file == nullptr) {
+        fprintf(stderr, "[ERROR]: Could not open \"%s\" for reading\n", filename);
+        return false;
+    }
+
+    Header header;
+    if(fread(&header, sizeof(header), 1, _file) != 1 || memcmp(header.magic, "SREC", 4) != 0 || header.version != VERSION) {
+        fprintf(stderr, "[ERROR]: \"%s\" is not a recording this build can replay\n", filename);
+        close();
+        return false;
+    }
+
+    _recording = false;
+    _seed = header.seed;
+    _numFrames = 0;
+    fprintf(stdout, "[INFO]: replaying \"%s\" with seed %u\n", filename, _seed);
+    return true;
+}
+
+bool SimRecorder::readFrame(FrameRecord &frame) {
+    if(_file == nullptr || _recording) return false;
+
+    uint16_t numEvents = 0;
+    bool complete = fread(&frame.timePassed, sizeof(int32_t), 1, _file) == 1
+                 && fread(&frame.timeThroughSecond, sizeof(int32_t), 1, _file) == 1
+                 && fread(&frame.cameraAngles[0], sizeof(float), 3, _file) == 3
+                 && fread(&frame.lookAtPoint[0], sizeof(float), 3, _file) == 3
+                 && fread(&numEvents, sizeof(uint16_t), 1, _file) == 1;
+    frame.events.resize(numEvents);
+    for(uint16_t e = 0; complete && e < numEvents; e++) {
+        InputEvent &event = frame.events[e];
+        complete = fread(&event.type, sizeof(uint8_t), 1, _file) == 1
+                && fread(&event.code, sizeof(int32_t), 1, _file) == 1
+                && fread(&event.action, sizeof(int32_t), 1, _file) == 1
+                && fread(&event.mods, sizeof(int32_t), 1, _file) == 1
+                && fread(&event.x, sizeof(double), 1, _file) == 1
+                && fread(&event.y, sizeof(double), 1, _file) == 1;
+    }
+    // a recording cut off mid frame just ends early
+    if(!complete) return false;
+    _numFrames++;
+    return true;
+}
+
+void SimRecorder::close() {
+    if(_file == nullptr) return;
+    if(_recording) {
+        fprintf(stdout, "[INFO]: recorded %u frames\n", _numFrames);
+    }
+    fclose(_file);
+    _file = nullptr;
+    _recording = false;
+}
+
+bool SimRecorder::isRecording() const {
+    return _recording;
+}
+
+bool SimRecorder::isReplaying() const {
+    return _file != nullptr && !_recording;
+}
+
+uint32_t SimRecorder::getSeed() const {
+    return _seed;
+}
+
+uint32_t SimRecorder::getNumFrames() const {
+    return _numFrames;
+}
@@ -0,0 +1,89 @@
+//
+// Records everything that makes one run differ from the next, so it can be replayed exactly.
+//
+// The simulation itself is deterministic given its random seed, the time
+// step of every update and the input the user gave, so those are all that
+// is written: a header with the seed, then one record per frame holding the
+// time step, the camera and the input events polled that frame.  Replaying
+// the stream feeds the same events back through the callbacks and the same
+// time steps into the updates, giving a frame for frame identical workload
+// to compare builds with.
+//
+// Records are written as they happen through a buffered stream, 34 bytes
+// for a frame without input.  Values are in the byte order of the machine
+// that wrote them, recordings are not meant to move between platforms.
+//
+
+#ifndef LAB10_SIMRECORDER_H
+#define LAB10_SIMRECORDER_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// one GLFW callback, with its arguments
+struct InputEvent {
+    enum Type {
+        KEY,                            // code is the key
+        MOUSE_BUTTON,                   // code is the button
+        CURSOR,                         // x and y are the position
+        SCROLL                          // x and y are the offsets
+    };
+
+    uint8_t type;
+    int32_t code;
+    int32_t action;
+    int32_t mods;
+    double x;
+    double y;
+};
+
+struct FrameRecord {
+    int32_t timePassed;                 // milliseconds since the last update
+    int32_t timeThroughSecond;          // milliseconds into the current second
+    glm::vec3 cameraAngles;             // after the events were handled
+    glm::vec3 lookAtPoint;
+    std::vector<InputEvent> events;     // in the order they were polled
+};
+
+class SimRecorder {
+public:
+    SimRecorder();
+    ~SimRecorder();
+
+    // writes the header, frames are appended by writeFrame() until close()
+    bool startRecording(const char* filename, uint32_t seed);
+    void writeFrame(const FrameRecord &frame);
+
+    // reads the header, frames are then read back in order by readFrame()
+    bool startReplay(const char* filename);
+    // false once every frame has been read
+    bool readFrame(FrameRecord &frame);
+
+    void close();
+
+    bool isRecording() const;
+    bool isReplaying() const;
+    uint32_t getSeed() const;
+    uint32_t getNumFrames() const;     // written or read so far
+
+private:
+    static const uint32_t VERSION = 1;
+
+    struct Header {
+        char magic[4];                  // "SREC"
+        uint32_t version;
+        uint32_t seed;
+        uint32_t reserved;
+    };
+
+    FILE *_file;
+    bool _recording;
+    uint32_t _seed;
+    uint32_t _numFrames;
+};
+
+#endif //LAB10_SIMRECORDER_H
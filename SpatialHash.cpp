@@ -0,0 +1,125 @@
+//
+// Uniform grid broadphase for spheres, hashed so the grid has no bounds.
+//
+
+#include "SpatialHash.h"
+
+#include <algorithm>
+
+SpatialHash::SpatialHash() {
+    _jobSystem = nullptr;
+    _cellSize = 1.0f;
+    _inverseCellSize = 1.0f;
+    _positions = nullptr;
+    _radii = nullptr;
+    _numItems = 0;
+    _bucketMask = 0;
+    _bucketStarts.assign(2, 0);
+    _counterCapacity = 0;
+}
+
+void SpatialHash::setJobSystem(JobSystem *jobSystem) {
+    _jobSystem = jobSystem;
+}
+
+void SpatialHash::setCellSize(float cellSize) {
+    _cellSize = cellSize;
+    _inverseCellSize = 1.0f / cellSize;
+}
+
+float SpatialHash::getCellSize() const {
+    return _cellSize;
+}
+
+size_t SpatialHash::getNumItems() const {
+    return _numItems;
+}
+
+size_t SpatialHash::getNumLarge() const {
+    return _large.size();
+}
+
+void SpatialHash::parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func) {
+    if(_jobSystem != nullptr) {
+        _jobSystem->parallelFor(count, grainSize, func);
+    } else {
+        func(0, count, 0);
+    }
+}
+
+void SpatialHash::build(const glm::vec3 *positions, const float *radii, size_t count) {
+    _positions = positions;
+    _radii = radii;
+    _numItems = count;
+
+    // about two buckets per item keeps the chains short without much to clear
+    uint32_t numBuckets = 64;
+    while(numBuckets < 2 * count) {
+        numBuckets *= 2;
+    }
+    _bucketMask = numBuckets - 1;
+    if(_counterCapacity < numBuckets) {
+        _counters.reset(new std::atomic<uint32_t>[numBuckets]);
+        _counterCapacity = numBuckets;
+    }
+    _bucketStarts.resize(numBuckets + 1);
+    _itemKeys.resize(count);
+    _itemBuckets.resize(count);
+
+    // spheres too big for the grid are kept out of it
+    const float MAX_RADIUS = 0.5f * _cellSize;
+    _large.clear();
+    for(size_t i = 0; i < count; i++) {
+        if(radii[i] > MAX_RADIUS) _large.push_back(i);
+    }
+
+    parallelFor(numBuckets, 16384, [&](size_t begin, size_t end, unsigned) {
+        for(size_t b = begin; b < end; b++) {
+            _counters[b].store(0, std::memory_order_relaxed);
+        }
+    });
+
+    // count
+    parallelFor(count, 4096, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            if(radii[i] > MAX_RADIUS) {
+                _itemBuckets[i] = numBuckets;
+                continue;
+            }
+            _itemKeys[i] = cellOf(positions[i]);
+            _itemBuckets[i] = bucketOf(_itemKeys[i]);
+            _counters[_itemBuckets[i]].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    // prefix sum, the counters become the write cursor of each bucket
+    uint32_t total = 0;
+    for(uint32_t b = 0; b < numBuckets; b++) {
+        uint32_t n = _counters[b].load(std::memory_order_relaxed);
+        _bucketStarts[b] = total;
+        _counters[b].store(total, std::memory_order_relaxed);
+        total += n;
+    }
+    _bucketStarts[numBuckets] = total;
+    _sortedItems.resize(total);
+
+    // scatter
+    parallelFor(count, 4096, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            if(_itemBuckets[i] == numBuckets) continue;
+            uint32_t slot = _counters[_itemBuckets[i]].fetch_add(1, std::memory_order_relaxed);
+            _sortedItems[slot] = i;
+        }
+    });
+
+    // the scatter order depends on thread timing, sorting the short buckets makes queries repeatable
+    parallelFor(numBuckets, 16384, [&](size_t begin, size_t end, unsigned) {
+        for(size_t b = begin; b < end; b++) {
+            uint32_t first = _bucketStarts[b];
+            uint32_t last = _bucketStarts[b + 1];
+            if(last - first > 1) {
+                std::sort(_sortedItems.begin() + first, _sortedItems.begin() + last);
+            }
+        }
+    });
+}
@@ -0,0 +1,131 @@
+//
+// Uniform grid broadphase for spheres, hashed so the grid has no bounds.
+//
+// build() drops every sphere into the cell holding its centre and counting
+// sorts them by hashed cell: count per bucket, prefix sum, scatter.  The count
+// and scatter passes run on the job system and each bucket is sorted by index
+// afterwards so queries visit candidates in the same order every run.  Both
+// the build and a query against a cell sized sphere are linear in the number
+// of items.
+//
+// A sphere must fit in half a cell to be found from the 27 cells around a
+// query.  Anything bigger - the teapot next to a cloud of debris - goes in a
+// separate list that every query tests directly.  There should only be a
+// handful of those.
+//
+// The positions and radii passed to build() are kept by pointer and read by
+// the queries, so they have to stay alive until the next build.
+//
+
+#ifndef LAB10_SPATIALHASH_H
+#define LAB10_SPATIALHASH_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "JobSystem.h"
+
+class SpatialHash {
+public:
+    SpatialHash();
+
+    // used for the count and scatter passes, may be null
+    void setJobSystem(JobSystem *jobSystem);
+
+    // edge length of a cell, should be about the diameter of the common spheres
+    void setCellSize(float cellSize);
+    float getCellSize() const;
+
+    // rebuilds the grid over count spheres
+    void build(const glm::vec3 *positions, const float *radii, size_t count);
+
+    // calls visit(index) for every sphere overlapping the query sphere
+    template<typename Visitor>
+    void querySphere(const glm::vec3 &center, float radius, Visitor visit) const;
+
+    size_t getNumItems() const;
+    size_t getNumLarge() const;         // spheres too big for the grid in the last build
+
+private:
+    struct CellKey {
+        int32_t x, y, z;
+    };
+
+    void parallelFor(size_t count, size_t grainSize, const JobSystem::RangeFunction &func);
+
+    CellKey cellOf(const glm::vec3 &position) const;
+    uint32_t bucketOf(const CellKey &key) const;
+    bool overlaps(uint32_t index, const glm::vec3 &center, float radius) const;
+
+    JobSystem *_jobSystem;
+    float _cellSize;
+    float _inverseCellSize;
+
+    const glm::vec3 *_positions;
+    const float *_radii;
+    size_t _numItems;
+
+    uint32_t _bucketMask;               // number of buckets minus one, always a power of two
+    std::vector<uint32_t> _bucketStarts;    // first entry of each bucket in _sortedItems, plus an end marker
+    std::vector<uint32_t> _sortedItems;
+    std::vector<CellKey> _itemKeys;     // cell of every item, hash collisions are skipped by comparing these
+    std::vector<uint32_t> _itemBuckets;
+    std::vector<uint32_t> _large;
+
+    std::unique_ptr<std::atomic<uint32_t>[]> _counters;
+    size_t _counterCapacity;
+};
+
+inline SpatialHash::CellKey SpatialHash::cellOf(const glm::vec3 &position) const {
+    CellKey key;
+    key.x = (int32_t)std::floor(position.x * _inverseCellSize);
+    key.y = (int32_t)std::floor(position.y * _inverseCellSize);
+    key.z = (int32_t)std::floor(position.z * _inverseCellSize);
+    return key;
+}
+
+inline uint32_t SpatialHash::bucketOf(const CellKey &key) const {
+    uint32_t h = (uint32_t)key.x * 73856093u ^ (uint32_t)key.y * 19349663u ^ (uint32_t)key.z * 83492791u;
+    return h & _bucketMask;
+}
+
+inline bool SpatialHash::overlaps(uint32_t index, const glm::vec3 &center, float radius) const {
+    glm::vec3 d = _positions[index] - center;
+    float reach = radius + _radii[index];
+    return glm::dot(d, d) < reach * reach;
+}
+
+template<typename Visitor>
+void SpatialHash::querySphere(const glm::vec3 &center, float radius, Visitor visit) const {
+    for(size_t l = 0; l < _large.size(); l++) {
+        if(overlaps(_large[l], center, radius)) visit(_large[l]);
+    }
+    if(_numItems == _large.size()) return;
+
+    // grid items are at most half a cell across, so their centres are within this of the query
+    float reach = radius + 0.5f * _cellSize;
+    CellKey lo = cellOf(center - glm::vec3(reach));
+    CellKey hi = cellOf(center + glm::vec3(reach));
+    for(int32_t z = lo.z; z <= hi.z; z++) {
+        for(int32_t y = lo.y; y <= hi.y; y++) {
+            for(int32_t x = lo.x; x <= hi.x; x++) {
+                CellKey key = { x, y, z };
+                uint32_t bucket = bucketOf(key);
+                for(uint32_t e = _bucketStarts[bucket]; e < _bucketStarts[bucket + 1]; e++) {
+                    uint32_t index = _sortedItems[e];
+                    const CellKey &itemKey = _itemKeys[index];
+                    if(itemKey.x != x || itemKey.y != y || itemKey.z != z) continue;
+                    if(overlaps(index, center, radius)) visit(index);
+                }
+            }
+        }
+    }
+}
+
+#endif //LAB10_SPATIALHASH_H
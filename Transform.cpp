@@ -14,7 +14,7 @@
         glm::mat4 translationMtx = glm::translate(glm::mat4(1), position);
         matrix = (translationMtx * scaleMtx) * rotationMtx;
         if(parent != nullptr) {
-            matrix = parent->matrix * matrix;
+            matrix = parent->getMatrix() * matrix;     // walk up so a stale parent is never used
         }
     }
     glm::mat4 Transform::getMatrix()    {
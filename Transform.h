@@ -10,7 +10,7 @@
 #define TUTORIALS_TRANSFORM_H
 class Transform {
 public:
-    Transform *parent;
+    Transform *parent = nullptr;
     glm::quat rotation;
     glm::vec3 position = glm::vec3 (0,0,0);
     glm::vec3 scale = glm::vec3 (1,1,1);
@@ -0,0 +1,576 @@
+//
+// Bounding volume hierarchy over a static triangle mesh for ray and segment queries.
+//
+
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TRIANGLE_BVH_SSE
+#endif
+
+const uint32_t TriangleBVH::MAX_LEAF_TRIANGLES;
+const uint32_t TriangleBVH::NUM_BINS;
+const uint32_t TriangleBVH::MAX_SAH_DEPTH;
+
+namespace {
+    const uint32_t NO_TRIANGLE = 0xffffffff;
+    const int STACK_SIZE = 128;         // MAX_SAH_DEPTH levels plus the halving below them
+
+    float surfaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+        glm::vec3 e = boundsMax - boundsMin;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+}
+
+TriangleBVH::TriangleBVH() {}
+
+void TriangleBVH::clear() {
+    _vertices.clear();
+    _nodes.clear();
+    _packets.clear();
+}
+
+void TriangleBVH::addTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    _vertices.push_back(a);
+    _vertices.push_back(b);
+    _vertices.push_back(c);
+}
+
+size_t TriangleBVH::getNumTriangles() const {
+    return _vertices.size() / 3;
+}
+
+size_t TriangleBVH::getNumNodes() const {
+    return _nodes.size();
+}
+
+glm::vec3 TriangleBVH::getBoundsMin() const {
+    return _nodes.empty() ? glm::vec3(0.0f) : _nodes[0].boundsMin;
+}
+
+glm::vec3 TriangleBVH::getBoundsMax() const {
+    return _nodes.empty() ? glm::vec3(0.0f) : _nodes[0].boundsMax;
+}
+
+bool TriangleBVH::loadOBJ(const char* filename, const glm::mat4 &transform) {
+    std::ifstream in(filename);
+    if(!in.is_open()) {
+        fprintf(stderr, "[ERROR]: Could not open \"%s\" for the collision mesh\n", filename);
+        return false;
+    }
+
+    // only the positions and faces matter here, texture coordinates and normals are skipped
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> face;
+    size_t numTriangles = getNumTriangles();
+    std::string line;
+    while(std::getline(in, line)) {
+        if(line.size() < 2) continue;
+        if(line[0] == 'v' && line[1] == ' ') {
+            glm::vec4 p(0.0f, 0.0f, 0.0f, 1.0f);
+            sscanf(line.c_str() + 2, "%f %f %f", &p.x, &p.y, &p.z);
+            positions.push_back(glm::vec3(transform * p));
+        } else if(line[0] == 'f' && line[1] == ' ') {
+            face.clear();
+            std::istringstream tokens(line.substr(2));
+            std::string token;
+            while(tokens >> token) {
+                // v, v/vt, v//vn or v/vt/vn - negative indices count back from the last vertex
+                long index = strtol(token.c_str(), nullptr, 10);
+                if(index < 0) index += positions.size() + 1;
+                if(index < 1 || index > (long)positions.size()) {
+                    fprintf(stderr, "[ERROR]: Bad face index in \"%s\": %s\n", filename, token.c_str());
+                    return false;
+                }
+                face.push_back(index - 1);
+            }
+            for(size_t k = 2; k < face.size(); k++) {
+                addTriangle(positions[face[0]], positions[face[k - 1]], positions[face[k]]);
+            }
+        }
+    }
+
+    fprintf(stdout, "[INFO]: collision mesh \"%s\" read in with %zu triangles\n", filename, getNumTriangles() - numTriangles);
+    return true;
+}
+
+void TriangleBVH::build() {
+    _nodes.clear();
+    _packets.clear();
+    uint32_t numTriangles = getNumTriangles();
+    if(numTriangles == 0) return;
+
+    std::vector<glm::vec3> centroids(numTriangles);
+    std::vector<uint32_t> order(numTriangles);
+    for(uint32_t i = 0; i < numTriangles; i++) {
+        centroids[i] = (_vertices[3 * i] + _vertices[3 * i + 1] + _vertices[3 * i + 2]) / 3.0f;
+        order[i] = i;
+    }
+
+    _nodes.reserve(2 * (numTriangles / MAX_LEAF_TRIANGLES + 1));
+    _packets.reserve(numTriangles / MAX_LEAF_TRIANGLES + 1);
+    _nodes.push_back(Node());
+    subdivide(0, 0, numTriangles, 0, order, centroids);
+}
+
+void TriangleBVH::subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth, std::vector<uint32_t> &order,
+                            const std::vector<glm::vec3> &centroids) {
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+    for(uint32_t i = first; i < first + count; i++) {
+        uint32_t t = order[i];
+        for(int k = 0; k < 3; k++) {
+            boundsMin = glm::min(boundsMin, _vertices[3 * t + k]);
+            boundsMax = glm::max(boundsMax, _vertices[3 * t + k]);
+        }
+        centroidMin = glm::min(centroidMin, centroids[t]);
+        centroidMax = glm::max(centroidMax, centroids[t]);
+    }
+    _nodes[nodeIndex].boundsMin = boundsMin;
+    _nodes[nodeIndex].boundsMax = boundsMax;
+
+    if(count <= MAX_LEAF_TRIANGLES) {
+        makeLeaf(_nodes[nodeIndex], first, count, order);
+        return;
+    }
+
+    // bin the centroids along every axis and keep the cheapest plane
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    float bestCost = FLT_MAX;
+    for(int axis = 0; axis < 3 && depth < MAX_SAH_DEPTH; axis++) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if(extent <= 0.0f) continue;
+        float binScale = NUM_BINS / extent;
+
+        uint32_t binCounts[NUM_BINS] = { 0 };
+        glm::vec3 binMin[NUM_BINS], binMax[NUM_BINS];
+        for(uint32_t b = 0; b < NUM_BINS; b++) {
+            binMin[b] = glm::vec3(FLT_MAX);
+            binMax[b] = glm::vec3(-FLT_MAX);
+        }
+        for(uint32_t i = first; i < first + count; i++) {
+            uint32_t t = order[i];
+            uint32_t b = std::min((uint32_t)((centroids[t][axis] - centroidMin[axis]) * binScale), NUM_BINS - 1);
+            binCounts[b]++;
+            for(int k = 0; k < 3; k++) {
+                binMin[b] = glm::min(binMin[b], _vertices[3 * t + k]);
+                binMax[b] = glm::max(binMax[b], _vertices[3 * t + k]);
+            }
+        }
+
+        // sweep from the right to get the cost of everything above each plane, then from the left
+        float rightArea[NUM_BINS];
+        uint32_t rightCount[NUM_BINS];
+        glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+        uint32_t sweepCount = 0;
+        for(uint32_t b = NUM_BINS - 1; b > 0; b--) {
+            sweepMin = glm::min(sweepMin, binMin[b]);
+            sweepMax = glm::max(sweepMax, binMax[b]);
+            sweepCount += binCounts[b];
+            rightArea[b] = sweepCount > 0 ? surfaceArea(sweepMin, sweepMax) : 0.0f;
+            rightCount[b] = sweepCount;
+        }
+        sweepMin = glm::vec3(FLT_MAX);
+        sweepMax = glm::vec3(-FLT_MAX);
+        sweepCount = 0;
+        for(uint32_t b = 1; b < NUM_BINS; b++) {
+            sweepMin = glm::min(sweepMin, binMin[b - 1]);
+            sweepMax = glm::max(sweepMax, binMax[b - 1]);
+            sweepCount += binCounts[b - 1];
+            if(sweepCount == 0 || rightCount[b] == 0) continue;
+            float cost = surfaceArea(sweepMin, sweepMax) * sweepCount + rightArea[b] * rightCount[b];
+            if(cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    // with every centroid in the same spot, or too deep already, the node is just cut in half
+    uint32_t leftCount = count / 2;
+    if(bestAxis >= 0) {
+        float binScale = NUM_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        float axisMin = centroidMin[bestAxis];
+        uint32_t *middle = std::partition(&order[first], &order[first] + count, [&](uint32_t t) {
+            return std::min((uint32_t)((centroids[t][bestAxis] - axisMin) * binScale), NUM_BINS - 1) < bestSplit;
+        });
+        leftCount = middle - &order[first];
+    }
+    uint32_t left = _nodes.size();
+    _nodes.push_back(Node());
+    _nodes.push_back(Node());
+    _nodes[nodeIndex].leftOrPacket = left;
+    _nodes[nodeIndex].count = 0;
+    subdivide(left, first, leftCount, depth + 1, order, centroids);
+    subdivide(left + 1, first + leftCount, count - leftCount, depth + 1, order, centroids);
+}
+
+void TriangleBVH::makeLeaf(Node &node, uint32_t first, uint32_t count, const std::vector<uint32_t> &order) {
+    TrianglePacket packet;
+    memset(&packet, 0, sizeof(packet));
+    for(uint32_t lane = 0; lane < MAX_LEAF_TRIANGLES; lane++) {
+        if(lane >= count) {
+            packet.ids[lane] = NO_TRIANGLE;
+            continue;
+        }
+        uint32_t t = order[first + lane];
+        glm::vec3 v0 = _vertices[3 * t];
+        glm::vec3 e1 = _vertices[3 * t + 1] - v0;
+        glm::vec3 e2 = _vertices[3 * t + 2] - v0;
+        for(int c = 0; c < 3; c++) {
+            packet.v0[c][lane] = v0[c];
+            packet.e1[c][lane] = e1[c];
+            packet.e2[c][lane] = e2[c];
+        }
+        packet.ids[lane] = t;
+    }
+    node.leftOrPacket = _packets.size();
+    node.count = count;
+    _packets.push_back(packet);
+}
+
+void TriangleBVH::finishHit(const glm::vec3 &direction, uint32_t packet, uint32_t lane, float t, RayHit &hit) const {
+    const TrianglePacket &p = _packets[packet];
+    glm::vec3 e1(p.e1[0][lane], p.e1[1][lane], p.e1[2][lane]);
+    glm::vec3 e2(p.e2[0][lane], p.e2[1][lane], p.e2[2][lane]);
+    glm::vec3 normal = glm::normalize(glm::cross(e1, e2));
+    hit.t = t;
+    hit.triangle = p.ids[lane];
+    hit.normal = glm::dot(normal, direction) > 0.0f ? -normal : normal;
+}
+
+glm::vec3 TriangleBVH::getNormal(uint32_t triangle) const {
+    return glm::normalize(glm::cross(_vertices[3 * triangle + 1] - _vertices[3 * triangle],
+                                     _vertices[3 * triangle + 2] - _vertices[3 * triangle]));
+}
+
+bool TriangleBVH::closestPoint(const glm::vec3 &point, float maxDistance, glm::vec3 &closest, uint32_t &triangle) const {
+    if(_packets.empty()) return false;
+
+    // squared distance from the point to a node's box, anything further than the best so far is skipped
+    float best2 = maxDistance * maxDistance;
+    auto boxDistance2 = [&](const Node &node) {
+        glm::vec3 d = glm::max(glm::max(node.boundsMin - point, point - node.boundsMax), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    };
+
+    bool found = false;
+    uint32_t stack[STACK_SIZE];
+    float stackDistances[STACK_SIZE];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+    if(boxDistance2(_nodes[0]) > best2) return false;
+
+    while(true) {
+        const Node &node = _nodes[nodeIndex];
+        if(node.count > 0) {
+            const TrianglePacket &p = _packets[node.leftOrPacket];
+            for(uint32_t lane = 0; lane < node.count; lane++) {
+                // closest point on a triangle by its voronoi regions, Ericson's Real-Time Collision Detection 5.1.5
+                glm::vec3 a(p.v0[0][lane], p.v0[1][lane], p.v0[2][lane]);
+                glm::vec3 ab(p.e1[0][lane], p.e1[1][lane], p.e1[2][lane]);
+                glm::vec3 ac(p.e2[0][lane], p.e2[1][lane], p.e2[2][lane]);
+                glm::vec3 ap = point - a, q;
+                float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+                glm::vec3 bp = ap - ab, cp = ap - ac;
+                float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+                float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+                float va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+                if(d1 <= 0.0f && d2 <= 0.0f) {
+                    q = a;
+                } else if(d3 >= 0.0f && d4 <= d3) {
+                    q = a + ab;
+                } else if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+                    q = a + ab * (d1 / (d1 - d3));
+                } else if(d6 >= 0.0f && d5 <= d6) {
+                    q = a + ac;
+                } else if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+                    q = a + ac * (d2 / (d2 - d6));
+                } else if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+                    q = a + ab + (ac - ab) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+                } else {
+                    float denominator = 1.0f / (va + vb + vc);
+                    q = a + ab * (vb * denominator) + ac * (vc * denominator);
+                }
+                glm::vec3 d = point - q;
+                float distance2 = glm::dot(d, d);
+                if(distance2 < best2) {
+                    best2 = distance2;
+                    closest = q;
+                    triangle = p.ids[lane];
+                    found = true;
+                }
+            }
+        } else {
+            uint32_t near = node.leftOrPacket, far = near + 1;
+            float nearDistance = boxDistance2(_nodes[near]), farDistance = boxDistance2(_nodes[far]);
+            if(farDistance < nearDistance) {
+                std::swap(near, far);
+                std::swap(nearDistance, farDistance);
+            }
+            if(nearDistance <= best2) {
+                if(farDistance <= best2) {
+                    stack[stackSize] = far;
+                    stackDistances[stackSize++] = farDistance;
+                }
+                nodeIndex = near;
+                continue;
+            }
+        }
+
+        while(stackSize > 0 && stackDistances[stackSize - 1] > best2) stackSize--;
+        if(stackSize == 0) break;
+        nodeIndex = stack[--stackSize];
+    }
+    return found;
+}
+
+bool TriangleBVH::intersectSegment(const glm::vec3 &start, const glm::vec3 &end, RayHit &hit) const {
+    return intersect(start, end - start, 1.0f, hit);
+}
+
+bool TriangleBVH::intersectBruteForce(const glm::vec3 &origin, const glm::vec3 &direction, float maxT, RayHit &hit) const {
+    const float EPSILON = 1e-12f;
+    float closest = maxT;
+    uint32_t closestTriangle = NO_TRIANGLE;
+    for(uint32_t t = 0; t < getNumTriangles(); t++) {
+        glm::vec3 v0 = _vertices[3 * t];
+        glm::vec3 e1 = _vertices[3 * t + 1] - v0;
+        glm::vec3 e2 = _vertices[3 * t + 2] - v0;
+        glm::vec3 pvec = glm::cross(direction, e2);
+        float det = glm::dot(e1, pvec);
+        if(std::fabs(det) < EPSILON) continue;
+        float inverseDet = 1.0f / det;
+        glm::vec3 tvec = origin - v0;
+        float u = glm::dot(tvec, pvec) * inverseDet;
+        if(u < 0.0f || u > 1.0f) continue;
+        glm::vec3 qvec = glm::cross(tvec, e1);
+        float v = glm::dot(direction, qvec) * inverseDet;
+        if(v < 0.0f || u + v > 1.0f) continue;
+        float distance = glm::dot(e2, qvec) * inverseDet;
+        if(distance > 0.0f && distance < closest) {
+            closest = distance;
+            closestTriangle = t;
+        }
+    }
+    if(closestTriangle == NO_TRIANGLE) return false;
+
+    glm::vec3 normal = glm::normalize(glm::cross(_vertices[3 * closestTriangle + 1] - _vertices[3 * closestTriangle],
+                                                 _vertices[3 * closestTriangle + 2] - _vertices[3 * closestTriangle]));
+    hit.t = closest;
+    hit.triangle = closestTriangle;
+    hit.normal = glm::dot(normal, direction) > 0.0f ? -normal : normal;
+    return true;
+}
+
+bool TriangleBVH::intersectScalar(const glm::vec3 &origin, const glm::vec3 &direction, float maxT, RayHit &hit) const {
+    if(_packets.empty()) return false;
+    const float EPSILON = 1e-12f;
+    glm::vec3 inverseDirection = 1.0f / direction;
+
+    // entry distance of the ray into a node's box, FLT_MAX for a miss or anything past the closest hit
+    float closest = maxT;
+    auto boxEntry = [&](const Node &node) {
+        glm::vec3 t1 = (node.boundsMin - origin) * inverseDirection;
+        glm::vec3 t2 = (node.boundsMax - origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t1, t2), tFar = glm::max(t1, t2);
+        float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, closest));
+        return entry <= exit ? entry : FLT_MAX;
+    };
+
+    uint32_t hitPacket = 0, hitLane = 0;
+    bool found = false;
+    uint32_t stack[STACK_SIZE];
+    float stackEntries[STACK_SIZE];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+    if(boxEntry(_nodes[0]) == FLT_MAX) return false;
+
+    while(true) {
+        const Node &node = _nodes[nodeIndex];
+        if(node.count > 0) {
+            const TrianglePacket &p = _packets[node.leftOrPacket];
+            for(uint32_t lane = 0; lane < node.count; lane++) {
+                glm::vec3 e1(p.e1[0][lane], p.e1[1][lane], p.e1[2][lane]);
+                glm::vec3 e2(p.e2[0][lane], p.e2[1][lane], p.e2[2][lane]);
+                glm::vec3 pvec = glm::cross(direction, e2);
+                float det = glm::dot(e1, pvec);
+                if(std::fabs(det) < EPSILON) continue;
+                float inverseDet = 1.0f / det;
+                glm::vec3 tvec = origin - glm::vec3(p.v0[0][lane], p.v0[1][lane], p.v0[2][lane]);
+                float u = glm::dot(tvec, pvec) * inverseDet;
+                if(u < 0.0f || u > 1.0f) continue;
+                glm::vec3 qvec = glm::cross(tvec, e1);
+                float v = glm::dot(direction, qvec) * inverseDet;
+                if(v < 0.0f || u + v > 1.0f) continue;
+                float t = glm::dot(e2, qvec) * inverseDet;
+                if(t > 0.0f && t < closest) {
+                    closest = t;
+                    hitPacket = node.leftOrPacket;
+                    hitLane = lane;
+                    found = true;
+                }
+            }
+        } else {
+            uint32_t near = node.leftOrPacket, far = near + 1;
+            float nearEntry = boxEntry(_nodes[near]), farEntry = boxEntry(_nodes[far]);
+            if(farEntry < nearEntry) {
+                std::swap(near, far);
+                std::swap(nearEntry, farEntry);
+            }
+            if(nearEntry != FLT_MAX) {
+                if(farEntry != FLT_MAX) {
+                    stack[stackSize] = far;
+                    stackEntries[stackSize++] = farEntry;
+                }
+                nodeIndex = near;
+                continue;
+            }
+        }
+
+        // pop the next node that could still hold something closer
+        while(stackSize > 0 && stackEntries[stackSize - 1] > closest) stackSize--;
+        if(stackSize == 0) break;
+        nodeIndex = stack[--stackSize];
+    }
+
+    if(found) finishHit(direction, hitPacket, hitLane, closest, hit);
+    return found;
+}
+
+#ifdef TRIANGLE_BVH_SSE
+
+bool TriangleBVH::intersect(const glm::vec3 &origin, const glm::vec3 &direction, float maxT, RayHit &hit) const {
+    if(_packets.empty()) return false;
+
+    // the ray splatted once per component for the packets, and packed xyz_ for the boxes
+    const __m128 OX = _mm_set1_ps(origin.x), OY = _mm_set1_ps(origin.y), OZ = _mm_set1_ps(origin.z);
+    const __m128 DX = _mm_set1_ps(direction.x), DY = _mm_set1_ps(direction.y), DZ = _mm_set1_ps(direction.z);
+    const __m128 ORIGIN = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+    const __m128 INVERSE_DIRECTION = _mm_set_ps(1.0f, 1.0f / direction.z, 1.0f / direction.y, 1.0f / direction.x);
+    const __m128 ZERO = _mm_setzero_ps(), ONE = _mm_set1_ps(1.0f);
+    const __m128 EPSILON = _mm_set1_ps(1e-12f);
+    const __m128 ABS_MASK = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 XYZ_MASK = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+    float closest = maxT;
+    auto boxEntry = [&](const Node &node) {
+        // the fourth lane of each load is the child or count field.  Small integers read as
+        // floats are denormals, which are very slow to compute with, so the lane is cleared
+        // first and overwritten with the x lane before the reductions
+        __m128 boundsMin = _mm_and_ps(_mm_loadu_ps(&node.boundsMin.x), XYZ_MASK);
+        __m128 boundsMax = _mm_and_ps(_mm_loadu_ps(&node.boundsMax.x), XYZ_MASK);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(boundsMin, ORIGIN), INVERSE_DIRECTION);
+        __m128 t2 = _mm_mul_ps(_mm_sub_ps(boundsMax, ORIGIN), INVERSE_DIRECTION);
+        __m128 tNear = _mm_min_ps(t1, t2), tFar = _mm_max_ps(t1, t2);
+        tNear = _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(0, 2, 1, 0));
+        tFar = _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(0, 2, 1, 0));
+        tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(1, 0, 3, 2)));
+        tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(2, 3, 0, 1)));
+        tFar = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(1, 0, 3, 2)));
+        tFar = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(2, 3, 0, 1)));
+        float entry = std::max(_mm_cvtss_f32(tNear), 0.0f);
+        float exit = std::min(_mm_cvtss_f32(tFar), closest);
+        return entry <= exit ? entry : FLT_MAX;
+    };
+
+    uint32_t hitPacket = 0, hitLane = 0;
+    bool found = false;
+    uint32_t stack[STACK_SIZE];
+    float stackEntries[STACK_SIZE];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+    if(boxEntry(_nodes[0]) == FLT_MAX) return false;
+
+    while(true) {
+        const Node &node = _nodes[nodeIndex];
+        if(node.count > 0) {
+            // moller-trumbore against the four triangles of the leaf at once
+            const TrianglePacket &p = _packets[node.leftOrPacket];
+            __m128 e1x = _mm_load_ps(p.e1[0]), e1y = _mm_load_ps(p.e1[1]), e1z = _mm_load_ps(p.e1[2]);
+            __m128 e2x = _mm_load_ps(p.e2[0]), e2y = _mm_load_ps(p.e2[1]), e2z = _mm_load_ps(p.e2[2]);
+
+            __m128 px = _mm_sub_ps(_mm_mul_ps(DY, e2z), _mm_mul_ps(DZ, e2y));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(DZ, e2x), _mm_mul_ps(DX, e2z));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(DX, e2y), _mm_mul_ps(DY, e2x));
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 inverseDet = _mm_div_ps(ONE, det);
+
+            __m128 tx = _mm_sub_ps(OX, _mm_load_ps(p.v0[0]));
+            __m128 ty = _mm_sub_ps(OY, _mm_load_ps(p.v0[1]));
+            __m128 tz = _mm_sub_ps(OZ, _mm_load_ps(p.v0[2]));
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inverseDet);
+
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(DX, qx), _mm_mul_ps(DY, qy)), _mm_mul_ps(DZ, qz)), inverseDet);
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet);
+
+            // degenerate padding lanes have det 0 and fail the first test
+            __m128 mask = _mm_cmpge_ps(_mm_and_ps(det, ABS_MASK), EPSILON);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(u, ZERO));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(v, ZERO));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), ONE));
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, ZERO));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(closest)));
+            int lanes = _mm_movemask_ps(mask);
+            if(lanes != 0) {
+                float ts[4];
+                _mm_storeu_ps(ts, t);
+                for(uint32_t lane = 0; lane < 4; lane++) {
+                    if((lanes & (1 << lane)) && ts[lane] < closest) {
+                        closest = ts[lane];
+                        hitPacket = node.leftOrPacket;
+                        hitLane = lane;
+                        found = true;
+                    }
+                }
+            }
+        } else {
+            uint32_t near = node.leftOrPacket, far = near + 1;
+            float nearEntry = boxEntry(_nodes[near]), farEntry = boxEntry(_nodes[far]);
+            if(farEntry < nearEntry) {
+                std::swap(near, far);
+                std::swap(nearEntry, farEntry);
+            }
+            if(nearEntry != FLT_MAX) {
+                if(farEntry != FLT_MAX) {
+                    stack[stackSize] = far;
+                    stackEntries[stackSize++] = farEntry;
+                }
+                nodeIndex = near;
+                continue;
+            }
+        }
+
+        while(stackSize > 0 && stackEntries[stackSize - 1] > closest) stackSize--;
+        if(stackSize == 0) break;
+        nodeIndex = stack[--stackSize];
+    }
+
+    if(found) finishHit(direction, hitPacket, hitLane, closest, hit);
+    return found;
+}
+
+#else
+
+bool TriangleBVH::intersect(const glm::vec3 &origin, const glm::vec3 &direction, float maxT, RayHit &hit) const {
+    return intersectScalar(origin, direction, maxT, hit);
+}
+
+#endif
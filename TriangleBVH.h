@@ -0,0 +1,90 @@
+//
+// Bounding volume hierarchy over a static triangle mesh for ray and segment queries.
+//
+// The tree is built top down with the surface area heuristic evaluated over
+// sixteen centroid bins per axis.  Nodes are 32 bytes, the two children of a
+// node sit next to each other and leaves hold at most four triangles.  The
+// triangles of a leaf are stored as one packet, each vertex and edge component
+// in its own array of four, so the SSE path tests a ray against the whole leaf
+// at once.  Inner nodes are visited nearest child first so the closest hit
+// found so far prunes the far side.
+//
+// Builds without SSE (Apple silicon) use the scalar traversal, which is also
+// what the benchmark compares the SSE path against.
+//
+
+#ifndef LAB10_TRIANGLEBVH_H
+#define LAB10_TRIANGLEBVH_H
+
+#include <glm/glm.hpp>                  // include GLM libraries
+
+// include C and C++ libraries
+#include <cstdint>
+#include <vector>
+
+struct RayHit {
+    float t;                            // distance along the ray in units of its direction
+    uint32_t triangle;                  // in the order the triangles were added
+    glm::vec3 normal;                   // unit geometric normal, facing back along the ray
+};
+
+class TriangleBVH {
+public:
+    TriangleBVH();
+
+    void clear();
+    void addTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c);
+    // adds every face of an OBJ file moved by transform, polygons are split into fans
+    bool loadOBJ(const char* filename, const glm::mat4 &transform);
+
+    // must be called after adding triangles and before any query
+    void build();
+
+    // closest hit along origin + t * direction for 0 < t < maxT
+    bool intersect(const glm::vec3 &origin, const glm::vec3 &direction, float maxT, RayHit &hit) const;
+    // closest hit on the segment from start to end, t is the fraction of the way along
+    bool intersectSegment(const glm::vec3 &start, const glm::vec3 &end, RayHit &hit) const;
+    bool intersectScalar(const glm::vec3 &origin, const glm::vec3 &direction, float maxT, RayHit &hit) const;
+    // tests every triangle, for checking the tree
+    bool intersectBruteForce(const glm::vec3 &origin, const glm::vec3 &direction, float maxT, RayHit &hit) const;
+
+    // nearest point on the mesh within maxDistance of point, for distance fields
+    bool closestPoint(const glm::vec3 &point, float maxDistance, glm::vec3 &closest, uint32_t &triangle) const;
+    glm::vec3 getNormal(uint32_t triangle) const;     // unit, from the winding of the triangle
+
+    size_t getNumTriangles() const;
+    size_t getNumNodes() const;
+    glm::vec3 getBoundsMin() const;
+    glm::vec3 getBoundsMax() const;
+
+private:
+    static const uint32_t MAX_LEAF_TRIANGLES = 4;
+    static const uint32_t NUM_BINS = 16;
+    static const uint32_t MAX_SAH_DEPTH = 64;  // deeper nodes are split in half so the traversal stack cannot overflow
+
+    struct Node {
+        glm::vec3 boundsMin;
+        uint32_t leftOrPacket;          // first child for inner nodes, packet index for leaves
+        glm::vec3 boundsMax;
+        uint32_t count;                 // triangles in a leaf, 0 for inner nodes
+    };
+
+    // four triangles as v0 + u e1 + v e2, unused lanes are degenerate and never hit
+    struct alignas(16) TrianglePacket {
+        float v0[3][4];
+        float e1[3][4];
+        float e2[3][4];
+        uint32_t ids[4];
+    };
+
+    void subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth, std::vector<uint32_t> &order,
+                   const std::vector<glm::vec3> &centroids);
+    void makeLeaf(Node &node, uint32_t first, uint32_t count, const std::vector<uint32_t> &order);
+    void finishHit(const glm::vec3 &direction, uint32_t packet, uint32_t lane, float t, RayHit &hit) const;
+
+    std::vector<glm::vec3> _vertices;   // three per triangle
+    std::vector<Node> _nodes;
+    std::vector<TrianglePacket> _packets;
+};
+
+#endif //LAB10_TRIANGLEBVH_H
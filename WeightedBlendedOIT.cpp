@@ -0,0 +1,99 @@
+//
+// Weighted blended order-independent transparency, for drawing particles without sorting them.
+//
+
+#include "WeightedBlendedOIT.h"
+#include "ResourceRegistry.h"
+
+#include <cstdio>				// for printf functionality
+
+WeightedBlendedOIT::WeightedBlendedOIT() {
+    _framebuffer = 0;
+    _accumTexture = 0;
+    _revealTexture = 0;
+    _quadVAO = 0;
+}
+
+bool WeightedBlendedOIT::initialize(GLsizei width, GLsizei height, GLuint depthRenderbuffer) {
+    GLuint textures[2];
+    ResourceRegistry::genTextures(OWNER_PARTICLES, 2, textures);
+    _accumTexture = textures[0];
+    _revealTexture = textures[1];
+
+    glBindTexture(GL_TEXTURE_2D, _accumTexture);
+    ResourceRegistry::texImage2D(_accumTexture, GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, _revealTexture);
+    ResourceRegistry::texImage2D(_revealTexture, GL_TEXTURE_2D, 0, GL_R8, width, height, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    ResourceRegistry::genFramebuffers(OWNER_PARTICLES, 1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _accumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, _revealTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    const GLenum DRAW_BUFFERS[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, DRAW_BUFFERS);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    ResourceRegistry::genVertexArrays(OWNER_PARTICLES, 1, &_quadVAO);
+
+    if(status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "[ERROR]: transparency framebuffer is incomplete (0x%x)\n", status);
+        return false;
+    }
+    fprintf(stdout, "[INFO]: transparency targets are %dx%d\n", width, height);
+    return true;
+}
+
+void WeightedBlendedOIT::begin() {
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    const GLfloat NOTHING_ACCUMULATED[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const GLfloat FULLY_REVEALED[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glClearBufferfv(GL_COLOR, 0, NOTHING_ACCUMULATED);
+    glClearBufferfv(GL_COLOR, 1, FULLY_REVEALED);
+
+    // fragments are still hidden by opaque geometry, but never by each other
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);                        // sum of weighted colors
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);       // product of (1 - alpha)
+}
+
+void WeightedBlendedOIT::composite(const OITCompositeUniforms &uniforms, GLuint targetFramebuffer, GLuint firstUnit) {
+    glDepthMask(GL_TRUE);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_2D, _accumTexture);
+    glUniform1i(uniforms.accumTexture, firstUnit);
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, _revealTexture);
+    glUniform1i(uniforms.revealTexture, firstUnit + 1);
+
+    // one triangle over the whole target, in front of everything
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(_quadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_DEPTH_TEST);
+
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void WeightedBlendedOIT::cleanup() {
+    fprintf( stdout, "[INFO]: ...deleting transparency targets....\n" );
+
+    ResourceRegistry::deleteFramebuffers(1, &_framebuffer);
+    const GLuint TEXTURES[2] = { _accumTexture, _revealTexture };
+    ResourceRegistry::deleteTextures(2, TEXTURES);
+    ResourceRegistry::deleteVertexArrays(1, &_quadVAO);
+}
@@ -0,0 +1,50 @@
+//
+// Weighted blended order-independent transparency, for drawing particles without sorting them.
+//
+// Transparent surfaces are drawn in any order into two targets of their own
+// that share the scene's depth buffer (McGuire and Bavoil 2013):
+//   accumulation   - RGBA16F, premultiplied color and alpha times a depth weight, added up
+//   revealage      - R8, how much of the background still shows through, multiplied down
+// composite() then resolves the weighted average color over the opaque scene.
+// The result is an approximation, nearer fragments get more weight rather
+// than strictly covering the ones behind, which suits soft particles well.
+//
+// Between begin() and composite() depth writes are off and the blend state
+// belongs to this class, so draw only transparent geometry in between with a
+// shader that writes accumulation to output 0 and revealage to output 1.
+//
+
+#ifndef LAB10_WEIGHTEDBLENDEDOIT_H
+#define LAB10_WEIGHTEDBLENDEDOIT_H
+
+// opengl libraries
+#include <GL/glew.h>                    // define our OpenGL extensions
+
+struct OITCompositeUniforms {
+    GLint accumTexture;                 // sampler for the accumulation target
+    GLint revealTexture;                // sampler for the revealage target
+};
+
+class WeightedBlendedOIT {
+public:
+    WeightedBlendedOIT();
+
+    // makes the two targets at the given size, depth testing against the renderbuffer the opaque scene drew into
+    bool initialize(GLsizei width, GLsizei height, GLuint depthRenderbuffer);
+
+    // binds and clears the targets and sets up the accumulation blending
+    void begin();
+    // blends the result over targetFramebuffer with the composite program already in use, then restores the
+    // usual alpha blending and depth writes.  The viewport must still be the size of the targets
+    void composite(const OITCompositeUniforms &uniforms, GLuint targetFramebuffer, GLuint firstUnit);
+
+    void cleanup();
+
+private:
+    GLuint _framebuffer;
+    GLuint _accumTexture;
+    GLuint _revealTexture;
+    GLuint _quadVAO;                    // empty, the composite vertex shader makes its triangle from gl_VertexID
+};
+
+#endif //LAB10_WEIGHTEDBLENDEDOIT_H
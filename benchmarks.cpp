@@ -0,0 +1,1217 @@
+/*
+ *  CSCI 441, Computer Graphics, Fall 2020
+ *
+ *  Project: final project
+ *  File: benchmarks.cpp
+ *
+ *  Description:
+ *      Standalone benchmarks for the rendering and simulation systems.
+ *      Creates a hidden window for the benchmarks that need an OpenGL context.
+ *
+ *      usage: benchmarks [name ...]     runs every benchmark when no name is given
+ *
+ */
+
+//***********************************************************************************************************************************************************
+//
+// Library includes
+
+#include <GL/glew.h>                    // define our OpenGL extensions
+#include <GLFW/glfw3.h>			        // include GLFW framework header
+
+#include <glm/glm.hpp>                  // include GLM libraries
+#include <glm/gtc/matrix_transform.hpp> // and matrix functions
+
+#include <algorithm>
+#include <cstdio>				        // for printf functionality
+#include <cstdlib>				        // for exit functionality
+#include <chrono>                       // for high resolution time
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <CSCI441/ShaderProgram.hpp>    // wrapper class for GLSL shader programs
+
+#include "BodySystem.h"
+#include "Checkpoint.h"
+#include "CurlNoiseField.h"
+#include "FluidSolver.h"
+#include "GPUDepthSort.h"
+#include "InstanceBatch.h"
+#include "JobSystem.h"
+#include "NBodySolver.h"
+#include "ParticleCuller.h"
+#include "QuaternionBatch.h"
+#include "SceneGraph.h"
+#include "ShaderVariantCache.h"
+#include "SignedDistanceField.h"
+#include "SpatialHash.h"
+#include "Transform.h"
+#include "TriangleBVH.h"
+
+//***********************************************************************************************************************************************************
+//
+// Helper Functions
+
+// createHiddenContext() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Creates an invisible window so the GPU benchmarks have an OpenGL context
+/// \return window - the hidden window, nullptr if a context could not be created
+// /////////////////////////////////////////////////////////////////////////////
+GLFWwindow* createHiddenContext() {
+    if (!glfwInit()) {
+        fprintf( stderr, "[ERROR]: Could not initialize GLFW\n" );
+        return nullptr;
+    }
+
+    glfwWindowHint( GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE );
+    glfwWindowHint( GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE );
+    glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 4 );
+    glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 1 );
+    glfwWindowHint( GLFW_VISIBLE, GLFW_FALSE );
+
+    GLFWwindow *window = glfwCreateWindow(64, 64, "benchmarks", nullptr, nullptr );
+    if( !window ) {
+        fprintf( stderr, "[ERROR]: GLFW Window could not be created\n" );
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent( window );
+    glfwSwapInterval( 0 );
+
+    glewExperimental = GL_TRUE;
+    if( glewInit() != GLEW_OK ) {
+        fprintf( stderr, "[ERROR]: Error initializing GLEW\n");
+        glfwDestroyWindow( window );
+        glfwTerminate();
+        return nullptr;
+    }
+    return window;
+}
+
+// timeGPU() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Measures the GPU time of a block of draw calls with a timer query
+/// \return the elapsed GPU time in milliseconds
+// /////////////////////////////////////////////////////////////////////////////
+template<typename DrawFunc>
+double timeGPU(DrawFunc draw) {
+    GLuint query;
+    glGenQueries(1, &query);
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    draw();
+    glEndQuery(GL_TIME_ELAPSED);
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    glDeleteQueries(1, &query);
+    return elapsed / 1.0e6;
+}
+
+// timeCPU() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Measures the wall clock time of a block of CPU work
+/// \return the elapsed time in milliseconds
+// /////////////////////////////////////////////////////////////////////////////
+template<typename WorkFunc>
+double timeCPU(WorkFunc work) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    work();
+    std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// randFloat() /////////////////////////////////////////////////////////////////////////////
+/// \desc generates a random float between [0, 1]
+// /////////////////////////////////////////////////////////////////////////////
+GLfloat randFloat() {
+    return rand() / (GLfloat)RAND_MAX;
+}
+
+//***********************************************************************************************************************************************************
+//
+// Benchmarks
+
+// benchmarkBarnesHut() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Times the Barnes-Hut solver against the brute force pairwise sum for
+///     growing body counts and reports the RMS relative error of the tree
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkBarnesHut(JobSystem &jobSystem) {
+    const size_t BODY_COUNTS[5] = { 1000, 4000, 16000, 64000, 256000 };
+    const size_t MAX_BRUTE_FORCE = 64000;      // O(n^2) gets too slow past this
+
+    NBodySolver solver;
+    solver.setJobSystem(&jobSystem);
+    solver.setGravitationalConstant(0.05f);
+    solver.setSoftening(0.3f);
+    Attractor blackHole;
+    blackHole.position = glm::vec3(0.0f);
+    blackHole.gm = 2.0f;
+    solver.addAttractor(blackHole);
+
+    printf("[BENCH]: Barnes-Hut vs brute force, %u threads\n", jobSystem.getNumWorkers());
+    for(int c = 0; c < 5; c++) {
+        size_t n = BODY_COUNTS[c];
+
+        // a thick disk of bodies around the black hole
+        std::vector<glm::vec3> positions(n), treeAcc(n), bruteAcc(n);
+        std::vector<float> masses(n, 1.0f / n);
+        for(size_t i = 0; i < n; i++) {
+            float angle = randFloat() * 6.28f, radius = 2.0f + 10.0f * randFloat();
+            positions[i] = glm::vec3(cosf(angle) * radius, (randFloat() - 0.5f), sinf(angle) * radius);
+        }
+
+        for(int t = 0; t < 3; t++) {
+            const float THETAS[3] = { 0.3f, 0.5f, 0.8f };
+            solver.setOpeningAngle(THETAS[t]);
+            double treeMs = timeCPU([&]() { solver.computeAccelerations(&positions[0], &masses[0], n, &treeAcc[0]); });
+            if(n > MAX_BRUTE_FORCE) {
+                printf("[BENCH]:   n %7zu theta %.1f  tree %9.2f ms (%zu nodes)\n", n, THETAS[t], treeMs, solver.getNumNodes());
+                continue;
+            }
+            double bruteMs = t == 0 ? timeCPU([&]() { solver.computeAccelerationsBruteForce(&positions[0], &masses[0], n, &bruteAcc[0]); }) : 0.0;
+
+            double errorSum = 0.0, magnitudeSum = 0.0;
+            for(size_t i = 0; i < n; i++) {
+                glm::vec3 diff = treeAcc[i] - bruteAcc[i];
+                errorSum += glm::dot(diff, diff);
+                magnitudeSum += glm::dot(bruteAcc[i], bruteAcc[i]);
+            }
+            printf("[BENCH]:   n %7zu theta %.1f  tree %9.2f ms  brute %9.2f ms  rms rel error %.2e\n",
+                   n, THETAS[t], treeMs, bruteMs, sqrt(errorSum / magnitudeSum));
+        }
+    }
+}
+
+// benchmarkIntegrator() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Runs orbits around the black hole with the same number of substeps for
+///     every body and with adaptive substeps, reporting the time and the energy
+///     error of each.  Most orbits are near circular, one in ten dives close to
+///     the singularity.  Mutual gravity is off so every body's own orbital
+///     energy is conserved and its relative change measures the accuracy.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkIntegrator(JobSystem &jobSystem) {
+    const size_t NUM_BODIES = 2000;
+    const int NUM_FRAMES = 300;
+    const float GM = 2.0f;
+    const float SOFTENING = 0.3f;
+
+    std::vector<glm::vec3> startPositions(NUM_BODIES), startVelocities(NUM_BODIES);
+    for(size_t i = 0; i < NUM_BODIES; i++) {
+        float angle = randFloat() * 6.28f, radius = 2.0f + 10.0f * randFloat();
+        float speed = sqrtf(GM / radius) * (i % 10 == 0 ? 0.1f + 0.3f * randFloat() : 0.9f + 0.2f * randFloat());
+        startPositions[i] = glm::vec3(cosf(angle) * radius, randFloat() - 0.5f, sinf(angle) * radius);
+        startVelocities[i] = glm::vec3(-sinf(angle) * speed, 0.0f, cosf(angle) * speed);
+    }
+    auto orbitalEnergy = [&](const glm::vec3 &position, const glm::vec3 &velocity) {
+        return 0.5 * glm::dot(velocity, velocity) - GM / sqrt(glm::dot(position, position) + SOFTENING * SOFTENING);
+    };
+
+    auto run = [&](const char* name, uint32_t uniformSubsteps, float accuracy) {
+        BodySystem system;
+        system.initialize(&jobSystem);
+        system.getSolver().setGravitationalConstant(0.0f);
+        system.getSolver().setSoftening(SOFTENING);
+        Attractor blackHole;
+        blackHole.position = glm::vec3(0.0f);
+        blackHole.gm = GM;
+        system.getSolver().addAttractor(blackHole);
+        system.setUniformSubsteps(uniformSubsteps);
+        system.setSubstepAccuracy(accuracy);
+        system.setMaxSubsteps(4096);
+        for(size_t i = 0; i < NUM_BODIES; i++) {
+            system.create(startPositions[i], startVelocities[i], glm::vec3(0.0f), glm::vec3(1.0f), 0.0f, 1.0f, 0);
+        }
+        system.resetEnergyReference();
+
+        double substeps = 0.0;
+        double ms = timeCPU([&]() {
+            for(int f = 0; f < NUM_FRAMES; f++) {
+                system.step(1.0f);
+                substeps += system.getTotalSubsteps();
+            }
+        });
+
+        std::vector<double> errors(NUM_BODIES);
+        for(size_t i = 0; i < NUM_BODIES; i++) {
+            double start = orbitalEnergy(startPositions[i], startVelocities[i]);
+            errors[i] = fabs(orbitalEnergy(system.positions[i], system.velocities[i]) - start) / fabs(start);
+        }
+        std::sort(errors.begin(), errors.end());
+        printf("[BENCH]:   %-8s %6.4f %9.2f ms %7.1f substeps/body  energy error median %.1e p99 %.1e max %.1e  total drift %+.1e\n",
+               name, uniformSubsteps > 0 ? (float)uniformSubsteps : accuracy, ms, substeps / (NUM_FRAMES * NUM_BODIES),
+               errors[NUM_BODIES / 2], errors[NUM_BODIES * 99 / 100], errors[NUM_BODIES - 1], system.getEnergyDrift());
+    };
+
+    printf("[BENCH]: integrator, %zu bodies for %d frames\n", NUM_BODIES, NUM_FRAMES);
+    const uint32_t UNIFORM[5] = { 8, 16, 32, 64, 128 };
+    for(int u = 0; u < 5; u++) {
+        run("uniform", UNIFORM[u], 0.0f);
+    }
+    const float ACCURACY[5] = { 0.2f, 0.1f, 0.05f, 0.025f, 0.0125f };
+    for(int a = 0; a < 5; a++) {
+        run("adaptive", 0, ACCURACY[a]);
+    }
+}
+
+// benchmarkBroadphase() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Builds the spatial hash over growing numbers of bodies at a fixed
+///     density and times the body against body and particle against body
+///     queries, ten particles per body.  The smallest size is checked against
+///     brute force pair counts.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkBroadphase(JobSystem &jobSystem) {
+    const size_t BODY_COUNTS[4] = { 1000, 2500, 5000, 10000 };
+    const size_t PARTICLES_PER_BODY = 10;
+    const float BODIES_PER_UNIT3 = 8.0f;
+    const float PARTICLE_RADIUS = 0.05f;
+    const int NUM_FRAMES = 10;
+
+    SpatialHash hash;
+    hash.setJobSystem(&jobSystem);
+    hash.setCellSize(0.3f);
+
+    printf("[BENCH]: spatial hash broadphase, %u threads\n", jobSystem.getNumWorkers());
+    for(int c = 0; c < 4; c++) {
+        size_t numBodies = BODY_COUNTS[c];
+        size_t numParticles = numBodies * PARTICLES_PER_BODY;
+        float side = cbrtf(numBodies / BODIES_PER_UNIT3);
+
+        // debris sized bodies plus a few big ones the grid has to keep aside
+        std::vector<glm::vec3> bodies(numBodies), particles(numParticles);
+        std::vector<float> radii(numBodies);
+        for(size_t i = 0; i < numBodies; i++) {
+            bodies[i] = glm::vec3(randFloat(), randFloat(), randFloat()) * side;
+            radii[i] = i < 3 ? 1.0f : 0.05f + 0.08f * randFloat();
+        }
+        for(size_t i = 0; i < numParticles; i++) {
+            particles[i] = glm::vec3(randFloat(), randFloat(), randFloat()) * side;
+        }
+
+        double buildMs = timeCPU([&]() {
+            for(int f = 0; f < NUM_FRAMES; f++) {
+                hash.build(&bodies[0], &radii[0], numBodies);
+            }
+        }) / NUM_FRAMES;
+
+        std::vector<uint32_t> bodyHits(numBodies), particleHits(numParticles);
+        double bodyMs = timeCPU([&]() {
+            jobSystem.parallelFor(numBodies, 256, [&](size_t begin, size_t end, unsigned) {
+                for(size_t i = begin; i < end; i++) {
+                    uint32_t hits = 0;
+                    hash.querySphere(bodies[i], radii[i], [&](uint32_t j) { if(j != i) hits++; });
+                    bodyHits[i] = hits;
+                }
+            });
+        });
+        double particleMs = timeCPU([&]() {
+            jobSystem.parallelFor(numParticles, 2048, [&](size_t begin, size_t end, unsigned) {
+                for(size_t i = begin; i < end; i++) {
+                    uint32_t hits = 0;
+                    hash.querySphere(particles[i], PARTICLE_RADIUS, [&](uint32_t) { hits++; });
+                    particleHits[i] = hits;
+                }
+            });
+        });
+
+        size_t bodyPairs = 0, particleContacts = 0;
+        for(size_t i = 0; i < numBodies; i++) bodyPairs += bodyHits[i];
+        for(size_t i = 0; i < numParticles; i++) particleContacts += particleHits[i];
+        bodyPairs /= 2;
+
+        printf("[BENCH]:   %6zu bodies %7zu particles  build %7.3f ms  body queries %7.3f ms (%zu pairs)  particle queries %7.3f ms (%zu contacts)  %.0f ns/query\n",
+               numBodies, numParticles, buildMs, bodyMs, bodyPairs, particleMs, particleContacts,
+               (bodyMs + particleMs) * 1e6 / (numBodies + numParticles));
+
+        if(c == 0) {
+            size_t brutePairs = 0, bruteContacts = 0;
+            for(size_t i = 0; i < numBodies; i++) {
+                for(size_t j = i + 1; j < numBodies; j++) {
+                    glm::vec3 d = bodies[i] - bodies[j];
+                    if(glm::dot(d, d) < (radii[i] + radii[j]) * (radii[i] + radii[j])) brutePairs++;
+                }
+                for(size_t p = 0; p < numParticles; p++) {
+                    glm::vec3 d = particles[p] - bodies[i];
+                    if(glm::dot(d, d) < (radii[i] + PARTICLE_RADIUS) * (radii[i] + PARTICLE_RADIUS)) bruteContacts++;
+                }
+            }
+            printf("[BENCH]:   brute force %zu pairs %zu contacts (%s)\n", brutePairs, bruteContacts,
+                   brutePairs == bodyPairs && bruteContacts == particleContacts ? "match" : "MISMATCH");
+        }
+    }
+}
+
+// benchmarkTriangleBVH() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Builds the BVH over the town model and platform and measures how many
+///     rays per second it answers with the scalar and SSE traversals: camera
+///     rays through a 512x512 image, rays in random directions from random
+///     points, and short particle sized segments.  A few thousand random rays
+///     are checked against testing every triangle.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkTriangleBVH(JobSystem &jobSystem) {
+    TriangleBVH bvh;
+    if(!bvh.loadOBJ("assets/models/medstreet/medstreet.obj", glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, 0.1f, 0.0f)))) return;
+    bvh.addTriangle(glm::vec3(-20.0f, 0.0f, -20.0f), glm::vec3(20.0f, 0.0f, -20.0f), glm::vec3(-20.0f, 0.0f, 20.0f));
+    bvh.addTriangle(glm::vec3(20.0f, 0.0f, -20.0f), glm::vec3(20.0f, 0.0f, 20.0f), glm::vec3(-20.0f, 0.0f, 20.0f));
+    double buildMs = timeCPU([&]() { bvh.build(); });
+    printf("[BENCH]: triangle BVH, %zu triangles, %zu nodes built in %.2f ms, %u threads\n",
+           bvh.getNumTriangles(), bvh.getNumNodes(), buildMs, jobSystem.getNumWorkers());
+
+    const size_t IMAGE_SIZE = 512;
+    const size_t NUM_RAYS = IMAGE_SIZE * IMAGE_SIZE;
+    glm::vec3 boundsMin = bvh.getBoundsMin(), boundsMax = bvh.getBoundsMax();
+    std::vector<glm::vec3> origins[3], directions[3];
+    float maxT[3] = { 100.0f, 100.0f, 1.0f };
+    const char* NAMES[3] = { "camera", "random", "segment" };
+    for(int s = 0; s < 3; s++) {
+        origins[s].resize(NUM_RAYS);
+        directions[s].resize(NUM_RAYS);
+    }
+    glm::vec3 eye(-12.0f, 10.0f, 14.0f);
+    glm::vec3 forward = glm::normalize(glm::vec3(4.0f, 2.0f, 0.0f) - eye);
+    glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+    glm::vec3 up = glm::cross(right, forward);
+    for(size_t i = 0; i < NUM_RAYS; i++) {
+        float u = (i % IMAGE_SIZE) / (float)IMAGE_SIZE - 0.5f, v = (i / IMAGE_SIZE) / (float)IMAGE_SIZE - 0.5f;
+        origins[0][i] = eye;
+        directions[0][i] = glm::normalize(forward + right * u + up * v);
+
+        glm::vec3 p = boundsMin + (boundsMax - boundsMin) * glm::vec3(randFloat(), randFloat(), randFloat());
+        glm::vec3 d = glm::normalize(glm::vec3(randFloat(), randFloat(), randFloat()) - 0.5f);
+        origins[1][i] = p;
+        directions[1][i] = d;
+        origins[2][i] = p;
+        directions[2][i] = d * 0.05f;
+    }
+
+    for(int s = 0; s < 3; s++) {
+        size_t hits[2] = { 0, 0 };
+        double ms[2];
+        for(int wide = 0; wide < 2; wide++) {
+            std::vector<unsigned char> hit(NUM_RAYS);
+            ms[wide] = timeCPU([&]() {
+                jobSystem.parallelFor(NUM_RAYS, 1024, [&](size_t begin, size_t end, unsigned) {
+                    RayHit result;
+                    for(size_t i = begin; i < end; i++) {
+                        hit[i] = wide ? bvh.intersect(origins[s][i], directions[s][i], maxT[s], result)
+                                      : bvh.intersectScalar(origins[s][i], directions[s][i], maxT[s], result);
+                    }
+                });
+            });
+            for(size_t i = 0; i < NUM_RAYS; i++) hits[wide] += hit[i];
+        }
+        printf("[BENCH]:   %-8s %7zu rays  scalar %7.2f Mrays/s  sse %7.2f Mrays/s  (%zu / %zu hits)\n",
+               NAMES[s], NUM_RAYS, NUM_RAYS / (ms[0] * 1e3), NUM_RAYS / (ms[1] * 1e3), hits[0], hits[1]);
+    }
+
+    // brute force reference on the random rays
+    const size_t NUM_CHECKED = 2000;
+    std::vector<RayHit> reference(NUM_CHECKED);
+    std::vector<unsigned char> referenceHit(NUM_CHECKED);
+    double bruteMs = timeCPU([&]() {
+        for(size_t i = 0; i < NUM_CHECKED; i++) {
+            referenceHit[i] = bvh.intersectBruteForce(origins[1][i], directions[1][i], maxT[1], reference[i]);
+        }
+    });
+    size_t mismatches = 0;
+    for(size_t i = 0; i < NUM_CHECKED; i++) {
+        RayHit result;
+        bool hit = bvh.intersect(origins[1][i], directions[1][i], maxT[1], result);
+        if(hit != (bool)referenceHit[i] || (hit && result.triangle != reference[i].triangle)) mismatches++;
+    }
+    printf("[BENCH]:   brute force %7.3f Mrays/s, %zu of %zu rays disagree with the BVH\n", NUM_CHECKED / (bruteMs * 1e3), mismatches, NUM_CHECKED);
+}
+
+// benchmarkDistanceField() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Moves a million particle sized steps through the baked distance field
+///     and through the BVH of the same scene, and counts how often the two
+///     agree on a hit.  Needs the field from sdfBake.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkDistanceField(JobSystem &jobSystem) {
+    SignedDistanceField field;
+    if(!field.load("assets/models/medstreet/medstreet.sdf")) {
+        printf("[BENCH]: distance field skipped, run sdfBake first\n");
+        return;
+    }
+    TriangleBVH bvh;
+    if(!bvh.loadOBJ("assets/models/medstreet/medstreet.obj", glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, 0.1f, 0.0f)))) return;
+    bvh.addTriangle(glm::vec3(-20.0f, 0.0f, -20.0f), glm::vec3(20.0f, 0.0f, -20.0f), glm::vec3(-20.0f, 0.0f, 20.0f));
+    bvh.addTriangle(glm::vec3(20.0f, 0.0f, -20.0f), glm::vec3(20.0f, 0.0f, 20.0f), glm::vec3(-20.0f, 0.0f, 20.0f));
+    bvh.build();
+    printf("[BENCH]: distance field, %u bricks in %.1f MB against %zu triangles, %u threads\n",
+           field.getNumBricks(), field.getSizeBytes() / (1024.0 * 1024.0), bvh.getNumTriangles(), jobSystem.getNumWorkers());
+
+    // falling particles, mostly downwards and up to a few voxels per step, starting outside the scene like real ones
+    const size_t NUM_STEPS = 1 << 20;
+    glm::vec3 boundsMin = field.getBoundsMin(), boundsMax = field.getBoundsMax();
+    std::vector<glm::vec3> starts(NUM_STEPS), ends(NUM_STEPS);
+    for(size_t i = 0; i < NUM_STEPS; i++) {
+        do {
+            starts[i] = boundsMin + (boundsMax - boundsMin) * glm::vec3(randFloat(), randFloat(), randFloat());
+        } while(field.sample(starts[i]) < field.getVoxelSize());
+        ends[i] = starts[i] + glm::vec3(randFloat() - 0.5f, -2.0f * randFloat(), randFloat() - 0.5f) * 0.2f;
+    }
+
+    std::vector<unsigned char> fieldHits(NUM_STEPS), meshHits(NUM_STEPS);
+    double fieldMs = timeCPU([&]() {
+        jobSystem.parallelFor(NUM_STEPS, 1024, [&](size_t begin, size_t end, unsigned) {
+            float t;
+            glm::vec3 normal;
+            for(size_t i = begin; i < end; i++) {
+                fieldHits[i] = field.intersectSegment(starts[i], ends[i], t, normal);
+            }
+        });
+    });
+    double meshMs = timeCPU([&]() {
+        jobSystem.parallelFor(NUM_STEPS, 1024, [&](size_t begin, size_t end, unsigned) {
+            RayHit hit;
+            for(size_t i = begin; i < end; i++) {
+                meshHits[i] = bvh.intersectSegment(starts[i], ends[i], hit);
+            }
+        });
+    });
+    double sampleMs = timeCPU([&]() {
+        jobSystem.parallelFor(NUM_STEPS, 1024, [&](size_t begin, size_t end, unsigned) {
+            glm::vec3 gradient;
+            for(size_t i = begin; i < end; i++) {
+                fieldHits[i] |= field.sample(starts[i], gradient) < -1e9f;
+            }
+        });
+    });
+
+    size_t numField = 0, numMesh = 0, numBoth = 0;
+    for(size_t i = 0; i < NUM_STEPS; i++) {
+        numField += fieldHits[i];
+        numMesh += meshHits[i];
+        numBoth += fieldHits[i] && meshHits[i];
+    }
+    printf("[BENCH]:   field steps %7.2f M/s  BVH segments %7.2f M/s  field samples %7.2f M/s\n",
+           NUM_STEPS / (fieldMs * 1e3), NUM_STEPS / (meshMs * 1e3), NUM_STEPS / (sampleMs * 1e3));
+    printf("[BENCH]:   hits field %zu  BVH %zu  both %zu\n", numField, numMesh, numBoth);
+}
+
+// benchmarkCurlNoise() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Generates the 64^3 turbulence grid and compares a million particle
+///     lookups through it, scalar and SSE, with evaluating the curl of the
+///     noise directly.  Also reports how far the interpolated grid strays
+///     from the direct evaluation.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkCurlNoise(JobSystem &jobSystem) {
+    CurlNoiseField field;
+    field.setJobSystem(&jobSystem);
+    double generateMs = timeCPU([&]() { field.generate(); });
+    printf("[BENCH]: curl noise, %u^3 grid generated in %.1f ms, %u threads\n", field.getResolution(), generateMs, jobSystem.getNumWorkers());
+
+    const size_t NUM_PARTICLES = 1 << 20;
+    const float SCALE = 0.08f;
+    std::vector<glm::vec3> positions(NUM_PARTICLES), analytic(NUM_PARTICLES), scalar(NUM_PARTICLES, glm::vec3(0.0f)), wide(NUM_PARTICLES, glm::vec3(0.0f));
+    for(size_t i = 0; i < NUM_PARTICLES; i++) {
+        positions[i] = glm::vec3(randFloat() - 0.5f, randFloat(), randFloat() - 0.5f) * 40.0f;
+    }
+
+    // single threaded, it is the cost per particle that matters
+    double analyticMs = timeCPU([&]() {
+        for(size_t i = 0; i < NUM_PARTICLES; i++) {
+            analytic[i] = field.sampleAnalytic(positions[i] * SCALE);
+        }
+    });
+    double scalarMs = timeCPU([&]() { field.addVelocitiesScalar(&positions[0], &scalar[0], NUM_PARTICLES, SCALE, 1.0f); });
+    double wideMs = timeCPU([&]() { field.addVelocities(&positions[0], &wide[0], NUM_PARTICLES, SCALE, 1.0f); });
+
+    double errorSum = 0.0, magnitudeSum = 0.0, simdError = 0.0;
+    for(size_t i = 0; i < NUM_PARTICLES; i++) {
+        glm::vec3 diff = scalar[i] - analytic[i];
+        errorSum += glm::dot(diff, diff);
+        magnitudeSum += glm::dot(analytic[i], analytic[i]);
+        simdError = std::max(simdError, (double)glm::length(wide[i] - scalar[i]));
+    }
+    printf("[BENCH]:   analytic %8.2f ms  grid %7.2f ms  grid sse %7.2f ms  (%.1f%% of analytic)\n",
+           analyticMs, scalarMs, wideMs, 100.0 * wideMs / analyticMs);
+    printf("[BENCH]:   grid rms rel error %.2e, sse differs from scalar by at most %.1e\n", sqrt(errorSum / magnitudeSum), simdError);
+}
+
+// runDamBreak() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Steps a side^3 block of water falling into a 2m box, leaving the final
+///     positions behind and optionally the average time per step
+// /////////////////////////////////////////////////////////////////////////////
+void runDamBreak(FluidSolver &solver, uint32_t side, uint32_t steps, std::vector<glm::vec3> &positions, double *msPerStep) {
+    const float SPACING = 0.02f, DT = 0.001f, BOX = 2.0f;
+    positions.clear();
+    for(uint32_t z = 0; z < side; z++) {
+        for(uint32_t y = 0; y < side; y++) {
+            for(uint32_t x = 0; x < side; x++) {
+                positions.push_back(glm::vec3(x + 0.5f, y + 0.5f, z + 0.5f) * SPACING);
+            }
+        }
+    }
+    std::vector<glm::vec3> velocities(positions.size(), glm::vec3(0.0f)), accelerations(positions.size());
+
+    double totalMs = timeCPU([&]() {
+        for(uint32_t step = 0; step < steps; step++) {
+            solver.computeAccelerations(&positions[0], &velocities[0], positions.size(), &accelerations[0]);
+            for(size_t i = 0; i < positions.size(); i++) {
+                velocities[i] += (accelerations[i] + glm::vec3(0.0f, -9.8f, 0.0f)) * DT;
+                positions[i] += velocities[i] * DT;
+                // walls of the box, losing half the speed into them
+                for(int axis = 0; axis < 3; axis++) {
+                    if(positions[i][axis] < 0.0f) {
+                        positions[i][axis] = 0.0f;
+                        velocities[i][axis] *= -0.5f;
+                    } else if(positions[i][axis] > BOX) {
+                        positions[i][axis] = BOX;
+                        velocities[i][axis] *= -0.5f;
+                    }
+                }
+            }
+        }
+    });
+    if(msPerStep) *msPerStep = totalMs / steps;
+}
+
+// benchmarkFluid() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Drops a 50k particle block of water into a box and times the SPH steps,
+///     then runs a smaller block with and without the job system to check the
+///     results come out the same bit for bit.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkFluid(JobSystem &jobSystem) {
+    // water in SI units, about 27 neighbours each at rest
+    const float SPACING = 0.02f;
+    FluidSolver solver;
+    solver.setSmoothingRadius(2.0f * SPACING);
+    solver.setParticleMass(1000.0f * SPACING * SPACING * SPACING);
+    solver.setRestDensity(1000.0f);
+    solver.setStiffness(100.0f);
+    solver.setViscosity(0.5f);
+    solver.setJobSystem(&jobSystem);
+
+    std::vector<glm::vec3> positions;
+    double msPerStep = 0.0;
+    runDamBreak(solver, 37, 20, positions, &msPerStep);
+    printf("[BENCH]: sph fluid, %zu particles %6.2f ms per step (%.0f steps/s), %.1f neighbours, %u threads\n",
+           positions.size(), msPerStep, 1000.0 / msPerStep, solver.getAverageNeighbors(), jobSystem.getNumWorkers());
+
+    std::vector<glm::vec3> threaded, serial;
+    runDamBreak(solver, 16, 50, threaded, nullptr);
+    solver.setJobSystem(nullptr);
+    runDamBreak(solver, 16, 50, serial, nullptr);
+    bool identical = memcmp(&threaded[0], &serial[0], threaded.size() * sizeof(glm::vec3)) == 0;
+    printf("[BENCH]:   threaded and serial runs %s after 50 steps\n", identical ? "identical" : "DIFFER");
+}
+
+// benchmarkCheckpoint() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Warms up 50k bodies orbiting the black hole, saves them to a
+///     checkpoint and restores them into a fresh system, comparing the time
+///     with the warm up it replaces.  Both systems are then stepped on and
+///     must stay identical bit for bit.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkCheckpoint(JobSystem &jobSystem) {
+    const size_t NUM_BODIES = 50000;
+    const int WARM_UP_FRAMES = 10, CHECK_FRAMES = 5;
+    const char* FILENAME = "benchmark.ckp";
+
+    auto setUp = [&](BodySystem &system) {
+        system.initialize(&jobSystem);
+        system.getSolver().setSoftening(0.3f);
+        Attractor blackHole;
+        blackHole.position = glm::vec3(0.0f);
+        blackHole.gm = 2.0f;
+        system.getSolver().addAttractor(blackHole);
+        system.setCollisionCellSize(0.3f);
+    };
+
+    BodySystem warm;
+    setUp(warm);
+    for(size_t i = 0; i < NUM_BODIES; i++) {
+        float angle = randFloat() * 6.28f, radius = 3.0f + 30.0f * randFloat();
+        float speed = sqrtf(2.0f / radius);
+        warm.create(glm::vec3(cosf(angle) * radius, randFloat() - 0.5f, sinf(angle) * radius), glm::vec3(-sinf(angle) * speed, 0.0f, cosf(angle) * speed),
+                    glm::vec3(0.0f, 0.02f, 0.0f), glm::vec3(0.1f), 0.1f, 1.0f, 0);
+    }
+    double warmUpMs = timeCPU([&]() {
+        for(int f = 0; f < WARM_UP_FRAMES; f++) warm.step(1.0f);
+    });
+
+    CheckpointWriter writer;
+    warm.saveCheckpoint(writer);
+    double saveMs = timeCPU([&]() { writer.write(FILENAME); });
+
+    BodySystem restored;
+    setUp(restored);
+    CheckpointReader reader;
+    bool ok = false;
+    double restoreMs = timeCPU([&]() { ok = reader.open(FILENAME) && restored.restoreCheckpoint(reader); });
+    reader.close();
+    remove(FILENAME);
+
+    printf("[BENCH]: checkpoint, %zu bodies, %d warm up frames %.1f ms, saved in %.1f ms, restored in %.2f ms\n",
+           NUM_BODIES, WARM_UP_FRAMES, warmUpMs, saveMs, restoreMs);
+    if(!ok) {
+        printf("[BENCH]:   restore FAILED\n");
+        return;
+    }
+
+    for(int f = 0; f < CHECK_FRAMES; f++) {
+        warm.step(1.0f);
+        restored.step(1.0f);
+    }
+    bool identical = memcmp(&warm.positions[0], &restored.positions[0], NUM_BODIES * sizeof(glm::vec3)) == 0
+                  && memcmp(&warm.velocities[0], &restored.velocities[0], NUM_BODIES * sizeof(glm::vec3)) == 0
+                  && memcmp(&warm.orientations[0], &restored.orientations[0], NUM_BODIES * sizeof(glm::quat)) == 0;
+    printf("[BENCH]:   restored and original runs %s after %d more frames\n", identical ? "identical" : "DIFFER", CHECK_FRAMES);
+}
+
+// benchmarkSceneGraph() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Times world matrix updates of 100k node hierarchies - a single chain and
+///     a tree with four children per node - when everything, a few leaves or
+///     nothing changed.  The tree is also timed through Transform::getMatrix(),
+///     which walks up to the root for every node.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkSceneGraph() {
+    const uint32_t NUM_NODES = 100000;
+    const uint32_t BRANCHING[2] = { 1, 4 };
+    const char* NAMES[2] = { "chain", "tree " };
+
+    printf("[BENCH]: scene graph, %u nodes\n", NUM_NODES);
+    for(int h = 0; h < 2; h++) {
+        SceneGraph graph;
+        graph.reserve(NUM_NODES);
+        glm::quat rotation = Transform::toQuaternion(0.01f, 0.02f, 0.0f);
+        double buildMs = timeCPU([&]() {
+            graph.addNode(SceneGraph::NO_PARENT, glm::vec3(0.0f), rotation, glm::vec3(1.0f));
+            for(uint32_t i = 1; i < NUM_NODES; i++) {
+                graph.addNode((i - 1) / BRANCHING[h], glm::vec3(0.1f, 0.0f, 0.0f), rotation, glm::vec3(1.0f));
+            }
+            graph.update();
+        });
+
+        double cleanMs = timeCPU([&]() { graph.update(); });
+        size_t cleanCount = graph.getNumUpdated();
+
+        double rootMs = timeCPU([&]() {
+            graph.setPosition(0, glm::vec3(1.0f, 0.0f, 0.0f));
+            graph.update();
+        });
+        size_t rootCount = graph.getNumUpdated();
+
+        double leavesMs = timeCPU([&]() {
+            for(int i = 0; i < 100; i++) {
+                graph.setPosition(NUM_NODES - 1 - (rand() % (NUM_NODES / 2)), glm::vec3(randFloat(), 0.0f, 0.0f));
+            }
+            graph.update();
+        });
+        size_t leavesCount = graph.getNumUpdated();
+
+        printf("[BENCH]:   %s  build %8.2f ms  nothing dirty %8.3f ms (%zu)  root dirty %8.2f ms (%zu)  100 random dirty %8.2f ms (%zu)\n",
+               NAMES[h], buildMs, cleanMs, cleanCount, rootMs, rootCount, leavesMs, leavesCount);
+    }
+
+    // the same tree through Transform, every world matrix walks up to the root
+    std::vector<Transform> transforms(NUM_NODES);
+    for(uint32_t i = 0; i < NUM_NODES; i++) {
+        transforms[i].rotation = Transform::toQuaternion(0.01f, 0.02f, 0.0f);
+        transforms[i].position = glm::vec3(0.1f, 0.0f, 0.0f);
+        transforms[i].parent = i == 0 ? nullptr : &transforms[(i - 1) / 4];
+    }
+    float sink = 0.0f;                  // keeps the matrices from being optimized away
+    double transformMs = timeCPU([&]() {
+        for(uint32_t i = 0; i < NUM_NODES; i++) {
+            sink += transforms[i].getMatrix()[3][0];
+        }
+    });
+    printf("[BENCH]:   tree  Transform::getMatrix() for every node %8.2f ms (%.1f)\n", transformMs, sink);
+}
+
+// benchmarkQuaternions() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Times one frame of spin integration and matrix conversion for 100k
+///     bodies - the old euler angle round trip through Transform against the
+///     scalar and SSE quaternion kernels
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkQuaternions() {
+    const size_t NUM_BODIES = 100000;
+    const int NUM_FRAMES = 10;
+
+    std::vector<glm::quat> orientations(NUM_BODIES, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    std::vector<glm::vec3> angularVelocities(NUM_BODIES), positions(NUM_BODIES);
+    for(size_t i = 0; i < NUM_BODIES; i++) {
+        angularVelocities[i] = glm::vec3(randFloat(), randFloat(), randFloat()) * 0.1f;
+        positions[i] = glm::vec3(randFloat(), randFloat(), randFloat());
+    }
+    std::vector<glm::mat4> matrices(NUM_BODIES);
+
+    std::vector<Transform> transforms(NUM_BODIES);
+    double eulerMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            for(size_t i = 0; i < NUM_BODIES; i++) {
+                transforms[i].setRotation(transforms[i].eulerAngles() + angularVelocities[i]);
+            }
+        }
+    }) / NUM_FRAMES;
+    double scalarMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            QuaternionBatch::integrateScalar(&orientations[0], &angularVelocities[0], NUM_BODIES, 1.0f);
+        }
+    }) / NUM_FRAMES;
+    double batchMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            QuaternionBatch::integrate(&orientations[0], &angularVelocities[0], NUM_BODIES, 1.0f);
+        }
+    }) / NUM_FRAMES;
+    printf("[BENCH]: spin integration, %zu bodies  euler round trip %7.3f ms  quaternion %7.3f ms  batched %7.3f ms\n",
+           NUM_BODIES, eulerMs, scalarMs, batchMs);
+
+    double glmMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            for(size_t i = 0; i < NUM_BODIES; i++) {
+                matrices[i] = glm::translate(glm::mat4(1.0f), positions[i]) * glm::toMat4(orientations[i]);
+            }
+        }
+    }) / NUM_FRAMES;
+    float sink = matrices[NUM_BODIES / 2][0][1];
+    double toMatricesMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            QuaternionBatch::toMatrices(&orientations[0], &positions[0], NUM_BODIES, &matrices[0]);
+        }
+    }) / NUM_FRAMES;
+    printf("[BENCH]: quaternion to matrix, %zu bodies  glm %7.3f ms  batched %7.3f ms (difference %.1e)\n",
+           NUM_BODIES, glmMs, toMatricesMs, fabs(sink - matrices[NUM_BODIES / 2][0][1]));
+}
+
+// benchmarkInstanceMatrices() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Times building model and normal matrices for 100k instances - composing
+///     and inverting full 4x4 matrices through GLM against the scalar and AVX2
+///     batch kernels
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkInstanceMatrices() {
+    const size_t NUM_INSTANCES = 100000;
+    const int NUM_FRAMES = 10;
+
+    std::vector<glm::vec3> positions(NUM_INSTANCES), scales(NUM_INSTANCES), angularVelocities(NUM_INSTANCES);
+    std::vector<glm::quat> orientations(NUM_INSTANCES, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    for(size_t i = 0; i < NUM_INSTANCES; i++) {
+        positions[i] = glm::vec3(randFloat(), randFloat(), randFloat()) * 10.0f;
+        scales[i] = glm::vec3(0.5f + randFloat(), 0.5f + randFloat(), 0.5f + randFloat());
+        angularVelocities[i] = glm::vec3(randFloat(), randFloat(), randFloat());
+    }
+    QuaternionBatch::integrate(&orientations[0], &angularVelocities[0], NUM_INSTANCES, 1.0f);
+
+    std::vector<glm::mat4> models(NUM_INSTANCES);
+    std::vector<glm::mat3> normals(NUM_INSTANCES);
+    double glmMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            for(size_t i = 0; i < NUM_INSTANCES; i++) {
+                models[i] = glm::translate(glm::mat4(1.0f), positions[i]) * glm::toMat4(orientations[i]) * glm::scale(glm::mat4(1.0f), scales[i]);
+                normals[i] = glm::mat3(glm::transpose(glm::inverse(models[i])));
+            }
+        }
+    }) / NUM_FRAMES;
+
+    std::vector<InstanceTransform> instances(NUM_INSTANCES);
+    double scalarMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            InstanceBatch::buildTransformsScalar(&positions[0], &orientations[0], &scales[0], NUM_INSTANCES, &instances[0]);
+        }
+    }) / NUM_FRAMES;
+    double batchMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            InstanceBatch::buildTransforms(&positions[0], &orientations[0], &scales[0], NUM_INSTANCES, &instances[0]);
+        }
+    }) / NUM_FRAMES;
+
+    // the batch output against the general inverse
+    float maxError = 0.0f;
+    for(size_t i = 0; i < NUM_INSTANCES; i++) {
+        for(int r = 0; r < 3; r++) {
+            for(int c = 0; c < 3; c++) {
+                maxError = fmax(maxError, fabs(instances[i].modelRows[r][c] - models[i][c][r]));
+                maxError = fmax(maxError, fabs(instances[i].normalRows[r][c] - normals[i][c][r]));
+            }
+        }
+    }
+    printf("[BENCH]: instance matrices, %zu instances  glm + inverse %7.3f ms  scalar %7.3f ms  batched (avx2 %s) %7.3f ms  max error %.1e\n",
+           NUM_INSTANCES, glmMs, scalarMs, InstanceBatch::hasAVX2() ? "on" : "off", batchMs, maxError);
+}
+
+// benchmarkParticleCulling() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Times culling 100k particles scattered around the camera to the frustum
+///     and a one pixel size threshold, scalar against SSE, and checks both keep
+///     the same particles
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkParticleCulling() {
+    const size_t NUM_PARTICLES = 100000;
+    const int NUM_FRAMES = 20;
+
+    std::vector<glm::vec3> positions(NUM_PARTICLES);
+    for(size_t i = 0; i < NUM_PARTICLES; i++) {
+        positions[i] = (glm::vec3(randFloat(), randFloat(), randFloat()) * 2.0f - 1.0f) * 100.0f;
+    }
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(45.0f, 1.0f, 0.001f, 100.0f);
+    ParticleCuller culler;
+    culler.setView(view, projection, 0.283f, 1024.0f, 1.0f);
+
+    std::vector<glm::vec3> scalarVisible(NUM_PARTICLES), batchVisible(NUM_PARTICLES);
+    size_t numScalar = 0, numBatch = 0;
+    double scalarMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            numScalar = culler.cullScalar(&positions[0], NUM_PARTICLES, &scalarVisible[0]);
+        }
+    }) / NUM_FRAMES;
+    double batchMs = timeCPU([&]() {
+        for(int f = 0; f < NUM_FRAMES; f++) {
+            numBatch = culler.cull(&positions[0], NUM_PARTICLES, &batchVisible[0]);
+        }
+    }) / NUM_FRAMES;
+    bool same = numScalar == numBatch && std::equal(scalarVisible.begin(), scalarVisible.begin() + numScalar, batchVisible.begin());
+    printf("[BENCH]: particle culling, %zu particles  %zu visible  scalar %7.3f ms  sse %7.3f ms  %s\n",
+           NUM_PARTICLES, numBatch, scalarMs, batchMs, same ? "same survivors" : "SURVIVORS DIFFER");
+}
+
+// benchmarkShaderVariants() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Compares vertex throughput of the gourad uber-shader against the
+///     specialized permutation for each light type.  Vertices are drawn as
+///     points into a single pixel so the vertex stage dominates.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkShaderVariants() {
+    const GLuint NUM_VERTICES = 1 << 20;
+    const int NUM_DRAWS = 20;
+    const char* LIGHT_NAMES[4] = { "point", "directional", "spot", "black hole" };
+
+    ShaderVariantCache variants;
+    GLuint uber = variants.getProgram( "shaders/gouradShader.v.glsl", "shaders/gouradShader.f.glsl", std::vector<std::string>() );
+    if(uber == 0) return;
+
+    // random positions and normals on a unit sphere shell
+    std::vector<glm::vec3> vertexData(NUM_VERTICES * 2);
+    for(GLuint i = 0; i < NUM_VERTICES; i++) {
+        glm::vec3 p(rand() / (GLfloat)RAND_MAX - 0.5f, rand() / (GLfloat)RAND_MAX - 0.5f, rand() / (GLfloat)RAND_MAX - 0.5f);
+        p = glm::normalize(p + glm::vec3(0.001f));
+        vertexData[i*2] = p * 3.0f;
+        vertexData[i*2+1] = p;
+    }
+
+    GLuint vao, vbo;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(glm::vec3), &vertexData[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)sizeof(glm::vec3));
+
+    glViewport(0, 0, 1, 1);
+
+    printf("[BENCH]: gourad vertex throughput, %u vertices x %d draws\n", NUM_VERTICES, NUM_DRAWS);
+    for(int type = 0; type < 4; type++) {
+        std::vector<std::string> defines;
+        defines.push_back("LIGHT_TYPE " + std::to_string(type));
+        GLuint variant = variants.getProgram( "shaders/gouradShader.v.glsl", "shaders/gouradShader.f.glsl", defines );
+
+        GLuint programs[2] = { uber, variant };
+        double ms[2];
+        for(int p = 0; p < 2; p++) {
+            glUseProgram(programs[p]);
+            glm::mat4 identity(1.0f);
+            glm::mat3 identity3(1.0f);
+            glm::vec3 light(1.0f, 3.0f, 1.0f);
+            glUniformMatrix4fv(glGetUniformLocation(programs[p], "mvpMatrix"), 1, GL_FALSE, &identity[0][0]);
+            glUniformMatrix4fv(glGetUniformLocation(programs[p], "modelMatrix"), 1, GL_FALSE, &identity[0][0]);
+            glUniformMatrix3fv(glGetUniformLocation(programs[p], "normalMtx"), 1, GL_FALSE, &identity3[0][0]);
+            glUniform3fv(glGetUniformLocation(programs[p], "lightPos"), 1, &light[0]);
+            glUniform3fv(glGetUniformLocation(programs[p], "lightDir"), 1, &light[0]);
+            glUniform1f(glGetUniformLocation(programs[p], "lightCutoff"), 0.9f);
+            glUniform1i(glGetUniformLocation(programs[p], "lightType"), type);
+
+            glDrawArrays(GL_POINTS, 0, NUM_VERTICES);     // warm up
+            ms[p] = timeGPU([&]() {
+                for(int d = 0; d < NUM_DRAWS; d++) glDrawArrays(GL_POINTS, 0, NUM_VERTICES);
+            });
+        }
+        double total = (double)NUM_VERTICES * NUM_DRAWS;
+        printf("[BENCH]:   %-12s uber %8.2f ms (%7.1f Mvert/s)   variant %8.2f ms (%7.1f Mvert/s)   speedup %.2fx\n",
+               LIGHT_NAMES[type], ms[0], total / (ms[0] * 1000.0), ms[1], total / (ms[1] * 1000.0), ms[0] / ms[1]);
+    }
+
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+    variants.cleanup();
+}
+
+// benchmarkBillboards() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Times drawing 100k to 1M particle sprites by expanding points in the
+///     geometry shader against instancing one quad with a packed 12 byte
+///     per-particle buffer, then the per frame upload of the packed buffer
+///     against the same particles as 24 bytes of floats.  The sprites are small
+///     and spread out so vertex work dominates.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkBillboards() {
+    const GLuint SPRITE_COUNTS[3] = { 100000, 250000, 1000000 };
+    const int NUM_DRAWS = 10;
+    const GLuint MAX_SPRITES = SPRITE_COUNTS[2];
+
+    CSCI441::ShaderProgram geometryProgram( "shaders/billboardQuadShader.v.glsl", "shaders/billboardQuadShader.g.glsl", "shaders/billboardQuadShader.f.glsl" );
+    CSCI441::ShaderProgram instancedProgram( "shaders/billboardInstanced.v.glsl", "shaders/billboardInstanced.f.glsl" );
+    CSCI441::ShaderProgram *programs[2] = { &geometryProgram, &instancedProgram };
+    glm::mat4 mvMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -60.0f));
+    glm::mat4 projMatrix = glm::perspective(45.0f, 1.0f, 0.1f, 200.0f);
+    for(int p = 0; p < 2; p++) {
+        programs[p]->useProgram();
+        glUniformMatrix4fv(programs[p]->getUniformLocation("mvMatrix"), 1, GL_FALSE, &mvMatrix[0][0]);
+        glUniformMatrix4fv(programs[p]->getUniformLocation("projMatrix"), 1, GL_FALSE, &projMatrix[0][0]);
+    }
+    glUniform3f(instancedProgram.getUniformLocation("emitterOrigin"), 0.0f, 0.0f, 0.0f);
+    glUniform1f(instancedProgram.getUniformLocation("maxSize"), 0.2f);
+    glUniform1f(instancedProgram.getUniformLocation("spinPerLife"), 6.0f);
+    glUniform1f(instancedProgram.getUniformLocation("framesPerLife"), 1.0f);
+    glUniform1i(instancedProgram.getUniformLocation("numFrames"), 1);
+
+    // the same particles as floats for the geometry shader, and packed: half float offsets, 16 bit age, 8 bit
+    // tint and size.  Halves with exponents 10 to 19 keep the offsets within +-32 without a conversion
+    std::vector<glm::vec3> points(MAX_SPRITES);
+    std::vector<GLfloat> floatInstances(MAX_SPRITES * 6);
+    std::vector<GLushort> packedInstances(MAX_SPRITES * 6);
+    for(GLuint i = 0; i < MAX_SPRITES; i++) {
+        GLushort *packed = &packedInstances[i * 6];
+        for(int c = 0; c < 3; c++) {
+            GLushort half = (rand() & 1) << 15 | (10 + rand() % 10) << 10 | (rand() & 0x3FF);
+            packed[c] = half;
+            int exponent = ((half >> 10) & 0x1F) - 15;
+            points[i][c] = (half & 0x8000 ? -1.0f : 1.0f) * ldexpf(1.0f + (half & 0x3FF) / 1024.0f, exponent);
+            floatInstances[i * 6 + c] = points[i][c];
+        }
+        packed[3] = rand() & 0xFFFF;
+        packed[4] = 0xFFFF;
+        packed[5] = 0x8000 | (rand() & 0x7FFF);
+        floatInstances[i * 6 + 3] = 0.2f * (packed[5] >> 8) / 255.0f;
+        floatInstances[i * 6 + 4] = randFloat() * 6.28f;
+        floatInstances[i * 6 + 5] = packed[3] / 65535.0f;
+    }
+    const GLfloat QUAD_CORNERS[8] = { -1.0f, -1.0f,   -1.0f, 1.0f,   1.0f, -1.0f,   1.0f, 1.0f };
+
+    GLuint vaos[2], vbos[3];
+    glGenVertexArrays(2, vaos);
+    glGenBuffers(3, vbos);
+    glBindVertexArray(vaos[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
+    glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(glm::vec3), &points[0], GL_STATIC_DRAW);
+    GLint pointPos = geometryProgram.getAttributeLocation("vPos");
+    glEnableVertexAttribArray(pointPos);
+    glVertexAttribPointer(pointPos, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+    glBindVertexArray(vaos[1]);
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[1]);
+    glBufferData(GL_ARRAY_BUFFER, packedInstances.size() * sizeof(GLushort), &packedInstances[0], GL_STREAM_DRAW);
+    const GLint PER_INSTANCE[3] = { instancedProgram.getAttributeLocation("particleOffset"), instancedProgram.getAttributeLocation("particleAge"),
+                                    instancedProgram.getAttributeLocation("particleColorSize") };
+    const GLint COMPONENTS[3] = { 3, 1, 4 };
+    const GLenum TYPES[3] = { GL_HALF_FLOAT, GL_UNSIGNED_SHORT, GL_UNSIGNED_BYTE };
+    const GLboolean NORMALIZED[3] = { GL_FALSE, GL_TRUE, GL_TRUE };
+    const size_t OFFSETS[3] = { 0, 6, 8 };
+    for(int a = 0; a < 3; a++) {
+        glEnableVertexAttribArray(PER_INSTANCE[a]);
+        glVertexAttribPointer(PER_INSTANCE[a], COMPONENTS[a], TYPES[a], NORMALIZED[a], 6 * sizeof(GLushort), (void*)OFFSETS[a]);
+        glVertexAttribDivisor(PER_INSTANCE[a], 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[2]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD_CORNERS), QUAD_CORNERS, GL_STATIC_DRAW);
+    GLint corner = instancedProgram.getAttributeLocation("vCorner");
+    glEnableVertexAttribArray(corner);
+    glVertexAttribPointer(corner, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+    glViewport(0, 0, 64, 64);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    printf("[BENCH]: particle billboards, %d draws each\n", NUM_DRAWS);
+    for(int c = 0; c < 3; c++) {
+        GLuint count = SPRITE_COUNTS[c];
+        double ms[2];
+        for(int p = 0; p < 2; p++) {
+            programs[p]->useProgram();
+            glBindVertexArray(vaos[p]);
+            if(p == 0) glDrawArrays(GL_POINTS, 0, count);                       // warm up
+            else glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+            ms[p] = timeGPU([&]() {
+                for(int d = 0; d < NUM_DRAWS; d++) {
+                    if(p == 0) glDrawArrays(GL_POINTS, 0, count);
+                    else glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+                }
+            }) / NUM_DRAWS;
+        }
+        printf("[BENCH]:   %8u sprites  geometry shader %8.2f ms  instanced %8.2f ms  speedup %.2fx\n",
+               count, ms[0], ms[1], ms[0] / ms[1]);
+    }
+
+    // what the instanced path streams every frame
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[1]);
+    double uploadMs[2];
+    const void *UPLOADS[2] = { &floatInstances[0], &packedInstances[0] };
+    const size_t UPLOAD_BYTES[2] = { floatInstances.size() * sizeof(GLfloat), packedInstances.size() * sizeof(GLushort) };
+    for(int u = 0; u < 2; u++) {
+        uploadMs[u] = timeCPU([&]() {
+            for(int d = 0; d < NUM_DRAWS; d++) {
+                glBufferData(GL_ARRAY_BUFFER, UPLOAD_BYTES[u], UPLOADS[u], GL_STREAM_DRAW);
+                glFinish();
+            }
+        }) / NUM_DRAWS;
+    }
+    printf("[BENCH]:   upload of %u sprites  floats %zu B each %8.2f ms  packed %zu B each %8.2f ms  %.2fx less bandwidth\n",
+           MAX_SPRITES, UPLOAD_BYTES[0] / MAX_SPRITES, uploadMs[0], UPLOAD_BYTES[1] / MAX_SPRITES, uploadMs[1],
+           (double)UPLOAD_BYTES[0] / UPLOAD_BYTES[1]);
+
+    glDisable(GL_BLEND);
+    glBindVertexArray(0);
+    glDeleteBuffers(3, vbos);
+    glDeleteVertexArrays(2, vaos);
+}
+
+// benchmarkDepthSort() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Sorts particles back to front with the compute shader bitonic sort and checks the order it
+///     leaves in the index buffer, against computing the depths and std::sort on the CPU.
+// /////////////////////////////////////////////////////////////////////////////
+void benchmarkDepthSort() {
+    const GLuint PARTICLE_COUNTS[3] = { 100000, 250000, 1000000 };
+    const int NUM_SORTS = 10;
+    const GLuint MAX_PARTICLES = PARTICLE_COUNTS[2];
+
+    GPUDepthSort depthSort;
+    if(!depthSort.initialize()) {
+        printf("[BENCH]: depth sort skipped, compute shaders need OpenGL 4.3\n");
+        return;
+    }
+
+    std::vector<glm::vec3> positions(MAX_PARTICLES);
+    for(GLuint i = 0; i < MAX_PARTICLES; i++) {
+        positions[i] = glm::vec3(randFloat(), randFloat(), randFloat()) * 100.0f - 50.0f;
+    }
+    GLuint positionBuffer;
+    glGenBuffers(1, &positionBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    const glm::vec3 EYE_POS(10.0f, 20.0f, 120.0f);
+    const glm::vec3 VIEW_DIRECTION = glm::normalize(-EYE_POS);
+
+    printf("[BENCH]: particle depth sort, %d sorts each\n", NUM_SORTS);
+    std::vector<GLfloat> distances(MAX_PARTICLES);
+    std::vector<GLuint> indices(MAX_PARTICLES);
+    std::vector<char> seen(MAX_PARTICLES);
+    for(int c = 0; c < 3; c++) {
+        GLuint count = PARTICLE_COUNTS[c];
+        depthSort.sort(positionBuffer, GPUDepthSort::FLOAT_POSITIONS, 3, count, glm::vec3(0.0f), EYE_POS, VIEW_DIRECTION);     // warm up
+        double gpuMs = timeGPU([&]() {
+            for(int s = 0; s < NUM_SORTS; s++) {
+                depthSort.sort(positionBuffer, GPUDepthSort::FLOAT_POSITIONS, 3, count, glm::vec3(0.0f), EYE_POS, VIEW_DIRECTION);
+            }
+        }) / NUM_SORTS;
+
+        // every particle once, farthest first, allowing for the GPU rounding its dot products differently
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, depthSort.getIndexBuffer());
+        glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, count * sizeof(GLuint), &indices[0]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        std::fill(seen.begin(), seen.begin() + count, 0);
+        GLuint numWrong = 0;
+        GLfloat previous = 3.402823e38f;
+        for(GLuint i = 0; i < count; i++) {
+            GLuint index = indices[i];
+            if(index >= count || seen[index]) {
+                numWrong++;
+                continue;
+            }
+            seen[index] = 1;
+            GLfloat distance = glm::dot(positions[index] - EYE_POS, VIEW_DIRECTION);
+            if(distance > previous + 1.0e-4f) numWrong++;
+            previous = distance;
+        }
+
+        double cpuMs = timeCPU([&]() {
+            for(int s = 0; s < NUM_SORTS; s++) {
+                for(GLuint i = 0; i < count; i++) {
+                    distances[i] = glm::dot(positions[i] - EYE_POS, VIEW_DIRECTION);
+                    indices[i] = i;
+                }
+                const GLfloat *particleDistances = &distances[0];
+                std::sort(indices.begin(), indices.begin() + count,
+                          [particleDistances](GLuint a, GLuint b) { return particleDistances[a] > particleDistances[b]; });
+            }
+        }) / NUM_SORTS;
+        printf("[BENCH]:   %8u particles  GPU bitonic %8.2f ms  CPU std::sort %8.2f ms  speedup %.2fx  %s\n",
+               count, gpuMs, cpuMs, cpuMs / gpuMs, numWrong == 0 ? "sorted" : "OUT OF ORDER");
+    }
+
+    glDeleteBuffers(1, &positionBuffer);
+    depthSort.cleanup();
+}
+
+//**********************************************************************************************************************************************************
+//
+// Our main function
+
+// wanted() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     true when the benchmark was named on the command line or no names were given
+// /////////////////////////////////////////////////////////////////////////////
+bool wanted(int argc, char** argv, const char* name) {
+    if(argc <= 1) return true;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], name) == 0) return true;
+    }
+    return false;
+}
+
+// main() /////////////////////////////////////////////////////////////////////////////
+///
+// /////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+    // CPU benchmarks
+    JobSystem jobSystem;
+    jobSystem.initialize();
+    if(wanted(argc, argv, "barnesHut")) benchmarkBarnesHut(jobSystem);
+    if(wanted(argc, argv, "integrator")) benchmarkIntegrator(jobSystem);
+    if(wanted(argc, argv, "broadphase")) benchmarkBroadphase(jobSystem);
+    if(wanted(argc, argv, "triangleBVH")) benchmarkTriangleBVH(jobSystem);
+    if(wanted(argc, argv, "distanceField")) benchmarkDistanceField(jobSystem);
+    if(wanted(argc, argv, "curlNoise")) benchmarkCurlNoise(jobSystem);
+    if(wanted(argc, argv, "fluid")) benchmarkFluid(jobSystem);
+    if(wanted(argc, argv, "checkpoint")) benchmarkCheckpoint(jobSystem);
+    if(wanted(argc, argv, "sceneGraph")) benchmarkSceneGraph();
+    if(wanted(argc, argv, "quaternions")) benchmarkQuaternions();
+    if(wanted(argc, argv, "instanceMatrices")) benchmarkInstanceMatrices();
+    if(wanted(argc, argv, "particleCulling")) benchmarkParticleCulling();
+    jobSystem.cleanup();
+
+    // GPU benchmarks
+    const char* GPU_BENCHMARKS[3] = { "shaderVariants", "billboards", "depthSort" };
+    bool needsContext = false;
+    for(int i = 0; i < 3; i++) {
+        needsContext = needsContext || wanted(argc, argv, GPU_BENCHMARKS[i]);
+    }
+    if(!needsContext) return EXIT_SUCCESS;
+
+    GLFWwindow *window = createHiddenContext();
+    if(window) {
+        if(wanted(argc, argv, "shaderVariants")) benchmarkShaderVariants();
+        if(wanted(argc, argv, "billboards")) benchmarkBillboards();
+        if(wanted(argc, argv, "depthSort")) benchmarkDepthSort();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+    return EXIT_SUCCESS;
+}
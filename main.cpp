@@ -21,8 +21,13 @@
 #include <glm/glm.hpp>                  // include GLM libraries
 #include <glm/gtc/matrix_transform.hpp> // and matrix functions
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>                       // for high resolution time
 #include <cstdio>				        // for printf functionality
 #include <cstdlib>				        // for exit functionality
+#include <cstring>
+#include <ctime>                        // for time() functionality
 
 #include <CSCI441/FramebufferUtils.hpp> // assists with FBO error checking
 #include <CSCI441/modelLoader.hpp>      // load OBJ files
@@ -30,6 +35,20 @@
 #include <CSCI441/ShaderProgram.hpp>    // wrapper class for GLSL shader programs
 #include <CSCI441/TextureUtils.hpp>     // convenience for loading textures
 
+#include "CurlNoiseField.h"
+#include "FluidSolver.h"
+#include "ForceVolumes.h"
+#include "FrameArena.h"
+#include "HeapCounter.h"
+#include "JobSystem.h"
+#include "LightingShaderStructs.h"
+#include "ParticleSystem.h"
+#include "ResourceRegistry.h"
+#include "SignedDistanceField.h"
+#include "SimRecorder.h"
+#include "TriangleBVH.h"
+#include "WeightedBlendedOIT.h"
+
 //***********************************************************************************************************************************************************
 //
 // Global Parameters
@@ -69,6 +88,34 @@ GLuint skyboxHandles[6];                // all of our skybox texture handles in
 GLuint platformTextureHandle;           // handle for the platform texture
 
 CSCI441::ModelLoader* townModel = nullptr;  // stores OBJ model
+const glm::vec3 TOWN_POSITION(4.0f, 0.1f, 0.0f);    // where the town model is placed on the platform
+TriangleBVH townCollisionMesh;          // the town and the platform, for particle collisions and picking
+SignedDistanceField townDistanceField;  // the same surfaces baked by sdfBake, cheaper for particles when present
+
+// particles raining down on the town from above whatever the mouse is over
+ParticleSystem particleSystem;
+CurlNoiseField particleTurbulence;      // swirls the particles about as they fall
+ForceVolumes forceVolumes;              // wind, a vortex and an attractor over the town
+FluidSolver fluidSolver;                // makes the fountain particles splash off each other
+bool fluidMode = false;
+bool drawBoundings = false;             // outline the force volumes
+JobSystem jobSystem;                    // worker threads, for generating the turbulence
+glm::vec3 particleEmitterPos(4.0f, 12.0f, 0.0f);
+const GLfloat EMITTER_HEIGHT = 6.0f;    // how far above the picked point the emitter hovers
+unsigned long long now;                 // time of the last update in milliseconds
+uint32_t simulationSeed = 1;            // seeds the particle spawning
+
+// scratch memory for one update, so a steady frame never touches the heap
+FrameArena frameArena;
+const unsigned WARMUP_FRAMES = 60;      // frames after a change before allocations count as a bug
+unsigned steadyFrames = 0;              // frames since a key toggle or a new most particles alive
+size_t mostParticles = 0;
+
+// recording a run or replaying one, see main() for the command line
+SimRecorder simRecorder;
+FrameRecord currentFrame;               // this frame's input, written out with its time step by updateScene()
+bool replayingEvents = false;           // true while the callbacks are fed from the recording
+glm::mat4 viewProjectionMatrix;         // of the last frame, used to turn the mouse position into a ray
 
 // framebuffer information
 GLuint fbo, rbo;                        // handles for the FBO and RBO
@@ -105,6 +152,29 @@ struct ModelPhongShaderProgramAttributes {
     GLint vTextureCoord;                // the vertex texture coordinate
 } modelPhongShaderProgramAttributes;
 
+// Billboard shader program and flat shader program for the particle system
+CSCI441::ShaderProgram *billboardShaderProgram = nullptr;
+ParticleShaderUniforms particleShaderUniforms;
+ParticleShaderAttributes particleShaderAttributes;
+CSCI441::ShaderProgram *flatShaderProgram = nullptr;
+FlatShaderProgramUniforms flatShaderProgramUniforms;
+FlatShaderProgramAttributes flatShaderProgramAttributes;
+
+// unsorted particles through weighted blended transparency, O switches to it and back
+CSCI441::ShaderProgram *billboardOITShaderProgram = nullptr;
+ParticleShaderUniforms particleOITShaderUniforms;
+ParticleShaderAttributes particleOITShaderAttributes;
+CSCI441::ShaderProgram *oitCompositeShaderProgram = nullptr;
+OITCompositeUniforms oitCompositeUniforms;
+WeightedBlendedOIT particleTransparency;
+bool particleTransparencyReady = false;  // false if the targets could not be made, particles then stay sorted
+
+// particles as instanced quads rather than geometry shader points, sorted and order independent, I switches
+CSCI441::ShaderProgram *billboardInstancedShaderProgram = nullptr;
+CSCI441::ShaderProgram *billboardInstancedOITShaderProgram = nullptr;
+InstancedParticleShaderUniforms particleInstancedShaderUniforms[2];
+InstancedParticleShaderAttributes particleInstancedShaderAttributes[2];
+
 // Postprocessing shader program for after effects
 CSCI441::ShaderProgram *postprocessingShaderProgram = nullptr;
 struct PostprocessingShaderProgramUniforms {
@@ -178,6 +248,53 @@ void computeAndSendTransformationMatrices( const glm::mat4 MODEL_MATRIX, const g
     glUniformMatrix4fv( NORMAL_MTX_LOC,         1, GL_FALSE, &normalMatrix[0][0]      );
 }
 
+// /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Casts a ray from the camera through a point in the window against the
+///  town and the platform, and moves the particle emitter above what it hits.
+/// \param xPos - horizontal window coordinate of the point
+/// \param yPos - vertical window coordinate of the point
+// /////////////////////////////////////////////////////////////////////////////
+void pickScene( double xPos, double yPos ) {
+    // the scene fills the window through the FBO so window coordinates map straight to NDC
+    GLfloat x = 2.0f * (GLfloat)xPos / WINDOW_WIDTH - 1.0f;
+    GLfloat y = 1.0f - 2.0f * (GLfloat)yPos / WINDOW_HEIGHT;
+    glm::mat4 inverseViewProjection = glm::inverse( viewProjectionMatrix );
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(x, y, 1.0f, 1.0f);
+    glm::vec3 rayStart = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 rayEnd = glm::vec3(farPoint) / farPoint.w;
+
+    RayHit hit;
+    if( townCollisionMesh.intersectSegment(rayStart, rayEnd, hit) ) {
+        particleEmitterPos = rayStart + (rayEnd - rayStart) * hit.t + glm::vec3(0.0f, EMITTER_HEIGHT, 0.0f);
+    }
+}
+
+// /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Called at the top of every input callback.  Adds the event to the
+///     recording when there is one, and turns away input from the window
+///     while a replay is feeding the callbacks instead.
+/// \return false if the callback should ignore the event
+// /////////////////////////////////////////////////////////////////////////////
+bool acceptEvent(InputEvent::Type type, int code, int action, int mods, double x, double y) {
+    if( simRecorder.isReplaying() ) {
+        return replayingEvents;
+    }
+    if( simRecorder.isRecording() ) {
+        InputEvent event;
+        event.type = type;
+        event.code = code;
+        event.action = action;
+        event.mods = mods;
+        event.x = x;
+        event.y = y;
+        currentFrame.events.push_back( event );
+    }
+    return true;
+}
+
 //***********************************************************************************************************************************************************
 //
 // Event Callbacks
@@ -201,12 +318,39 @@ static void error_callback(int error, const char* description) {
 ///
 // /////////////////////////////////////////////////////////////////////////////
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if( !acceptEvent(InputEvent::KEY, key, action, mods, 0.0, 0.0) ) return;
     if(action == GLFW_PRESS) {
         switch( key ) {
             case GLFW_KEY_Q:
             case GLFW_KEY_ESCAPE:
                 glfwSetWindowShouldClose( window, GLFW_TRUE );
                 break;
+            case GLFW_KEY_B:
+                drawBoundings = !drawBoundings;
+                break;
+            case GLFW_KEY_M:
+                ResourceRegistry::printReport();
+                fprintf( stdout, "[INFO]: %zu particles drawn, %zu culled\n", particleSystem.getNumVisible(), particleSystem.getNumCulled() );
+                break;
+            case GLFW_KEY_O:
+                if( !particleTransparencyReady ) break;
+                particleSystem.setBlendMode( particleSystem.getBlendMode() == ParticleSystem::SORTED ? ParticleSystem::WEIGHTED_OIT : ParticleSystem::SORTED );
+                fprintf( stdout, "[INFO]: particles %s\n", particleSystem.getBlendMode() == ParticleSystem::SORTED ? "sorted" : "order independent" );
+                break;
+            case GLFW_KEY_I:
+                particleSystem.setBillboardPath( particleSystem.getBillboardPath() == ParticleSystem::GEOMETRY_SHADER ? ParticleSystem::INSTANCED_QUADS : ParticleSystem::GEOMETRY_SHADER );
+                fprintf( stdout, "[INFO]: particles drawn as %s\n", particleSystem.getBillboardPath() == ParticleSystem::GEOMETRY_SHADER ? "geometry shader points" : "instanced quads" );
+                break;
+            case GLFW_KEY_G:
+                particleSystem.setGPUSorting( !particleSystem.isGPUSorting() );
+                fprintf( stdout, "[INFO]: particles depth sorted on the %s\n", particleSystem.isGPUSorting() ? "GPU" : "CPU" );
+                break;
+            case GLFW_KEY_F:
+                fluidMode = !fluidMode;
+                particleSystem.setFluidSolver( fluidMode ? &fluidSolver : nullptr );
+                steadyFrames = 0;                       // the solver sizes its grid on the next few updates
+                fprintf( stdout, "[INFO]: fluid particles %s\n", fluidMode ? "on" : "off" );
+                break;
 
             default: break;
         }
@@ -222,6 +366,7 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 ///
 // /////////////////////////////////////////////////////////////////////////////
 static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    if( !acceptEvent(InputEvent::MOUSE_BUTTON, button, action, mods, 0.0, 0.0) ) return;
     if( button == GLFW_MOUSE_BUTTON_LEFT ) {
         if( action == GLFW_PRESS ) {
             leftMouseDown = GL_TRUE;
@@ -242,6 +387,7 @@ static void mouse_button_callback(GLFWwindow* window, int button, int action, in
 ///
 // /////////////////////////////////////////////////////////////////////////////
 static void cursor_callback( GLFWwindow* window, double xPos, double yPos ) {
+    if( !acceptEvent(InputEvent::CURSOR, 0, 0, 0, xPos, yPos) ) return;
     // make sure movement is in bounds of the window
     // glfw captures mouse movement on entire screen
     if( xPos > 0 && xPos < WINDOW_WIDTH ) {
@@ -266,7 +412,7 @@ static void cursor_callback( GLFWwindow* window, double xPos, double yPos ) {
             }
                 // passive motion
             else {
-
+                pickScene(xPos, yPos);
             }
         }
     }
@@ -280,6 +426,7 @@ static void cursor_callback( GLFWwindow* window, double xPos, double yPos ) {
 ///
 // /////////////////////////////////////////////////////////////////////////////
 static void scroll_callback(GLFWwindow* window, double xOffset, double yOffset ) {
+    if( !acceptEvent(InputEvent::SCROLL, 0, 0, 0, xOffset, yOffset) ) return;
     double totChgSq = yOffset;
     arcballCam.cameraAngles.z += totChgSq*0.2f;
     updateCameraDirection();
@@ -315,6 +462,9 @@ GLFWwindow* setupGLFW() {
     glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 1 );		                // request OpenGL X.1 context
     glfwWindowHint( GLFW_DOUBLEBUFFER, GLFW_TRUE );                             // request double buffering
     glfwWindowHint( GLFW_RESIZABLE, GLFW_FALSE );                               // do not allow the window to be resized
+    if( simRecorder.isReplaying() ) {
+        glfwWindowHint( GLFW_VISIBLE, GLFW_FALSE );                             // replays run headless
+    }
 
     // create a window for a given size, with a given title
     GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Lab12: Framebuffer Objects", nullptr, nullptr );
@@ -327,7 +477,7 @@ GLFWwindow* setupGLFW() {
     }
 
     glfwMakeContextCurrent(	window );	                                        // make the created window the current window
-    glfwSwapInterval( 1 );				                                // update our screen after at least 1 screen refresh
+    glfwSwapInterval( simRecorder.isReplaying() ? 0 : 1 );                     // update our screen after at least 1 screen refresh, replays as fast as they can
 
     glfwSetKeyCallback(         window, key_callback		  );            	// set our keyboard callback function
     glfwSetMouseButtonCallback( window, mouse_button_callback );	            // set our mouse button callback function
@@ -410,6 +560,64 @@ void setupShaders() {
     postprocessingShaderProgramAttributes.vTextureCoord = postprocessingShaderProgram->getAttributeLocation( "vTexCoord" );
     postprocessingShaderProgram->useProgram();
     glUniform1i(postprocessingShaderProgramUniforms.fbo, 0);
+
+    billboardShaderProgram = new CSCI441::ShaderProgram( "shaders/billboardQuadShader.v.glsl",
+                                                         "shaders/billboardQuadShader.g.glsl",
+                                                         "shaders/billboardQuadShader.f.glsl" );
+    particleShaderUniforms.mvMatrix                     = billboardShaderProgram->getUniformLocation( "mvMatrix" );
+    particleShaderUniforms.projMatrix                   = billboardShaderProgram->getUniformLocation( "projMatrix" );
+    particleShaderUniforms.image                        = billboardShaderProgram->getUniformLocation( "image" );
+    particleShaderAttributes.vPos                       = billboardShaderProgram->getAttributeLocation( "vPos" );
+    particleShaderAttributes.lifespan                   = billboardShaderProgram->getAttributeLocation( "lifespan" );
+    billboardShaderProgram->useProgram();
+    glUniform1i(particleShaderUniforms.image, 0);
+    particleSystem.setParticleShaderUandA(*billboardShaderProgram, particleShaderUniforms, particleShaderAttributes);
+
+    flatShaderProgram = new CSCI441::ShaderProgram( "shaders/flatShader.v.glsl", "shaders/flatShader.f.glsl" );
+    flatShaderProgramUniforms.mvpMatrix                 = flatShaderProgram->getUniformLocation( "mvpMatrix" );
+    flatShaderProgramUniforms.color                     = flatShaderProgram->getUniformLocation( "color" );
+    flatShaderProgramAttributes.vPos                    = flatShaderProgram->getAttributeLocation( "vPos" );
+    particleSystem.setFlatShaderUandA(*flatShaderProgram, flatShaderProgramUniforms, flatShaderProgramAttributes);
+
+    billboardOITShaderProgram = new CSCI441::ShaderProgram( "shaders/billboardQuadShader.v.glsl",
+                                                            "shaders/billboardQuadShader.g.glsl",
+                                                            "shaders/billboardQuadOIT.f.glsl" );
+    particleOITShaderUniforms.mvMatrix                  = billboardOITShaderProgram->getUniformLocation( "mvMatrix" );
+    particleOITShaderUniforms.projMatrix                = billboardOITShaderProgram->getUniformLocation( "projMatrix" );
+    particleOITShaderUniforms.image                     = billboardOITShaderProgram->getUniformLocation( "image" );
+    particleOITShaderAttributes.vPos                    = billboardOITShaderProgram->getAttributeLocation( "vPos" );
+    particleOITShaderAttributes.lifespan                = billboardOITShaderProgram->getAttributeLocation( "lifespan" );
+    billboardOITShaderProgram->useProgram();
+    glUniform1i(particleOITShaderUniforms.image, 0);
+    particleSystem.setOITShaderUandA(*billboardOITShaderProgram, particleOITShaderUniforms, particleOITShaderAttributes);
+
+    billboardInstancedShaderProgram = new CSCI441::ShaderProgram( "shaders/billboardInstanced.v.glsl", "shaders/billboardInstanced.f.glsl" );
+    billboardInstancedOITShaderProgram = new CSCI441::ShaderProgram( "shaders/billboardInstanced.v.glsl", "shaders/billboardInstancedOIT.f.glsl" );
+    CSCI441::ShaderProgram *instancedPrograms[2] = { billboardInstancedShaderProgram, billboardInstancedOITShaderProgram };
+    for(int p = 0; p < 2; p++) {
+        particleInstancedShaderUniforms[p].mvMatrix             = instancedPrograms[p]->getUniformLocation( "mvMatrix" );
+        particleInstancedShaderUniforms[p].projMatrix           = instancedPrograms[p]->getUniformLocation( "projMatrix" );
+        particleInstancedShaderUniforms[p].flipbook             = instancedPrograms[p]->getUniformLocation( "flipbook" );
+        particleInstancedShaderUniforms[p].emitterOrigin        = instancedPrograms[p]->getUniformLocation( "emitterOrigin" );
+        particleInstancedShaderUniforms[p].maxSize              = instancedPrograms[p]->getUniformLocation( "maxSize" );
+        particleInstancedShaderUniforms[p].spinPerLife          = instancedPrograms[p]->getUniformLocation( "spinPerLife" );
+        particleInstancedShaderUniforms[p].framesPerLife        = instancedPrograms[p]->getUniformLocation( "framesPerLife" );
+        particleInstancedShaderUniforms[p].numFrames            = instancedPrograms[p]->getUniformLocation( "numFrames" );
+        particleInstancedShaderUniforms[p].blendFrames          = instancedPrograms[p]->getUniformLocation( "blendFrames" );
+        particleInstancedShaderAttributes[p].vCorner            = instancedPrograms[p]->getAttributeLocation( "vCorner" );
+        particleInstancedShaderAttributes[p].particleOffset     = instancedPrograms[p]->getAttributeLocation( "particleOffset" );
+        particleInstancedShaderAttributes[p].particleAge        = instancedPrograms[p]->getAttributeLocation( "particleAge" );
+        particleInstancedShaderAttributes[p].particleColorSize  = instancedPrograms[p]->getAttributeLocation( "particleColorSize" );
+        instancedPrograms[p]->useProgram();
+        glUniform1i(particleInstancedShaderUniforms[p].flipbook, 0);
+    }
+    particleSystem.setInstancedShaderUandA(*billboardInstancedShaderProgram, particleInstancedShaderUniforms[0], particleInstancedShaderAttributes[0]);
+    particleSystem.setInstancedOITShaderUandA(*billboardInstancedOITShaderProgram, particleInstancedShaderUniforms[1], particleInstancedShaderAttributes[1]);
+    particleSystem.setBillboardPath( ParticleSystem::INSTANCED_QUADS );
+
+    oitCompositeShaderProgram = new CSCI441::ShaderProgram( "shaders/oitComposite.v.glsl", "shaders/oitComposite.f.glsl" );
+    oitCompositeUniforms.accumTexture                   = oitCompositeShaderProgram->getUniformLocation( "accumTexture" );
+    oitCompositeUniforms.revealTexture                  = oitCompositeShaderProgram->getUniformLocation( "revealTexture" );
 }
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -419,17 +627,26 @@ void setupShaders() {
 // /////////////////////////////////////////////////////////////////////////////
 void setupBuffers() {
 
-    // generate ALL VAOs, VBOs, IBOs at once
-    glGenVertexArrays( NUM_VAOS, vaos );
-    glGenBuffers( NUM_VAOS, vbos );
-    glGenBuffers( NUM_VAOS, ibos );
+    // generate the VAOs, VBOs, IBOs for each owner
+    ResourceRegistry::genVertexArrays( OWNER_SKYBOX, 6, &vaos[VAOS.SKYBOX] );
+    ResourceRegistry::genBuffers( OWNER_SKYBOX, 6, &vbos[VAOS.SKYBOX] );
+    ResourceRegistry::genBuffers( OWNER_SKYBOX, 6, &ibos[VAOS.SKYBOX] );
+    ResourceRegistry::genVertexArrays( OWNER_SCENE, 1, &vaos[VAOS.PLATFORM] );
+    ResourceRegistry::genBuffers( OWNER_SCENE, 1, &vbos[VAOS.PLATFORM] );
+    ResourceRegistry::genBuffers( OWNER_SCENE, 1, &ibos[VAOS.PLATFORM] );
+    ResourceRegistry::genVertexArrays( OWNER_POST_PROCESS, 1, &vaos[VAOS.TEXTURED_QUAD] );
+    ResourceRegistry::genBuffers( OWNER_POST_PROCESS, 1, &vbos[VAOS.TEXTURED_QUAD] );
+    ResourceRegistry::genBuffers( OWNER_POST_PROCESS, 1, &ibos[VAOS.TEXTURED_QUAD] );
 
     // ////////////////////////////////////////
     //
-    // Model
+    // Model - its buffers are made by the model loader, so only its CPU memory is counted
 
-    townModel = new CSCI441::ModelLoader();
-    townModel->loadModelFile( "assets/models/medstreet/medstreet.obj" );
+    {
+        ResourceRegistry::OwnerScope townScope( OWNER_TOWN );
+        townModel = new CSCI441::ModelLoader();
+        townModel->loadModelFile( "assets/models/medstreet/medstreet.obj" );
+    }
 
     // ///////////////////////////////////////
     //
@@ -454,7 +671,7 @@ void setupBuffers() {
     glBindVertexArray( vaos[VAOS.PLATFORM] );
 
     glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.PLATFORM] );
-    glBufferData( GL_ARRAY_BUFFER, sizeof( PLATFORM_VERTICES ), PLATFORM_VERTICES, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( vbos[VAOS.PLATFORM], GL_ARRAY_BUFFER, sizeof( PLATFORM_VERTICES ), PLATFORM_VERTICES, GL_STATIC_DRAW );
 
     glEnableVertexAttribArray( textureShaderProgramAttributes.vPos );
     glVertexAttribPointer( textureShaderProgramAttributes.vPos, 3, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*) 0 );
@@ -463,7 +680,25 @@ void setupBuffers() {
     glVertexAttribPointer( textureShaderProgramAttributes.vTexCoord, 2, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*) (sizeof(GLfloat) * 3) );
 
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibos[VAOS.PLATFORM] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( PLATFORM_INDICES ), PLATFORM_INDICES, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( ibos[VAOS.PLATFORM], GL_ELEMENT_ARRAY_BUFFER, sizeof( PLATFORM_INDICES ), PLATFORM_INDICES, GL_STATIC_DRAW );
+
+    // ////////////////////////////////////////
+    //
+    // COLLISION MESH - the town where it is drawn plus the platform's strip as two triangles
+
+    {
+        ResourceRegistry::OwnerScope townScope( OWNER_TOWN );
+        townCollisionMesh.loadOBJ( "assets/models/medstreet/medstreet.obj", glm::translate( glm::mat4(1.0f), TOWN_POSITION ) );
+        townCollisionMesh.addTriangle( PLATFORM_VERTICES[0].pos, PLATFORM_VERTICES[1].pos, PLATFORM_VERTICES[2].pos );
+        townCollisionMesh.addTriangle( PLATFORM_VERTICES[1].pos, PLATFORM_VERTICES[3].pos, PLATFORM_VERTICES[2].pos );
+        townCollisionMesh.build();
+        fprintf( stdout, "[INFO]: collision BVH built with %zu nodes over %zu triangles\n", townCollisionMesh.getNumNodes(), townCollisionMesh.getNumTriangles() );
+
+        // the baked field is mapped rather than read, so this costs nothing until particles touch it
+        if( !townDistanceField.load( "assets/models/medstreet/medstreet.sdf" ) ) {
+            fprintf( stdout, "[INFO]: no distance field baked, particles collide with the BVH (run sdfBake to make one)\n" );
+        }
+    }
 
     // ////////////////////////////////////////
     //
@@ -520,10 +755,10 @@ void setupBuffers() {
         glBindVertexArray( vaos[VAOS.SKYBOX + i] );
 
         glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.SKYBOX + i] );
-        glBufferData( GL_ARRAY_BUFFER, sizeof(SKYBOX_VERTICES[i]), SKYBOX_VERTICES[i], GL_STATIC_DRAW );
+        ResourceRegistry::bufferData( vbos[VAOS.SKYBOX + i], GL_ARRAY_BUFFER, sizeof(SKYBOX_VERTICES[i]), SKYBOX_VERTICES[i], GL_STATIC_DRAW );
 
         glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibos[VAOS.SKYBOX + i] );
-        glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(SKYBOX_INDICES), SKYBOX_INDICES, GL_STATIC_DRAW );
+        ResourceRegistry::bufferData( ibos[VAOS.SKYBOX + i], GL_ELEMENT_ARRAY_BUFFER, sizeof(SKYBOX_INDICES), SKYBOX_INDICES, GL_STATIC_DRAW );
 
         glEnableVertexAttribArray( textureShaderProgramAttributes.vPos );
         glVertexAttribPointer( textureShaderProgramAttributes.vPos, 3, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*) 0 );
@@ -548,10 +783,10 @@ void setupBuffers() {
     glBindVertexArray( vaos[VAOS.TEXTURED_QUAD] );
 
     glBindBuffer( GL_ARRAY_BUFFER, vbos[VAOS.TEXTURED_QUAD] );
-    glBufferData( GL_ARRAY_BUFFER, sizeof(TEXTURED_QUAD_VERTICES), TEXTURED_QUAD_VERTICES, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( vbos[VAOS.TEXTURED_QUAD], GL_ARRAY_BUFFER, sizeof(TEXTURED_QUAD_VERTICES), TEXTURED_QUAD_VERTICES, GL_STATIC_DRAW );
 
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibos[VAOS.TEXTURED_QUAD] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(TEXTURED_QUAD_INDICES), TEXTURED_QUAD_INDICES, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( ibos[VAOS.TEXTURED_QUAD], GL_ELEMENT_ARRAY_BUFFER, sizeof(TEXTURED_QUAD_INDICES), TEXTURED_QUAD_INDICES, GL_STATIC_DRAW );
 
     glEnableVertexAttribArray( postprocessingShaderProgramAttributes.vPos );
     glVertexAttribPointer(postprocessingShaderProgramAttributes.vPos, 3, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*) 0);
@@ -566,17 +801,17 @@ void setupBuffers() {
 ///
 // /////////////////////////////////////////////////////////////////////////////
 void setupTextures() {
-    platformTextureHandle = CSCI441::TextureUtils::loadAndRegisterTexture( "assets/textures/ground.png" );
+    platformTextureHandle = ResourceRegistry::loadTexture( OWNER_SCENE, "assets/textures/ground.png" );
 
     // get handles for our full skybox
     printf( "[INFO]: registering skybox...\n" );
     fflush( stdout );
-    skyboxHandles[0] = CSCI441::TextureUtils::loadAndRegisterTexture( "assets/textures/skybox/DOOM16BK.png"   );
-    skyboxHandles[1] = CSCI441::TextureUtils::loadAndRegisterTexture( "assets/textures/skybox/DOOM16RT.png"   );
-    skyboxHandles[2] = CSCI441::TextureUtils::loadAndRegisterTexture( "assets/textures/skybox/DOOM16FT.png"  );
-    skyboxHandles[3] = CSCI441::TextureUtils::loadAndRegisterTexture( "assets/textures/skybox/DOOM16LF.png"  );
-    skyboxHandles[4] = CSCI441::TextureUtils::loadAndRegisterTexture( "assets/textures/skybox/DOOM16DN.png" );
-    skyboxHandles[5] = CSCI441::TextureUtils::loadAndRegisterTexture( "assets/textures/skybox/DOOM16UP.png"    );
+    skyboxHandles[0] = ResourceRegistry::loadTexture( OWNER_SKYBOX, "assets/textures/skybox/DOOM16BK.png"   );
+    skyboxHandles[1] = ResourceRegistry::loadTexture( OWNER_SKYBOX, "assets/textures/skybox/DOOM16RT.png"   );
+    skyboxHandles[2] = ResourceRegistry::loadTexture( OWNER_SKYBOX, "assets/textures/skybox/DOOM16FT.png"  );
+    skyboxHandles[3] = ResourceRegistry::loadTexture( OWNER_SKYBOX, "assets/textures/skybox/DOOM16LF.png"  );
+    skyboxHandles[4] = ResourceRegistry::loadTexture( OWNER_SKYBOX, "assets/textures/skybox/DOOM16DN.png" );
+    skyboxHandles[5] = ResourceRegistry::loadTexture( OWNER_SKYBOX, "assets/textures/skybox/DOOM16UP.png"    );
     printf( "[INFO]: skybox textures read in and registered!\n\n" );
 }
 
@@ -587,15 +822,15 @@ void setupTextures() {
 // /////////////////////////////////////////////////////////////////////////////
 void setupFramebuffers() {
     // TODO #1 set up the framebuffer object!
-    glGenFramebuffers(1, &fbo);
+    ResourceRegistry::genFramebuffers(OWNER_POST_PROCESS, 1, &fbo);
     glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glGenRenderbuffers(1, &rbo);
+    ResourceRegistry::genRenderbuffers(OWNER_POST_PROCESS, 1, &rbo);
     glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, FBO_WIDTH, FBO_HEIGHT);
+    ResourceRegistry::renderbufferStorage(rbo, GL_RENDERBUFFER, GL_DEPTH_COMPONENT, FBO_WIDTH, FBO_HEIGHT);
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
-    glGenTextures(1, &fboTextureHandle);
+    ResourceRegistry::genTextures(OWNER_POST_PROCESS, 1, &fboTextureHandle);
     glBindTexture(GL_TEXTURE_2D, fboTextureHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, FBO_WIDTH, FBO_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    ResourceRegistry::texImage2D(fboTextureHandle, GL_TEXTURE_2D, 0, GL_RGBA, FBO_WIDTH, FBO_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -603,6 +838,9 @@ void setupFramebuffers() {
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fboTextureHandle, 0);
     CSCI441::FramebufferUtils::printFramebufferStatusMessage(GL_FRAMEBUFFER);
     CSCI441::FramebufferUtils::printFramebufferInfo(GL_FRAMEBUFFER, fbo);
+
+    // transparency targets the same size, depth tested against the scene's RBO
+    particleTransparencyReady = particleTransparency.initialize(FBO_WIDTH, FBO_HEIGHT, rbo);
 }
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -622,6 +860,36 @@ void setupScene() {
     arcballCam.lookAtPoint    = glm::vec3(0.0f, 0.0f, 0.0f);
     arcballCam.upVector       = glm::vec3(    0.0f,  1.0f,  0.0f );
     updateCameraDirection();
+
+    // set up the particles, falling and bouncing off the town
+    ResourceRegistry::OwnerScope particleScope( OWNER_PARTICLES );
+    particleSystem.initialize( particleEmitterPos, 0.2f );
+    particleSystem.setGravity( glm::vec3(0.0f, -0.004f, 0.0f) );
+    particleSystem.setMaxLifespan( 300 );
+    particleSystem.setFlipbook( "assets/textures/smokeSheet.png", 4, 4, 16, 0.0f, true );   // puffs that billow out over their life
+    particleTurbulence.setJobSystem( &jobSystem );
+    particleTurbulence.loadOrGenerate( "assets/curlnoise.cache" );
+    particleSystem.setTurbulence( &particleTurbulence, 0.01f, 0.08f );
+    forceVolumes.addBox( ForceVolume::WIND, glm::vec3(-6.0f, 4.0f, 0.0f), glm::vec3(6.0f, 4.0f, 10.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.002f );
+    forceVolumes.addSphere( ForceVolume::VORTEX, glm::vec3(10.0f, 3.0f, 4.0f), 4.0f, glm::vec3(0.0f, 1.0f, 0.0f), 0.004f );
+    forceVolumes.addSphere( ForceVolume::ATTRACTOR, glm::vec3(4.0f, 8.0f, -8.0f), 3.0f, glm::vec3(0.0f, 1.0f, 0.0f), 0.003f );
+    forceVolumes.build();
+    particleSystem.setForceVolumes( &forceVolumes );
+    particleSystem.setFrameArena( &frameArena );
+    particleSystem.setCullSettings( FBO_HEIGHT, 1.0f );   // the scene is drawn into the FBO
+    // in world units and updates, about 0.2 between particles at rest
+    fluidSolver.setJobSystem( &jobSystem );
+    fluidSolver.setSmoothingRadius( 0.4f );
+    fluidSolver.setParticleMass( 0.008f );
+    fluidSolver.setRestDensity( 1.0f );
+    fluidSolver.setStiffness( 0.02f );
+    fluidSolver.setViscosity( 0.005f );
+    particleSystem.setSeed( simulationSeed );
+    particleSystem.setCollisionMesh( &townCollisionMesh, ParticleSystem::BOUNCE, 0.5f );
+    if( townDistanceField.isLoaded() ) {
+        particleSystem.setCollisionField( &townDistanceField, ParticleSystem::BOUNCE, 0.5f );
+    }
+    now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -643,6 +911,7 @@ GLFWwindow* initialize() {
     setupBuffers();										// load all our VAOs and VBOs onto the GPU
     setupTextures();                                    // load all of our textures onto the GPU
     setupFramebuffers();                                // initialize our FBOs on the GPU
+    jobSystem.initialize();                             // start the worker threads
     setupScene();                                       // initialize all of our scene information
 
     fprintf( stdout, "\n[INFO]: Setup complete\n" );
@@ -665,6 +934,12 @@ void cleanupShaders() {
     delete textureShaderProgram;
     delete modelPhongShaderProgram;
     delete postprocessingShaderProgram;
+    delete billboardShaderProgram;
+    delete flatShaderProgram;
+    delete billboardOITShaderProgram;
+    delete billboardInstancedShaderProgram;
+    delete billboardInstancedOITShaderProgram;
+    delete oitCompositeShaderProgram;
 }
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -675,15 +950,20 @@ void cleanupShaders() {
 void cleanupBuffers() {
     fprintf( stdout, "[INFO]: ...deleting IBOs....\n" );
 
-    glDeleteBuffers( NUM_VAOS, ibos );
+    ResourceRegistry::deleteBuffers( NUM_VAOS, ibos );
 
     fprintf( stdout, "[INFO]: ...deleting VBOs....\n" );
 
-    glDeleteBuffers( NUM_VAOS, vbos );
+    ResourceRegistry::deleteBuffers( NUM_VAOS, vbos );
 
     fprintf( stdout, "[INFO]: ...deleting VAOs....\n" );
 
-    glDeleteVertexArrays( NUM_VAOS, vaos );
+    ResourceRegistry::deleteVertexArrays( NUM_VAOS, vaos );
+
+    fprintf( stdout, "[INFO]: ...deleting town model....\n" );
+
+    delete townModel;
+    townModel = nullptr;
 }
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -694,17 +974,18 @@ void cleanupBuffers() {
 void cleanupTextures() {
     fprintf( stdout, "[INFO]: ...deleting textures\n" );
 
-    glDeleteTextures(1, &platformTextureHandle);
-    glDeleteTextures(6, skyboxHandles);
+    ResourceRegistry::deleteTextures(1, &platformTextureHandle);
+    ResourceRegistry::deleteTextures(6, skyboxHandles);
 }
 
 void cleanupFramebuffers() {
     fprintf( stdout, "[INFO]: ...deleting FBOs....\n");
-    glDeleteFramebuffers(1, &fbo);                          // delete the FBO
-    glDeleteTextures(1, &fboTextureHandle);     // and the associated texture for it
+    ResourceRegistry::deleteFramebuffers(1, &fbo);          // delete the FBO
+    ResourceRegistry::deleteTextures(1, &fboTextureHandle); // and the associated texture for it
 
     fprintf( stdout, "[INFO]: ...deleting RBOs....\n");
-    glDeleteRenderbuffers(1, &rbo);                         // plus the RBO
+    ResourceRegistry::deleteRenderbuffers(1, &rbo);         // plus the RBO
+    particleTransparency.cleanup();                         // and the transparency targets sharing it
 }
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -714,12 +995,16 @@ void cleanupFramebuffers() {
 // /////////////////////////////////////////////////////////////////////////////
 void shutdown(GLFWwindow* window) {
     fprintf( stdout, "\n[INFO]: Shutting down.......\n" );
+    ResourceRegistry::printReport();                    // what everything held at the end
     fprintf( stdout, "[INFO]: ...closing window...\n" );
     glfwDestroyWindow( window );                        // close our window
     cleanupShaders();                                   // delete shaders from GPU
     cleanupBuffers();                                   // delete VAOs/VBOs from GPU
     cleanupTextures();                                  // delete textures from GPU
     cleanupFramebuffers();                              // delete FBOs from GPU
+    particleSystem.cleanup();                           // delete VAOs/VBOs and textures from the particle system
+    jobSystem.cleanup();                                // stop the worker threads
+    ResourceRegistry::checkForLeaks();                  // anything left now was forgotten above
     fprintf( stdout, "[INFO]: ...closing GLFW.....\n" );
     glfwTerminate();						            // shut down GLFW to clean up our context
     fprintf( stdout, "[INFO]: ..shut down complete!\n" );
@@ -768,7 +1053,7 @@ void renderScene( glm::mat4 viewMatrix, glm::mat4 projectionMatrix ) {
     // Draw Object Model with Phong Shading using Blinn-Phong Reflectance & Texturing
 
     modelPhongShaderProgram->useProgram();
-    modelMatrix = glm::translate( glm::mat4(1.0f), glm::vec3(4, 0.1, 0) );
+    modelMatrix = glm::translate( glm::mat4(1.0f), TOWN_POSITION );
 
     computeAndSendTransformationMatrices(modelMatrix, viewMatrix, projectionMatrix,
                                          -1, modelPhongShaderProgramUniforms.viewMtx, -1,
@@ -779,6 +1064,46 @@ void renderScene( glm::mat4 viewMatrix, glm::mat4 projectionMatrix ) {
     townModel->draw( modelPhongShaderProgramAttributes.vPos, modelPhongShaderProgramAttributes.vNormal, modelPhongShaderProgramAttributes.vTextureCoord,
                  modelPhongShaderProgramUniforms.materialDiffuse, modelPhongShaderProgramUniforms.materialSpecular, modelPhongShaderProgramUniforms.materialShininess, modelPhongShaderProgramUniforms.materialAmbient,
                  GL_TEXTURE0 );
+
+    // ///////////////////////
+    //
+    // Draw Particles
+
+    if( particleSystem.getBlendMode() == ParticleSystem::WEIGHTED_OIT ) {
+        // accumulated in any order, then resolved over what is already in the FBO
+        particleTransparency.begin();
+        particleSystem.draw( viewMatrix, projectionMatrix );
+        oitCompositeShaderProgram->useProgram();
+        particleTransparency.composite( oitCompositeUniforms, fbo, 0 );
+    } else {
+        particleSystem.draw( viewMatrix, projectionMatrix );
+    }
+    if( drawBoundings ) {
+        particleSystem.drawBoundings( viewMatrix, projectionMatrix, glm::mat4(1.0f) );
+    }
+}
+
+// /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///      Once the particle count has settled an update should get everything it
+///      needs from the frame arena and memory kept from earlier frames.  Debug
+///      builds stop on a steady frame that still allocated
+/// \param numAllocations - heap allocations made during the update
+// /////////////////////////////////////////////////////////////////////////////
+void checkFrameAllocations(uint64_t numAllocations) {
+    // the arrays only grow when more particles are alive than ever before
+    if( particleSystem.getNumParticles() > mostParticles ) {
+        mostParticles = particleSystem.getNumParticles();
+        steadyFrames = 0;
+    }
+    if( steadyFrames < WARMUP_FRAMES ) {
+        steadyFrames++;
+        return;
+    }
+    if( numAllocations > 0 ) {
+        fprintf( stderr, "[ERROR]: a steady frame made %llu heap allocations\n", (unsigned long long)numAllocations );
+    }
+    assert( numAllocations == 0 );
 }
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -787,7 +1112,63 @@ void renderScene( glm::mat4 viewMatrix, glm::mat4 projectionMatrix ) {
 ///
 // /////////////////////////////////////////////////////////////////////////////
 void updateScene() {
+    uint64_t allocationsBefore = HeapCounter::getNumAllocations();
+
+    // find time passed since last update, a replay takes it from the recording instead
+    int timePassed = currentFrame.timePassed;
+    int timeThroughSecond = currentFrame.timeThroughSecond;
+    if( !simRecorder.isReplaying() ) {
+        unsigned long long time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        timePassed = time - now;
+        timeThroughSecond = time % 1000;
+        now = time;
+    }
+
+    {
+        ResourceRegistry::OwnerScope particleScope( OWNER_PARTICLES );
+        particleSystem.update( timePassed, timeThroughSecond, particleEmitterPos );
+    }
+
+    if( simRecorder.isRecording() ) {
+        currentFrame.timePassed = timePassed;
+        currentFrame.timeThroughSecond = timeThroughSecond;
+        currentFrame.cameraAngles = arcballCam.cameraAngles;
+        currentFrame.lookAtPoint = arcballCam.lookAtPoint;
+        simRecorder.writeFrame( currentFrame );
+        currentFrame.events.clear();
+    }
+
+    frameArena.reset();
+    checkFrameAllocations( HeapCounter::getNumAllocations() - allocationsBefore );
+}
+
+// /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///      Reads the next frame of the replay and feeds its input through the
+///      callbacks, then puts the camera where it was when it was recorded
+/// \param window - passed on to the callbacks
+/// \return false once the recording has run out
+// /////////////////////////////////////////////////////////////////////////////
+bool replayFrame(GLFWwindow* window) {
+    if( !simRecorder.readFrame(currentFrame) ) return false;
+
+    replayingEvents = true;
+    for( size_t e = 0; e < currentFrame.events.size(); e++ ) {
+        const InputEvent &event = currentFrame.events[e];
+        switch( event.type ) {
+            case InputEvent::KEY:           key_callback( window, event.code, 0, event.action, event.mods );    break;
+            case InputEvent::MOUSE_BUTTON:  mouse_button_callback( window, event.code, event.action, event.mods ); break;
+            case InputEvent::CURSOR:        cursor_callback( window, event.x, event.y );                        break;
+            case InputEvent::SCROLL:        scroll_callback( window, event.x, event.y );                        break;
+            default: break;
+        }
+    }
+    replayingEvents = false;
 
+    arcballCam.cameraAngles = currentFrame.cameraAngles;
+    arcballCam.lookAtPoint = currentFrame.lookAtPoint;
+    updateCameraDirection();
+    return true;
 }
 
 // /////////////////////////////////////////////////////////////////////////////
@@ -817,6 +1198,8 @@ void firstPass(GLFWwindow* window) {
     glm::mat4 viewMatrix = glm::lookAt( arcballCam.eyePos,
                                         arcballCam.lookAtPoint,
                                         arcballCam.upVector );
+    viewProjectionMatrix = projectionMatrix * viewMatrix;
+    particleSystem.setCameraVariables( arcballCam.lookAtPoint, arcballCam.eyePos );
 
     // draw everything to the window
     // pass our view and projection matrices
@@ -860,6 +1243,7 @@ void run(GLFWwindow* window) {
     //  This is our draw loop - all rendering is done here.  We use a loop to keep the window open
     //	until the user decides to close the window and quit the program.  Without a loop, the
     //	window will display once and then the program exits.
+    std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
     while( !glfwWindowShouldClose(window) ) {	        // check if the window was instructed to be closed
 
         // /////////////////
@@ -880,9 +1264,19 @@ void run(GLFWwindow* window) {
 
         glfwSwapBuffers(window);                        // flush the OpenGL commands and make sure they get rendered!
         glfwPollEvents();				                // check for any events and signal to redraw screen
+        if( simRecorder.isReplaying() && !replayFrame(window) ) {
+            break;                                      // the recording is over
+        }
 
         updateScene();                                  // update the objects in our scene
     }
+
+    if( simRecorder.isReplaying() ) {
+        double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+        fprintf( stdout, "[INFO]: replayed %u frames in %.1f ms, %.3f ms per frame\n",
+                 simRecorder.getNumFrames(), totalMs, totalMs / std::max(simRecorder.getNumFrames(), 1u) );
+    }
+    simRecorder.close();
 }
 
 //**********************************************************************************************************************************************************
@@ -890,9 +1284,23 @@ void run(GLFWwindow* window) {
 // Our main function
 
 // /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     usage: main [--record file | --replay file]
 ///
+///     --record writes the seed, time steps, camera and input of the run to
+///     file, --replay runs it again exactly, headless and as fast as it can
 // /////////////////////////////////////////////////////////////////////////////
-int main() {
+int main(int argc, char** argv) {
+    for( int i = 1; i + 1 < argc; i++ ) {
+        if( strcmp(argv[i], "--record") == 0 ) {
+            simulationSeed = (uint32_t)time(nullptr);
+            if( !simRecorder.startRecording(argv[++i], simulationSeed) ) return EXIT_FAILURE;
+        } else if( strcmp(argv[i], "--replay") == 0 ) {
+            if( !simRecorder.startReplay(argv[++i]) ) return EXIT_FAILURE;
+            simulationSeed = simRecorder.getSeed();
+        }
+    }
+
     GLFWwindow *window = initialize();                  // create OpenGL context and setup EVERYTHING for our program
     run(window);                                        // enter our draw loop and run our program
     shutdown(window);                                   // free up all the memory used and close OpenGL context
@@ -25,6 +25,8 @@
 #include <cstdio>				        // for printf functionality
 #include <cstdlib>				        // for exit functionality
 #include <chrono>                       // for high resolution time
+#include <atomic>
+#include <cstring>                      // for memcpy
 
 #include <CSCI441/materials.hpp>        // our pre-defined material properties
 #include <CSCI441/OpenGLUtils.hpp>      // prints OpenGL information
@@ -34,9 +36,17 @@
 
 #include "LightingShaderStructs.h"
 #include "ParticleSystem.h"
+#include "ResourceRegistry.h"
 #include <glm/gtx/quaternion.hpp>
 
 #include "Transform.h"
+#include "ShaderVariantCache.h"
+#include "ClusteredLighting.h"
+#include "JobSystem.h"
+#include "BodySystem.h"
+#include "InstanceBatch.h"
+#include "SceneGraph.h"
+#include "SimPipeline.h"
 
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -47,6 +57,7 @@
 
 // fix our window to a specific size
 const GLint WINDOW_WIDTH = 640, WINDOW_HEIGHT = 640;
+const GLfloat NEAR_PLANE = 0.001f, FAR_PLANE = 100.0f;    // depth range of our projection
 
 // keep track our mouse information
 GLboolean controlDown;                  // if the control button was pressed when the mouse was pressed
@@ -87,6 +98,7 @@ GLuint ibos[NUM_VAOS];                  // an array of our IBO descriptors
 
 // Particle System
 ParticleSystem particleSystem;
+const GLfloat PARTICLE_RADIUS = 0.05f;  // for bouncing off the bodies
 
 // point sprite information
 const GLuint NUM_SPRITES = 75;          // the number of sprites to draw
@@ -99,22 +111,32 @@ GLfloat snowglobeAngle;                 // rotates all of our snowflakes
 
 CSCI441::ModelLoader* model = nullptr;  // assign as a null pointer to delay creation until
 GLint vpos_attrib_location;
-struct suckableObject   {
-    glm::vec3 color;
-    glm::vec3 ambient;
-    glm::vec3 spec;
-    glm::vec3 position;
-    glm::vec3 velocity;
-
-    glm::vec3 rotationalVelocity;
-    float shininess = 1;
-    //glm::quat rotation;
-    Transform transform;
-
-};
-suckableObject myTeapot;
-suckableObject myCube;
-suckableObject myBulb;
+
+// every body pulled around by the black hole, the suckable objects are looked up through their handles
+JobSystem jobSystem;                    // worker threads shared by the simulation
+BodySystem bodies;
+BodyHandle teapotBody;
+BodyHandle cubeBody;
+BodyHandle bulbBody;
+SceneGraph sceneGraph;                  // world matrices of everything drawn with a transform
+GLuint teapotNode, cubeNode, bulbNode;
+const GLuint NUM_DEBRIS = 2000;         // small bodies orbiting the black hole
+const GLfloat BLACK_HOLE_GM = 2.0f;     // strength of the black hole's pull
+const GLuint NUM_SUCKABLES = 3;         // created first, the debris fill the rest of the body arrays
+GLuint debrisVAO, debrisVBO, debrisIBO; // cube mesh the debris are instanced from
+GLuint debrisInstanceVBO;               // per-instance matrices, rebuilt every frame
+GLuint debrisCapacity = 0;              // number of instances debrisInstanceVBO can hold
+const GLuint NUM_DEBRIS_INDICES = 36;
+
+// the simulation runs a frame ahead on its own thread and hands frames to the renderer as snapshots
+SimPipeline simPipeline;
+bool pipelineSimulation = true;         // false steps the scene on the render thread after each frame
+SimSnapshot serialSnapshot;             // the frame being drawn while the pipeline is off
+const SimSnapshot *frameSnapshot = nullptr; // what renderScene() draws
+std::atomic<bool> energyReportRequested(false); // printed by the simulation, which owns the bodies
+std::atomic<bool> checkpointSaveRequested(false);   // also handled by the simulation, between updates
+std::atomic<bool> checkpointRestoreRequested(false);
+const char* CHECKPOINT_FILE = "blackhole.ckp";
 
 // Billboard shader program
 CSCI441::ShaderProgram *billboardShaderProgram = nullptr;
@@ -145,6 +167,7 @@ struct GouradShaderProgramUniforms {
     GLint mvpMatrix;                    // the MVP Matrix to apply
     GLint modelMatrix;                  // model matrix
     GLint normalMtx;                    // normal matrix
+    GLint viewProjMatrix;               // view projection matrix - instanced variants only
     GLint eyePos;                       // camera position
     GLint lightPos;                     // light position - used for point/spot
     GLint lightDir;                     // light direction - used for directional/spot
@@ -162,6 +185,26 @@ struct GouradShaderProgramAttributes {
     GLint vNormal;                      // normal for the vertex
 } gouradShaderProgramAttributes;
 
+// compile time specialized permutations of the gourad shader, one per light type
+const GLuint NUM_LIGHT_TYPES = 4;       // 0 point 1 directional 2 spot 3 black hole
+ShaderVariantCache lightingShaderVariants;
+GLuint gouradVariantHandles[NUM_LIGHT_TYPES];
+GouradShaderProgramUniforms gouradVariantUniforms[NUM_LIGHT_TYPES];
+GouradShaderProgramUniforms gouradUberUniforms;     // locations within the uber-shader
+GLuint gouradInstancedHandles[NUM_LIGHT_TYPES];     // the same permutations drawing instanced meshes
+GouradShaderProgramUniforms gouradInstancedUniforms[NUM_LIGHT_TYPES];
+bool useShaderVariants = true;          // false falls back to the uber-shader branching on lightType
+
+// clustered forward shading with many point lights
+GLuint clusteredProgramHandle = 0;
+GouradShaderProgramUniforms clusteredPhongUniforms;     // material/matrix uniforms shared with gourad
+ClusteredShaderUniforms clusteredShaderUniforms;
+ClusteredLighting clusteredLighting;
+bool useClusteredLighting = false;
+std::vector<PointLight> sceneLights;    // bulb, particles and accretion disk lights
+const GLuint NUM_DISK_LIGHTS = 256;     // lights orbiting the black hole
+GLfloat diskAngle;                      // rotates the accretion disk lights
+
 // keep track of our texture shader program
 CSCI441::ShaderProgram *texShaderProgram = nullptr;
 struct TexShaderProgramUniforms {
@@ -251,6 +294,85 @@ void computeAndSendTransformationMatrices(glm::mat4 modelMatrix, glm::mat4 viewM
     glUniformMatrix3fv(normalMtxLocation, 1, GL_FALSE, &normalMatrix[0][0]);
 }
 
+// lookupGouradUniforms() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+/// Queries the location of every gourad uniform within a given program handle
+/// \param handle - linked program to query
+/// \param uniforms - struct to fill with the locations
+// //////////////////////////////////////////////////////////////////////////////
+void lookupGouradUniforms(GLuint handle, GouradShaderProgramUniforms &uniforms) {
+    uniforms.mvpMatrix           = glGetUniformLocation(handle, "mvpMatrix");
+    uniforms.modelMatrix         = glGetUniformLocation(handle, "modelMatrix");
+    uniforms.normalMtx           = glGetUniformLocation(handle, "normalMtx");
+    uniforms.viewProjMatrix      = glGetUniformLocation(handle, "viewProjMatrix");
+    uniforms.eyePos              = glGetUniformLocation(handle, "eyePos");
+    uniforms.lightPos            = glGetUniformLocation(handle, "lightPos");
+    uniforms.lightDir            = glGetUniformLocation(handle, "lightDir");
+    uniforms.lightCutoff         = glGetUniformLocation(handle, "lightCutoff");
+    uniforms.lightColor          = glGetUniformLocation(handle, "lightColor");
+    uniforms.lightType           = glGetUniformLocation(handle, "lightType");      // -1 in the variants
+    uniforms.materialDiffColor   = glGetUniformLocation(handle, "materialDiffColor");
+    uniforms.materialSpecColor   = glGetUniformLocation(handle, "materialSpecColor");
+    uniforms.materialShininess   = glGetUniformLocation(handle, "materialShininess");
+    uniforms.materialAmbColor    = glGetUniformLocation(handle, "materialAmbColor");
+    uniforms.pointLightPos       = glGetUniformLocation(handle, "pointLightPos");
+}
+
+// useGouradShader() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+/// Binds the gourad program for the current light type and points
+/// gouradShaderProgramUniforms at its uniform locations.  Uses the
+/// specialized variant when one is available, the uber-shader otherwise.
+/// When clustered lighting is on the per fragment clustered program is bound instead.
+// //////////////////////////////////////////////////////////////////////////////
+void useGouradShader() {
+    if(useClusteredLighting && clusteredProgramHandle != 0) {
+        glUseProgram(clusteredProgramHandle);
+        gouradShaderProgramUniforms = clusteredPhongUniforms;
+        clusteredLighting.bind(clusteredShaderUniforms, 1);
+    } else if(useShaderVariants && lightType < NUM_LIGHT_TYPES && gouradVariantHandles[lightType] != 0) {
+        glUseProgram(gouradVariantHandles[lightType]);
+        gouradShaderProgramUniforms = gouradVariantUniforms[lightType];
+    } else {
+        gouradShaderProgram->useProgram();
+        gouradShaderProgramUniforms = gouradUberUniforms;
+    }
+}
+
+// gatherSceneLights() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+/// Collects every point light in the scene - the bulb, one per particle and
+/// the lights of the accretion disk orbiting the black hole
+// //////////////////////////////////////////////////////////////////////////////
+void gatherSceneLights() {
+    sceneLights.clear();
+
+    PointLight bulbLight;
+    bulbLight.position = frameSnapshot->lightPosition;
+    bulbLight.radius = 15.0f;
+    bulbLight.color = glm::vec3(1.0f, 1.0f, 0.7f);
+    sceneLights.push_back(bulbLight);
+
+    const std::vector<glm::vec3> &particlePositions = frameSnapshot->particlePositions;
+    for(size_t i = 0; i < particlePositions.size(); i++) {
+        PointLight particleLight;
+        particleLight.position = particlePositions[i];
+        particleLight.radius = 1.5f;
+        particleLight.color = glm::vec3(0.4f, 0.6f, 1.0f);
+        sceneLights.push_back(particleLight);
+    }
+
+    for(GLuint i = 0; i < NUM_DISK_LIGHTS; i++) {
+        GLfloat t = i / (GLfloat)NUM_DISK_LIGHTS;
+        GLfloat orbit = 3.0f + 5.0f * glm::fract(t * 7.31f);
+        GLfloat angle = t * 6.28f + diskAngle * (8.0f / orbit);     // inner lights orbit faster
+        PointLight diskLight;
+        diskLight.position = glm::vec3(cosf(angle) * orbit, 0.3f * sinf(t * 40.0f), sinf(angle) * orbit);
+        diskLight.radius = 2.0f;
+        diskLight.color = glm::mix(glm::vec3(1.0f, 0.5f, 0.1f), glm::vec3(0.6f, 0.2f, 1.0f), t);
+        sceneLights.push_back(diskLight);
+    }
+}
 
 // randNumber() /////////////////////////////////////////////////////////////////////////////
 /// \dexc generates a random float between [-max, max]
@@ -292,13 +414,37 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
                 break;
             case GLFW_KEY_3:    // spot light
                 lightType = key - GLFW_KEY_1;
-                // send the light type to the shader
+                // send the light type to the uber-shader, the variants have it baked in
                 gouradShaderProgram->useProgram();
-                glUniform1i(gouradShaderProgramUniforms.lightType, lightType);
+                glUniform1i(gouradUberUniforms.lightType, lightType);
+                break;
+            case GLFW_KEY_C:
+                useClusteredLighting = !useClusteredLighting;
+                fprintf( stdout, "[INFO]: clustered lighting %s\n", useClusteredLighting ? "on" : "off" );
+                break;
+            case GLFW_KEY_V:
+                useShaderVariants = !useShaderVariants;
+                fprintf( stdout, "[INFO]: gourad shader variants %s\n", useShaderVariants ? "on" : "off" );
                 break;
             case GLFW_KEY_B:
                 drawBoundings = !drawBoundings;
                 break;
+            case GLFW_KEY_E:
+                energyReportRequested = true;
+                break;
+            case GLFW_KEY_M:
+                ResourceRegistry::printReport();
+                fprintf( stdout, "[INFO]: %zu particles drawn, %zu culled\n", particleSystem.getNumVisible(), particleSystem.getNumCulled() );
+                break;
+            case GLFW_KEY_P:
+                pipelineSimulation = !pipelineSimulation;
+                break;
+            case GLFW_KEY_K:
+                checkpointSaveRequested = true;
+                break;
+            case GLFW_KEY_L:
+                checkpointRestoreRequested = true;
+                break;
             case GLFW_KEY_1:
                 arcBallChoice=true;
                 break;
@@ -506,6 +652,7 @@ void setupShaders() {
     gouradShaderProgramUniforms.mvpMatrix           = gouradShaderProgram->getUniformLocation( "mvpMatrix");
     gouradShaderProgramUniforms.modelMatrix         = gouradShaderProgram->getUniformLocation("modelMatrix");
     gouradShaderProgramUniforms.normalMtx           = gouradShaderProgram->getUniformLocation("normalMtx");
+    gouradShaderProgramUniforms.viewProjMatrix      = -1;
     gouradShaderProgramUniforms.eyePos              = gouradShaderProgram->getUniformLocation("eyePos");
     gouradShaderProgramUniforms.lightPos            = gouradShaderProgram->getUniformLocation("lightPos");
     gouradShaderProgramUniforms.lightDir            = gouradShaderProgram->getUniformLocation("lightDir");
@@ -519,6 +666,23 @@ void setupShaders() {
     gouradShaderProgramUniforms.pointLightPos           = gouradShaderProgram->getUniformLocation( "pointLightPos");
     gouradShaderProgramAttributes.vPos              = gouradShaderProgram->getAttributeLocation("vPos");
     gouradShaderProgramAttributes.vNormal           = gouradShaderProgram->getAttributeLocation("vNormal");
+    gouradUberUniforms = gouradShaderProgramUniforms;
+
+    // one specialized permutation per light type, attributes share the same explicit locations
+    for(GLuint i = 0; i < NUM_LIGHT_TYPES; i++) {
+        std::vector<std::string> defines;
+        defines.push_back("LIGHT_TYPE " + std::to_string(i));
+        gouradVariantHandles[i] = lightingShaderVariants.getProgram( "shaders/gouradShader.v.glsl", "shaders/gouradShader.f.glsl", defines );
+        lookupGouradUniforms(gouradVariantHandles[i], gouradVariantUniforms[i]);
+
+        defines.push_back("INSTANCED");
+        gouradInstancedHandles[i] = lightingShaderVariants.getProgram( "shaders/gouradShader.v.glsl", "shaders/gouradShader.f.glsl", defines );
+        lookupGouradUniforms(gouradInstancedHandles[i], gouradInstancedUniforms[i]);
+    }
+
+    clusteredProgramHandle = lightingShaderVariants.getProgram( "shaders/clusteredPhong.v.glsl", "shaders/clusteredPhong.f.glsl", std::vector<std::string>() );
+    lookupGouradUniforms(clusteredProgramHandle, clusteredPhongUniforms);
+    ClusteredLighting::lookupUniforms(clusteredProgramHandle, clusteredShaderUniforms);
 
     texShaderProgram = new CSCI441::ShaderProgram( "shaders/lab06.v.glsl", "shaders/lab06.f.glsl" );
     texShaderProgramUniforms.mvpMatrix   = texShaderProgram->getUniformLocation("mvpMatrix");
@@ -586,13 +750,13 @@ void setupBuffers() {
 
     unsigned short platformIndices[4] = { 0, 1, 2, 3 };
 
-    glGenVertexArrays( 1, &platformVAO );
+    ResourceRegistry::genVertexArrays( OWNER_SCENE, 1, &platformVAO );
     glBindVertexArray( platformVAO );
 
-    glGenBuffers( 2, platformVBOs );
+    ResourceRegistry::genBuffers( OWNER_SCENE, 2, platformVBOs );
 
     glBindBuffer( GL_ARRAY_BUFFER, platformVBOs[0] );
-    glBufferData( GL_ARRAY_BUFFER, sizeof( platformVertices ), platformVertices, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( platformVBOs[0], GL_ARRAY_BUFFER, sizeof( platformVertices ), platformVertices, GL_STATIC_DRAW );
 
     glEnableVertexAttribArray( gouradShaderProgramAttributes.vPos );
     glVertexAttribPointer( gouradShaderProgramAttributes.vPos, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) 0 );
@@ -601,7 +765,7 @@ void setupBuffers() {
     glVertexAttribPointer( gouradShaderProgramAttributes.vNormal, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)) );
 
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, platformVBOs[1] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( platformIndices ), platformIndices, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( platformVBOs[1], GL_ELEMENT_ARRAY_BUFFER, sizeof( platformIndices ), platformIndices, GL_STATIC_DRAW );
 
     fprintf( stdout, "[INFO]: platform read in with VAO %d\n", platformVAO );
 
@@ -637,13 +801,13 @@ void setupBuffers() {
     unsigned short skyBoxFrontIndices[4] = { 0, 1, 2, 3 };
     unsigned short skyBoxTopIndices[4] = { 0, 1, 2, 3 };
 
-    glGenVertexArrays( 1, &skyboxFrontVAO );
+    ResourceRegistry::genVertexArrays( OWNER_SKYBOX, 1, &skyboxFrontVAO );
     glBindVertexArray( skyboxFrontVAO );
 
-    glGenBuffers( 2, skyboxFrontVBOs );
+    ResourceRegistry::genBuffers( OWNER_SKYBOX, 2, skyboxFrontVBOs );
 
     glBindBuffer( GL_ARRAY_BUFFER, skyboxFrontVBOs[0] );
-    glBufferData( GL_ARRAY_BUFFER, sizeof( skyBoxFrontVertices ), skyBoxFrontVertices, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( skyboxFrontVBOs[0], GL_ARRAY_BUFFER, sizeof( skyBoxFrontVertices ), skyBoxFrontVertices, GL_STATIC_DRAW );
 
     glEnableVertexAttribArray( texShaderProgramAttributes.vPos );
     glVertexAttribPointer( texShaderProgramAttributes.vPos, 3, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*) 0 );
@@ -653,17 +817,17 @@ void setupBuffers() {
     glVertexAttribPointer( texShaderProgramAttributes.texCoordIn, 2, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*)(sizeof(float) * 3) );
 
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, skyboxFrontVBOs[1] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( skyBoxFrontIndices ), skyBoxFrontIndices, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( skyboxFrontVBOs[1], GL_ELEMENT_ARRAY_BUFFER, sizeof( skyBoxFrontIndices ), skyBoxFrontIndices, GL_STATIC_DRAW );
 
     fprintf( stdout, "[INFO]: quad read in with VAO %d\n\n", skyboxFrontVAO );
 
-    glGenVertexArrays( 1, &skyboxSideVAO );
+    ResourceRegistry::genVertexArrays( OWNER_SKYBOX, 1, &skyboxSideVAO );
     glBindVertexArray( skyboxSideVAO );
 
-    glGenBuffers( 2, skyboxSideVBOs );
+    ResourceRegistry::genBuffers( OWNER_SKYBOX, 2, skyboxSideVBOs );
 
     glBindBuffer( GL_ARRAY_BUFFER, skyboxSideVBOs[0] );
-    glBufferData( GL_ARRAY_BUFFER, sizeof( skyBoxSideVertices ), skyBoxSideVertices, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( skyboxSideVBOs[0], GL_ARRAY_BUFFER, sizeof( skyBoxSideVertices ), skyBoxSideVertices, GL_STATIC_DRAW );
 
     glEnableVertexAttribArray( texShaderProgramAttributes.vPos );
     glVertexAttribPointer( texShaderProgramAttributes.vPos, 3, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*) 0 );
@@ -673,17 +837,17 @@ void setupBuffers() {
     glVertexAttribPointer( texShaderProgramAttributes.texCoordIn, 2, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*)(sizeof(float) * 3) );
 
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, skyboxSideVBOs[1] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( skyBoxSidesIndices ), skyBoxSidesIndices, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( skyboxSideVBOs[1], GL_ELEMENT_ARRAY_BUFFER, sizeof( skyBoxSidesIndices ), skyBoxSidesIndices, GL_STATIC_DRAW );
 
     fprintf( stdout, "[INFO]: quad read in with VAO %d\n\n", skyboxSideVAO );
 
-    glGenVertexArrays( 1, &skyboxTopVAO );
+    ResourceRegistry::genVertexArrays( OWNER_SKYBOX, 1, &skyboxTopVAO );
     glBindVertexArray( skyboxTopVAO );
 
-    glGenBuffers( 2, skyboxTopVBOs );
+    ResourceRegistry::genBuffers( OWNER_SKYBOX, 2, skyboxTopVBOs );
 
     glBindBuffer( GL_ARRAY_BUFFER, skyboxTopVBOs[0] );
-    glBufferData( GL_ARRAY_BUFFER, sizeof( skyBoxTopVertices ), skyBoxTopVertices, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( skyboxTopVBOs[0], GL_ARRAY_BUFFER, sizeof( skyBoxTopVertices ), skyBoxTopVertices, GL_STATIC_DRAW );
 
     glEnableVertexAttribArray( texShaderProgramAttributes.vPos );
     glVertexAttribPointer( texShaderProgramAttributes.vPos, 3, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*) 0 );
@@ -693,12 +857,70 @@ void setupBuffers() {
     glVertexAttribPointer( texShaderProgramAttributes.texCoordIn, 2, GL_FLOAT, GL_FALSE, sizeof(VertexTextured), (void*)(sizeof(float) * 3) );
 
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, skyboxTopVBOs[1] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( skyBoxTopIndices ), skyBoxTopIndices, GL_STATIC_DRAW );
+    ResourceRegistry::bufferData( skyboxTopVBOs[1], GL_ELEMENT_ARRAY_BUFFER, sizeof( skyBoxTopIndices ), skyBoxTopIndices, GL_STATIC_DRAW );
 
     fprintf( stdout, "[INFO]: quad read in with VAO %d\n\n", skyboxTopVAO );
 
-    particleSystem.initialize(glm::vec3(0,0,0), 1);
+    {
+        ResourceRegistry::OwnerScope particleScope( OWNER_PARTICLES );
+        particleSystem.initialize(glm::vec3(0,0,0), 1);
+        particleSystem.setCullSettings(WINDOW_HEIGHT, 1.0f);
+    }
+
+    clusteredLighting.initialize();
+
+    // debris cube, one face at a time so every face gets its own normal
+    struct VertexNormal {
+        float x, y, z;
+        float nx, ny, nz;
+    };
+    VertexNormal debrisVertices[24];
+    GLushort debrisIndices[NUM_DEBRIS_INDICES];
+    for(GLuint face = 0; face < 6; face++) {
+        glm::vec3 normal(0.0f);
+        normal[face / 2] = face % 2 == 0 ? 1.0f : -1.0f;
+        glm::vec3 u(0.0f), v(0.0f);
+        u[(face / 2 + 1) % 3] = 0.5f;
+        v[(face / 2 + 2) % 3] = 0.5f;
+        if(face % 2 == 1) u = -u;                       // keep the winding counter clockwise
+        glm::vec3 center = normal * 0.5f;
+        glm::vec3 corners[4] = { center - u - v, center + u - v, center + u + v, center - u + v };
+        for(GLuint c = 0; c < 4; c++) {
+            debrisVertices[face * 4 + c] = { corners[c].x, corners[c].y, corners[c].z, normal.x, normal.y, normal.z };
+        }
+        const GLushort QUAD[6] = { 0, 1, 2, 0, 2, 3 };
+        for(GLuint k = 0; k < 6; k++) {
+            debrisIndices[face * 6 + k] = face * 4 + QUAD[k];
+        }
+    }
+
+    ResourceRegistry::genVertexArrays( OWNER_BODIES, 1, &debrisVAO );
+    glBindVertexArray( debrisVAO );
+
+    ResourceRegistry::genBuffers( OWNER_BODIES, 1, &debrisVBO );
+    glBindBuffer( GL_ARRAY_BUFFER, debrisVBO );
+    ResourceRegistry::bufferData( debrisVBO, GL_ARRAY_BUFFER, sizeof(debrisVertices), debrisVertices, GL_STATIC_DRAW );
+    glEnableVertexAttribArray( 0 );
+    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormal), (void*) 0 );
+    glEnableVertexAttribArray( 1 );
+    glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexNormal), (void*) (sizeof(float) * 3) );
+
+    ResourceRegistry::genBuffers( OWNER_BODIES, 1, &debrisIBO );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, debrisIBO );
+    ResourceRegistry::bufferData( debrisIBO, GL_ELEMENT_ARRAY_BUFFER, sizeof(debrisIndices), debrisIndices, GL_STATIC_DRAW );
+
+    // per-instance matrices at the locations the INSTANCED gourad permutation expects
+    ResourceRegistry::genBuffers( OWNER_BODIES, 1, &debrisInstanceVBO );
+    glBindBuffer( GL_ARRAY_BUFFER, debrisInstanceVBO );
+    debrisCapacity = NUM_DEBRIS;                        // grown in renderScene() if more bodies are spawned
+    ResourceRegistry::bufferData( debrisInstanceVBO, GL_ARRAY_BUFFER, debrisCapacity * sizeof(InstanceTransform), nullptr, GL_STREAM_DRAW );
+    for(GLuint row = 0; row < 6; row++) {
+        glEnableVertexAttribArray( 2 + row );
+        glVertexAttribPointer( 2 + row, row < 3 ? 4 : 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*) (sizeof(glm::vec4) * row) );
+        glVertexAttribDivisor( 2 + row, 1 );
+    }
 
+    fprintf( stdout, "[INFO]: debris read in with VAO %d\n", debrisVAO );
 
 }
 
@@ -709,9 +931,9 @@ void setupBuffers() {
 // /////////////////////////////////////////////////////////////////////////////
 void setupTextures() {
     // LOOKHERE #4
-    skyboxSidesTextureHandle = CSCI441::TextureUtils::loadAndRegisterTexture("assets/textures/SpaceSkyBox.png");
-    skyboxTopTextureHandle = CSCI441::TextureUtils::loadAndRegisterTexture("assets/textures/SpaceSkyBox.png");
-    spriteTextureHandle = CSCI441::TextureUtils::loadAndRegisterTexture("assets/textures/snowflake.png");
+    skyboxSidesTextureHandle = ResourceRegistry::loadTexture(OWNER_SKYBOX, "assets/textures/SpaceSkyBox.png");
+    skyboxTopTextureHandle = ResourceRegistry::loadTexture(OWNER_SKYBOX, "assets/textures/SpaceSkyBox.png");
+    spriteTextureHandle = ResourceRegistry::loadTexture(OWNER_PARTICLES, "assets/textures/snowflake.png");
 
 }
 
@@ -753,42 +975,81 @@ void setupScene() {
     glm::vec3 lightDir(-1.0f, -3.0f, -1.0f);
     float lightCutoff = glm::cos( glm::radians(7.5f) );
     lightType = 0;
-    gouradShaderProgram->useProgram();
-    glUniform3fv(gouradShaderProgramUniforms.lightColor, 1, &lightColor[0]);
-    glUniform3fv(gouradShaderProgramUniforms.lightPos, 1, &lightPos[0]);
-    glUniform3fv(gouradShaderProgramUniforms.lightDir, 1, &lightDir[0]);
-    glUniform3fv(gouradShaderProgramUniforms.pointLightPos, 1,&blackHolePos[0] );
-    glUniform1f(gouradShaderProgramUniforms.lightCutoff, lightCutoff);
-    glUniform1i(gouradShaderProgramUniforms.lightType, lightType);
+    // every permutation keeps its own copy of the light uniforms
+    for(GLuint i = 0; i <= NUM_LIGHT_TYPES; i++) {
+        GouradShaderProgramUniforms uniforms = gouradUberUniforms;
+        if(i < NUM_LIGHT_TYPES) {
+            if(gouradVariantHandles[i] == 0) continue;
+            glUseProgram(gouradVariantHandles[i]);
+            uniforms = gouradVariantUniforms[i];
+        } else {
+            gouradShaderProgram->useProgram();
+        }
+        glUniform3fv(uniforms.lightColor, 1, &lightColor[0]);
+        glUniform3fv(uniforms.lightPos, 1, &lightPos[0]);
+        glUniform3fv(uniforms.lightDir, 1, &lightDir[0]);
+        glUniform3fv(uniforms.pointLightPos, 1,&blackHolePos[0] );
+        glUniform1f(uniforms.lightCutoff, lightCutoff);
+        glUniform1i(uniforms.lightType, lightType);
+    }
 
 
+    for(GLuint i = 0; i < NUM_LIGHT_TYPES; i++) {
+        if(gouradInstancedHandles[i] == 0) continue;
+        const GouradShaderProgramUniforms &uniforms = gouradInstancedUniforms[i];
+        glUseProgram(gouradInstancedHandles[i]);
+        glUniform3fv(uniforms.lightColor, 1, &lightColor[0]);
+        glUniform3fv(uniforms.lightPos, 1, &lightPos[0]);
+        glUniform3fv(uniforms.lightDir, 1, &lightDir[0]);
+        glUniform3fv(uniforms.pointLightPos, 1,&blackHolePos[0] );
+        glUniform1f(uniforms.lightCutoff, lightCutoff);
+    }
+
     // setup snowglobe
     snowglobeAngle = 0.0f;
+    diskAngle = 0.0f;
 
     //suckable objects:
-    myTeapot.color = glm::vec3(.8,0,0);
-    myTeapot.spec = glm::vec3(0,.8,0);
-    myTeapot.ambient = glm::vec3(0,0,.3);
-    myTeapot.transform.position = glm::vec3 (5,5,2);
-    myTeapot.velocity = glm::vec3 (-.6,.3,.4);
-    myTeapot.transform.rotation = Transform::toQuaternion(0,0,0);
-    myTeapot.rotationalVelocity = glm::vec3 (0.1,0,0.05);
-
-    myCube.color = glm::vec3(.8,.3,.4);
-    myCube.spec = glm::vec3(.9,.9,.95);
-    myCube.ambient = glm::vec3(.7,.7,.7);
-    myCube.transform.position = glm::vec3 (0,2,5);
-    myCube.velocity = glm::vec3 (.6,-.4,.1);
-    myCube.transform.rotation = Transform::toQuaternion(0,0,0);
-    myCube.rotationalVelocity = glm::vec3 (-0.1,.02,0);
-
-    myBulb.color = glm::vec3(.8, .4, .0);
-    myBulb.spec = glm::vec3(.2, .2, .2);
-    myBulb.ambient = glm::vec3(.3, .3, .3);
-    myBulb.transform.position = glm::vec3 (1, -4, -3);
-    myBulb.velocity = glm::vec3 (-.6, .4, .1);
-    myBulb.transform.rotation = Transform::toQuaternion(0, 0, 0);
-    myBulb.rotationalVelocity = glm::vec3 (-0.1, .02, 0);
+    ResourceRegistry::OwnerScope bodyScope( OWNER_BODIES );
+    bodies.initialize(&jobSystem);
+    BodyMaterial teapotMaterial = { glm::vec3(.8,0,0), glm::vec3(0,.8,0), glm::vec3(0,0,.3), 1.0f };
+    BodyMaterial cubeMaterial = { glm::vec3(.8,.3,.4), glm::vec3(.9,.9,.95), glm::vec3(.7,.7,.7), 1.0f };
+    BodyMaterial bulbMaterial = { glm::vec3(.8, .4, .0), glm::vec3(.2, .2, .2), glm::vec3(.3, .3, .3), 1.0f };
+    BodyMaterial debrisMaterial = { glm::vec3(0.9f, 0.7f, 0.5f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f };
+    teapotBody = bodies.create(glm::vec3 (5,5,2), glm::vec3 (-.6,.3,.4), glm::vec3 (0.05,0,0.1), glm::vec3(1.0f), 2.0f, 1.0f, bodies.addMaterial(teapotMaterial));
+    cubeBody = bodies.create(glm::vec3 (0,2,5), glm::vec3 (.6,-.4,.1), glm::vec3 (0,.02,-0.1), glm::vec3(1.0f), 0.87f, 1.0f, bodies.addMaterial(cubeMaterial));
+    bulbBody = bodies.create(glm::vec3 (1, -4, -3), glm::vec3 (-.6, .4, .1), glm::vec3 (0, .02, -0.1), glm::vec3(1.0f), 1.0f, 1.0f, bodies.addMaterial(bulbMaterial));
+
+    teapotNode = sceneGraph.addNode(SceneGraph::NO_PARENT, glm::vec3(5,5,2), Transform::toQuaternion(0,0,0), glm::vec3(1.0f));
+    cubeNode = sceneGraph.addNode(SceneGraph::NO_PARENT, glm::vec3(0,2,5), Transform::toQuaternion(0,0,0), glm::vec3(1.0f));
+    bulbNode = sceneGraph.addNode(SceneGraph::NO_PARENT, glm::vec3(1, -4, -3), Transform::toQuaternion(0,0,0), glm::vec3(1.0f));
+    sceneGraph.update();
+
+    // a disk of debris in rough circular orbits
+    GLuint debrisMaterialID = bodies.addMaterial(debrisMaterial);
+    for(GLuint i = 0; i < NUM_DEBRIS; i++) {
+        GLfloat angle = randNumber(3.14f);
+        GLfloat radius = 4.0f + fabs(randNumber(8.0f));
+        GLfloat speed = sqrtf(BLACK_HOLE_GM / radius);
+        glm::vec3 scale(0.05f + fabs(randNumber(0.1f)), 0.05f + fabs(randNumber(0.1f)), 0.05f + fabs(randNumber(0.1f)));
+        bodies.create(glm::vec3(cosf(angle) * radius, randNumber(0.5f), sinf(angle) * radius),
+                      glm::vec3(-sinf(angle) * speed, 0.0f, cosf(angle) * speed),
+                      glm::vec3(randNumber(0.1f), randNumber(0.1f), randNumber(0.1f)),
+                      scale, 0.5f * glm::length(scale),
+                      0.001f, debrisMaterialID);
+    }
+
+    NBodySolver &nbodySolver = bodies.getSolver();
+    nbodySolver.setGravitationalConstant(0.05f);
+    nbodySolver.setSoftening(0.3f);
+    nbodySolver.setOpeningAngle(0.5f);
+    Attractor blackHole;
+    blackHole.position = blackHolePos;
+    blackHole.gm = BLACK_HOLE_GM;
+    nbodySolver.addAttractor(blackHole);
+    bodies.setCollisionCellSize(0.3f);                 // the biggest debris cube is 0.26 across
+    bodies.setRestitution(0.6f);
+    bodies.resetEnergyReference();
 }
 
 // initialize() /////////////////////////////////////////////////////////////////////////////
@@ -811,6 +1072,7 @@ GLFWwindow* initialize() {
     setupTextures();                                    // load all of our textures onto the GPU
     setupScene();                                       // initialize all of our scene information
     CSCI441::setVertexAttributeLocations( vpos_attrib_location );
+    jobSystem.initialize();                             // start the simulation worker threads
 
     fprintf( stdout, "\n[INFO]: Setup complete\n" );
 
@@ -830,6 +1092,7 @@ void cleanupShaders() {
     fprintf( stdout, "[INFO]: ...deleting shaders.\n" );
 
     delete gouradShaderProgram;
+    lightingShaderVariants.cleanup();
     delete flatShaderProgram;
     delete texShaderProgram;
     delete billboardShaderProgram;
@@ -842,18 +1105,24 @@ void cleanupShaders() {
 ///
 // /////////////////////////////////////////////////////////////////////////////
 void cleanupBuffers() {
-    fprintf( stdout, "[INFO]: ...deleting IBOs....\n" );
-
-    glDeleteBuffers( NUM_VAOS, ibos );
-
-    fprintf( stdout, "[INFO]: ...deleting VBOs....\n" );
-
-    glDeleteBuffers( NUM_VAOS, vbos );
+    fprintf( stdout, "[INFO]: ...deleting VBOs and IBOs....\n" );
+
+    ResourceRegistry::deleteBuffers( 2, platformVBOs );
+    ResourceRegistry::deleteBuffers( 2, skyboxFrontVBOs );
+    ResourceRegistry::deleteBuffers( 2, skyboxSideVBOs );
+    ResourceRegistry::deleteBuffers( 2, skyboxTopVBOs );
+    ResourceRegistry::deleteBuffers( 1, &debrisVBO );
+    ResourceRegistry::deleteBuffers( 1, &debrisIBO );
+    ResourceRegistry::deleteBuffers( 1, &debrisInstanceVBO );
     CSCI441::deleteObjectVBOs();
 
     fprintf( stdout, "[INFO]: ...deleting VAOs....\n" );
 
-    glDeleteVertexArrays( NUM_VAOS, vaos );
+    ResourceRegistry::deleteVertexArrays( 1, &platformVAO );
+    ResourceRegistry::deleteVertexArrays( 1, &skyboxFrontVAO );
+    ResourceRegistry::deleteVertexArrays( 1, &skyboxSideVAO );
+    ResourceRegistry::deleteVertexArrays( 1, &skyboxTopVAO );
+    ResourceRegistry::deleteVertexArrays( 1, &debrisVAO );
     CSCI441::deleteObjectVAOs();
 
     free(spriteLocations);
@@ -869,7 +1138,9 @@ void cleanupBuffers() {
 void cleanupTextures() {
     fprintf( stdout, "[INFO]: ...deleting textures\n" );
 
-    glDeleteTextures(1, &spriteTextureHandle);
+    ResourceRegistry::deleteTextures(1, &skyboxSidesTextureHandle);
+    ResourceRegistry::deleteTextures(1, &skyboxTopTextureHandle);
+    ResourceRegistry::deleteTextures(1, &spriteTextureHandle);
 }
 
 void computeAndSendMatrixUniforms(glm::mat4 modelMtx, glm::mat4 viewMtx, glm::mat4 projMtx) {
@@ -885,31 +1156,20 @@ void computeAndSendMatrixUniforms(glm::mat4 modelMtx, glm::mat4 viewMtx, glm::ma
 }
 
 
-void SetupSuckable(suckableObject &object, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)  {
-    blackHolePos = glm::vec3 (0,0,0);
-
-    glm::vec3 objectForce = 2.5f * (blackHolePos-object.transform.position);
-
-
-    //physics:
-    object.velocity += (float)(1/(glm::pow(glm::length(objectForce),2))) * (objectForce) ;
-    object.transform.position += object.velocity;
-    object.transform.setRotation(object.transform.eulerAngles() + object.rotationalVelocity);
-
-    //now set velocity damping:
-    //object.velocity *= 0.98f;
-
-
-    object.transform.updateMatrix();
-
-    glUniform3fv(gouradShaderProgramUniforms.materialAmbColor, 1, &object.ambient[0]);
-    glUniform3fv(gouradShaderProgramUniforms.materialDiffColor, 1, &object.color[0]);
-    glUniform3fv(gouradShaderProgramUniforms.materialSpecColor, 1, &object.spec[0]);
-    glUniform3fv(gouradShaderProgramUniforms.materialShininess, 1, &object.shininess);
-
+// SetupSuckable() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///      Sends the material of a body and the matrices of its scene node to the gourad shader
+///
+// /////////////////////////////////////////////////////////////////////////////
+void SetupSuckable(BodyHandle handle, GLuint node, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)  {
+    const BodyMaterial &material = frameSnapshot->materialOf(frameSnapshot->indexOf(handle));
 
+    glUniform3fv(gouradShaderProgramUniforms.materialAmbColor, 1, &material.ambient[0]);
+    glUniform3fv(gouradShaderProgramUniforms.materialDiffColor, 1, &material.diffuse[0]);
+    glUniform3fv(gouradShaderProgramUniforms.materialSpecColor, 1, &material.specular[0]);
+    glUniform1f(gouradShaderProgramUniforms.materialShininess, material.shininess);
 
-    computeAndSendTransformationMatrices(object.transform.getMatrix(), viewMatrix, projectionMatrix,
+    computeAndSendTransformationMatrices(frameSnapshot->nodeMatrices[node], viewMatrix, projectionMatrix,
                                          gouradShaderProgramUniforms.mvpMatrix,
                                          gouradShaderProgramUniforms.modelMatrix,
                                          gouradShaderProgramUniforms.normalMtx);
@@ -922,12 +1182,16 @@ void SetupSuckable(suckableObject &object, glm::mat4 viewMatrix, glm::mat4 proje
 // /////////////////////////////////////////////////////////////////////////////
 void shutdown(GLFWwindow* window) {
     fprintf( stdout, "\n[INFO]: Shutting down.......\n" );
+    ResourceRegistry::printReport();                    // what everything held at the end
     fprintf( stdout, "[INFO]: ...closing window...\n" );
     glfwDestroyWindow( window );                        // close our window
     cleanupShaders();                                   // delete shaders from GPU
     cleanupBuffers();                                   // delete VAOs/VBOs from GPU
     cleanupTextures();                                  // delete textures from GPU
     particleSystem.cleanup();                           // delete shaders,VAO/VBOs, and textures from particle system
+    clusteredLighting.cleanup();                        // delete the light and cluster buffers
+    jobSystem.cleanup();                                // stop the simulation worker threads
+    ResourceRegistry::checkForLeaks();                  // anything left now was forgotten above
     fprintf( stdout, "[INFO]: ...closing GLFW.....\n" );
     glfwTerminate();						            // shut down GLFW to clean up our context
     fprintf( stdout, "[INFO]: ..shut down complete!\n" );
@@ -990,8 +1254,16 @@ void renderScene( glm::mat4 viewMatrix, glm::mat4 projectionMatrix ) {
 
 
 
+    // assign all of the point lights to clusters before any lit draws
+    if(useClusteredLighting) {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        gatherSceneLights();
+        clusteredLighting.update(sceneLights, viewMatrix, projectionMatrix, NEAR_PLANE, FAR_PLANE, viewport[2], viewport[3]);
+    }
+
     // ground stuff
-    gouradShaderProgram->useProgram();
+    useGouradShader();
     // set the eye position - needed for specular reflection
     if(arcBallChoice) {
         glUniform3fv(gouradShaderProgramUniforms.eyePos, 1, &(arcballCam.eyePos[0]));
@@ -1028,22 +1300,55 @@ void renderScene( glm::mat4 viewMatrix, glm::mat4 projectionMatrix ) {
     }
 */
 
-    gouradShaderProgram->useProgram();
+    useGouradShader();
 
-    SetupSuckable(myTeapot, viewMatrix, projectionMatrix);
+    SetupSuckable(teapotBody, teapotNode, viewMatrix, projectionMatrix);
     CSCI441::drawSolidTeapot( 2.0f );
-    SetupSuckable(myCube, viewMatrix, projectionMatrix);
+    SetupSuckable(cubeBody, cubeNode, viewMatrix, projectionMatrix);
     CSCI441::drawSolidCube(1);
-    SetupSuckable(myBulb, viewMatrix, projectionMatrix);
+    SetupSuckable(bulbBody, bulbNode, viewMatrix, projectionMatrix);
     //before we draw bulb, let's set the point light position:
-    glUniform3fv(gouradShaderProgramUniforms.lightPos, 1, &myBulb.transform.position[0]);
+    glUniform3fv(gouradShaderProgramUniforms.lightPos, 1, &frameSnapshot->lightPosition[0]);
     //now, let's actually use a different shader for the bulb:
     //flatShaderProgram->useProgram();
-    //glUniformMatrix4fv(flatShaderProgramUniforms.mvpMatrix, 1, GLU_FALSE, &myBulb.transform.getMatrix()[0][0]);
-    //glUniform3fv(flatShaderProgramUniforms.color, 1, &myBulb.color[0]);
+    //glUniformMatrix4fv(flatShaderProgramUniforms.mvpMatrix, 1, GLU_FALSE, &bulbMatrix[0][0]);
+    //glUniform3fv(flatShaderProgramUniforms.color, 1, &bulbMaterial.diffuse[0]);
     model->draw( vpos_attrib_location );
 
-    particleSystem.draw(viewMatrix, projectionMatrix);
+    // debris as instanced cubes in one draw
+    GLuint numDebris = frameSnapshot->instances.size();
+    if(numDebris > 0 && lightType < NUM_LIGHT_TYPES && gouradInstancedHandles[lightType] != 0) {
+        const GouradShaderProgramUniforms &uniforms = gouradInstancedUniforms[lightType];
+        glUseProgram(gouradInstancedHandles[lightType]);
+        glm::mat4 viewProjMatrix = projectionMatrix * viewMatrix;
+        const BodyMaterial &material = frameSnapshot->materialOf(NUM_SUCKABLES);
+        glUniformMatrix4fv(uniforms.viewProjMatrix, 1, GL_FALSE, &viewProjMatrix[0][0]);
+        glUniform3fv(uniforms.eyePos, 1, arcBallChoice ? &arcballCam.eyePos[0] : &freeCam.eyePos[0]);
+        glUniform3fv(uniforms.lightPos, 1, &frameSnapshot->lightPosition[0]);
+        glUniform3fv(uniforms.materialAmbColor, 1, &material.ambient[0]);
+        glUniform3fv(uniforms.materialDiffColor, 1, &material.diffuse[0]);
+        glUniform3fv(uniforms.materialSpecColor, 1, &material.specular[0]);
+        glUniform1f(uniforms.materialShininess, material.shininess);
+
+        // matrices were built by the simulation, only the copy into the buffer happens here
+        glBindVertexArray( debrisVAO );
+        glBindBuffer( GL_ARRAY_BUFFER, debrisInstanceVBO );
+        if(numDebris > debrisCapacity) {
+            debrisCapacity = numDebris;
+            ResourceRegistry::bufferData( debrisInstanceVBO, GL_ARRAY_BUFFER, debrisCapacity * sizeof(InstanceTransform), nullptr, GL_STREAM_DRAW );
+        }
+        InstanceTransform *instances = (InstanceTransform*) glMapBufferRange( GL_ARRAY_BUFFER, 0, numDebris * sizeof(InstanceTransform),
+                                                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+        if(instances != nullptr) {
+            memcpy( instances, &frameSnapshot->instances[0], numDebris * sizeof(InstanceTransform) );
+            glUnmapBuffer( GL_ARRAY_BUFFER );
+            glDrawElementsInstanced( GL_TRIANGLES, NUM_DEBRIS_INDICES, GL_UNSIGNED_SHORT, (void*)0, numDebris );
+        }
+    }
+
+    particleSystem.draw(viewMatrix, projectionMatrix, frameSnapshot->particlePositions.empty() ? nullptr : &frameSnapshot->particlePositions[0],
+                        frameSnapshot->particleLifespans.empty() ? nullptr : &frameSnapshot->particleLifespans[0], frameSnapshot->particlePositions.size(),
+                        frameSnapshot->particleEmitter);
 
     if(drawBoundings)
         particleSystem.drawBoundings(viewMatrix,projectionMatrix, modelMatrix);
@@ -1093,6 +1398,40 @@ void renderScene( glm::mat4 viewMatrix, glm::mat4 projectionMatrix ) {
 //    glDrawElements( GL_POINTS, NUM_SPRITES, GL_UNSIGNED_SHORT, (void*)0 );
 }
 
+// saveCheckpoint() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///      Writes the particles and bodies to a checkpoint so a later run can skip the warm up
+/// \param filename - the checkpoint to write
+// /////////////////////////////////////////////////////////////////////////////
+void saveCheckpoint(const char* filename) {
+    CheckpointWriter checkpoint;
+    particleSystem.saveCheckpoint(checkpoint);
+    bodies.saveCheckpoint(checkpoint);
+    if(checkpoint.write(filename)) {
+        fprintf( stdout, "[INFO]: saved %zu particles and %zu bodies to \"%s\"\n", particleSystem.getNumParticles(), bodies.size(), filename );
+    }
+}
+
+// restoreCheckpoint() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///      Maps a checkpoint written by saveCheckpoint() and copies the particles and bodies out of it
+/// \param filename - the checkpoint to read
+// /////////////////////////////////////////////////////////////////////////////
+void restoreCheckpoint(const char* filename) {
+    CheckpointReader checkpoint;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(!checkpoint.open(filename)) return;
+    // both systems are checked before either changes, so a bad checkpoint leaves the whole scene as it was
+    if(!particleSystem.canRestoreCheckpoint(checkpoint) || !bodies.canRestoreCheckpoint(checkpoint)) {
+        fprintf( stderr, "[ERROR]: \"%s\" could not be restored\n", filename );
+        return;
+    }
+    particleSystem.restoreCheckpoint(checkpoint);
+    bodies.restoreCheckpoint(checkpoint);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    fprintf( stdout, "[INFO]: restored %zu particles and %zu bodies from \"%s\" in %.2f ms\n", particleSystem.getNumParticles(), bodies.size(), filename, ms );
+}
+
 // updateScene() /////////////////////////////////////////////////////////////////////////////
 /// \desc
 ///      Update all of our scene objects - perform animation here
@@ -1102,6 +1441,12 @@ void renderScene( glm::mat4 viewMatrix, glm::mat4 projectionMatrix ) {
 
 
 void updateScene() {
+    if(checkpointSaveRequested.exchange(false)) {
+        saveCheckpoint(CHECKPOINT_FILE);
+    }
+    if(checkpointRestoreRequested.exchange(false)) {
+        restoreCheckpoint(CHECKPOINT_FILE);
+    }
 
     //find time passed since last update
     unsigned long long time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
@@ -1112,7 +1457,28 @@ void updateScene() {
 
     now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
-    particleSystem.update(timePassed, timeThroughSecond, glm::vec3(0,0,0));
+    {
+        ResourceRegistry::OwnerScope particleScope( OWNER_PARTICLES );
+        particleSystem.update(timePassed, timeThroughSecond, glm::vec3(0,0,0));
+    }
+
+    ResourceRegistry::OwnerScope bodyScope( OWNER_BODIES );
+    bodies.step(1.0f);
+    bodies.collideParticles(particleSystem.getPositions(), particleSystem.getVelocities(), particleSystem.getNumParticles(), PARTICLE_RADIUS);
+
+    // only the nodes that moved, and anything attached to them, get new world matrices
+    BodyHandle suckableBodies[3] = { teapotBody, cubeBody, bulbBody };
+    GLuint suckableNodes[3] = { teapotNode, cubeNode, bulbNode };
+    for(int i = 0; i < 3; i++) {
+        uint32_t index = bodies.indexOf(suckableBodies[i]);
+        sceneGraph.setLocal(suckableNodes[i], bodies.positions[index], bodies.orientations[index]);
+    }
+    sceneGraph.update();
+
+    if(energyReportRequested.exchange(false)) {
+        fprintf( stdout, "[INFO]: energy drift %.3e, %u substeps last frame (max %u per body)\n",
+                 bodies.getEnergyDrift(), bodies.getTotalSubsteps(), bodies.getMaxSubstepsTaken() );
+    }
 
     snowglobeAngle += 0.01f;
     if(snowglobeAngle >= 6.28f) {
@@ -1120,6 +1486,49 @@ void updateScene() {
     }
 }
 
+// simulateFrame() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///      Updates the scene and copies everything renderScene() reads into the
+///      snapshot.  Runs on the simulation thread while the pipeline is on, so
+///      it must not touch OpenGL.
+/// \param snapshot - the frame to fill in
+// /////////////////////////////////////////////////////////////////////////////
+void simulateFrame(SimSnapshot &snapshot) {
+    updateScene();
+
+    particleSystem.getDrawState(snapshot.particlePositions, snapshot.particleLifespans, snapshot.particleEmitter);
+    snapshot.bodyPositions.assign(bodies.positions.begin(), bodies.positions.end());
+    snapshot.bodyMaterialIDs.assign(bodies.materialIDs.begin(), bodies.materialIDs.end());
+    snapshot.bodyMaterials.assign(bodies.getMaterials().begin(), bodies.getMaterials().end());
+    bodies.copyHandleTables(snapshot.bodySlotToIndex, snapshot.bodySlotGenerations);
+    snapshot.lightPosition = bodies.positions[bodies.indexOf(bulbBody)];
+    snapshot.nodeMatrices.resize(sceneGraph.size());
+    for(uint32_t node = 0; node < sceneGraph.size(); node++) {
+        snapshot.nodeMatrices[node] = sceneGraph.getWorldMatrix(node);
+    }
+
+    // debris matrices are built here on the workers, the render thread only copies them to the GPU
+    GLuint numDebris = bodies.size() - NUM_SUCKABLES;
+    snapshot.instances.resize(numDebris);
+    if(numDebris > 0) {
+        InstanceTransform *instances = &snapshot.instances[0];
+        jobSystem.parallelFor(numDebris, 1024, [instances](size_t begin, size_t end, unsigned) {
+            InstanceBatch::buildTransforms(&bodies.positions[NUM_SUCKABLES + begin], &bodies.orientations[NUM_SUCKABLES + begin],
+                                           &bodies.scales[NUM_SUCKABLES + begin], end - begin, instances + begin);
+        });
+    }
+}
+
+// reportPipeline() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///      Prints how much of the simulation was hidden behind rendering
+// /////////////////////////////////////////////////////////////////////////////
+void reportPipeline() {
+    if(simPipeline.getNumFrames() == 0) return;
+    fprintf( stdout, "[INFO]: %llu pipelined frames, simulation %.2f ms, render thread waited %.2f ms per frame, %.0f%% overlapped\n",
+             (unsigned long long)simPipeline.getNumFrames(), simPipeline.getSimulationTime(), simPipeline.getWaitTime(), 100.0 * simPipeline.getOverlap() );
+}
+
 // run() /////////////////////////////////////////////////////////////////////////////
 /// \desc
 ///      Runs our draw loop and renders/updates our scene
@@ -1129,7 +1538,20 @@ void run(GLFWwindow* window) {
     //  This is our draw loop - all rendering is done here.  We use a loop to keep the window open
     //	until the user decides to close the window and quit the program.  Without a loop, the
     //	window will display once and then the program exits.
+    serialSnapshot.frame = 0;
+    simulateFrame(serialSnapshot);                      // the first frame for when the pipeline starts off
     while( !glfwWindowShouldClose(window) ) {	        // check if the window was instructed to be closed
+        // start or stop the simulation thread when P was pressed
+        if(pipelineSimulation && !simPipeline.isRunning()) {
+            simPipeline.start(simulateFrame);
+        } else if(!pipelineSimulation && simPipeline.isRunning()) {
+            reportPipeline();
+            simPipeline.stop();                         // the scene is left as of the last frame it simulated
+            simulateFrame(serialSnapshot);
+        }
+        // frame N is drawn while the simulation thread works on frame N+1
+        frameSnapshot = pipelineSimulation ? &simPipeline.acquire() : &serialSnapshot;
+
         glDrawBuffer( GL_BACK );				        // work with our back frame buffer
         glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );	// clear the current color contents and depth buffer in the window
 
@@ -1145,7 +1567,7 @@ void run(GLFWwindow* window) {
         // set the projection matrix based on the window size
         // use a perspective projection that ranges
         // with a FOV of 45 degrees, for our current aspect ratio, and Z ranges from [0.001, 1000].
-        glm::mat4 projectionMatrix = glm::perspective( 45.0f, (GLfloat) WINDOW_WIDTH / (GLfloat) WINDOW_HEIGHT, 0.001f, 100.0f );
+        glm::mat4 projectionMatrix = glm::perspective( 45.0f, (GLfloat) WINDOW_WIDTH / (GLfloat) WINDOW_HEIGHT, NEAR_PLANE, FAR_PLANE );
 
         // set up our look at matrix to position our camera
         if(arcBallChoice) {
@@ -1176,7 +1598,16 @@ void run(GLFWwindow* window) {
         glfwSwapBuffers(window);                        // flush the OpenGL commands and make sure they get rendered!
         glfwPollEvents();				                // check for any events and signal to redraw screen
 
-        updateScene();                                  // update the objects in our scene
+        diskAngle += 0.01f;                             // the disk lights are only drawn, they animate here
+        if(simPipeline.isRunning()) {
+            simPipeline.release();                      // lets the simulation reuse this frame's snapshot
+        } else {
+            simulateFrame(serialSnapshot);              // update the objects in our scene
+        }
+    }
+    if(simPipeline.isRunning()) {
+        reportPipeline();
+        simPipeline.stop();
     }
 }
 
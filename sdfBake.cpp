@@ -0,0 +1,212 @@
+/*
+ *  CSCI 441, Computer Graphics, Fall 2020
+ *
+ *  Project: final project
+ *  File: sdfBake.cpp
+ *
+ *  Description:
+ *      Offline tool that bakes the town and platform into a sparse signed
+ *      distance field for SignedDistanceField to memory map at startup.
+ *      The surfaces must match the collision mesh built in main.cpp.
+ *
+ *      usage: sdfBake [output] [voxelSize]
+ *          output defaults to assets/models/medstreet/medstreet.sdf, voxelSize to 0.1
+ *
+ */
+
+//***********************************************************************************************************************************************************
+//
+// Library includes
+
+#include <glm/glm.hpp>                  // include GLM libraries
+#include <glm/gtc/matrix_transform.hpp> // and matrix functions
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>                       // for high resolution time
+#include <cmath>
+#include <cstdio>				        // for printf functionality
+#include <cstdlib>				        // for exit functionality
+#include <cstring>
+#include <vector>
+
+#include "JobSystem.h"
+#include "SignedDistanceField.h"
+#include "TriangleBVH.h"
+
+//***********************************************************************************************************************************************************
+//
+// Global Parameters
+
+const glm::vec3 TOWN_POSITION(4.0f, 0.1f, 0.0f);    // must match main.cpp
+const float PLATFORM_SIZE = 20.0f;                  // must match main.cpp
+const float BAND_VOXELS = 5.0f;                     // distances are stored this many voxels either side of the surface
+
+//***********************************************************************************************************************************************************
+//
+// Helper Functions
+
+// signedDistance() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Distance from point to the mesh, negative behind the nearest triangle
+/// \param mesh - the scene to measure against
+/// \param point - where to measure
+/// \param maxDistance - how far to look
+/// \return the signed distance, maxDistance if nothing is that close
+// /////////////////////////////////////////////////////////////////////////////
+float signedDistance(const TriangleBVH &mesh, const glm::vec3 &point, float maxDistance) {
+    glm::vec3 closest;
+    uint32_t triangle;
+    if(!mesh.closestPoint(point, maxDistance, closest, triangle)) {
+        return maxDistance;
+    }
+    float distance = glm::length(point - closest);
+    return glm::dot(point - closest, mesh.getNormal(triangle)) < 0.0f ? -distance : distance;
+}
+
+// alignOffset() /////////////////////////////////////////////////////////////////////////////
+/// \desc
+///     Rounds a file offset up to a cache line so every table in the file is aligned once mapped
+// /////////////////////////////////////////////////////////////////////////////
+uint64_t alignOffset(uint64_t offset) {
+    return (offset + 63) & ~(uint64_t)63;
+}
+
+//***********************************************************************************************************************************************************
+//
+// Our main function
+
+// main() ///////////////////////////////////////////////////////////////
+//
+//  Bakes the field and writes it out
+//
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+    const char* output = argc > 1 ? argv[1] : "assets/models/medstreet/medstreet.sdf";
+    const float voxelSize = argc > 2 ? (float)atof(argv[2]) : 0.1f;
+    if(voxelSize <= 0.0f) {
+        fprintf(stderr, "[ERROR]: voxel size must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    TriangleBVH mesh;
+    if(!mesh.loadOBJ("assets/models/medstreet/medstreet.obj", glm::translate(glm::mat4(1.0f), TOWN_POSITION))) {
+        return EXIT_FAILURE;
+    }
+    // wound to face up, the sign of the field comes from the winding and above the platform is outside
+    mesh.addTriangle(glm::vec3(-PLATFORM_SIZE, 0.0f, -PLATFORM_SIZE), glm::vec3(-PLATFORM_SIZE, 0.0f,  PLATFORM_SIZE),
+                     glm::vec3( PLATFORM_SIZE, 0.0f, -PLATFORM_SIZE));
+    mesh.addTriangle(glm::vec3( PLATFORM_SIZE, 0.0f, -PLATFORM_SIZE), glm::vec3(-PLATFORM_SIZE, 0.0f,  PLATFORM_SIZE),
+                     glm::vec3( PLATFORM_SIZE, 0.0f,  PLATFORM_SIZE));
+    mesh.build();
+
+    JobSystem jobSystem;
+    jobSystem.initialize();
+
+    // lay bricks over the mesh with a band of room on every side
+    const uint32_t B = SignedDistanceField::BRICK_SIZE, S = B + 1;
+    const float band = BAND_VOXELS * voxelSize;
+    const float brickSize = B * voxelSize;
+    const float halfDiagonal = 0.5f * std::sqrt(3.0f) * brickSize;
+    glm::vec3 origin = mesh.getBoundsMin() - glm::vec3(band);
+    glm::vec3 extent = mesh.getBoundsMax() + glm::vec3(band) - origin;
+    uint32_t bricks[3];
+    for(int axis = 0; axis < 3; axis++) {
+        bricks[axis] = std::max(1u, (uint32_t)std::ceil(extent[axis] / brickSize));
+    }
+    size_t numSlots = (size_t)bricks[0] * bricks[1] * bricks[2];
+
+    // coarse pass, one distance per brick tells which bricks the surface can reach
+    std::vector<float> coarse(numSlots);
+    std::vector<float> centreDistances(numSlots);
+    jobSystem.parallelFor(numSlots, 64, [&](size_t begin, size_t end, unsigned) {
+        for(size_t slot = begin; slot < end; slot++) {
+            uint32_t bx = slot % bricks[0], by = (slot / bricks[0]) % bricks[1], bz = slot / ((size_t)bricks[0] * bricks[1]);
+            glm::vec3 centre = origin + (glm::vec3(bx, by, bz) + 0.5f) * brickSize;
+            float d = signedDistance(mesh, centre, FLT_MAX);
+            centreDistances[slot] = d;
+            // nowhere in the brick can be closer than this, so sphere tracing through it stays safe
+            float bound = std::max(std::fabs(d) - halfDiagonal, band);
+            coarse[slot] = d < 0.0f ? -bound : bound;
+        }
+    });
+
+    std::vector<uint32_t> slots(numSlots, SignedDistanceField::EMPTY_BRICK);
+    std::vector<uint32_t> stored;
+    for(size_t slot = 0; slot < numSlots; slot++) {
+        if(std::fabs(centreDistances[slot]) < band + halfDiagonal) {
+            slots[slot] = stored.size();
+            stored.push_back(slot);
+        }
+    }
+
+    // fine pass, every sample of the stored bricks, borders included so lookups stay inside one brick
+    const size_t brickSamples = S * S * S;
+    std::vector<int16_t> samples(stored.size() * brickSamples);
+    jobSystem.parallelFor(stored.size(), 1, [&](size_t begin, size_t end, unsigned) {
+        for(size_t i = begin; i < end; i++) {
+            uint32_t slot = stored[i];
+            uint32_t bx = slot % bricks[0], by = (slot / bricks[0]) % bricks[1], bz = slot / (bricks[0] * bricks[1]);
+            glm::vec3 corner = origin + glm::vec3(bx, by, bz) * brickSize;
+            int16_t *brick = &samples[i * brickSamples];
+            for(uint32_t z = 0; z < S; z++) {
+                for(uint32_t y = 0; y < S; y++) {
+                    for(uint32_t x = 0; x < S; x++) {
+                        // the surface is within band + halfDiagonal of the centre, so within this of any sample
+                        float d = signedDistance(mesh, corner + glm::vec3(x, y, z) * voxelSize, band + 2.0f * halfDiagonal);
+                        d = glm::clamp(d / band, -1.0f, 1.0f);
+                        brick[(z * S + y) * S + x] = (int16_t)std::lround(d * 32767.0f);
+                    }
+                }
+            }
+        }
+    });
+    jobSystem.cleanup();
+
+    SDFFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "SDF1", 4);
+    header.version = SignedDistanceField::VERSION;
+    header.origin[0] = origin.x;
+    header.origin[1] = origin.y;
+    header.origin[2] = origin.z;
+    header.voxelSize = voxelSize;
+    memcpy(header.bricks, bricks, sizeof(bricks));
+    header.brickSize = B;
+    header.band = band;
+    header.numBricks = stored.size();
+    header.slotOffset = alignOffset(sizeof(header));
+    header.coarseOffset = alignOffset(header.slotOffset + numSlots * sizeof(uint32_t));
+    header.sampleOffset = alignOffset(header.coarseOffset + numSlots * sizeof(float));
+    uint64_t fileSize = header.sampleOffset + samples.size() * sizeof(int16_t);
+
+    FILE *file = fopen(output, "wb");
+    if(file == nullptr) {
+        fprintf(stderr, "[ERROR]: Could not open \"%s\" for writing\n", output);
+        return EXIT_FAILURE;
+    }
+    std::vector<char> padding(64, 0);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(&padding[0], 1, header.slotOffset - sizeof(header), file);
+    fwrite(&slots[0], sizeof(uint32_t), numSlots, file);
+    fwrite(&padding[0], 1, header.coarseOffset - (header.slotOffset + numSlots * sizeof(uint32_t)), file);
+    fwrite(&coarse[0], sizeof(float), numSlots, file);
+    fwrite(&padding[0], 1, header.sampleOffset - (header.coarseOffset + numSlots * sizeof(float)), file);
+    if(!samples.empty()) fwrite(&samples[0], sizeof(int16_t), samples.size(), file);
+    bool written = ferror(file) == 0;
+    fclose(file);
+    if(!written) {
+        fprintf(stderr, "[ERROR]: Could not write \"%s\"\n", output);
+        return EXIT_FAILURE;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    double denseBytes = (double)numSlots * B * B * B * sizeof(int16_t);
+    fprintf(stdout, "[INFO]: baked %zu triangles into %ux%ux%u bricks of %u^3 voxels (%.3f) in %.2f s\n",
+            mesh.getNumTriangles(), bricks[0], bricks[1], bricks[2], B, voxelSize, seconds);
+    fprintf(stdout, "[INFO]: %zu of %zu bricks stored, %.1f MB against %.1f MB dense, written to \"%s\"\n",
+            stored.size(), numSlots, fileSize / (1024.0 * 1024.0), denseBytes / (1024.0 * 1024.0), output);
+    return EXIT_SUCCESS;
+}
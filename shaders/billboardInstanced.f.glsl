@@ -0,0 +1,24 @@
+/*
+ *   Fragment Shader
+ *
+ *   Instanced particle sprites, one frame of a flipbook or two blended
+ */
+
+#version 410 core
+
+in vec2 texCoord;
+in vec4 tint;
+flat in vec2 frameLayers;
+flat in float frameBlend;
+
+uniform sampler2DArray flipbook;        // one layer per frame
+
+out vec4 fragColorOut;
+
+void main() {
+    vec4 color = texture(flipbook, vec3(texCoord, frameLayers.x));
+    if(frameBlend > 0.0) {
+        color = mix(color, texture(flipbook, vec3(texCoord, frameLayers.y)), frameBlend);
+    }
+    fragColorOut = color * tint;
+}
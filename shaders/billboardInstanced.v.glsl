@@ -0,0 +1,48 @@
+/*
+ *   Vertex Shader
+ *
+ *   Particle sprites as instances of one quad, in place of the geometry shader
+ */
+
+#version 410 core
+
+// the corner of the quad, the same for every instance
+layout(location = 0) in vec2 vCorner;
+
+// one set per particle, 12 bytes packed and unpacked by the vertex fetch
+layout(location = 1) in vec3 particleOffset;        // half floats, from emitterOrigin
+layout(location = 2) in float particleAge;          // 16 bit normalized, 0 when spawned and 1 when it dies
+layout(location = 3) in vec4 particleColorSize;     // 8 bit normalized tint, and the size as a fraction of maxSize
+
+uniform mat4 mvMatrix;
+uniform mat4 projMatrix;
+uniform vec3 emitterOrigin;
+uniform float maxSize;
+uniform float spinPerLife;
+uniform float framesPerLife;                        // how far through the flipbook a particle gets, it loops after numFrames
+uniform int numFrames;
+uniform bool blendFrames;                           // crossfade into the next frame rather than cutting to it
+
+out vec2 texCoord;
+out vec4 tint;
+flat out vec2 frameLayers;                          // the layers of this frame and the next
+flat out float frameBlend;                          // how much of the next frame to mix in
+
+void main() {
+    // spread the corners out in view space, so the quad always faces the camera
+    float angle = particleAge * spinPerLife;
+    float c = cos(angle);
+    float s = sin(angle);
+    vec2 offset = mat2(c, s, -s, c) * vCorner * (particleColorSize.a * maxSize);
+    gl_Position = projMatrix * (mvMatrix * vec4(emitterOrigin + particleOffset, 1.0) + vec4(offset, 0.0, 0.0));
+
+    // the same corner to texel mapping as billboardQuadShader.g.glsl
+    texCoord = vCorner.yx * 0.5 + 0.5;
+    tint = vec4(particleColorSize.rgb, 1.0 - particleAge * particleAge);
+
+    // the frame follows from the age alone, so animating costs the CPU nothing
+    float frame = particleAge * framesPerLife;
+    float firstFrame = floor(frame);
+    frameLayers = vec2(mod(firstFrame, float(numFrames)), mod(firstFrame + 1.0, float(numFrames)));
+    frameBlend = blendFrames ? frame - firstFrame : 0.0;
+}
@@ -0,0 +1,32 @@
+/*
+ *   Fragment Shader
+ *
+ *   Instanced particle sprites from a flipbook, for weighted blended order-independent transparency
+ */
+
+#version 410 core
+
+in vec2 texCoord;
+in vec4 tint;
+flat in vec2 frameLayers;
+flat in float frameBlend;
+
+uniform sampler2DArray flipbook;        // one layer per frame
+
+layout(location = 0) out vec4 accumOut;
+layout(location = 1) out float revealOut;
+
+void main() {
+    vec4 color = texture(flipbook, vec3(texCoord, frameLayers.x));
+    if(frameBlend > 0.0) {
+        color = mix(color, texture(flipbook, vec3(texCoord, frameLayers.y)), frameBlend);
+    }
+    color *= tint;
+
+    // the same weight as billboardQuadOIT.f.glsl
+    float depth = 1.0 / gl_FragCoord.w;
+    float weight = color.a * clamp(10.0 / (1e-5 + pow(depth / 5.0, 2.0) + pow(depth / 200.0, 6.0)), 1e-2, 3e3);
+
+    accumOut = vec4(color.rgb * color.a, color.a) * weight;
+    revealOut = color.a;
+}
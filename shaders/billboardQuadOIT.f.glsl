@@ -0,0 +1,27 @@
+/*
+ *   Fragment Shader
+ *
+ *   Particle sprites for weighted blended order-independent transparency
+ */
+
+#version 410 core
+
+in vec2  texCoord;
+in vec4 tint;
+
+uniform sampler2D image;
+
+layout(location = 0) out vec4 accumOut;
+layout(location = 1) out float revealOut;
+
+void main() {
+    vec4 color = texture(image, texCoord) * tint;
+
+    // McGuire and Bavoil's weight for a wide depth range (their equation 9), nearer
+    // fragments count for more.  gl_FragCoord.w is one over the eye space depth
+    float depth = 1.0 / gl_FragCoord.w;
+    float weight = color.a * clamp(10.0 / (1e-5 + pow(depth / 5.0, 2.0) + pow(depth / 200.0, 6.0)), 1e-2, 3e3);
+
+    accumOut = vec4(color.rgb * color.a, color.a) * weight;
+    revealOut = color.a;
+}
@@ -8,6 +8,7 @@
 
 // TODO #J
 in vec2  texCoord;
+in vec4 tint;
 
 // TODO #K
 uniform sampler2D image;
@@ -21,5 +22,5 @@ void main() {
     /*****************************************/
 
     // TODO #L
-    fragColorOut = texture(image,texCoord);
+    fragColorOut = texture(image,texCoord) * tint;
 }
@@ -16,6 +16,7 @@ uniform mat4 projMatrix;
 
 // TODO #I
 out vec2 texCoord;
+out vec4 tint;                  // every sprite untinted and opaque, the instanced path colors and fades them
 
 void main() {
 
@@ -24,21 +25,25 @@ void main() {
 
     // TODO #D
     texCoord = vec2(0,0);
+    tint = vec4(1.0);
     EmitVertex();
 
     // TODO #F
     gl_Position = projMatrix * (gl_in[0].gl_Position + vec4(-0.2,0.2,0,0));
     texCoord = vec2(1,0);
+    tint = vec4(1.0);
     EmitVertex();
 
     // TODO #G
     gl_Position = projMatrix * (gl_in[0].gl_Position + vec4(0.2,-0.2,0,0));
     texCoord = vec2(0,1);
+    tint = vec4(1.0);
     EmitVertex();
 
     // TODO #H
     gl_Position = projMatrix * (gl_in[0].gl_Position + vec4(0.2,0.2,0,0));
     texCoord = vec2(1,1);
+    tint = vec4(1.0);
     EmitVertex();
 
     // TODO #E
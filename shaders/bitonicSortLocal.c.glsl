@@ -0,0 +1,53 @@
+/*
+ *   Compute Shader
+ *
+ *   Every bitonic pass whose partners lie in the same block, done in shared memory
+ */
+
+#version 430 core
+
+// each workgroup sorts a block of twice WORKGROUP_SIZE elements
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+layout(std430, binding = 1) buffer Keys { float keys[]; };
+layout(std430, binding = 2) buffer Indices { uint indices[]; };
+
+uniform uint kFirst;                    // the sequence sizes merged, doubling from kFirst up to kLast
+uniform uint kLast;
+
+shared float blockKeys[2 * WORKGROUP_SIZE];
+shared uint blockIndices[2 * WORKGROUP_SIZE];
+
+void main() {
+    uint t = gl_LocalInvocationID.x;
+    uint first = gl_WorkGroupID.x * 2u * WORKGROUP_SIZE;
+    blockKeys[t] = keys[first + t];
+    blockKeys[t + WORKGROUP_SIZE] = keys[first + t + WORKGROUP_SIZE];
+    blockIndices[t] = indices[first + t];
+    blockIndices[t + WORKGROUP_SIZE] = indices[first + t + WORKGROUP_SIZE];
+    barrier();
+
+    for(uint k = kFirst; k <= kLast; k <<= 1) {
+        // passes with partners further apart than the block were already done by bitonicSortStep
+        for(uint j = min(k >> 1, uint(WORKGROUP_SIZE)); j > 0u; j >>= 1) {
+            uint i = 2u * j * (t / j) + (t % j);
+            uint partner = i + j;
+            bool descending = ((first + i) & k) == 0u;
+            float key = blockKeys[i];
+            float partnerKey = blockKeys[partner];
+            if((key < partnerKey) == descending && key != partnerKey) {
+                blockKeys[i] = partnerKey;
+                blockKeys[partner] = key;
+                uint index = blockIndices[i];
+                blockIndices[i] = blockIndices[partner];
+                blockIndices[partner] = index;
+            }
+            barrier();
+        }
+    }
+
+    keys[first + t] = blockKeys[t];
+    keys[first + t + WORKGROUP_SIZE] = blockKeys[t + WORKGROUP_SIZE];
+    indices[first + t] = blockIndices[t];
+    indices[first + t + WORKGROUP_SIZE] = blockIndices[t + WORKGROUP_SIZE];
+}
@@ -0,0 +1,34 @@
+/*
+ *   Compute Shader
+ *
+ *   One compare and swap pass of a bitonic sort, for partners too far apart to share a workgroup
+ */
+
+#version 430 core
+
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+layout(std430, binding = 1) buffer Keys { float keys[]; };
+layout(std430, binding = 2) buffer Indices { uint indices[]; };
+
+uniform uint k;                         // the size of the bitonic sequences being merged
+uniform uint j;                         // how far apart the partners are
+
+void main() {
+    // one invocation per pair
+    uint t = gl_GlobalInvocationID.x;
+    uint i = 2u * j * (t / j) + (t % j);
+    uint partner = i + j;
+
+    // back to front overall, so the first half of every sequence goes down
+    bool descending = (i & k) == 0u;
+    float key = keys[i];
+    float partnerKey = keys[partner];
+    if((key < partnerKey) == descending && key != partnerKey) {
+        keys[i] = partnerKey;
+        keys[partner] = key;
+        uint index = indices[i];
+        indices[i] = indices[partner];
+        indices[partner] = index;
+    }
+}
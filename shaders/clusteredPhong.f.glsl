@@ -0,0 +1,69 @@
+#version 410 core
+
+// uniform inputs
+uniform vec3 eyePos;                    // eye position in world space
+uniform vec3 materialDiffColor;         // the material diffuse color
+uniform vec3 materialSpecColor;         // the material specular color
+uniform float materialShininess;        // the material shininess value
+uniform vec3 materialAmbColor;          // the material ambient color
+
+uniform uvec3 clusterDims;              // number of clusters along x, y, z
+uniform vec2 screenSize;                // viewport size in pixels
+uniform vec3 depthSlicing;              // x - depth where slice 1 starts, y - log scale, z - log bias
+uniform samplerBuffer lightData;        // two texels per light: (position, radius), (color, unused)
+uniform usamplerBuffer clusterGrid;     // per cluster: (offset into lightIndices, number of lights)
+uniform usamplerBuffer lightIndices;    // light index lists for every cluster
+
+// varying inputs
+layout(location = 0) in vec3 posWorld;      // interpolated world space position
+layout(location = 1) in vec3 normalWorld;   // interpolated world space normal
+
+// outputs
+out vec4 fragColorOut;                  // color to apply to this fragment
+
+// finds the cluster this fragment falls in, must match ClusteredLighting::update()
+uint clusterIndex() {
+    // view space depth recovered from the window z and w
+    float depth = 1.0 / gl_FragCoord.w;
+
+    uint slice = 0u;
+    if(depth >= depthSlicing.x) {
+        slice = min(clusterDims.z - 1u, 1u + uint(max(log(depth) * depthSlicing.y + depthSlicing.z, 0.0)));
+    }
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / screenSize * vec2(clusterDims.xy)), clusterDims.xy - 1u);
+    return (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x;
+}
+
+void main() {
+    vec3 normal = normalize(normalWorld);
+    vec3 viewVector = normalize(eyePos - posWorld);
+
+    vec3 color = materialAmbColor;
+
+    // only loop over the lights assigned to our cluster
+    uvec2 cluster = texelFetch(clusterGrid, int(clusterIndex())).xy;
+    for(uint i = 0u; i < cluster.y; i++) {
+        int light = int(texelFetch(lightIndices, int(cluster.x + i)).x);
+        vec4 positionRadius = texelFetch(lightData, light * 2);
+        vec3 lightColor = texelFetch(lightData, light * 2 + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - posWorld;
+        float dist = length(toLight);
+        if(dist >= positionRadius.w) continue;
+
+        // smooth falloff that reaches zero at the light radius
+        float falloff = 1.0 - dist / positionRadius.w;
+        falloff *= falloff;
+
+        // Blinn-Phong reflectance
+        vec3 lightVector = toLight / dist;
+        vec3 halfwayVector = normalize(viewVector + lightVector);
+        float nDotL = max(dot(normal, lightVector), 0.0);
+        vec3 diffColor = materialDiffColor * nDotL;
+        vec3 specColor = materialSpecColor * pow(max(dot(normal, halfwayVector), 0.0), 4.0 * materialShininess);
+
+        color += lightColor * falloff * (diffColor + specColor);
+    }
+
+    fragColorOut = vec4(color, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 410 core
+
+// uniform inputs
+uniform mat4 mvpMatrix;                 // the precomputed Model-View-Projection Matrix
+uniform mat4 modelMatrix;               // just the model matrix
+uniform mat3 normalMtx;                 // normal matrix
+uniform vec3 pointLightPos;             // location of the black hole
+
+// attribute inputs
+layout(location = 0) in vec3 vPos;      // the position of this specific vertex in object space
+layout(location = 1) in vec3 vNormal;   // the normal of this specific vertex in object space
+
+// varying outputs
+layout(location = 0) out vec3 posWorld;     // position of this vertex in world space
+layout(location = 1) out vec3 normalWorld;  // normal of this vertex in world space
+
+void main() {
+    // modifies the position based on proximity to black hole
+    vec3 posMod = 1/length(vPos - pointLightPos) * normalize(vPos - pointLightPos);
+    vec3 actualPos = vPos - posMod;
+
+    gl_Position = mvpMatrix * vec4(actualPos, 1.0);
+
+    // lighting is evaluated per fragment in world space
+    posWorld = (modelMatrix * vec4(vPos, 1.0)).xyz;
+    normalWorld = normalMtx * vNormal;
+}
@@ -0,0 +1,42 @@
+/*
+ *   Compute Shader
+ *
+ *   A depth key and an index for each particle, ready to be sorted back to front
+ */
+
+#version 430 core
+
+// WORKGROUP_SIZE is defined by GPUDepthSort, and HALF_POSITIONS when positions are half float offsets from origin
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+layout(std430, binding = 0) readonly buffer Positions { uint positionWords[]; };
+layout(std430, binding = 1) writeonly buffer Keys { float keys[]; };
+layout(std430, binding = 2) writeonly buffer Indices { uint indices[]; };
+
+uniform uint count;                     // particles in the position buffer
+uniform uint paddedCount;               // the power of two being sorted
+uniform uint wordsPerElement;           // 32 bit words from one particle to the next
+uniform vec3 origin;
+uniform vec3 eyePos;
+uniform vec3 viewDir;
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= paddedCount) return;
+    indices[i] = i;
+
+    // the padding ends up behind everything, after the real particles
+    if(i >= count) {
+        keys[i] = -3.402823e38;
+        return;
+    }
+
+    uint first = i * wordsPerElement;
+#ifdef HALF_POSITIONS
+    vec3 position = origin + vec3(unpackHalf2x16(positionWords[first]), unpackHalf2x16(positionWords[first + 1u]).x);
+#else
+    vec3 position = vec3(uintBitsToFloat(positionWords[first]), uintBitsToFloat(positionWords[first + 1u]),
+                         uintBitsToFloat(positionWords[first + 2u]));
+#endif
+    keys[i] = dot(position - eyePos, viewDir);
+}
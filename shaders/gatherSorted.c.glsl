@@ -0,0 +1,27 @@
+/*
+ *   Compute Shader
+ *
+ *   Copies elements into the order of the sorted indices, for drawing them instanced
+ */
+
+#version 430 core
+
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+layout(std430, binding = 0) readonly buffer Source { uint sourceWords[]; };
+layout(std430, binding = 2) readonly buffer Indices { uint indices[]; };
+layout(std430, binding = 3) writeonly buffer Destination { uint destinationWords[]; };
+
+uniform uint count;
+uniform uint wordsPerElement;
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= count) return;
+
+    uint from = indices[i] * wordsPerElement;
+    uint to = i * wordsPerElement;
+    for(uint w = 0u; w < wordsPerElement; w++) {
+        destinationWords[to + w] = sourceWords[from + w];
+    }
+}
@@ -1,9 +1,20 @@
 #version 410 core
 
+// permutation defines - injected after #version by ShaderVariantCache
+// LIGHT_TYPE - when defined, bakes the light type in as a constant so the
+//              branches below fold away at compile time.  when not defined
+//              this is the uber-shader that switches on the lightType uniform.
+// INSTANCED  - model and normal matrices come from per-instance attributes and
+//              the view projection matrix replaces mvpMatrix
+
 // uniform inputs
+#ifdef INSTANCED
+uniform mat4 viewProjMatrix;            // the precomputed View-Projection Matrix
+#else
 uniform mat4 mvpMatrix;                 // the precomputed Model-View-Projection Matrix
 uniform mat4 modelMatrix;               // just the model matrix
 uniform mat3 normalMtx;                 // normal matrix
+#endif
 uniform vec3 eyePos;                    // eye position in world space
 uniform vec3 lightPos;                  // light position in world space
 uniform vec3 lightDir;                  // light direction in world space
@@ -13,93 +24,93 @@ uniform vec3 materialDiffColor;         // the material diffuse color
 uniform vec3 materialSpecColor;         // the material specular color
 uniform float materialShininess;        // the material shininess value
 uniform vec3 materialAmbColor;          // the material ambient color
-uniform int lightType;                  // 0 - point light, 1 - directional light, 2 - spotlight
+#ifdef LIGHT_TYPE
+const int lightType = LIGHT_TYPE;       // 0 - point light, 1 - directional light, 2 - spotlight, 3 - black hole point light
+#else
+uniform int lightType;                  // 0 - point light, 1 - directional light, 2 - spotlight, 3 - black hole point light
+#endif
 uniform vec3 pointLightPos;
 // attribute inputs
 layout(location = 0) in vec3 vPos;      // the position of this specific vertex in object space
 layout(location = 1) in vec3 vNormal;   // the normal of this specific vertex in object space
+#ifdef INSTANCED
+layout(location = 2) in vec4 iModelRow0;    // rows of the affine model matrix
+layout(location = 3) in vec4 iModelRow1;
+layout(location = 4) in vec4 iModelRow2;
+layout(location = 5) in vec3 iNormalRow0;   // rows of the normal matrix
+layout(location = 6) in vec3 iNormalRow1;
+layout(location = 7) in vec3 iNormalRow2;
+#endif
 
 // varying outputs
 layout(location = 0) out vec4 color;    // color to apply to this vertex
 
-vec3 diffuseColor(vec3 vertexPosition, vec3 vertexNormal) {
-    vec3 lightVector;
-
+// computes the normalized vector from the vertex towards the light
+vec3 lightVector(vec3 vertexPosition) {
     // directional light
     if(lightType == 1) {
-        lightVector = normalize( -lightDir );
+        return normalize( -lightDir );
     }
     //  point light
-    else if(lightType==3) {
-        lightVector = normalize(pointLightPos - vertexPosition);
+    else if(lightType == 3) {
+        return normalize(pointLightPos - vertexPosition);
     }
     //spot light
     else  {
-        lightVector = normalize(lightPos - vertexPosition);
+        return normalize(lightPos - vertexPosition);
     }
+}
 
-    vec3 diffColor = lightColor * materialDiffColor * max( dot(vertexNormal, lightVector), 0.0 );
-
-    // spot light
+// returns 0 if the vertex is outside of the spot light cone, 1 otherwise
+float spotFactor(vec3 lightVec) {
     if(lightType == 2) {
-        float theta = dot(normalize(lightDir), normalize(-lightVector));
+        float theta = dot(normalize(lightDir), -lightVec);
         if( theta <= lightCutoff ) {
-            diffColor = vec3(0.0, 0.0, 0.0);
+            return 0.0;
         }
     }
-
-    return diffColor;
+    return 1.0;
 }
 
-vec3 specularColor(vec3 vertexPosition, vec3 vertexNormal) {
-    vec3 lightVector;
-
-    // directional light
-    if(lightType == 1) {
-        lightVector = normalize( -lightDir );
-    }
-    // spot light or point light
-    else if(lightType==3){
-        lightVector = normalize(pointLightPos - vertexPosition);
-    }
-    else{
-        lightVector = normalize(lightPos - vertexPosition);
-    }
-
+vec3 diffuseColor(vec3 lightVec, vec3 vertexNormal) {
+    return lightColor * materialDiffColor * max( dot(vertexNormal, lightVec), 0.0 );
+}
 
+vec3 specularColor(vec3 lightVec, vec3 vertexPosition, vec3 vertexNormal) {
     vec3 viewVector = normalize(eyePos - vertexPosition);
-    vec3 halfwayVector = normalize(viewVector + lightVector);
-
-    vec3 specColor = lightColor * materialSpecColor * pow(max( dot(vertexNormal, halfwayVector), 0.0 ), 4.0*materialShininess);
+    vec3 halfwayVector = normalize(viewVector + lightVec);
 
-    // spot light
-    if(lightType == 2) {
-        float theta = dot(normalize(lightDir), normalize(-lightVector));
-        if( theta <= lightCutoff ) {
-            specColor = vec3(0.0, 0.0, 0.0);
-        }
-    }
-
-    return specColor;
+    return lightColor * materialSpecColor * pow(max( dot(vertexNormal, halfwayVector), 0.0 ), 4.0*materialShininess);
 }
 
 void main() {
     // transform & output the vertex in clip space
-    
+
     // modifies the position based on proximity to black hole
     vec3 posMod = 1/length(vPos - pointLightPos) * normalize(vPos - pointLightPos);
     vec3 actualPos = vPos - posMod;
     //modifies the position based on proximity to black hole
-    
+
+#ifdef INSTANCED
+    // the rows are transposed into glsl's column major matrices
+    mat4 modelMatrix = transpose(mat4(iModelRow0, iModelRow1, iModelRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+    mat3 normalMtx = transpose(mat3(iNormalRow0, iNormalRow1, iNormalRow2));
+    gl_Position = viewProjMatrix * (modelMatrix * vec4(actualPos, 1.0));
+#else
     gl_Position = mvpMatrix * vec4(actualPos, 1.0);
+#endif
 
     // transform vertex information to world space
     vec3 vPosWorld = (modelMatrix * vec4(vPos, 1.0)).xyz;
     vec3 nVecWorld = normalize( normalMtx * vNormal );
 
+    // the light vector is shared by the diffuse and specular terms
+    vec3 lightVec = lightVector(vPosWorld);
+    float spot = spotFactor(lightVec);
+
     // compute each component of the Phong Illumination Model
-    vec3 diffColor = diffuseColor(vPosWorld, nVecWorld);
-    vec3 specColor = specularColor(vPosWorld, nVecWorld);
+    vec3 diffColor = spot * diffuseColor(lightVec, nVecWorld);
+    vec3 specColor = spot * specularColor(lightVec, vPosWorld, nVecWorld);
     vec3 ambColor = materialAmbColor;
 
     // assign the final color for this vertex
@@ -0,0 +1,22 @@
+/*
+ *   Fragment Shader
+ *
+ *   Resolves the weighted blended transparency targets over the opaque scene
+ */
+
+#version 410 core
+
+uniform sampler2D accumTexture;
+uniform sampler2D revealTexture;
+
+out vec4 fragColorOut;
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float revealage = texelFetch(revealTexture, texel, 0).r;
+    if(revealage >= 1.0) discard;                   // nothing transparent was drawn here
+
+    vec4 accum = texelFetch(accumTexture, texel, 0);
+    vec3 averageColor = accum.rgb / max(accum.a, 1e-5);
+    fragColorOut = vec4(averageColor, 1.0 - revealage);
+}